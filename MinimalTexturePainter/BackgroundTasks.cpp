@@ -0,0 +1,138 @@
+#include "BackgroundTasks.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <nfd/nfd.h>
+
+#include "CpuProfiler.h"
+#include "imgui/imgui.h"
+
+BackgroundTasks::BackgroundTasks(ThreadPool& threadPool):
+	threadPool(threadPool),
+	renderThread(std::this_thread::get_id())
+{
+}
+
+void BackgroundTasks::showDialog(bool save, const std::vector<FileFilter>& filters, const std::function<void(const std::string&)>& onPicked)
+{
+	//NFD sets up COM for the thread it is initialised on.
+	NFD_Init();
+
+	std::vector<nfdu8filteritem_t> filterItems;
+	for (const FileFilter& filter : filters)
+	{
+		filterItems.push_back({ filter.name.c_str(), filter.extensions.c_str() });
+	}
+	nfdu8char_t* outPath;
+	nfdresult_t result;
+	if (save)
+	{
+		nfdsavedialogu8args_t args = { 0 };
+		args.filterList = filterItems.data();
+		args.filterCount = static_cast<nfdfiltersize_t>(filterItems.size());
+		result = NFD_SaveDialogU8_With(&outPath, &args);
+	}
+	else
+	{
+		nfdopendialogu8args_t args = { 0 };
+		args.filterList = filterItems.data();
+		args.filterCount = static_cast<nfdfiltersize_t>(filterItems.size());
+		result = NFD_OpenDialogU8_With(&outPath, &args);
+	}
+
+	if (result == NFD_OKAY)
+	{
+		std::string path = outPath;
+		NFD_FreePathU8(outPath);
+		if (!stopping)
+		{
+			threadPool.schedule([onPicked, path]() { onPicked(path); }, {}, renderThread);
+		}
+	}
+	else if (result == NFD_CANCEL)
+	{
+	}
+	else
+	{
+		printf("Error: %s\n", NFD_GetError());
+	}
+
+	NFD_Quit();
+}
+
+bool BackgroundTasks::openFileDialog(bool save, const std::vector<FileFilter>& filters, std::function<void(const std::string&)> onPicked)
+{
+	if (dialogOpen) return false;
+	//The previous dialog's thread has already finished, it clears dialogOpen last.
+	if (dialogThread.joinable()) dialogThread.join();
+
+	dialogOpen = true;
+	dialogThread = std::thread([this, save, filters, onPicked]()
+		{
+			setProfilerThreadName("Dialog");
+			showDialog(save, filters, onPicked);
+			dialogOpen = false;
+		});
+	return true;
+}
+
+bool BackgroundTasks::isDialogOpen() const
+{
+	return dialogOpen;
+}
+
+std::shared_ptr<TaskProgress> BackgroundTasks::beginTask(const std::string& name)
+{
+	std::shared_ptr<TaskProgress> progress = std::make_shared<TaskProgress>();
+	tasks.push_back(Task{ name, progress });
+	return progress;
+}
+
+void BackgroundTasks::finishTask(const std::shared_ptr<TaskProgress>& progress)
+{
+	tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [&progress](const Task& task) { return task.progress == progress; }), tasks.end());
+}
+
+bool BackgroundTasks::isBusy() const
+{
+	return dialogOpen || !tasks.empty();
+}
+
+void BackgroundTasks::drawUI()
+{
+	if (dialogOpen)
+	{
+		ImGui::TextDisabled("Waiting for the file dialog");
+	}
+	for (const Task& task : tasks)
+	{
+		ImGui::PushID(task.progress.get());
+		ImGui::Text("%s", task.name.c_str());
+		ImGui::ProgressBar(task.progress->fraction, ImVec2(200, 0));
+		ImGui::SameLine();
+		ImGui::BeginDisabled(task.progress->cancelled);
+		if (ImGui::Button("Cancel"))
+		{
+			task.progress->cancelled = true;
+		}
+		ImGui::EndDisabled();
+		ImGui::PopID();
+	}
+}
+
+BackgroundTasks::~BackgroundTasks()
+{
+	stopping = true;
+	if (dialogThread.joinable()) dialogThread.join();
+
+	//Cancelled work winds down in a few steps.
+	for (const Task& task : tasks)
+	{
+		task.progress->cancelled = true;
+	}
+	while (!tasks.empty())
+	{
+		threadPool.runPinnedJobs();
+		std::this_thread::yield();
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TaskProgress.h"
+#include "ThreadPool.h"
+
+//File dialogs and the loads they start, kept off the render thread so painting carries on while they are open or running.
+//A native dialog blocks the thread showing it until it is closed, so dialogs get a thread of their own, one at a time.
+//Results come back as jobs pinned to the render thread. Running tasks are listed in the toolbar with a cancel button.
+class BackgroundTasks
+{
+public:
+	struct FileFilter
+	{
+		std::string name;
+		//Comma separated, without dots.
+		std::string extensions;
+	};
+
+private:
+	struct Task
+	{
+		std::string name;
+		std::shared_ptr<TaskProgress> progress;
+	};
+
+	ThreadPool& threadPool;
+	std::thread::id renderThread;
+	std::thread dialogThread;
+	std::atomic<bool> dialogOpen{ false };
+	//Set while shutting down, so a dialog closed then doesn't start anything.
+	std::atomic<bool> stopping{ false };
+	//Only touched on the render thread.
+	std::vector<Task> tasks;
+
+	//Runs on the dialog thread.
+	void showDialog(bool save, const std::vector<FileFilter>& filters, const std::function<void(const std::string&)>& onPicked);
+
+public:
+	//Results are delivered to the thread it is constructed on, which has to run its pinned jobs every frame.
+	BackgroundTasks(ThreadPool& threadPool);
+	BackgroundTasks(const BackgroundTasks&) = delete;
+	BackgroundTasks& operator=(const BackgroundTasks&) = delete;
+
+	//Shows an open or save dialog and returns straight away. onPicked runs on the render thread with the chosen path, or
+	//not at all if the dialog is cancelled. Returns false without showing anything while another dialog is open.
+	bool openFileDialog(bool save, const std::vector<FileFilter>& filters, std::function<void(const std::string&)> onPicked);
+
+	bool isDialogOpen() const;
+
+	//Lists work in the toolbar until finishTask is called with the progress it returns. The work updates the progress and
+	//checks it for cancellation.
+	std::shared_ptr<TaskProgress> beginTask(const std::string& name);
+
+	void finishTask(const std::shared_ptr<TaskProgress>& progress);
+
+	//A dialog is open or a task is running.
+	bool isBusy() const;
+
+	void drawUI();
+
+	//Waits for an open dialog to be closed and drops its result. Then cancels the running tasks and runs the render
+	//thread's pinned jobs until they have finished, as their jobs refer to objects destroyed after this.
+	~BackgroundTasks();
+};
@@ -0,0 +1,397 @@
+#include "BatchPainter.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CpuPaintEngine.h"
+#include "DirectionalLight.h"
+#include "GLExtensions.h"
+#include "GLResources.h"
+#include "HeadlessContext.h"
+#include "Image.h"
+#include "LayerStack.h"
+#include "Renderer.h"
+#include "StrokeScript.h"
+#include "TextureBlender.h"
+#include "TextureCache.h"
+#include "TextureExporter.h"
+#include "TextureUploader.h"
+#include "ThreadPool.h"
+#include "WorldObject.h"
+
+static constexpr int channelCount = 3;
+static const char* channelNames[channelCount] = { "diffuse", "specular", "normal" };
+static const char* channelTextureTypes[channelCount] = { "texture_diffuse", "texture_specular", "texture_normal" };
+
+struct BatchOptions
+{
+	std::string scriptPath;
+	std::string outputDirectory = ".";
+	std::string brushPaths[channelCount];
+	bool preview = false;
+	bool cpu = false;
+	unsigned int workers = 0;
+	std::vector<std::string> models;
+};
+
+//Everything that holds GL objects, created on the worker's thread with its context current.
+struct BatchWorker
+{
+	Shader blendShader;
+	Shader compositeShader;
+	Renderer renderer;
+	TextureUploader textureUploader;
+	TextureCache textureCache;
+	TextureExporter textureExporter;
+
+	BatchWorker(ThreadPool& threadPool):
+		blendShader("blend.vert", "blend.frag"),
+		compositeShader("composite.vert", "composite.frag"),
+		renderer(Shader("default.vert", "default.frag"), Shader("shadow.vert", "shadow.frag"), 4096, 4096),
+		textureCache(textureUploader),
+		textureExporter(threadPool)
+	{
+	}
+};
+
+static std::string fileStem(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+static bool exportAndWait(TextureExporter& exporter, unsigned int texture, const std::string& path, std::string& error)
+{
+	exporter.exportTexture(texture, path);
+	exporter.flush();
+	if (exporter.getLastFinished().stage == TextureExporter::Stage::Failed)
+	{
+		error = "Failed to write " + path;
+		return false;
+	}
+	return true;
+}
+
+//Renders the painted model from the editor's starting camera and light.
+static bool exportPreview(BatchWorker& worker, const std::vector<WorldObject>& worldObjects, const std::string& path, std::string& error)
+{
+	constexpr int width = 1280;
+	constexpr int height = 720;
+
+	unsigned int framebuffer = createFramebuffer();
+	unsigned int texture = createTexture2D(GL_RGB8, width, height);
+	attachFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, texture);
+	unsigned int depth = createRenderbuffer(GL_DEPTH24_STENCIL8, width, height);
+	attachFramebufferRenderbuffer(framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, depth);
+
+	CameraParams cameraParams{ glm::vec3(0.0f, 0.0f, 6.0f),
+		glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::radians(60.f),
+		(float)width / (float)height };
+	DirectionalLight dirLight{ glm::vec3(1, 0, 0),
+		glm::vec3(0.1f, 0.1f, 0.1f),
+		glm::vec3(1.6f, 1.6f, 1.6f),
+		glm::vec3(2.0f, 2.0f, 2.0f) };
+
+	glEnable(GL_DEPTH_TEST);
+	worker.renderer.render(framebuffer, cameraParams, worldObjects, dirLight, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	bool exported = exportAndWait(worker.textureExporter, texture, path, error);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteTextures(1, &texture);
+	glDeleteFramebuffers(1, &framebuffer);
+	return exported;
+}
+
+static bool paintModel(BatchWorker& worker, ThreadPool& threadPool, const BatchOptions& options, const std::vector<ScriptStroke>& strokes,
+	const std::string& modelPath, std::string& error)
+{
+	//Brushes are acquired first so they decode while the model loads.
+	unsigned int brushes[channelCount] = {};
+	for (int c = 0; c < channelCount; c++)
+	{
+		if (!options.brushPaths[c].empty())
+			brushes[c] = worker.textureCache.acquireTexture(options.brushPaths[c], c == 0, GL_LINEAR_MIPMAP_LINEAR);
+	}
+
+	std::vector<WorldObject> worldObjects;
+	worldObjects.emplace_back(glm::mat4(1.f), std::make_shared<Model>(modelPath.c_str(), threadPool, worker.textureCache));
+	//Painting over rows still being streamed would lose the paint.
+	worker.textureUploader.flush();
+	Model& model = worldObjects.front().getModel();
+
+	bool succeeded = true;
+	std::unique_ptr<LayerStack> layers[channelCount];
+	std::unique_ptr<TextureBlender> blenders[channelCount];
+	if (model.meshes.empty())
+	{
+		error = "Failed to load " + modelPath;
+		succeeded = false;
+	}
+	else
+	{
+		//Same as the editor's layer stacks, except only channels with a brush are painted.
+		for (const Texture& texture : model.textures_loaded)
+		{
+			int c = static_cast<int>(std::find_if(channelTextureTypes, channelTextureTypes + channelCount,
+				[&texture](const char* type) { return texture.type == type; }) - channelTextureTypes);
+			if (c == channelCount || layers[c] || !texture.id || !brushes[c]) continue;
+
+			layers[c] = std::make_unique<LayerStack>(worker.compositeShader, texture.id);
+			model.replaceTexture(texture.id, layers[c]->getCompositeTexture());
+			blenders[c] = std::make_unique<TextureBlender>(worker.blendShader, layers[c]->getWidth(), layers[c]->getHeight(), brushes[c]);
+		}
+
+		for (const ScriptStroke& stroke : strokes)
+		{
+			//Same alpha as the editor, without the frame time scaling flow since dabs are already spaced.
+			float alpha = stroke.accumulation == TextureBlender::Accumulation::Max ? 1.f : stroke.alpha;
+			for (int c = 0; c < channelCount; c++)
+			{
+				if (!blenders[c]) continue;
+				blenders[c]->beginStroke();
+				layers[c]->setStroke(&blenders[c]->getStrokeBuffer(), stroke.opacity);
+			}
+			for (glm::vec2 uv : stroke.dabs)
+			{
+				for (int c = 0; c < channelCount; c++)
+				{
+					if (blenders[c]) blenders[c]->blend(uv, stroke.brushSize, alpha, stroke.sourceScale, strokeScriptTexSize, stroke.accumulation);
+				}
+			}
+			for (int c = 0; c < channelCount; c++)
+			{
+				if (layers[c]) layers[c]->commitStroke();
+			}
+		}
+
+		std::string outputStem = options.outputDirectory + "/" + fileStem(modelPath);
+		for (int c = 0; c < channelCount && succeeded; c++)
+		{
+			if (!layers[c]) continue;
+			layers[c]->update();
+			succeeded = exportAndWait(worker.textureExporter, layers[c]->getCompositeTexture(), outputStem + "_" + channelNames[c] + ".png", error);
+		}
+		if (succeeded && options.preview)
+		{
+			succeeded = exportPreview(worker, worldObjects, outputStem + "_preview.png", error);
+		}
+	}
+
+	for (int c = 0; c < channelCount; c++)
+	{
+		blenders[c].reset();
+		layers[c].reset();
+		worker.textureCache.releaseTexture(brushes[c]);
+	}
+	worldObjects.clear();
+	return succeeded;
+}
+
+//paintModel on CpuPaintEngine, which needs no context. The material textures are read from their files and each painted
+//channel is flattened over its texture on the CPU, so the output matches the GPU path's.
+static bool paintModelOnCpu(ThreadPool& threadPool, const BatchOptions& options, const Image brushes[channelCount],
+	const std::vector<ScriptStroke>& strokes, const std::string& modelPath, std::string& error)
+{
+	vector<Texture> textures;
+	std::string readError;
+	if (!Model::readMaterialTextures(modelPath, textures, readError))
+	{
+		error = "Failed to load " + modelPath + ": " + readError;
+		return false;
+	}
+
+	std::string outputStem = options.outputDirectory + "/" + fileStem(modelPath);
+	bool painted[channelCount] = {};
+	for (const Texture& texture : textures)
+	{
+		int c = static_cast<int>(std::find_if(channelTextureTypes, channelTextureTypes + channelCount,
+			[&texture](const char* type) { return texture.type == type; }) - channelTextureTypes);
+		if (c == channelCount || painted[c] || !brushes[c].isValid()) continue;
+		//Flipped like the texture cache does, so rows line up with the GPU path's textures.
+		Image base = loadImage(texture.path, true);
+		if (!base.isValid()) continue;
+		painted[c] = true;
+
+		CpuPaintEngine engine(threadPool, base.width, base.height);
+		engine.setSource(brushes[c], c == 0);
+		std::vector<CpuPaintEngine::Dab> dabs;
+		for (const ScriptStroke& stroke : strokes)
+		{
+			//Same alpha as paintModel.
+			float alpha = stroke.accumulation == TextureBlender::Accumulation::Max ? 1.f : stroke.alpha;
+			dabs.resize(stroke.dabs.size());
+			for (size_t i = 0; i < dabs.size(); i++)
+			{
+				dabs[i].uv = stroke.dabs[i];
+				dabs[i].pixelRadius = stroke.brushSize;
+				dabs[i].alpha = alpha;
+				dabs[i].sourceScale = stroke.sourceScale;
+				dabs[i].texSize = strokeScriptTexSize;
+				dabs[i].accumulation = stroke.accumulation;
+			}
+			engine.beginStroke();
+			engine.paint(dabs.data(), dabs.size());
+			engine.commitStroke(stroke.opacity);
+		}
+
+		std::vector<unsigned char> pixels;
+		engine.flattenRGB8(base, c == 0, pixels);
+		std::string outputPath = outputStem + "_" + channelNames[c] + ".png";
+		TaskProgress progress;
+		if (!TextureExporter::encode(outputPath, pixels.data(), base.width, base.height, threadPool, progress))
+		{
+			error = "Failed to write " + outputPath;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool parseOptions(int argc, char* argv[], BatchOptions& options)
+{
+	//argv[1] is --batch.
+	if (argc < 3) return false;
+	options.scriptPath = argv[2];
+	for (int i = 3; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--workers" && hasValue) options.workers = static_cast<unsigned int>(std::max(atoi(argv[++i]), 1));
+		else if (argument == "--out" && hasValue) options.outputDirectory = argv[++i];
+		else if (argument == "--brush-diffuse" && hasValue) options.brushPaths[0] = argv[++i];
+		else if (argument == "--brush-specular" && hasValue) options.brushPaths[1] = argv[++i];
+		else if (argument == "--brush-normal" && hasValue) options.brushPaths[2] = argv[++i];
+		else if (argument == "--preview") options.preview = true;
+		else if (argument == "--cpu") options.cpu = true;
+		else if (argument.rfind("--", 0) == 0) return false;
+		else options.models.push_back(argument);
+	}
+	//Previews are rendered, which needs the GPU.
+	return !options.models.empty() && !(options.cpu && options.preview);
+}
+
+int runBatch(int argc, char* argv[])
+{
+	BatchOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printf("Usage: --batch <script> [--workers N] [--out dir] [--brush-diffuse path] [--brush-specular path] [--brush-normal path] [--preview | --cpu] <model.obj>...\n");
+		return 1;
+	}
+
+	std::vector<ScriptStroke> strokes;
+	std::string error;
+	if (!loadStrokeScript(options.scriptPath, strokes, error))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+
+	unsigned int workerCount = options.workers ? options.workers : std::min<unsigned int>(static_cast<unsigned int>(options.models.size()), 4);
+	workerCount = std::min<unsigned int>(workerCount, static_cast<unsigned int>(options.models.size()));
+
+	//The CPU path decodes its brushes once up front, flipped like the texture cache does.
+	Image cpuBrushes[channelCount];
+	for (int c = 0; c < channelCount && options.cpu; c++)
+	{
+		if (options.brushPaths[c].empty()) continue;
+		cpuBrushes[c] = loadImage(options.brushPaths[c], true);
+		if (!cpuBrushes[c].isValid())
+		{
+			printf("Failed to load %s\n", options.brushPaths[c].c_str());
+			return 1;
+		}
+	}
+
+	//Otherwise a context per worker. They are all created here, GLFW can only create its windows on the main thread.
+	std::vector<std::unique_ptr<HeadlessContext>> contexts;
+	for (unsigned int i = 0; i < workerCount && !options.cpu; i++)
+	{
+		std::unique_ptr<HeadlessContext> context = HeadlessContext::create();
+		if (!context) break;
+		contexts.push_back(std::move(context));
+	}
+	if (!options.cpu)
+	{
+		if (contexts.empty())
+		{
+			printf("Failed to create an OpenGL context.\n");
+			return 1;
+		}
+
+		if (!contexts[0]->makeCurrent() || !contexts[0]->loadFunctions())
+		{
+			printf("Failed to initialize GLAD.\n");
+			return 1;
+		}
+		contexts[0]->releaseCurrent();
+		workerCount = static_cast<unsigned int>(contexts.size());
+	}
+
+	//Shared by all workers for decoding and encoding.
+	ThreadPool threadPool;
+	std::atomic<size_t> nextModel{ 0 };
+	std::atomic<int> failures{ 0 };
+	std::mutex printMutex;
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back([&, context = options.cpu ? nullptr : contexts[i].get()]()
+			{
+				if (context && !context->makeCurrent())
+				{
+					std::lock_guard<std::mutex> lock(printMutex);
+					printf("Failed to make a worker's context current.\n");
+					failures++;
+					return;
+				}
+				{
+					std::unique_ptr<BatchWorker> worker;
+					if (context) worker = std::make_unique<BatchWorker>(threadPool);
+					size_t index;
+					while ((index = nextModel.fetch_add(1)) < options.models.size())
+					{
+						const std::string& modelPath = options.models[index];
+						auto modelStart = std::chrono::steady_clock::now();
+						std::string modelError;
+						bool succeeded = worker ? paintModel(*worker, threadPool, options, strokes, modelPath, modelError) :
+							paintModelOnCpu(threadPool, options, cpuBrushes, strokes, modelPath, modelError);
+						double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - modelStart).count();
+
+						std::lock_guard<std::mutex> lock(printMutex);
+						if (succeeded)
+						{
+							printf("Painted %s in %.2fs\n", modelPath.c_str(), seconds);
+						}
+						else
+						{
+							printf("%s\n", modelError.c_str());
+							failures++;
+						}
+					}
+				}
+				if (context) context->releaseCurrent();
+			});
+	}
+	for (std::thread& worker : workers)
+		worker.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%zu models, %d failed, %u workers, %.2fs\n", options.models.size(), failures.load(), workerCount, seconds);
+	return failures ? 1 : 0;
+}
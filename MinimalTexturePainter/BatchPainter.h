@@ -0,0 +1,10 @@
+#pragma once
+
+//Paints a stroke script onto many models with no UI, for render farm style automation.
+//  --batch <script> [--workers N] [--out dir] [--brush-diffuse path] [--brush-specular path] [--brush-normal path] [--preview | --cpu] <model.obj>...
+//Each painted channel is written to <out>/<model>_<channel>.png, and with --preview a render of the painted model too.
+//See loadStrokeScript for the script format. Each worker has its own HeadlessContext and paints one model at a time.
+//With --cpu the workers paint with CpuPaintEngine instead and need no GPU or context at all, within CpuPaintEngine's
+//tolerance of the GPU's output.
+//Returns the process exit code.
+int runBatch(int argc, char* argv[]);
@@ -0,0 +1,629 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "CpuPaintEngine.h"
+#include "Image.h"
+#include "ImageEncoder.h"
+#include "MaskBaker.h"
+#include "MeshBVH.h"
+#include "Model.h"
+#include "PaintKernels.h"
+#include "ThreadPool.h"
+#include "stb_image_write.h"
+
+//Smooth gradients with some noise, closer to a painted texture than pure noise or a flat colour.
+static std::vector<unsigned char> makeSyntheticImage(int width, int height, int components)
+{
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * components);
+	unsigned int seed = 12345;
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			int noise = (seed >> 24) & 15;
+			unsigned char* pixel = &pixels[(static_cast<size_t>(y) * width + x) * components];
+			for (int c = 0; c < components; c++)
+			{
+				pixel[c] = static_cast<unsigned char>(((x >> 4) * (c + 1) + (y >> 5) + noise) & 255);
+			}
+		}
+	}
+	return pixels;
+}
+
+//Powers of two up to and including hardware_concurrency.
+static std::vector<unsigned int> getThreadCounts()
+{
+	unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+	return threadCounts;
+}
+
+int runEncodeBenchmark()
+{
+	constexpr int width = 8192;
+	constexpr int height = 8192;
+	constexpr int components = 3;
+	constexpr int repetitions = 3;
+
+	std::vector<unsigned char> pixels = makeSyntheticImage(width, height, components);
+	double megabytes = pixels.size() / (1024.0 * 1024.0);
+	std::vector<unsigned int> threadCounts = getThreadCounts();
+
+	printf("Encoding %dx%d RGB (%.0f MB), best of %d\n", width, height, megabytes, repetitions);
+	printf("%-6s %8s %10s %12s\n", "format", "threads", "MB/s", "bytes");
+	for (ImageFormat format : { ImageFormat::Png, ImageFormat::Jpeg })
+	{
+		for (unsigned int threads : threadCounts)
+		{
+			ThreadPool pool(threads);
+			double bestSeconds = 0;
+			size_t encodedSize = 0;
+			for (int i = 0; i < repetitions; i++)
+			{
+				std::vector<unsigned char> encoded;
+				auto start = std::chrono::steady_clock::now();
+				//Started from a pool task like the exporter does, so the pool size is the total thread count.
+				bool succeeded = pool.submit([&]()
+					{
+						return encodeImage(format, pixels.data(), width, height, components, true, 100, pool, encoded);
+					}).get();
+				if (!succeeded)
+				{
+					printf("Encode failed\n");
+					return 1;
+				}
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (i == 0 || seconds < bestSeconds) bestSeconds = seconds;
+				encodedSize = encoded.size();
+			}
+			printf("%-6s %8u %10.1f %12zu\n", format == ImageFormat::Png ? "png" : "jpeg", threads, megabytes / bestSeconds, encodedSize);
+		}
+	}
+	return 0;
+}
+
+int runPaintBenchmark()
+{
+	constexpr int size = 4096;
+	constexpr int sourceSize = 1024;
+	constexpr int dabCount = 2000;
+	constexpr float dabRadius = 48.f;
+	constexpr int repetitions = 3;
+
+	std::vector<unsigned char> sourcePixels = makeSyntheticImage(sourceSize, sourceSize, 4);
+	Image source;
+	source.width = sourceSize;
+	source.height = sourceSize;
+	source.components = 4;
+	source.pixels = std::shared_ptr<unsigned char>(sourcePixels.data(), [](unsigned char*) {});
+
+	//A looping stroke with dabs overlapping like a real one.
+	std::vector<CpuPaintEngine::Dab> dabs(dabCount);
+	for (int i = 0; i < dabCount; i++)
+	{
+		float t = 6.2831853f * i / dabCount;
+		dabs[i].uv = glm::vec2(0.5f + 0.4f * std::sin(t * 3.f), 0.5f + 0.4f * std::sin(t * 2.f));
+		dabs[i].pixelRadius = dabRadius;
+		dabs[i].alpha = 0.3f;
+		dabs[i].sourceScale = 1.f;
+		dabs[i].texSize = size;
+	}
+
+	std::vector<unsigned int> threadCounts = getThreadCounts();
+	printf("Painting %d dabs of radius %.0f on %dx%d, best of %d\n", dabCount, dabRadius, size, size, repetitions);
+	printf("%-6s %-8s %8s %10s %8s\n", "accum", "kernels", "threads", "MP/s", "maxdiff");
+	for (TextureBlender::Accumulation accumulation : { TextureBlender::Accumulation::Max, TextureBlender::Accumulation::Flow })
+	{
+		const char* accumulationName = accumulation == TextureBlender::Accumulation::Max ? "max" : "flow";
+		for (CpuPaintEngine::Dab& dab : dabs)
+			dab.accumulation = accumulation;
+
+		//Scalar on one thread runs first and is what the rest are compared against.
+		std::vector<unsigned char> reference;
+		for (PaintKernelSet kernelSet : { PaintKernelSet::Scalar, PaintKernelSet::SSE4, PaintKernelSet::AVX2 })
+		{
+			if (!isPaintKernelSetSupported(kernelSet))
+			{
+				printf("%-6s %-8s unsupported\n", accumulationName, getPaintKernelSetName(kernelSet));
+				continue;
+			}
+			for (unsigned int threads : threadCounts)
+			{
+				ThreadPool pool(threads);
+				CpuPaintEngine engine(pool, size, size);
+				engine.setKernelSet(kernelSet);
+				engine.setSource(source, true);
+
+				double bestSeconds = 0;
+				uint64_t pixels = 0;
+				for (int i = 0; i < repetitions; i++)
+				{
+					engine.getLayer().clear();
+					uint64_t pixelsBefore = engine.getPixelsPainted();
+					auto start = std::chrono::steady_clock::now();
+					//Run from a pool task so the pool size is the total thread count.
+					pool.submit([&]()
+						{
+							engine.beginStroke();
+							engine.paint(dabs.data(), dabs.size());
+							engine.commitStroke(0.8f);
+						}).get();
+					double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					if (i == 0 || seconds < bestSeconds) bestSeconds = seconds;
+					pixels = engine.getPixelsPainted() - pixelsBefore;
+				}
+
+				std::vector<unsigned char> result;
+				engine.getLayer().readRGBA8(result);
+				if (reference.empty()) reference = result;
+				int maxDifference = 0;
+				for (size_t i = 0; i < result.size(); i++)
+					maxDifference = std::max(maxDifference, std::abs(result[i] - reference[i]));
+
+				printf("%-6s %-8s %8u %10.1f %8d\n", accumulationName, getPaintKernelSetName(kernelSet), threads,
+					pixels / bestSeconds / 1e6, maxDifference);
+			}
+		}
+	}
+	return 0;
+}
+
+struct MicrobenchmarkOptions
+{
+	std::string filter;
+	int warmup = 3;
+	int repetitions = 15;
+	//Each sample runs enough calls to take at least this long, so timer resolution doesn't matter for short bodies.
+	double minSampleMs = 20;
+};
+
+//Written by every benchmark body so the work can't be optimised away.
+static volatile size_t microbenchmarkSink;
+
+static double median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	size_t middle = values.size() / 2;
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+//Times body per call and prints the median and median absolute deviation over the repetitions, which unlike the mean and
+//standard deviation aren't thrown by the odd sample hit by a context switch. The throughput column is millions of
+//itemsPerCall per second, so byte counts come out in MB/s.
+template<typename Body>
+static void runMicrobenchmark(const MicrobenchmarkOptions& options, const std::string& name, double itemsPerCall, const char* unit, Body&& body)
+{
+	if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+
+	auto timeCalls = [&body](int calls)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < calls; i++)
+			body();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	//The last warmup call sizes the samples.
+	double warmupMs = timeCalls(1);
+	for (int i = 1; i < options.warmup; i++)
+		warmupMs = timeCalls(1);
+	int callsPerSample = static_cast<int>(std::min(std::ceil(options.minSampleMs / std::max(warmupMs, 1e-6)), 1e6));
+
+	std::vector<double> samples;
+	for (int i = 0; i < options.repetitions; i++)
+		samples.push_back(timeCalls(callsPerSample) / callsPerSample);
+	double medianMs = median(samples);
+	std::vector<double> deviations;
+	for (double sample : samples)
+		deviations.push_back(std::abs(sample - medianMs));
+	double madMs = median(deviations);
+
+	printf("%-34s %12.4f %10.4f %6.1f%% %10.1f %s\n", name.c_str(), medianMs, madMs, 100.0 * madMs / medianMs,
+		itemsPerCall / (medianMs / 1000.0) / 1e6, unit);
+}
+
+//Shaped like an imported mesh, with every attribute processMesh reads. aiMesh frees the arrays.
+static std::unique_ptr<aiMesh> makeMesh(unsigned int vertexCount)
+{
+	std::unique_ptr<aiMesh> mesh = std::make_unique<aiMesh>();
+	mesh->mNumVertices = vertexCount;
+	mesh->mVertices = new aiVector3D[vertexCount];
+	mesh->mNormals = new aiVector3D[vertexCount];
+	mesh->mTangents = new aiVector3D[vertexCount];
+	mesh->mTextureCoords[0] = new aiVector3D[vertexCount];
+	mesh->mNumUVComponents[0] = 2;
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		float t = static_cast<float>(i) / vertexCount;
+		mesh->mVertices[i] = aiVector3D(t, std::sin(t * 40.f), std::cos(t * 40.f));
+		mesh->mNormals[i] = aiVector3D(0, std::sin(t * 40.f), std::cos(t * 40.f));
+		mesh->mTangents[i] = aiVector3D(1, 0, 0);
+		mesh->mTextureCoords[0][i] = aiVector3D(t, 1.f - t, 0);
+	}
+
+	//A grid has about two triangles per vertex.
+	mesh->mNumFaces = vertexCount * 2;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+	{
+		aiFace& face = mesh->mFaces[i];
+		face.mNumIndices = 3;
+		face.mIndices = new unsigned int[3];
+		for (unsigned int j = 0; j < 3; j++)
+			face.mIndices[j] = (i / 2 + j * 7) % vertexCount;
+	}
+	return mesh;
+}
+
+#if USE_ASSIMP
+//Materials with a diffuse, specular and normal map each, drawn from a small set of paths like most models.
+static std::vector<std::unique_ptr<aiMaterial>> makeMaterials(int count, int uniquePaths)
+{
+	std::vector<std::unique_ptr<aiMaterial>> materials;
+	int next = 0;
+	for (int i = 0; i < count; i++)
+	{
+		std::unique_ptr<aiMaterial> material = std::make_unique<aiMaterial>();
+		for (aiTextureType type : { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_NORMALS })
+		{
+			aiString path(("textures/texture_" + std::to_string(next++ % uniquePaths) + ".png").c_str());
+			material->AddProperty(&path, AI_MATKEY_TEXTURE(type, 0));
+		}
+		materials.push_back(std::move(material));
+	}
+	return materials;
+}
+#endif
+
+static void countBytes(void* context, void*, int size)
+{
+	*static_cast<size_t*>(context) += size;
+}
+
+int runMicrobenchmarks(int argc, char* argv[])
+{
+	MicrobenchmarkOptions options;
+	//argv[1] is --benchmark-micro.
+	for (int i = 2; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--filter" && hasValue) options.filter = argv[++i];
+		else if (argument == "--warmup" && hasValue) options.warmup = std::max(atoi(argv[++i]), 1);
+		else if (argument == "--repetitions" && hasValue) options.repetitions = std::max(atoi(argv[++i]), 1);
+		else if (argument == "--min-sample-ms" && hasValue) options.minSampleMs = std::max(atof(argv[++i]), 0.0);
+		else
+		{
+			printf("Usage: --benchmark-micro [--filter name] [--warmup N] [--repetitions N] [--min-sample-ms ms]\n");
+			return 1;
+		}
+	}
+
+	printf("Median of %d samples after %d warmup calls, each sample at least %.0fms\n", options.repetitions, options.warmup, options.minSampleMs);
+	printf("%-34s %12s %10s %7s %10s\n", "benchmark", "median ms", "MAD ms", "MAD", "throughput");
+
+	//Vertex copy loop and BVH build run on worker threads while a model imports.
+	for (unsigned int vertexCount : { 10000u, 100000u, 1000000u })
+	{
+		std::unique_ptr<aiMesh> mesh = makeMesh(vertexCount);
+		runMicrobenchmark(options, "processMesh " + std::to_string(vertexCount / 1000) + "K", vertexCount, "Mvert/s", [&mesh]()
+			{
+				microbenchmarkSink = Model::processMesh(mesh.get()).vertices.size();
+			});
+	}
+
+#if USE_ASSIMP
+	//Material texture lookups, where repeated paths should cost a hash lookup and nothing else.
+	for (int materialCount : { 100, 1000, 10000 })
+	{
+		std::vector<std::unique_ptr<aiMaterial>> materials = makeMaterials(materialCount, 64);
+		runMicrobenchmark(options, "loadMaterialTextures " + std::to_string(materialCount), materialCount, "Mmat/s", [&materials]()
+			{
+				std::unordered_map<string, size_t> pathIndices;
+				vector<Texture> textures;
+				for (const std::unique_ptr<aiMaterial>& material : materials)
+				{
+					Model::loadMaterialTextures(material.get(), aiTextureType_DIFFUSE, "texture_diffuse", pathIndices, textures);
+					Model::loadMaterialTextures(material.get(), aiTextureType_SPECULAR, "texture_specular", pathIndices, textures);
+					Model::loadMaterialTextures(material.get(), aiTextureType_NORMALS, "texture_normal", pathIndices, textures);
+				}
+				microbenchmarkSink = textures.size();
+			});
+	}
+#endif
+
+	//Decoding as TextureCache does, from memory so the disk isn't part of it. Then encoding with plain stb, which is what
+	//the exporter's strip encoder is measured against.
+	ThreadPool pool;
+	for (int size : { 4096, 8192 })
+	{
+		std::vector<unsigned char> pixels = makeSyntheticImage(size, size, 3);
+		std::string sizeName = std::to_string(size / 1024) + "K";
+		for (ImageFormat format : { ImageFormat::Png, ImageFormat::Jpeg })
+		{
+			std::vector<unsigned char> encoded;
+			if (!encodeImage(format, pixels.data(), size, size, 3, false, 90, pool, encoded))
+			{
+				printf("Encode failed\n");
+				return 1;
+			}
+			const char* formatName = format == ImageFormat::Png ? "png" : "jpg";
+			runMicrobenchmark(options, std::string("stbi decode ") + formatName + " " + sizeName, static_cast<double>(pixels.size()), "MB/s", [&encoded]()
+				{
+					microbenchmarkSink = loadImageFromMemory(encoded.data(), encoded.size(), true).getByteSize();
+				});
+		}
+		runMicrobenchmark(options, "stbi_write_jpg " + sizeName, static_cast<double>(pixels.size()), "MB/s", [&pixels, size]()
+			{
+				size_t bytes = 0;
+				stbi_write_jpg_to_func(countBytes, &bytes, size, size, 3, pixels.data(), 90);
+				microbenchmarkSink = bytes;
+			});
+	}
+
+	//Picking in paint(): building a mesh's BVH, done once per import, and casting rays at it, done for every dab. The
+	//rays cross the mesh's bounds from all around, so some miss.
+	for (unsigned int vertexCount : { 10000u, 100000u, 1000000u })
+	{
+		std::unique_ptr<aiMesh> mesh = makeMesh(vertexCount);
+		Model::MeshData data = Model::processMesh(mesh.get());
+		std::string countName = std::to_string(vertexCount / 1000) + "K";
+		runMicrobenchmark(options, "bvh build " + countName, static_cast<double>(data.indices.size() / 3), "Mtri/s", [&data]()
+			{
+				microbenchmarkSink = MeshBVH(&data.vertices[0].position, sizeof(Vertex), data.indices).getNodeCount();
+			});
+
+		constexpr int rayCount = 256;
+		std::vector<glm::vec3> origins;
+		std::vector<glm::vec3> directions;
+		for (int i = 0; i < rayCount; i++)
+		{
+			float angle = i * 2.39996f;
+			glm::vec3 origin(0.5f + 2.f * std::cos(angle), 3.f * std::sin(angle * 0.5f), 3.f * std::cos(angle * 0.5f));
+			glm::vec3 target(static_cast<float>(i) / rayCount, 0.5f * std::sin(angle * 3.f), 0.5f * std::cos(angle * 5.f));
+			origins.push_back(origin);
+			directions.push_back(target - origin);
+		}
+		runMicrobenchmark(options, "pick ray " + countName, rayCount, "Mray/s", [&data, &origins, &directions]()
+			{
+				size_t hits = 0;
+				MeshBVH::Hit hit;
+				for (int i = 0; i < rayCount; i++)
+					hits += data.bvh.intersect(origins[i], directions[i], 2.f, hit);
+				microbenchmarkSink = hits;
+			});
+	}
+
+	//Row kernels of the CPU paint engine, one 4096 pixel row at a time.
+	constexpr int rowLength = 4096;
+	std::vector<float> source(rowLength * 4, 0.5f);
+	std::vector<float> stroke(rowLength * 4, 0.25f);
+	std::vector<float> bottom(rowLength * 4, 0.75f);
+	std::vector<uint8_t> packed8(rowLength * 4, 128);
+	std::vector<uint16_t> packed16(rowLength * 4, 0x3800);
+	DabRowParams params{ 0.5f, 0.5f, 1.f / rowLength, 1.f / rowLength, 0.5f, 8.f, 0.3f, false };
+	for (PaintKernelSet kernelSet : { PaintKernelSet::Scalar, PaintKernelSet::SSE4, PaintKernelSet::AVX2 })
+	{
+		if (!isPaintKernelSetSupported(kernelSet)) continue;
+		const PaintKernels& kernels = getPaintKernels(kernelSet);
+		std::string setName = getPaintKernelSetName(kernelSet);
+		runMicrobenchmark(options, "kernel dab " + setName, rowLength, "Mpix/s", [&]()
+			{
+				kernels.dab(source.data(), stroke.data(), rowLength, 0, rowLength / 2, params);
+				microbenchmarkSink = static_cast<size_t>(stroke[rowLength * 2]);
+			});
+		runMicrobenchmark(options, "kernel over " + setName, rowLength, "Mpix/s", [&]()
+			{
+				kernels.over(stroke.data(), bottom.data(), rowLength, 0.8f);
+				microbenchmarkSink = static_cast<size_t>(bottom[rowLength * 2]);
+			});
+		runMicrobenchmark(options, "kernel unpack/pack RGBA8 " + setName, rowLength, "Mpix/s", [&]()
+			{
+				kernels.unpackRGBA8(packed8.data(), bottom.data(), rowLength);
+				kernels.packRGBA8(bottom.data(), packed8.data(), rowLength);
+				microbenchmarkSink = packed8[rowLength];
+			});
+		runMicrobenchmark(options, "kernel unpack/pack RGBA16F " + setName, rowLength, "Mpix/s", [&]()
+			{
+				kernels.unpackRGBA16F(packed16.data(), stroke.data(), rowLength);
+				kernels.packRGBA16F(stroke.data(), packed16.data(), rowLength);
+				microbenchmarkSink = packed16[rowLength];
+			});
+	}
+	return 0;
+}
+
+int runJobBenchmark()
+{
+	constexpr int fanOutJobs = 100000;
+	constexpr int meshCount = 64;
+	constexpr unsigned int meshVertices = 20000;
+	constexpr int textureCount = 16;
+	constexpr int textureSize = 1024;
+	constexpr int repetitions = 3;
+
+	std::vector<std::unique_ptr<aiMesh>> sceneMeshes;
+	for (int i = 0; i < meshCount; i++)
+		sceneMeshes.push_back(makeMesh(meshVertices));
+	std::vector<unsigned char> png;
+	{
+		ThreadPool pool(1);
+		std::vector<unsigned char> pixels = makeSyntheticImage(textureSize, textureSize, 3);
+		if (!encodeImage(ImageFormat::Png, pixels.data(), textureSize, textureSize, 3, false, 90, pool, png))
+		{
+			printf("Encode failed\n");
+			return 1;
+		}
+	}
+	std::vector<unsigned int> threadCounts = getThreadCounts();
+	std::thread::id callingThread = std::this_thread::get_id();
+
+	printf("Fan out of %d empty jobs, then a load of %d meshes of %uK vertices and %d %dx%d PNGs, best of %d\n", fanOutJobs,
+		meshCount, meshVertices / 1000, textureCount, textureSize, textureSize, repetitions);
+	printf("%8s %10s %10s %8s\n", "threads", "Mjobs/s", "load ms", "speedup");
+	double oneThreadLoadMs = 0;
+	for (unsigned int threads : threadCounts)
+	{
+		ThreadPool pool(threads);
+		double bestFanOutSeconds = 0;
+		double bestLoadMs = 0;
+		for (int i = 0; i < repetitions; i++)
+		{
+			//Spawned from inside a job, so the jobs start on one worker's deque and the others have to steal them.
+			std::atomic<int> ran{ 0 };
+			ThreadPool::JobHandle fanOutDone;
+			auto start = std::chrono::steady_clock::now();
+			ThreadPool::JobHandle fanOut = pool.schedule([&]()
+				{
+					std::vector<ThreadPool::JobHandle> jobs(fanOutJobs);
+					for (ThreadPool::JobHandle& job : jobs)
+						job = pool.schedule([&ran]() { ran++; });
+					fanOutDone = pool.schedule([]() {}, jobs);
+				});
+			pool.wait(fanOut);
+			pool.wait(fanOutDone);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (ran != fanOutJobs)
+			{
+				printf("FAILED: %d of %d fan out jobs ran before the job depending on them\n", ran.load(), fanOutJobs);
+				return 1;
+			}
+			if (i == 0 || seconds < bestFanOutSeconds) bestFanOutSeconds = seconds;
+
+			//The same graph Model::loadModel builds, with the calling thread standing in for the render thread.
+			std::vector<Image> images(textureCount);
+			std::vector<size_t> vertexCounts(meshCount);
+			std::atomic<int> uploaded{ 0 };
+			std::atomic<bool> failed{ false };
+			ThreadPool::JobHandle finished;
+			start = std::chrono::steady_clock::now();
+			ThreadPool::JobHandle parse = pool.schedule([&]()
+				{
+					std::vector<ThreadPool::JobHandle> steps;
+					for (int t = 0; t < textureCount; t++)
+					{
+						ThreadPool::JobHandle decode = pool.schedule([&, t]()
+							{
+								images[t] = loadImageFromMemory(png.data(), png.size(), true);
+							});
+						steps.push_back(pool.schedule([&, t]()
+							{
+								if (std::this_thread::get_id() != callingThread || images[t].getByteSize() == 0) failed = true;
+								images[t] = Image();
+								uploaded++;
+							}, { decode }, callingThread));
+					}
+					for (int m = 0; m < meshCount; m++)
+					{
+						steps.push_back(pool.schedule([&, m]()
+							{
+								vertexCounts[m] = Model::processMesh(sceneMeshes[m].get()).vertices.size();
+							}));
+					}
+					finished = pool.schedule([&]()
+						{
+							if (std::this_thread::get_id() != callingThread || uploaded != textureCount) failed = true;
+							for (size_t vertexCount : vertexCounts)
+								if (vertexCount != meshVertices) failed = true;
+						}, steps, callingThread);
+				});
+			pool.wait(parse);
+			pool.wait(finished);
+			double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (failed)
+			{
+				printf("FAILED: a load job ran before its dependencies or off the thread it was pinned to\n");
+				return 1;
+			}
+			if (i == 0 || loadMs < bestLoadMs) bestLoadMs = loadMs;
+		}
+		if (threads == 1) oneThreadLoadMs = bestLoadMs;
+		printf("%8u %10.2f %10.1f %7.2fx\n", threads, fanOutJobs / bestFanOutSeconds / 1e6, bestLoadMs, oneThreadLoadMs / bestLoadMs);
+	}
+	return 0;
+}
+
+int runBakeBenchmark()
+{
+	constexpr int gridSize = 512;
+	constexpr int bakeSize = 1024;
+	constexpr int fullSize = 4096;
+	constexpr int repetitions = 3;
+
+	//A grid over the whole UV square with bumps to occlude and ridges to curve round, about half a million triangles.
+	auto height = [](float x, float y)
+	{
+		return 0.04f * std::sin(x * 25.f) * std::sin(y * 25.f) + 0.02f * std::abs(std::sin(x * 60.f + y * 20.f));
+	};
+	Model::MeshData data;
+	for (int j = 0; j <= gridSize; j++)
+	{
+		for (int i = 0; i <= gridSize; i++)
+		{
+			float x = static_cast<float>(i) / gridSize;
+			float y = static_cast<float>(j) / gridSize;
+			float step = 0.5f / gridSize;
+			glm::vec3 normal(height(x - step, y) - height(x + step, y), height(x, y - step) - height(x, y + step), 2.f * step);
+			data.vertices.push_back(Vertex{ glm::vec3(x, y, height(x, y)), glm::normalize(normal), glm::vec2(x, y), glm::vec3(1, 0, 0) });
+		}
+	}
+	for (unsigned int j = 0; j < gridSize; j++)
+	{
+		for (unsigned int i = 0; i < gridSize; i++)
+		{
+			unsigned int corner = j * (gridSize + 1) + i;
+			data.indices.insert(data.indices.end(), { corner, corner + 1, corner + gridSize + 2, corner, corner + gridSize + 2, corner + gridSize + 1 });
+		}
+	}
+	data.bvh = MeshBVH(&data.vertices[0].position, sizeof(Vertex), data.indices);
+	std::vector<BakeMesh> meshes{ BakeMesh{ &data.vertices, &data.indices, &data.bvh } };
+	BakeSettings settings;
+	settings.size = bakeSize;
+	std::vector<unsigned int> threadCounts = getThreadCounts();
+
+	printf("Baking %dx%d masks of %zu triangles with %d rays per texel, best of %d\n", bakeSize, bakeSize, data.indices.size() / 3,
+		settings.rayCount, repetitions);
+	printf("%8s %12s %18s %10s\n", "threads", "Mtexels/s", "Mtexels/s/thread", "4096 s");
+	for (unsigned int threads : threadCounts)
+	{
+		ThreadPool pool(threads);
+		BakeStats best;
+		for (int i = 0; i < repetitions; i++)
+		{
+			std::vector<uint8_t> pixels;
+			BakeStats stats;
+			//Started from a pool task like the editor does, so the pool size is the total thread count.
+			bool baked = pool.submit([&]()
+				{
+					return bakeMasks(meshes, settings, pool, pixels, stats);
+				}).get();
+			if (!baked)
+			{
+				printf("Bake failed\n");
+				return 1;
+			}
+			if (i == 0 || stats.seconds < best.seconds) best = stats;
+		}
+		double texelsPerSecond = best.texels / best.seconds;
+		double fullTexels = static_cast<double>(best.texels) * fullSize * fullSize / (static_cast<double>(bakeSize) * bakeSize);
+		printf("%8u %12.3f %18.3f %10.1f\n", threads, texelsPerSecond / 1e6, getTexelsPerThreadSecond(best) / 1e6, fullTexels / texelsPerSecond);
+	}
+	return 0;
+}
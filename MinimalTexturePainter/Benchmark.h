@@ -0,0 +1,27 @@
+#pragma once
+
+//Encodes a synthetic 8K RGB image as PNG and JPEG with 1 to hardware_concurrency threads and prints throughput in MB/s.
+//Run with --benchmark-encode. Returns the process exit code.
+int runEncodeBenchmark();
+
+//Paints the same strokes on a 4K target with every CPU paint kernel set the machine supports and 1 to hardware_concurrency
+//threads, printing throughput in megapixels per second and the largest difference from the scalar result.
+//Run with --benchmark-paint. Returns the process exit code.
+int runPaintBenchmark();
+
+//Times the hot spots of import, texture decode and encode, picking and the CPU paint kernels over a range of sizes, printing
+//the median and median absolute deviation per call. Needs no display or context. Builds without assimp skip the material
+//texture lookups.
+//Run with --benchmark-micro [--filter name] [--warmup N] [--repetitions N] [--min-sample-ms ms]. Returns the process exit code.
+int runMicrobenchmarks(int argc, char* argv[]);
+
+//Runs a fan out of empty jobs and a job graph shaped like a model load, with meshes to convert, PNGs to decode and uploads
+//pinned to the calling thread, on 1 to hardware_concurrency workers. Prints jobs per second, load time and speedup, and
+//fails if a job ran before its dependencies or off the thread it was pinned to.
+//Run with --benchmark-jobs. Returns the process exit code.
+int runJobBenchmark();
+
+//Bakes occlusion and curvature masks of a bumpy grid at 1024x1024 on 1 to hardware_concurrency threads. Prints covered
+//texels per second in total and per thread, the number to budget a bake by, and what a 4096x4096 bake would take.
+//Run with --benchmark-bake. Returns the process exit code.
+int runBakeBenchmark();
@@ -0,0 +1,134 @@
+#include "ComputeBrush.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "GLExtensions.h"
+#include "GLResources.h"
+
+ComputeBrush::ComputeBrush():
+	paintShader("brushpaint.comp"),
+	toolShader("brushtool.comp")
+{
+}
+
+void ComputeBrush::dispatch(int width, int height)
+{
+	glDispatchCompute((width + groupSize - 1) / groupSize, (height + groupSize - 1) / groupSize, 1);
+	//Results are next read by image loads, the composite's texture fetches or a blit when the stroke buffer grows.
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+void ComputeBrush::paint(const StrokeBuffer& strokeBuffer, unsigned int sourceTexture, int x0, int y0, int x1, int y1,
+	glm::vec2 uv, float pixelRadius, float alpha, float sourceScale, unsigned int texSize, bool flow, const BrushMask& mask)
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, strokeBuffer.getTargetWidth());
+	y1 = std::min(y1, strokeBuffer.getTargetHeight());
+	if (x0 >= x1 || y0 >= y1) return;
+
+	paintShader.useProgram();
+	paintShader.setIVec2("dabOrigin", glm::ivec2(x0, y0));
+	paintShader.setIVec2("dabSize", glm::ivec2(x1 - x0, y1 - y0));
+	paintShader.setIVec2("strokeOrigin", glm::ivec2(strokeBuffer.getOriginX(), strokeBuffer.getOriginY()));
+	paintShader.setIVec2("targetSize", glm::ivec2(strokeBuffer.getTargetWidth(), strokeBuffer.getTargetHeight()));
+	paintShader.setVec2("uv", uv);
+	paintShader.setFloat("pixelRadius", pixelRadius);
+	paintShader.setFloat("alpha", alpha);
+	paintShader.setFloat("sourceScale", sourceScale);
+	paintShader.setInt("texSize", (int)texSize);
+	paintShader.setBool("flow", flow);
+	paintShader.setInt("sourceTexture", 0);
+	paintShader.setInt("maskTexture", 1);
+	paintShader.setVec4("maskWeights", mask.weights);
+	paintShader.setFloat("maskOffset", mask.offset);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sourceTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mask.texture);
+	glBindImageTexture(0, strokeBuffer.getTexture(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+
+	dispatch(x1 - x0, y1 - y0);
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void ComputeBrush::applyTool(BrushTool tool, unsigned int layerTexture, int layerWidth, int layerHeight, unsigned int sourceTexture,
+	int x0, int y0, int x1, int y1, glm::vec2 uv, float pixelRadius, float strength, float sourceScale, unsigned int texSize,
+	glm::ivec2 smudgeOffset, const BrushMask& mask)
+{
+	if (tool == BrushTool::Paint) return;
+
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, layerWidth);
+	y1 = std::min(y1, layerHeight);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	//Snapshot whatever the dab can read: the blur footprint or where the smudge pulls from.
+	int margin = std::max({ 2, std::abs(smudgeOffset.x), std::abs(smudgeOffset.y) });
+	int snapshotX = std::max(x0 - margin, 0);
+	int snapshotY = std::max(y0 - margin, 0);
+	int copyWidth = std::min(x1 + margin, layerWidth) - snapshotX;
+	int copyHeight = std::min(y1 + margin, layerHeight) - snapshotY;
+	if (tool != BrushTool::Overlay)
+	{
+		if (copyWidth > snapshotWidth || copyHeight > snapshotHeight)
+		{
+			snapshotWidth = std::max(copyWidth, snapshotWidth);
+			snapshotHeight = std::max(copyHeight, snapshotHeight);
+			glDeleteTextures(1, &snapshotTexture);
+			snapshotTexture = createTexture2D(GL_RGBA8, snapshotWidth, snapshotHeight);
+			setTextureParameter(snapshotTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			setTextureParameter(snapshotTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+		glCopyImageSubData(layerTexture, GL_TEXTURE_2D, 0, snapshotX, snapshotY, 0,
+			snapshotTexture, GL_TEXTURE_2D, 0, 0, 0, 0, copyWidth, copyHeight, 1);
+	}
+
+	toolShader.useProgram();
+	toolShader.setInt("tool", static_cast<int>(tool));
+	toolShader.setIVec2("dabOrigin", glm::ivec2(x0, y0));
+	toolShader.setIVec2("dabSize", glm::ivec2(x1 - x0, y1 - y0));
+	toolShader.setIVec2("targetSize", glm::ivec2(layerWidth, layerHeight));
+	//Texels outside the copied area clamp to its edge.
+	toolShader.setIVec2("snapshotOrigin", glm::ivec2(snapshotX, snapshotY));
+	toolShader.setIVec2("smudgeOffset", smudgeOffset);
+	toolShader.setVec2("uv", uv);
+	toolShader.setFloat("pixelRadius", pixelRadius);
+	toolShader.setFloat("strength", strength);
+	toolShader.setFloat("sourceScale", sourceScale);
+	toolShader.setInt("texSize", (int)texSize);
+	toolShader.setInt("sourceTexture", 0);
+	toolShader.setInt("snapshot", 1);
+	toolShader.setInt("maskTexture", 2);
+	toolShader.setVec4("maskWeights", mask.weights);
+	toolShader.setFloat("maskOffset", mask.offset);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sourceTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, snapshotTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, mask.texture);
+	glBindImageTexture(0, layerTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+
+	dispatch(x1 - x0, y1 - y0);
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+ComputeBrush::~ComputeBrush()
+{
+	glDeleteTextures(1, &snapshotTexture);
+}
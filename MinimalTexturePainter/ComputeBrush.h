@@ -0,0 +1,68 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "StrokeBuffer.h"
+
+enum class BrushTool
+{
+	//Paints the brush texture through the stroke buffer. Works on every path.
+	Paint,
+	//The rest read the layer they change, so they need the compute path.
+	Smudge,
+	Blur,
+	Overlay
+};
+
+//Scales what a dab paints by a texture over the target's UV space, e.g. baked occlusion or curvature. The mask at a pixel
+//is dot(texel, weights) + offset, which picks one channel, its inverse, or with no weights no mask at all.
+struct BrushMask
+{
+	unsigned int texture = 0;
+	glm::vec4 weights = glm::vec4(0.f);
+	float offset = 1.f;
+};
+
+//The toolbar's masks, in its order, each a choice of weights and offset on the baked channels. Stroke logs store them.
+enum class BrushMaskMode
+{
+	None,
+	Crevices,
+	Exposed,
+	ConvexEdges,
+	ConcaveEdges
+};
+
+//GL 4.3 brush path. Each dab dispatches 16x16 workgroups over just the pixels it covers and updates the
+//destination with image load/store, which allows tools that depend on what is already painted.
+class ComputeBrush
+{
+private:
+	static constexpr int groupSize = 16;
+
+	Shader paintShader;
+	Shader toolShader;
+
+	//Copy of the layer under the current dab, grown as needed.
+	unsigned int snapshotTexture = 0;
+	int snapshotWidth = 0;
+	int snapshotHeight = 0;
+
+	static void dispatch(int width, int height);
+
+public:
+	ComputeBrush();
+	ComputeBrush(const ComputeBrush&) = delete;
+	ComputeBrush& operator=(const ComputeBrush&) = delete;
+
+	//Accumulates a dab into the stroke buffer. The bounds, in target pixels, must already be included in the buffer.
+	void paint(const StrokeBuffer& strokeBuffer, unsigned int sourceTexture, int x0, int y0, int x1, int y1,
+		glm::vec2 uv, float pixelRadius, float alpha, float sourceScale, unsigned int texSize, bool flow, const BrushMask& mask);
+
+	//Applies a tool other than Paint to an RGBA8 layer in place. Bounds are in layer pixels and clipped to it.
+	void applyTool(BrushTool tool, unsigned int layerTexture, int layerWidth, int layerHeight, unsigned int sourceTexture,
+		int x0, int y0, int x1, int y1, glm::vec2 uv, float pixelRadius, float strength, float sourceScale, unsigned int texSize,
+		glm::ivec2 smudgeOffset, const BrushMask& mask);
+
+	~ComputeBrush();
+};
@@ -0,0 +1,453 @@
+#include "CpuPaintEngine.h"
+
+#include <algorithm>
+#include <cmath>
+
+static void unpackRow(const PaintKernels& kernels, TiledImage::Format format, const unsigned char* in, float* out, int count)
+{
+	if (format == TiledImage::Format::RGBA8)
+		kernels.unpackRGBA8(in, out, count);
+	else
+		kernels.unpackRGBA16F(reinterpret_cast<const uint16_t*>(in), out, count);
+}
+
+static void packRow(const PaintKernels& kernels, TiledImage::Format format, const float* in, unsigned char* out, int count)
+{
+	if (format == TiledImage::Format::RGBA8)
+		kernels.packRGBA8(in, out, count);
+	else
+		kernels.packRGBA16F(in, reinterpret_cast<uint16_t*>(out), count);
+}
+
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+CpuPaintEngine::CpuPaintEngine(ThreadPool& pool, int width, int height, TiledImage::Format strokeFormat, TiledImage::Format layerFormat):
+	pool(pool),
+	stroke(width, height, strokeFormat),
+	layer(width, height, layerFormat)
+{
+	this->width = width;
+	this->height = height;
+	kernelSet = getBestPaintKernelSet();
+	sourceTiles.resize(static_cast<size_t>(stroke.getTilesX()) * stroke.getTilesY());
+}
+
+void CpuPaintEngine::setKernelSet(PaintKernelSet kernelSet)
+{
+	this->kernelSet = isPaintKernelSetSupported(kernelSet) ? kernelSet : PaintKernelSet::Scalar;
+}
+
+PaintKernelSet CpuPaintEngine::getKernelSet() const
+{
+	return kernelSet;
+}
+
+void CpuPaintEngine::buildLevels(const Image& image, bool srgb, std::vector<MipLevel>& levels)
+{
+	levels.clear();
+	if (!image.isValid()) return;
+
+	//Decoded per texel before filtering, like sampling an sRGB texture. Only colour is sRGB, alpha is always linear.
+	float decode[256];
+	for (int i = 0; i < 256; i++)
+		decode[i] = srgb ? srgbToLinear(i / 255.f) : i / 255.f;
+
+	MipLevel base{ image.width, image.height };
+	base.pixels.resize(static_cast<size_t>(image.width) * image.height * 4);
+	const unsigned char* pixels = image.pixels.get();
+	bool colourIsSRGB = srgb && image.components >= 3;
+	for (size_t i = 0; i < static_cast<size_t>(image.width) * image.height; i++)
+	{
+		const unsigned char* in = pixels + i * image.components;
+		float* out = &base.pixels[i * 4];
+		//Single channel images are uploaded as GL_RED.
+		out[0] = colourIsSRGB ? decode[in[0]] : in[0] / 255.f;
+		out[1] = image.components >= 3 ? (colourIsSRGB ? decode[in[1]] : in[1] / 255.f) : 0.f;
+		out[2] = image.components >= 3 ? (colourIsSRGB ? decode[in[2]] : in[2] / 255.f) : 0.f;
+		out[3] = image.components == 4 ? in[3] / 255.f : 1.f;
+	}
+	levels.push_back(std::move(base));
+
+	while (levels.back().width > 1 || levels.back().height > 1)
+	{
+		const MipLevel& previous = levels.back();
+		MipLevel level{ std::max(previous.width / 2, 1), std::max(previous.height / 2, 1) };
+		level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+		for (int y = 0; y < level.height; y++)
+		{
+			int y0 = std::min(y * 2, previous.height - 1);
+			int y1 = std::min(y * 2 + 1, previous.height - 1);
+			for (int x = 0; x < level.width; x++)
+			{
+				int x0 = std::min(x * 2, previous.width - 1);
+				int x1 = std::min(x * 2 + 1, previous.width - 1);
+				for (int c = 0; c < 4; c++)
+				{
+					float sum = previous.pixels[(static_cast<size_t>(y0) * previous.width + x0) * 4 + c] +
+						previous.pixels[(static_cast<size_t>(y0) * previous.width + x1) * 4 + c] +
+						previous.pixels[(static_cast<size_t>(y1) * previous.width + x0) * 4 + c] +
+						previous.pixels[(static_cast<size_t>(y1) * previous.width + x1) * 4 + c];
+					level.pixels[(static_cast<size_t>(y) * level.width + x) * 4 + c] = sum * 0.25f;
+				}
+			}
+		}
+		levels.push_back(std::move(level));
+	}
+}
+
+void CpuPaintEngine::sampleLevels(const std::vector<MipLevel>& levels, float u, float v, float lod, float* out)
+{
+	//Bilinear with repeat wrapping on one level.
+	auto bilinear = [&levels, u, v](int levelIndex, float* result)
+	{
+		const MipLevel& level = levels[levelIndex];
+		float x = u * level.width - 0.5f;
+		float y = v * level.height - 0.5f;
+		float floorX = std::floor(x);
+		float floorY = std::floor(y);
+		float fx = x - floorX;
+		float fy = y - floorY;
+		int x0 = ((static_cast<int>(floorX) % level.width) + level.width) % level.width;
+		int y0 = ((static_cast<int>(floorY) % level.height) + level.height) % level.height;
+		int x1 = (x0 + 1) % level.width;
+		int y1 = (y0 + 1) % level.height;
+		const float* p00 = &level.pixels[(static_cast<size_t>(y0) * level.width + x0) * 4];
+		const float* p10 = &level.pixels[(static_cast<size_t>(y0) * level.width + x1) * 4];
+		const float* p01 = &level.pixels[(static_cast<size_t>(y1) * level.width + x0) * 4];
+		const float* p11 = &level.pixels[(static_cast<size_t>(y1) * level.width + x1) * 4];
+		for (int c = 0; c < 4; c++)
+		{
+			float bottom = p00[c] + (p10[c] - p00[c]) * fx;
+			float top = p01[c] + (p11[c] - p01[c]) * fx;
+			result[c] = bottom + (top - bottom) * fy;
+		}
+	};
+
+	int maxLevel = static_cast<int>(levels.size()) - 1;
+	if (lod <= 0.f || maxLevel == 0)
+	{
+		bilinear(0, out);
+		return;
+	}
+	int level = std::min(static_cast<int>(lod), maxLevel);
+	if (level == maxLevel)
+	{
+		bilinear(maxLevel, out);
+		return;
+	}
+	float fine[4];
+	float coarse[4];
+	bilinear(level, fine);
+	bilinear(level + 1, coarse);
+	float blend = lod - level;
+	for (int c = 0; c < 4; c++)
+		out[c] = fine[c] + (coarse[c] - fine[c]) * blend;
+}
+
+void CpuPaintEngine::resetSourceTiles()
+{
+	for (std::unique_ptr<float[]>& tile : sourceTiles)
+		tile.reset();
+}
+
+void CpuPaintEngine::setSource(const Image& image, bool srgb)
+{
+	resetSourceTiles();
+	buildLevels(image, srgb, sourceLevels);
+}
+
+void CpuPaintEngine::setMask(const Image& image, glm::vec4 weights, float offset)
+{
+	//The mask is folded into the cached source.
+	resetSourceTiles();
+	buildLevels(image, false, maskLevels);
+	maskWeights = weights;
+	maskOffset = offset;
+}
+
+void CpuPaintEngine::fillSourceTile(int tileX, int tileY, float sourceScale, float* out) const
+{
+	constexpr int tileSize = TiledImage::tileSize;
+	if (sourceLevels.empty())
+	{
+		std::fill(out, out + tileSize * tileSize * 4, 0.f);
+		return;
+	}
+
+	//The level the GPU would pick from the screen space derivatives of texCoords / sourceScale.
+	const MipLevel& base = sourceLevels[0];
+	float texelsPerPixel = std::max(base.width / (width * sourceScale), base.height / (height * sourceScale));
+	float lod = std::log2(texelsPerPixel);
+
+	for (int y = 0; y < tileSize; y++)
+	{
+		float v = (tileY * tileSize + y + 0.5f) / height / sourceScale;
+		for (int x = 0; x < tileSize; x++)
+		{
+			float u = (tileX * tileSize + x + 0.5f) / width / sourceScale;
+			sampleLevels(sourceLevels, u, v, lod, &out[(y * tileSize + x) * 4]);
+		}
+	}
+	if (maskLevels.empty()) return;
+
+	//The kernels only use the source's alpha as a factor of coverage, which is where the GPU applies the mask, so scaling
+	//it here is exact. The mask covers the target's UV space and takes the level the brush shaders pick for it.
+	const MipLevel& maskBase = maskLevels[0];
+	float maskLod = std::log2(std::max(std::max(static_cast<float>(maskBase.width) / width, static_cast<float>(maskBase.height) / height), 1.f));
+	for (int y = 0; y < tileSize; y++)
+	{
+		float v = (tileY * tileSize + y + 0.5f) / height;
+		for (int x = 0; x < tileSize; x++)
+		{
+			float u = (tileX * tileSize + x + 0.5f) / width;
+			float texel[4];
+			sampleLevels(maskLevels, u, v, maskLod, texel);
+			float mask = glm::clamp(glm::dot(glm::vec4(texel[0], texel[1], texel[2], texel[3]), maskWeights) + maskOffset, 0.f, 1.f);
+			out[(y * tileSize + x) * 4 + 3] *= mask;
+		}
+	}
+}
+
+void CpuPaintEngine::beginStroke()
+{
+	stroke.clear();
+	//Only kept for the tiles of one stroke to bound memory.
+	resetSourceTiles();
+}
+
+void CpuPaintEngine::paint(const Dab* dabs, size_t count)
+{
+	//The cached source depends on the scale, so batches are split where it changes.
+	size_t start = 0;
+	for (size_t i = 1; i <= count; i++)
+	{
+		if (i == count || dabs[i].sourceScale != dabs[start].sourceScale)
+		{
+			paintBatch(dabs + start, i - start);
+			start = i;
+		}
+	}
+}
+
+void CpuPaintEngine::paintBatch(const Dab* dabs, size_t count)
+{
+	if (count == 0) return;
+	constexpr int tileSize = TiledImage::tileSize;
+	int tilesX = stroke.getTilesX();
+	int tilesY = stroke.getTilesY();
+
+	float sourceScale = dabs[0].sourceScale;
+	if (sourceScale != sourceTilesScale)
+	{
+		resetSourceTiles();
+		sourceTilesScale = sourceScale;
+	}
+
+	std::vector<PreparedDab> prepared;
+	prepared.reserve(count);
+	std::vector<bool> touched(static_cast<size_t>(tilesX) * tilesY, false);
+	for (size_t i = 0; i < count; i++)
+	{
+		const Dab& dab = dabs[i];
+
+		//Same bounds as TextureBlender::blend, then clipped.
+		float uvRadius = dab.pixelRadius / dab.texSize;
+		PreparedDab preparedDab;
+		preparedDab.x0 = std::max(static_cast<int>(std::floor((dab.uv.x - uvRadius) * width)), 0);
+		preparedDab.y0 = std::max(static_cast<int>(std::floor((dab.uv.y - uvRadius) * height)), 0);
+		preparedDab.x1 = std::min(static_cast<int>(std::ceil((dab.uv.x + uvRadius) * width)) + 1, width);
+		preparedDab.y1 = std::min(static_cast<int>(std::ceil((dab.uv.y + uvRadius) * height)) + 1, height);
+		if (preparedDab.x0 >= preparedDab.x1 || preparedDab.y0 >= preparedDab.y1) continue;
+
+		DabRowParams& params = preparedDab.params;
+		params.centreU = dab.uv.x;
+		params.centreV = dab.uv.y;
+		params.invWidth = 1.f / width;
+		params.invHeight = 1.f / height;
+		params.uvRadius = uvRadius;
+		params.falloffScale = dab.hardness >= 1.f ? 1e30f : 1.f / (uvRadius * (1.f - std::max(dab.hardness, 0.f)));
+		params.alpha = dab.alpha;
+		params.flow = dab.accumulation == TextureBlender::Accumulation::Flow;
+		prepared.push_back(preparedDab);
+
+		pixelsPainted += static_cast<uint64_t>(preparedDab.x1 - preparedDab.x0) * (preparedDab.y1 - preparedDab.y0);
+		for (int y = preparedDab.y0 / tileSize; y <= (preparedDab.y1 - 1) / tileSize; y++)
+			for (int x = preparedDab.x0 / tileSize; x <= (preparedDab.x1 - 1) / tileSize; x++)
+				touched[static_cast<size_t>(y) * tilesX + x] = true;
+	}
+
+	//Tiles are allocated here so the workers never resize anything.
+	std::vector<int> tiles;
+	std::vector<int> unsampledTiles;
+	for (int i = 0; i < tilesX * tilesY; i++)
+	{
+		if (!touched[i]) continue;
+		tiles.push_back(i);
+		stroke.getTile(i % tilesX, i / tilesX);
+		if (!sourceTiles[i])
+		{
+			sourceTiles[i].reset(new float[static_cast<size_t>(tileSize) * tileSize * 4]);
+			unsampledTiles.push_back(i);
+		}
+	}
+
+	pool.parallelFor(unsampledTiles.size(), [&](size_t i)
+		{
+			int tile = unsampledTiles[i];
+			fillSourceTile(tile % tilesX, tile / tilesX, sourceScale, sourceTiles[tile].get());
+		});
+
+	const PaintKernels& kernels = getPaintKernels(kernelSet);
+	TiledImage::Format format = stroke.getFormat();
+	int pixelSize = stroke.getPixelSize();
+	pool.parallelFor(tiles.size(), [&](size_t i)
+		{
+			int tile = tiles[i];
+			int tileX = tile % tilesX;
+			int tileY = tile / tilesX;
+			unsigned char* pixels = stroke.getTile(tileX, tileY);
+			const float* source = sourceTiles[tile].get();
+			float row[tileSize * 4];
+
+			//Every dab goes through the stored format, so rounding between dabs matches the GPU's stroke buffer.
+			for (const PreparedDab& dab : prepared)
+			{
+				int x0 = std::max(dab.x0, tileX * tileSize);
+				int x1 = std::min(dab.x1, (tileX + 1) * tileSize);
+				int y0 = std::max(dab.y0, tileY * tileSize);
+				int y1 = std::min(dab.y1, (tileY + 1) * tileSize);
+				if (x0 >= x1 || y0 >= y1) continue;
+
+				int columns = x1 - x0;
+				for (int y = y0; y < y1; y++)
+				{
+					size_t offset = static_cast<size_t>(y - tileY * tileSize) * tileSize + (x0 - tileX * tileSize);
+					unsigned char* rowPixels = pixels + offset * pixelSize;
+					unpackRow(kernels, format, rowPixels, row, columns);
+					kernels.dab(source + offset * 4, row, columns, x0, y, dab.params);
+					packRow(kernels, format, row, rowPixels, columns);
+				}
+			}
+		});
+}
+
+void CpuPaintEngine::commitStroke(float opacity)
+{
+	constexpr int tileSize = TiledImage::tileSize;
+	int tilesX = stroke.getTilesX();
+	int tilesY = stroke.getTilesY();
+
+	std::vector<int> tiles;
+	for (int i = 0; i < tilesX * tilesY; i++)
+	{
+		if (!stroke.findTile(i % tilesX, i / tilesX)) continue;
+		tiles.push_back(i);
+		layer.getTile(i % tilesX, i / tilesX);
+	}
+
+	//Untouched stroke pixels are transparent, which leaves the layer exactly as it was.
+	const PaintKernels& kernels = getPaintKernels(kernelSet);
+	pool.parallelFor(tiles.size(), [&](size_t i)
+		{
+			int tileX = tiles[i] % tilesX;
+			int tileY = tiles[i] / tilesX;
+			const unsigned char* strokePixels = stroke.findTile(tileX, tileY);
+			unsigned char* layerPixels = layer.getTile(tileX, tileY);
+			int columns = std::min(tileSize, width - tileX * tileSize);
+			int rows = std::min(tileSize, height - tileY * tileSize);
+			float top[tileSize * 4];
+			float bottom[tileSize * 4];
+			for (int y = 0; y < rows; y++)
+			{
+				unpackRow(kernels, stroke.getFormat(), strokePixels + static_cast<size_t>(y) * tileSize * stroke.getPixelSize(), top, columns);
+				unsigned char* layerRow = layerPixels + static_cast<size_t>(y) * tileSize * layer.getPixelSize();
+				unpackRow(kernels, layer.getFormat(), layerRow, bottom, columns);
+				kernels.over(top, bottom, columns, opacity);
+				packRow(kernels, layer.getFormat(), bottom, layerRow, columns);
+			}
+		});
+
+	stroke.clear();
+}
+
+void CpuPaintEngine::flattenRGB8(const Image& base, bool srgb, std::vector<unsigned char>& pixels) const
+{
+	constexpr int tileSize = TiledImage::tileSize;
+	pixels.resize(static_cast<size_t>(width) * height * 3);
+	float decode[256];
+	for (int i = 0; i < 256; i++)
+		decode[i] = srgb ? srgbToLinear(i / 255.f) : i / 255.f;
+	bool colourIsSRGB = srgb && base.components >= 3;
+	const PaintKernels& kernels = getPaintKernels(kernelSet);
+
+	//Rows of tiles are spread over the pool. Only painted tiles are blended, the rest are copied from the base as is.
+	pool.parallelFor(static_cast<size_t>(layer.getTilesY()), [&](size_t tileY)
+		{
+			float top[tileSize * 4];
+			float bottom[tileSize * 4];
+			int y0 = static_cast<int>(tileY) * tileSize;
+			int y1 = std::min(y0 + tileSize, height);
+			for (int y = y0; y < y1; y++)
+			{
+				const unsigned char* baseRow = base.pixels.get() + static_cast<size_t>(y) * width * base.components;
+				unsigned char* outRow = pixels.data() + static_cast<size_t>(y) * width * 3;
+				for (int x = 0; x < width; x++)
+				{
+					const unsigned char* in = baseRow + static_cast<size_t>(x) * base.components;
+					//Single channel textures read as red only.
+					outRow[x * 3] = in[0];
+					outRow[x * 3 + 1] = base.components >= 3 ? in[1] : 0;
+					outRow[x * 3 + 2] = base.components >= 3 ? in[2] : 0;
+				}
+
+				for (int tileX = 0; tileX < layer.getTilesX(); tileX++)
+				{
+					const unsigned char* layerTile = layer.findTile(tileX, static_cast<int>(tileY));
+					if (!layerTile) continue;
+					int x0 = tileX * tileSize;
+					int columns = std::min(tileSize, width - x0);
+					unpackRow(kernels, layer.getFormat(), layerTile + static_cast<size_t>(y - y0) * tileSize * layer.getPixelSize(), top, columns);
+					for (int i = 0; i < columns; i++)
+					{
+						const unsigned char* in = outRow + static_cast<size_t>(x0 + i) * 3;
+						for (int c = 0; c < 3; c++)
+							bottom[i * 4 + c] = colourIsSRGB ? decode[in[c]] : in[c] / 255.f;
+						bottom[i * 4 + 3] = 1.f;
+					}
+					kernels.over(top, bottom, columns, 1.f);
+					for (int i = 0; i < columns; i++)
+					{
+						unsigned char* out = outRow + static_cast<size_t>(x0 + i) * 3;
+						for (int c = 0; c < 3; c++)
+						{
+							float value = std::min(std::max(bottom[i * 4 + c], 0.f), 1.f);
+							out[c] = static_cast<unsigned char>((colourIsSRGB ? linearToSrgb(value) : value) * 255.f + 0.5f);
+						}
+					}
+				}
+			}
+		});
+}
+
+const TiledImage& CpuPaintEngine::getStroke() const
+{
+	return stroke;
+}
+
+TiledImage& CpuPaintEngine::getLayer()
+{
+	return layer;
+}
+
+uint64_t CpuPaintEngine::getPixelsPainted() const
+{
+	return pixelsPainted;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Image.h"
+#include "PaintKernels.h"
+#include "TextureBlender.h"
+#include "ThreadPool.h"
+#include "TiledImage.h"
+
+//Paints strokes on the CPU with the same maths as TextureBlender and LayerStack::commitStroke, for painting without a GPU,
+//as --batch --cpu does, and as a reference to check GPU output against. Layers come out within one 8 bit level of the
+//GPU's; what is left is source filtering precision and the GPU's own rounding. Flow strokes under a smoothly varying mask
+//can be two levels off, as the mask's filtering differences add up over the dabs. CpuPaintEngineTest checks both against
+//the raster and compute paths.
+//Dabs accumulate into a tiled stroke buffer which is composited onto a tiled layer when the stroke ends. Tiles are spread
+//over the pool and every row goes through the fastest kernel set the CPU has.
+class CpuPaintEngine
+{
+public:
+	//Same parameters as TextureBlender::blend.
+	struct Dab
+	{
+		glm::vec2 uv;
+		float pixelRadius;
+		float alpha;
+		float sourceScale;
+		unsigned int texSize;
+		TextureBlender::Accumulation accumulation;
+		//Fraction of the radius at full strength before fading out. 1 is the GPU brush's hard edge.
+		float hardness = 1.f;
+	};
+
+private:
+	struct MipLevel
+	{
+		int width;
+		int height;
+		//Straight linear RGBA.
+		std::vector<float> pixels{};
+	};
+
+	struct PreparedDab
+	{
+		DabRowParams params;
+		//Clipped to the target. Max is exclusive.
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+	};
+
+	ThreadPool& pool;
+	PaintKernelSet kernelSet;
+	int width;
+	int height;
+	TiledImage stroke;
+	TiledImage layer;
+
+	//Brush source and its mip chain, as a texture with LINEAR_MIPMAP_LINEAR and REPEAT would hold it.
+	std::vector<MipLevel> sourceLevels;
+	//Same for the mask, which is empty when there is none. See BrushMask.
+	std::vector<MipLevel> maskLevels;
+	glm::vec4 maskWeights = glm::vec4(0.f);
+	float maskOffset = 1.f;
+	//The source at every pixel of each tile the stroke touched. It doesn't change between dabs, so it is sampled once per stroke.
+	std::vector<std::unique_ptr<float[]>> sourceTiles;
+	float sourceTilesScale = 0.f;
+
+	uint64_t pixelsPainted = 0;
+
+	//Replaces levels with the image and its box filtered mips, as glGenerateMipmap makes them.
+	static void buildLevels(const Image& image, bool srgb, std::vector<MipLevel>& levels);
+
+	//Trilinear with repeat wrapping.
+	static void sampleLevels(const std::vector<MipLevel>& levels, float u, float v, float lod, float* out);
+
+	void resetSourceTiles();
+
+	void fillSourceTile(int tileX, int tileY, float sourceScale, float* out) const;
+
+	//All dabs share a source scale.
+	void paintBatch(const Dab* dabs, size_t count);
+
+public:
+	CpuPaintEngine(ThreadPool& pool, int width, int height,
+		TiledImage::Format strokeFormat = TiledImage::Format::RGBA16F, TiledImage::Format layerFormat = TiledImage::Format::RGBA8);
+	CpuPaintEngine(const CpuPaintEngine&) = delete;
+	CpuPaintEngine& operator=(const CpuPaintEngine&) = delete;
+
+	//Defaults to the best the CPU supports. Unsupported sets fall back to scalar.
+	void setKernelSet(PaintKernelSet kernelSet);
+
+	PaintKernelSet getKernelSet() const;
+
+	//Decoded like an sRGB texture when srgb is set.
+	void setSource(const Image& image, bool srgb);
+
+	//Scales every dab like BrushMask, with the mask's pixels in place of its texture. An invalid image removes the mask.
+	//Set it between strokes, as TextureBlender::setMask is.
+	void setMask(const Image& image, glm::vec4 weights, float offset);
+
+	void beginStroke();
+
+	//Dabs are applied in order. A batch spreads over the pool better than single dabs.
+	void paint(const Dab* dabs, size_t count);
+
+	//Composites the stroke onto the layer at its opacity and clears it.
+	void commitStroke(float opacity);
+
+	//Flattens the layer onto base as a LayerStack with it as the only layer would, at full opacity with Normal blending.
+	//base must be the layer's size. It is read like its texture, decoded from sRGB when srgb is set, and the result is
+	//encoded the same way. Pixels are RGB8 rows in glGetTexImage order, ready for TextureExporter::encode. The layer's
+//tolerance holds in linear values, so dark sRGB tones can be several encoded levels off.
+	void flattenRGB8(const Image& base, bool srgb, std::vector<unsigned char>& pixels) const;
+
+	const TiledImage& getStroke() const;
+
+	TiledImage& getLayer();
+
+	//Dab pixels covered since construction, for throughput.
+	uint64_t getPixelsPainted() const;
+};
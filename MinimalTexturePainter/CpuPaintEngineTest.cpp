@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ComputeBrush.h"
+#include "CpuPaintEngine.h"
+#include "GLExtensions.h"
+#include "GLResources.h"
+#include "HeadlessContext.h"
+#include "LayerStack.h"
+#include "Shader.h"
+#include "TextureBlender.h"
+
+//Paints the same dabs through TextureBlender, raster and compute, and through CpuPaintEngine, and checks the committed
+//layers and the flattened textures agree within the tolerance CpuPaintEngine.h documents. Built as CpuPaintEngineTest by
+//CMakeLists.txt and run by ctest from MinimalTexturePainter, where the shaders are. Skipped when there is no context to
+//compare against, otherwise prints each failure and exits non-zero if there were any.
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what)
+{
+	if (condition) return;
+	printf("FAILED: %s\n", what.c_str());
+	failures++;
+}
+
+static Image makeImage(int width, int height, int components)
+{
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.components = components;
+	image.pixels = std::shared_ptr<unsigned char>(new unsigned char[image.getByteSize()], std::default_delete<unsigned char[]>());
+	return image;
+}
+
+static unsigned int createTexture(const Image& image, GLenum internalFormat)
+{
+	unsigned int texture = createTexture2D(internalFormat, image.width, image.height, getMipLevelCount(image.width, image.height));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	uploadTexture2D(texture, 0, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.get());
+	generateTextureMipmaps(texture);
+	setTextureParameter(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	return texture;
+}
+
+static int maxDifference(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+	if (a.size() != b.size()) return 255;
+	int difference = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		difference = std::max(difference, std::abs(a[i] - b[i]));
+	return difference;
+}
+
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+}
+
+//Whether every value of the CPU's flattened texture is within levels of the GPU's in linear terms, which is how the layers
+//are compared, plus one encoded level for each side's own rounding of the blend. Near black one linear level is over ten
+//sRGB ones.
+static bool flattenedWithin(const std::vector<unsigned char>& gpu, const std::vector<unsigned char>& cpu, bool srgb, int levels)
+{
+	if (gpu.size() != cpu.size()) return false;
+	int low[256];
+	int high[256];
+	for (int i = 0; i < 256; i++)
+	{
+		float value = srgb ? srgbToLinear(i / 255.f) : i / 255.f;
+		float lowValue = std::max(value - levels / 255.f, 0.f);
+		float highValue = std::min(value + levels / 255.f, 1.f);
+		low[i] = static_cast<int>((srgb ? linearToSrgb(lowValue) : lowValue) * 255.f + 0.5f) - 1;
+		high[i] = static_cast<int>((srgb ? linearToSrgb(highValue) : highValue) * 255.f + 0.5f) + 1;
+	}
+	for (size_t i = 0; i < gpu.size(); i++)
+	{
+		if (cpu[i] < low[gpu[i]] || cpu[i] > high[gpu[i]]) return false;
+	}
+	return true;
+}
+
+int main()
+{
+	std::unique_ptr<HeadlessContext> context = HeadlessContext::create();
+	if (!context || !context->makeCurrent() || !context->loadFunctions())
+	{
+		printf("No OpenGL context, skipping.\n");
+		return 77;
+	}
+
+	constexpr int size = 512;
+	constexpr int sourceSize = 256;
+	constexpr int maskSize = 1024;
+
+	//A brush with every channel and alpha varying, so filtering and premultiplication both show up in the comparison.
+	Image source = makeImage(sourceSize, sourceSize, 4);
+	for (int y = 0; y < sourceSize; y++)
+	{
+		for (int x = 0; x < sourceSize; x++)
+		{
+			unsigned char* pixel = source.pixels.get() + (y * sourceSize + x) * 4;
+			pixel[0] = static_cast<unsigned char>(x);
+			pixel[1] = static_cast<unsigned char>(y);
+			pixel[2] = static_cast<unsigned char>((x * y) & 255);
+			pixel[3] = static_cast<unsigned char>(128 + ((x ^ y) & 127));
+		}
+	}
+	//Red varies smoothly, green is a checkerboard, the two kinds of mask a bake produces.
+	Image mask = makeImage(maskSize, maskSize, 4);
+	for (int y = 0; y < maskSize; y++)
+	{
+		for (int x = 0; x < maskSize; x++)
+		{
+			unsigned char* pixel = mask.pixels.get() + (y * maskSize + x) * 4;
+			pixel[0] = static_cast<unsigned char>(127 + 127 * std::sin(x * 0.05f) * std::cos(y * 0.07f));
+			pixel[1] = (x / 8 + y / 8) % 2 ? 255 : 0;
+			pixel[2] = static_cast<unsigned char>(x * 255 / maskSize);
+			pixel[3] = 255;
+		}
+	}
+	Image base = makeImage(size, size, 4);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			unsigned char* pixel = base.pixels.get() + (y * size + x) * 4;
+			pixel[0] = static_cast<unsigned char>(x / 2);
+			pixel[1] = static_cast<unsigned char>(y / 2);
+			pixel[2] = 128;
+			pixel[3] = 255;
+		}
+	}
+
+	Shader blendShader("blend.vert", "blend.frag");
+	Shader compositeShader("composite.vert", "composite.frag");
+	unsigned int sourceTexture = createTexture(source, GL_SRGB8_ALPHA8);
+	unsigned int maskTexture = createTexture(mask, GL_RGBA8);
+	unsigned int baseTextures[] = { createTexture(base, GL_RGBA8), createTexture(base, GL_SRGB8_ALPHA8) };
+	std::unique_ptr<ComputeBrush> computeBrush;
+	if (getGLCapabilities().computeShader) computeBrush = std::make_unique<ComputeBrush>();
+	else printf("No compute shaders, only checking the raster path.\n");
+
+	ThreadPool threadPool(2);
+	const char* maskNames[] = { "no mask", "smooth mask", "binary mask" };
+	for (int path = 0; path < (computeBrush ? 2 : 1); path++)
+	{
+		for (int maskCase = 0; maskCase < 3; maskCase++)
+		{
+			for (TextureBlender::Accumulation accumulation : { TextureBlender::Accumulation::Max, TextureBlender::Accumulation::Flow })
+			{
+				for (float sourceScale : { 1.f, 3.f })
+				{
+					bool flow = accumulation == TextureBlender::Accumulation::Flow;
+					//The diffuse channel's case, an sRGB base, for every other combination.
+					bool srgb = (maskCase + path) % 2 == 0;
+					BrushMask brushMask;
+					if (maskCase == 1)
+					{
+						brushMask.texture = maskTexture;
+						brushMask.weights = glm::vec4(-1.f, 0.f, 0.f, 0.f);
+						brushMask.offset = 1.f;
+					}
+					else if (maskCase == 2)
+					{
+						brushMask.texture = maskTexture;
+						brushMask.weights = glm::vec4(0.f, 1.f, 0.f, 0.f);
+						brushMask.offset = 0.f;
+					}
+
+					LayerStack layers(compositeShader, baseTextures[srgb]);
+					TextureBlender blender(blendShader, size, size, sourceTexture);
+					blender.setComputeBrush(path ? computeBrush.get() : nullptr);
+					blender.setMask(brushMask);
+					CpuPaintEngine engine(threadPool, size, size);
+					engine.setSource(source, true);
+					if (maskCase) engine.setMask(mask, brushMask.weights, brushMask.offset);
+
+					//Two overlapping wavy strokes, so the second one composites over paint.
+					for (int stroke = 0; stroke < 2; stroke++)
+					{
+						blender.beginStroke();
+						layers.setStroke(&blender.getStrokeBuffer(), 0.8f);
+						engine.beginStroke();
+						std::vector<CpuPaintEngine::Dab> dabs(60);
+						for (size_t i = 0; i < dabs.size(); i++)
+						{
+							CpuPaintEngine::Dab& dab = dabs[i];
+							dab.uv = glm::vec2(0.1f + i * 0.013f, 0.3f + stroke * 0.3f + 0.1f * std::sin(i * 0.2f));
+							dab.pixelRadius = 120.f;
+							dab.alpha = flow ? 0.25f : 0.9f;
+							dab.sourceScale = sourceScale;
+							dab.texSize = 2048;
+							dab.accumulation = accumulation;
+							blender.blend(dab.uv, dab.pixelRadius, dab.alpha, dab.sourceScale, dab.texSize, dab.accumulation);
+						}
+						engine.paint(dabs.data(), dabs.size());
+						layers.commitStroke();
+						engine.commitStroke(0.8f);
+					}
+					layers.update();
+
+					//Flow under a smooth mask is allowed two levels, as CpuPaintEngine.h says.
+					int tolerance = flow && maskCase == 1 ? 2 : 1;
+					std::string name = std::string(path ? "compute" : "raster") + ", " + maskNames[maskCase] + ", " +
+						(flow ? "flow" : "max") + ", source scale " + std::to_string(static_cast<int>(sourceScale)) +
+						(srgb ? ", sRGB" : "");
+
+					std::vector<unsigned char> gpuLayer(size * size * 4), cpuLayer;
+					glPixelStorei(GL_PACK_ALIGNMENT, 1);
+					glBindTexture(GL_TEXTURE_2D, layers.getActiveLayerTexture());
+					glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, gpuLayer.data());
+					engine.getLayer().readRGBA8(cpuLayer);
+					int layerDifference = maxDifference(gpuLayer, cpuLayer);
+					check(layerDifference <= tolerance, name + ": layer is " + std::to_string(layerDifference) + " levels off");
+					check(std::count(gpuLayer.begin(), gpuLayer.end(), 0) != static_cast<long>(gpuLayer.size()), name + ": nothing was painted");
+
+					std::vector<unsigned char> gpuTexture(size * size * 3), cpuTexture;
+					glBindTexture(GL_TEXTURE_2D, layers.getCompositeTexture());
+					glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, gpuTexture.data());
+					engine.flattenRGB8(base, srgb, cpuTexture);
+					check(flattenedWithin(gpuTexture, cpuTexture, srgb, tolerance), name + ": flattened texture is " +
+						std::to_string(maxDifference(gpuTexture, cpuTexture)) + " levels off");
+
+					check(glGetError() == GL_NO_ERROR, name + ": GL error");
+				}
+			}
+		}
+	}
+
+	glDeleteTextures(1, &sourceTexture);
+	glDeleteTextures(1, &maskTexture);
+	glDeleteTextures(2, baseTextures);
+	computeBrush.reset();
+	context->releaseCurrent();
+
+	if (failures) printf("%d checks failed\n", failures);
+	else printf("All checks passed\n");
+	return failures ? 1 : 0;
+}
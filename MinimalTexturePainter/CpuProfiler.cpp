@@ -0,0 +1,154 @@
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//24 bytes a zone, so about 1.5 MB per thread that records anything. That is several seconds of the main loop.
+static constexpr uint64_t ringCapacity = 65536;
+
+struct ZoneRing
+{
+	//Fields are atomics only so a trace can be written while the owner overwrites them. Relaxed stores compile to plain
+	//moves on the platforms this builds for.
+	struct Slot
+	{
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<int64_t> begin{ 0 };
+		std::atomic<int64_t> end{ 0 };
+	};
+
+	std::unique_ptr<Slot[]> slots{ new Slot[ringCapacity] };
+	//Zones recorded so far. Only the owning thread stores it.
+	std::atomic<uint64_t> recorded{ 0 };
+	int id = 0;
+	//Guarded by ringsMutex.
+	std::string threadName;
+};
+
+//Rings are never freed, so zones from worker threads that have exited still make it into the trace.
+static std::mutex ringsMutex;
+static std::vector<std::shared_ptr<ZoneRing>> rings;
+static thread_local ZoneRing* threadRing = nullptr;
+
+static ZoneRing& getThreadRing()
+{
+	if (!threadRing)
+	{
+		auto ring = std::make_shared<ZoneRing>();
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		ring->id = static_cast<int>(rings.size()) + 1;
+		rings.push_back(ring);
+		threadRing = ring.get();
+	}
+	return *threadRing;
+}
+
+int64_t getProfilerTime()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setProfilerThreadName(const std::string& name)
+{
+	//Naming would otherwise allocate a ring for every worker even with the zones compiled out.
+	if (!CPU_PROFILER) return;
+	ZoneRing& ring = getThreadRing();
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	ring.threadName = name;
+}
+
+void recordCpuZone(const char* name, int64_t beginNs, int64_t endNs)
+{
+	ZoneRing& ring = getThreadRing();
+	uint64_t index = ring.recorded.load(std::memory_order_relaxed);
+	ZoneRing::Slot& slot = ring.slots[index % ringCapacity];
+
+	//Orders the previous count before these stores, so a reader that sees any of them also sees that this slot is in use.
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.begin.store(beginNs, std::memory_order_relaxed);
+	slot.end.store(endNs, std::memory_order_relaxed);
+	ring.recorded.store(index + 1, std::memory_order_release);
+}
+
+static void writeJsonString(FILE* file, const std::string& value)
+{
+	fputc('"', file);
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+		else if (static_cast<unsigned char>(c) < 0x20) fprintf(file, "\\u%04x", c);
+		else fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+bool writeCpuTrace(const std::string& path)
+{
+	struct ThreadSnapshot
+	{
+		std::shared_ptr<ZoneRing> ring;
+		std::string name;
+	};
+
+	std::vector<ThreadSnapshot> threads;
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (const std::shared_ptr<ZoneRing>& ring : rings)
+			threads.push_back(ThreadSnapshot{ ring, ring->threadName.empty() ? "Thread " + std::to_string(ring->id) : ring->threadName });
+	}
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	for (const ThreadSnapshot& thread : threads)
+	{
+		const ZoneRing& ring = *thread.ring;
+		fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",", ring.id);
+		writeJsonString(file, thread.name);
+		fprintf(file, "}}");
+		first = false;
+
+		struct Zone
+		{
+			const char* name;
+			int64_t begin;
+			int64_t end;
+		};
+
+		uint64_t recorded = ring.recorded.load(std::memory_order_acquire);
+		uint64_t oldest = recorded > ringCapacity ? recorded - ringCapacity : 0;
+		std::vector<Zone> zones;
+		zones.reserve(static_cast<size_t>(recorded - oldest));
+		for (uint64_t i = oldest; i < recorded; i++)
+		{
+			const ZoneRing::Slot& slot = ring.slots[i % ringCapacity];
+			zones.push_back(Zone{ slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed) });
+		}
+
+		//Anything the owner has started overwriting since the copy began may be torn, including the slot it is writing now.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t recordedAfter = ring.recorded.load(std::memory_order_relaxed);
+		uint64_t firstIntact = recordedAfter + 1 > ringCapacity ? recordedAfter + 1 - ringCapacity : 0;
+
+		for (uint64_t i = std::max(oldest, firstIntact); i < recorded; i++)
+		{
+			const Zone& zone = zones[static_cast<size_t>(i - oldest)];
+			fprintf(file, ",\n{\"name\":");
+			writeJsonString(file, zone.name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", ring.id, zone.begin / 1e3, (zone.end - zone.begin) / 1e3);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	bool written = !ferror(file);
+	return fclose(file) == 0 && written;
+}
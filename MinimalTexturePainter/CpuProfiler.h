@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+//Define CPU_PROFILER as 0 to compile every zone out. The profiler functions stay so callers don't need guards, they just
+//have nothing to report.
+#ifndef CPU_PROFILER
+#define CPU_PROFILER 1
+#endif
+
+//Records timed zones from any thread into a per thread ring that always holds the most recent zones, so a trace can be
+//saved after something slow has already happened. Only the owning thread writes its ring and recording takes no locks,
+//a thread only locks once to register its ring the first time it records.
+
+//Nanoseconds since the profiler was first used.
+int64_t getProfilerTime();
+
+//Label for the calling thread in traces. Threads that never call this show up by number.
+void setProfilerThreadName(const std::string& name);
+
+//name must stay valid for the rest of the program, a string literal in practice.
+void recordCpuZone(const char* name, int64_t beginNs, int64_t endNs);
+
+//Writes every thread's ring in the Chrome trace event format, for chrome://tracing, Perfetto or Speedscope. Safe to call
+//while other threads are recording, zones overwritten during the copy are dropped.
+bool writeCpuTrace(const std::string& path);
+
+//Times the scope it lives in. Use through PROFILE_ZONE so it can be compiled out.
+class CpuZone
+{
+private:
+	const char* name;
+	int64_t begin;
+
+public:
+	CpuZone(const char* name):
+		name(name),
+		begin(getProfilerTime())
+	{
+	}
+
+	CpuZone(const CpuZone&) = delete;
+	CpuZone& operator=(const CpuZone&) = delete;
+
+	~CpuZone()
+	{
+		recordCpuZone(name, begin, getProfilerTime());
+	}
+};
+
+#if CPU_PROFILER
+#define PROFILE_ZONE_CONCAT_INNER(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) CpuZone PROFILE_ZONE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
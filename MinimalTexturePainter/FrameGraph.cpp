@@ -0,0 +1,375 @@
+#include "FrameGraph.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "GLResources.h"
+#include "GpuProfiler.h"
+
+//As drivers usually store them, three component formats padded to four.
+static size_t getBytesPerTexel(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8: return 1;
+	case GL_RGBA16F: return 8;
+	case GL_RGB32F: return 16;
+	case GL_RGBA32F: return 16;
+	default: return 4;
+	}
+}
+
+static bool isDepthFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH_COMPONENT || internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 ||
+		internalFormat == GL_DEPTH_COMPONENT32F;
+}
+
+static bool isDepthStencilFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_DEPTH_STENCIL || internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+static bool sameDesc(const FrameGraph::TextureDesc& a, const FrameGraph::TextureDesc& b)
+{
+	return a.internalFormat == b.internalFormat && a.width == b.width && a.height == b.height;
+}
+
+FrameGraph::Resource FrameGraph::createTexture(const char* name, const TextureDesc& desc)
+{
+	resources.push_back(ResourceNode{ name, true, desc, 0, 0, false });
+	return static_cast<Resource>(resources.size()) - 1;
+}
+
+FrameGraph::Resource FrameGraph::importTexture(const char* name, unsigned int texture, int width, int height)
+{
+	resources.push_back(ResourceNode{ name, false, TextureDesc{ 0, width, height }, texture, 0, false });
+	return static_cast<Resource>(resources.size()) - 1;
+}
+
+FrameGraph::Resource FrameGraph::importTexture(const char* name, unsigned int texture, int width, int height, unsigned int framebuffer)
+{
+	resources.push_back(ResourceNode{ name, false, TextureDesc{ 0, width, height }, texture, framebuffer, true });
+	return static_cast<Resource>(resources.size()) - 1;
+}
+
+FrameGraph::Resource FrameGraph::importFramebuffer(const char* name, unsigned int framebuffer, int width, int height)
+{
+	resources.push_back(ResourceNode{ name, false, TextureDesc{ 0, width, height }, 0, framebuffer, true });
+	return static_cast<Resource>(resources.size()) - 1;
+}
+
+void FrameGraph::markOutput(Resource resource)
+{
+	resources[resource].output = true;
+}
+
+void FrameGraph::addPass(const char* name, const std::vector<Resource>& reads, const std::vector<Resource>& writes, std::function<void()> execute)
+{
+	int index = static_cast<int>(passes.size());
+	PassNode pass{ name, {}, {}, std::move(execute) };
+	for (Resource resource : writes)
+	{
+		if (resources[resource].writer >= 0)
+		{
+			std::cout << "ERROR::FRAMEGRAPH::" << name << " writes " << resources[resource].name << ", already written by " <<
+				passes[resources[resource].writer].name << std::endl;
+			continue;
+		}
+		resources[resource].writer = index;
+		pass.writes.push_back(resource);
+	}
+	for (Resource resource : reads)
+	{
+		if (std::find(pass.writes.begin(), pass.writes.end(), resource) != pass.writes.end())
+		{
+			std::cout << "ERROR::FRAMEGRAPH::" << name << " reads " << resources[resource].name << " while writing it" << std::endl;
+			continue;
+		}
+		pass.reads.push_back(resource);
+	}
+	passes.push_back(std::move(pass));
+}
+
+void FrameGraph::cullPasses()
+{
+	for (PassNode& pass : passes)
+		pass.culled = true;
+
+	//Walk back from the outputs through the passes that write what a kept pass reads.
+	std::vector<Resource> needed;
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		if (resources[r].output) needed.push_back(static_cast<Resource>(r));
+	}
+	while (!needed.empty())
+	{
+		Resource resource = needed.back();
+		needed.pop_back();
+		int writer = resources[resource].writer;
+		if (writer < 0 || !passes[writer].culled) continue;
+		passes[writer].culled = false;
+		needed.insert(needed.end(), passes[writer].reads.begin(), passes[writer].reads.end());
+	}
+}
+
+std::vector<int> FrameGraph::sortPasses() const
+{
+	//Edges run from the writer of each resource to the kept passes reading it.
+	std::vector<int> waitingOn(passes.size(), 0);
+	std::vector<std::vector<int>> dependents(passes.size());
+	for (size_t p = 0; p < passes.size(); p++)
+	{
+		if (passes[p].culled) continue;
+		for (Resource resource : passes[p].reads)
+		{
+			int writer = resources[resource].writer;
+			if (writer < 0) continue;
+			waitingOn[p]++;
+			dependents[writer].push_back(static_cast<int>(p));
+		}
+	}
+
+	std::vector<int> order;
+	std::vector<bool> done(passes.size(), false);
+	while (true)
+	{
+		int next = -1;
+		for (size_t p = 0; p < passes.size() && next < 0; p++)
+		{
+			if (!passes[p].culled && !done[p] && waitingOn[p] == 0) next = static_cast<int>(p);
+		}
+		if (next < 0) break;
+		done[next] = true;
+		order.push_back(next);
+		for (int dependent : dependents[next])
+			waitingOn[dependent]--;
+	}
+
+	//Only a cycle leaves kept passes behind. They still run, in the order they were declared.
+	for (size_t p = 0; p < passes.size(); p++)
+	{
+		if (passes[p].culled || done[p]) continue;
+		std::cout << "ERROR::FRAMEGRAPH::" << passes[p].name << " waits on a cycle of passes reading each other's writes" << std::endl;
+		order.push_back(static_cast<int>(p));
+	}
+	return order;
+}
+
+void FrameGraph::allocateTransients(const std::vector<int>& order)
+{
+	for (PooledTexture& pooled : pool)
+		pooled.busyUntil = -1;
+
+	//First and last position each transient is used at.
+	std::vector<int> firstUse(resources.size(), -1);
+	std::vector<int> lastUse(resources.size(), -1);
+	for (int position = 0; position < static_cast<int>(order.size()); position++)
+	{
+		PassNode& pass = passes[order[position]];
+		pass.position = position;
+		for (const std::vector<Resource>* list : { &pass.reads, &pass.writes })
+		{
+			for (Resource resource : *list)
+			{
+				if (firstUse[resource] < 0) firstUse[resource] = position;
+				lastUse[resource] = position;
+			}
+		}
+	}
+
+	std::vector<Resource> transients;
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		if (resources[r].transient && firstUse[r] >= 0) transients.push_back(static_cast<Resource>(r));
+	}
+	std::stable_sort(transients.begin(), transients.end(), [&firstUse](Resource a, Resource b) { return firstUse[a] < firstUse[b]; });
+
+	//A pooled texture is free for a resource once everything that used it earlier in the frame is done with it.
+	for (Resource resource : transients)
+	{
+		ResourceNode& node = resources[resource];
+		stats.requestedBytes += getBytesPerTexel(node.desc.internalFormat) * node.desc.width * node.desc.height;
+
+		int chosen = -1;
+		for (size_t i = 0; i < pool.size() && chosen < 0; i++)
+		{
+			if (pool[i].busyUntil < firstUse[resource] && sameDesc(pool[i].desc, node.desc)) chosen = static_cast<int>(i);
+		}
+		if (chosen < 0)
+		{
+			unsigned int texture = createTexture2D(node.desc.internalFormat, node.desc.width, node.desc.height);
+			pool.push_back(PooledTexture{ node.desc, texture });
+			chosen = static_cast<int>(pool.size()) - 1;
+		}
+		if (pool[chosen].busyUntil < 0)
+			stats.allocatedBytes += getBytesPerTexel(node.desc.internalFormat) * node.desc.width * node.desc.height;
+		pool[chosen].busyUntil = lastUse[resource];
+		pool[chosen].idleFrames = 0;
+		node.pooledTexture = chosen;
+		node.texture = pool[chosen].texture;
+	}
+}
+
+unsigned int FrameGraph::getPassFramebuffer(const PassNode& pass, int& width, int& height)
+{
+	const ResourceNode& first = resources[pass.writes.front()];
+	width = first.desc.width;
+	height = first.desc.height;
+	if (pass.writes.size() == 1 && first.hasFramebuffer) return first.framebuffer;
+
+	std::vector<unsigned int> attachments;
+	for (Resource resource : pass.writes)
+	{
+		if (!resources[resource].texture)
+		{
+			std::cout << "ERROR::FRAMEGRAPH::" << pass.name << " writes " << resources[resource].name << " alongside other targets" << std::endl;
+			continue;
+		}
+		attachments.push_back(resources[resource].texture);
+	}
+
+	for (CachedFramebuffer& cached : framebuffers)
+	{
+		if (cached.attachments != attachments) continue;
+		cached.used = true;
+		return cached.framebuffer;
+	}
+
+	unsigned int framebuffer = createFramebuffer();
+	std::vector<GLenum> drawBuffers;
+	for (unsigned int texture : attachments)
+	{
+		//Imported textures don't say their format, so every attachment is asked. Only happens when a target set is new.
+		GLint internalFormat;
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		if (isDepthStencilFormat(internalFormat)) attachFramebufferTexture(framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, texture);
+		else if (isDepthFormat(internalFormat)) attachFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, texture);
+		else
+		{
+			GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(drawBuffers.size());
+			attachFramebufferTexture(framebuffer, attachment, texture);
+			drawBuffers.push_back(attachment);
+		}
+	}
+	if (drawBuffers.empty())
+	{
+		setFramebufferBuffers(framebuffer, GL_NONE, GL_NONE);
+	}
+	else if (drawBuffers.size() > 1)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+	}
+	if (!isFramebufferComplete(framebuffer))
+		std::cout << "ERROR::FRAMEGRAPH::" << pass.name << " framebuffer is not complete" << std::endl;
+
+	framebuffers.push_back(CachedFramebuffer{ attachments, framebuffer, true });
+	return framebuffer;
+}
+
+void FrameGraph::execute(GpuProfiler* profiler)
+{
+	stats = Stats();
+	cullPasses();
+	std::vector<int> order = sortPasses();
+	allocateTransients(order);
+
+	for (int index : order)
+	{
+		const PassNode& pass = passes[index];
+		GpuScope scope(profiler, pass.name);
+		if (!pass.writes.empty())
+		{
+			int width, height;
+			currentFramebuffer = getPassFramebuffer(pass, width, height);
+			glBindFramebuffer(GL_FRAMEBUFFER, currentFramebuffer);
+			glViewport(0, 0, width, height);
+		}
+		pass.execute();
+	}
+
+	for (int index : order)
+		stats.passes.push_back(PassInfo{ passes[index].name, false });
+	for (const PassNode& pass : passes)
+	{
+		if (pass.culled) stats.passes.push_back(PassInfo{ pass.name, true });
+	}
+	for (const ResourceNode& resource : resources)
+		stats.resources.push_back(ResourceInfo{ resource.name, resource.transient, resource.desc.width, resource.desc.height, resource.pooledTexture });
+	for (const PooledTexture& pooled : pool)
+		stats.pooledBytes += getBytesPerTexel(pooled.desc.internalFormat) * pooled.desc.width * pooled.desc.height;
+
+	resources.clear();
+	passes.clear();
+	releaseIdle();
+}
+
+void FrameGraph::releaseIdle()
+{
+	//Framebuffers are cheap to build again, so any the frame didn't use go straight away.
+	for (size_t i = 0; i < framebuffers.size();)
+	{
+		if (framebuffers[i].used)
+		{
+			framebuffers[i].used = false;
+			i++;
+			continue;
+		}
+		glDeleteFramebuffers(1, &framebuffers[i].framebuffer);
+		framebuffers.erase(framebuffers.begin() + i);
+	}
+
+	for (size_t i = 0; i < pool.size();)
+	{
+		if (pool[i].busyUntil >= 0 || ++pool[i].idleFrames <= maxIdleFrames)
+		{
+			i++;
+			continue;
+		}
+		forgetTexture(pool[i].texture);
+		glDeleteTextures(1, &pool[i].texture);
+		pool.erase(pool.begin() + i);
+	}
+}
+
+unsigned int FrameGraph::getTexture(Resource resource) const
+{
+	return resources[resource].texture;
+}
+
+unsigned int FrameGraph::getFramebuffer() const
+{
+	return currentFramebuffer;
+}
+
+void FrameGraph::forgetTexture(unsigned int texture)
+{
+	for (size_t i = 0; i < framebuffers.size();)
+	{
+		const std::vector<unsigned int>& attachments = framebuffers[i].attachments;
+		if (std::find(attachments.begin(), attachments.end(), texture) == attachments.end())
+		{
+			i++;
+			continue;
+		}
+		glDeleteFramebuffers(1, &framebuffers[i].framebuffer);
+		framebuffers.erase(framebuffers.begin() + i);
+	}
+}
+
+const FrameGraph::Stats& FrameGraph::getStats() const
+{
+	return stats;
+}
+
+FrameGraph::~FrameGraph()
+{
+	for (const CachedFramebuffer& cached : framebuffers)
+		glDeleteFramebuffers(1, &cached.framebuffer);
+	for (const PooledTexture& pooled : pool)
+		glDeleteTextures(1, &pooled.texture);
+}
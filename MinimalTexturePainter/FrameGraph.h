@@ -0,0 +1,158 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+class GpuProfiler;
+
+//Runs a frame's render passes from what each one reads and writes. Passes are declared every frame, then execute orders
+//them so every pass runs after the passes that write what it reads, culls the ones whose results nothing uses, and binds
+//each pass's render target before calling it. Transient textures only live within the frame. They come from a pool kept
+//between frames, and two with the same format and size share one texture when their passes don't overlap.
+class FrameGraph
+{
+public:
+	//A texture or framebuffer declared this frame.
+	typedef int Resource;
+
+	struct TextureDesc
+	{
+		GLenum internalFormat;
+		int width;
+		int height;
+	};
+
+	//What the last execute did, for the frame graph window. Passes are in the order they ran, culled ones last.
+	struct PassInfo
+	{
+		const char* name;
+		bool culled;
+	};
+
+	struct ResourceInfo
+	{
+		const char* name;
+		bool transient;
+		int width;
+		int height;
+		//Index of the pooled texture it was given, or -1 if imported or never used.
+		int pooledTexture;
+	};
+
+	struct Stats
+	{
+		std::vector<PassInfo> passes;
+		std::vector<ResourceInfo> resources;
+		//Bytes the transient textures would take if none were aliased.
+		size_t requestedBytes = 0;
+		//Bytes of the pooled textures the frame used.
+		size_t allocatedBytes = 0;
+		//Bytes of every pooled texture, including ones kept for reuse.
+		size_t pooledBytes = 0;
+	};
+
+private:
+	struct ResourceNode
+	{
+		const char* name;
+		bool transient;
+		TextureDesc desc;
+		//Imported texture, or the pooled texture once allocated. 0 for an imported framebuffer.
+		unsigned int texture;
+		//The framebuffer to bind when a pass writes only this resource, if it brought one.
+		unsigned int framebuffer;
+		bool hasFramebuffer;
+		bool output = false;
+		int writer = -1;
+		int pooledTexture = -1;
+	};
+
+	struct PassNode
+	{
+		const char* name;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		std::function<void()> execute;
+		bool culled = false;
+		int position = -1;
+	};
+
+	struct PooledTexture
+	{
+		TextureDesc desc;
+		unsigned int texture;
+		int idleFrames = 0;
+		//Execution index of the last pass using it this frame, -1 while free.
+		int busyUntil = -1;
+	};
+
+	struct CachedFramebuffer
+	{
+		std::vector<unsigned int> attachments;
+		unsigned int framebuffer;
+		bool used;
+	};
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	std::vector<PooledTexture> pool;
+	std::vector<CachedFramebuffer> framebuffers;
+	unsigned int currentFramebuffer = 0;
+	Stats stats;
+
+	//Kahn's algorithm, declaration order where nothing else decides.
+	std::vector<int> sortPasses() const;
+
+	void cullPasses();
+
+	void allocateTransients(const std::vector<int>& order);
+
+	unsigned int getPassFramebuffer(const PassNode& pass, int& width, int& height);
+
+	void releaseIdle();
+
+public:
+	//Pooled textures unused for this many frames are deleted, so textures from before a resize don't linger.
+	static constexpr int maxIdleFrames = 3;
+
+	FrameGraph() = default;
+	FrameGraph(const FrameGraph&) = delete;
+	FrameGraph& operator=(const FrameGraph&) = delete;
+	~FrameGraph();
+
+	//A texture that only lives within the frame. Its contents are undefined until a pass writes it.
+	Resource createTexture(const char* name, const TextureDesc& desc);
+
+	//A texture owned elsewhere, whose contents carry over between frames. Passes that write only this resource render
+	//through framebuffer if it is given, otherwise the graph builds one.
+	Resource importTexture(const char* name, unsigned int texture, int width, int height);
+
+	Resource importTexture(const char* name, unsigned int texture, int width, int height, unsigned int framebuffer);
+
+	//A framebuffer with no texture to sample, such as the default one. A pass writing it can't write anything else.
+	Resource importFramebuffer(const char* name, unsigned int framebuffer, int width, int height);
+
+	//Keeps the passes that write resource. Passes are culled unless an output depends on them.
+	void markOutput(Resource resource);
+
+	//name must outlive the stats of the frame, a string literal in practice. A pass can't read what it writes, that
+	//would be a feedback loop. Each resource is written by one pass per frame.
+	void addPass(const char* name, const std::vector<Resource>& reads, const std::vector<Resource>& writes, std::function<void()> execute);
+
+	//Runs the passes declared since the last execute, each in a GPU scope of its name, then forgets them. The pass's
+	//framebuffer is bound with the viewport covering it. Passes leave it bound like the renderer's passes do.
+	void execute(GpuProfiler* profiler);
+
+	//The texture behind a resource. Only valid while the passes are running.
+	unsigned int getTexture(Resource resource) const;
+
+	//The framebuffer bound for the running pass.
+	unsigned int getFramebuffer() const;
+
+	//Drops framebuffers built around texture. Call before deleting a texture that passes have written through an import,
+	//since the name can come back for a new texture.
+	void forgetTexture(unsigned int texture);
+
+	const Stats& getStats() const;
+};
@@ -0,0 +1,126 @@
+#include "GLCallStats.h"
+
+#include "GLExtensions.h"
+#include "GLStateCache.h"
+
+GLCallStats& GLCallStats::operator+=(const GLCallStats& other)
+{
+	draws += other.draws;
+	dispatches += other.dispatches;
+	programBinds += other.programBinds;
+	redundantProgramBinds += other.redundantProgramBinds;
+	textureBinds += other.textureBinds;
+	redundantTextureBinds += other.redundantTextureBinds;
+	activeTextureSets += other.activeTextureSets;
+	redundantActiveTextureSets += other.redundantActiveTextureSets;
+	framebufferBinds += other.framebufferBinds;
+	redundantFramebufferBinds += other.redundantFramebufferBinds;
+	vertexArrayBinds += other.vertexArrayBinds;
+	redundantVertexArrayBinds += other.redundantVertexArrayBinds;
+	bufferBinds += other.bufferBinds;
+	uniformUploads += other.uniformUploads;
+	return *this;
+}
+
+static GLCallStats stats;
+
+//Wraps an entry point whose calls are only counted, with no state to track.
+template<int Id, unsigned int GLCallStats::* Counter, typename Proc>
+struct CountedEntryPoint;
+
+template<int Id, unsigned int GLCallStats::* Counter, typename... Args>
+struct CountedEntryPoint<Id, Counter, void (APIENTRYP)(Args...)>
+{
+	static void (APIENTRYP original)(Args...);
+
+	static void APIENTRY call(Args... args)
+	{
+		stats.*Counter += 1;
+		original(args...);
+	}
+
+	static void install(void (APIENTRYP& entryPoint)(Args...))
+	{
+		if (!entryPoint) return;
+		original = entryPoint;
+		entryPoint = call;
+	}
+};
+
+template<int Id, unsigned int GLCallStats::* Counter, typename... Args>
+void (APIENTRYP CountedEntryPoint<Id, Counter, void (APIENTRYP)(Args...)>::original)(Args...) = nullptr;
+
+//Each use is on its own line so entry points with the same signature get their own original pointer.
+#define COUNT_CALLS(name, counter) CountedEntryPoint<__LINE__, &GLCallStats::counter, decltype(glad_##name)>::install(glad_##name)
+
+void installGLCallCounters()
+{
+	static bool installed = false;
+	if (installed) return;
+	installed = true;
+
+	//Binds are counted by the state cache, which is what tracks them.
+	installGLStateCache();
+
+	COUNT_CALLS(glDrawArrays, draws);
+	COUNT_CALLS(glDrawElements, draws);
+	COUNT_CALLS(glDrawArraysInstanced, draws);
+	COUNT_CALLS(glDrawElementsInstanced, draws);
+	COUNT_CALLS(glDrawRangeElements, draws);
+	COUNT_CALLS(glDrawElementsBaseVertex, draws);
+	COUNT_CALLS(glDispatchCompute, dispatches);
+	//Image units don't follow the active texture, so they are counted but never redundant.
+	COUNT_CALLS(glBindImageTexture, textureBinds);
+	COUNT_CALLS(glBindBuffer, bufferBinds);
+	COUNT_CALLS(glBindBufferBase, bufferBinds);
+	COUNT_CALLS(glBindBufferRange, bufferBinds);
+
+	COUNT_CALLS(glUniform1f, uniformUploads);
+	COUNT_CALLS(glUniform2f, uniformUploads);
+	COUNT_CALLS(glUniform3f, uniformUploads);
+	COUNT_CALLS(glUniform4f, uniformUploads);
+	COUNT_CALLS(glUniform1i, uniformUploads);
+	COUNT_CALLS(glUniform2i, uniformUploads);
+	COUNT_CALLS(glUniform3i, uniformUploads);
+	COUNT_CALLS(glUniform4i, uniformUploads);
+	COUNT_CALLS(glUniform1ui, uniformUploads);
+	COUNT_CALLS(glUniform2ui, uniformUploads);
+	COUNT_CALLS(glUniform3ui, uniformUploads);
+	COUNT_CALLS(glUniform4ui, uniformUploads);
+	COUNT_CALLS(glUniform1fv, uniformUploads);
+	COUNT_CALLS(glUniform2fv, uniformUploads);
+	COUNT_CALLS(glUniform3fv, uniformUploads);
+	COUNT_CALLS(glUniform4fv, uniformUploads);
+	COUNT_CALLS(glUniform1iv, uniformUploads);
+	COUNT_CALLS(glUniform2iv, uniformUploads);
+	COUNT_CALLS(glUniform3iv, uniformUploads);
+	COUNT_CALLS(glUniform4iv, uniformUploads);
+	COUNT_CALLS(glUniform1uiv, uniformUploads);
+	COUNT_CALLS(glUniform2uiv, uniformUploads);
+	COUNT_CALLS(glUniform3uiv, uniformUploads);
+	COUNT_CALLS(glUniform4uiv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix2fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix3fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix4fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix2x3fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix3x2fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix2x4fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix4x2fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix3x4fv, uniformUploads);
+	COUNT_CALLS(glUniformMatrix4x3fv, uniformUploads);
+}
+
+const GLCallStats& getGLCallStats()
+{
+	return stats;
+}
+
+void countGLCall(unsigned int GLCallStats::* counter)
+{
+	stats.*counter += 1;
+}
+
+void resetGLCallStats()
+{
+	stats = GLCallStats();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//GL calls by category since the last reset. Redundant counts are the part of the total that set what was already set.
+struct GLCallStats
+{
+	unsigned int draws = 0;
+	unsigned int dispatches = 0;
+	unsigned int programBinds = 0;
+	unsigned int redundantProgramBinds = 0;
+	unsigned int textureBinds = 0;
+	unsigned int redundantTextureBinds = 0;
+	unsigned int activeTextureSets = 0;
+	unsigned int redundantActiveTextureSets = 0;
+	unsigned int framebufferBinds = 0;
+	unsigned int redundantFramebufferBinds = 0;
+	unsigned int vertexArrayBinds = 0;
+	unsigned int redundantVertexArrayBinds = 0;
+	unsigned int bufferBinds = 0;
+	unsigned int uniformUploads = 0;
+
+	GLCallStats& operator+=(const GLCallStats& other);
+};
+
+//Swaps glad's entry points for wrappers that count calls before calling the driver, so every call site is counted without
+//changing it. Binds are counted by the state cache, which this installs too and which has the same restrictions. Must be
+//called after loadGLExtensions with the context current. ImGui's backend has its own loader, so the UI draw isn't counted.
+void installGLCallCounters();
+
+const GLCallStats& getGLCallStats();
+
+void resetGLCallStats();
+
+//Adds one to counter, for wrappers installed elsewhere.
+void countGLCall(unsigned int GLCallStats::* counter);
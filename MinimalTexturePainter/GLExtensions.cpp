@@ -0,0 +1,124 @@
+#include "GLExtensions.h"
+
+#include <cstring>
+
+PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = nullptr;
+PFNGLBINDTEXTURESPROC glad_glBindTextures = nullptr;
+PFNGLBINDIMAGETEXTUREPROC glad_glBindImageTexture = nullptr;
+PFNGLMEMORYBARRIERPROC glad_glMemoryBarrier = nullptr;
+PFNGLDISPATCHCOMPUTEPROC glad_glDispatchCompute = nullptr;
+PFNGLCOPYIMAGESUBDATAPROC glad_glCopyImageSubData = nullptr;
+PFNGLPUSHDEBUGGROUPPROC glad_glPushDebugGroup = nullptr;
+PFNGLPOPDEBUGGROUPPROC glad_glPopDebugGroup = nullptr;
+PFNGLCREATEBUFFERSPROC glad_glCreateBuffers = nullptr;
+PFNGLNAMEDBUFFERSTORAGEPROC glad_glNamedBufferStorage = nullptr;
+PFNGLCREATETEXTURESPROC glad_glCreateTextures = nullptr;
+PFNGLTEXTURESTORAGE2DPROC glad_glTextureStorage2D = nullptr;
+PFNGLTEXTURESUBIMAGE2DPROC glad_glTextureSubImage2D = nullptr;
+PFNGLTEXTUREPARAMETERIPROC glad_glTextureParameteri = nullptr;
+PFNGLGENERATETEXTUREMIPMAPPROC glad_glGenerateTextureMipmap = nullptr;
+PFNGLCREATEFRAMEBUFFERSPROC glad_glCreateFramebuffers = nullptr;
+PFNGLNAMEDFRAMEBUFFERTEXTUREPROC glad_glNamedFramebufferTexture = nullptr;
+PFNGLNAMEDFRAMEBUFFERRENDERBUFFERPROC glad_glNamedFramebufferRenderbuffer = nullptr;
+PFNGLNAMEDFRAMEBUFFERDRAWBUFFERPROC glad_glNamedFramebufferDrawBuffer = nullptr;
+PFNGLNAMEDFRAMEBUFFERREADBUFFERPROC glad_glNamedFramebufferReadBuffer = nullptr;
+PFNGLCHECKNAMEDFRAMEBUFFERSTATUSPROC glad_glCheckNamedFramebufferStatus = nullptr;
+PFNGLCREATERENDERBUFFERSPROC glad_glCreateRenderbuffers = nullptr;
+PFNGLNAMEDRENDERBUFFERSTORAGEPROC glad_glNamedRenderbufferStorage = nullptr;
+PFNGLCREATEVERTEXARRAYSPROC glad_glCreateVertexArrays = nullptr;
+PFNGLVERTEXARRAYVERTEXBUFFERPROC glad_glVertexArrayVertexBuffer = nullptr;
+PFNGLVERTEXARRAYELEMENTBUFFERPROC glad_glVertexArrayElementBuffer = nullptr;
+PFNGLENABLEVERTEXARRAYATTRIBPROC glad_glEnableVertexArrayAttrib = nullptr;
+PFNGLVERTEXARRAYATTRIBFORMATPROC glad_glVertexArrayAttribFormat = nullptr;
+PFNGLVERTEXARRAYATTRIBBINDINGPROC glad_glVertexArrayAttribBinding = nullptr;
+
+static GLCapabilities capabilities;
+
+static bool hasExtension(const char* name)
+{
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension && std::strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+static bool isVersionAtLeast(int major, int minor)
+{
+	return capabilities.majorVersion > major || (capabilities.majorVersion == major && capabilities.minorVersion >= minor);
+}
+
+void loadGLExtensions(GLADloadproc load)
+{
+	glGetIntegerv(GL_MAJOR_VERSION, &capabilities.majorVersion);
+	glGetIntegerv(GL_MINOR_VERSION, &capabilities.minorVersion);
+
+	if (isVersionAtLeast(4, 4) || hasExtension("GL_ARB_buffer_storage"))
+	{
+		glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+		capabilities.bufferStorage = glad_glBufferStorage != nullptr;
+	}
+
+	if (isVersionAtLeast(4, 4) || hasExtension("GL_ARB_multi_bind"))
+	{
+		glad_glBindTextures = (PFNGLBINDTEXTURESPROC)load("glBindTextures");
+		capabilities.multiBind = glad_glBindTextures != nullptr;
+	}
+
+	if (isVersionAtLeast(4, 3))
+	{
+		glad_glBindImageTexture = (PFNGLBINDIMAGETEXTUREPROC)load("glBindImageTexture");
+		glad_glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+		glad_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+		glad_glCopyImageSubData = (PFNGLCOPYIMAGESUBDATAPROC)load("glCopyImageSubData");
+		capabilities.computeShader = glad_glBindImageTexture && glad_glMemoryBarrier && glad_glDispatchCompute && glad_glCopyImageSubData;
+	}
+
+	//Core KHR_debug has no suffix.
+	if (isVersionAtLeast(4, 3) || hasExtension("GL_KHR_debug"))
+	{
+		glad_glPushDebugGroup = (PFNGLPUSHDEBUGGROUPPROC)load("glPushDebugGroup");
+		glad_glPopDebugGroup = (PFNGLPOPDEBUGGROUPPROC)load("glPopDebugGroup");
+		capabilities.debugGroups = glad_glPushDebugGroup && glad_glPopDebugGroup;
+	}
+
+	//Only the subset used to create and edit objects. Core ARB_direct_state_access has no suffix.
+	if (isVersionAtLeast(4, 5) || hasExtension("GL_ARB_direct_state_access"))
+	{
+		glad_glCreateBuffers = (PFNGLCREATEBUFFERSPROC)load("glCreateBuffers");
+		glad_glNamedBufferStorage = (PFNGLNAMEDBUFFERSTORAGEPROC)load("glNamedBufferStorage");
+		glad_glCreateTextures = (PFNGLCREATETEXTURESPROC)load("glCreateTextures");
+		glad_glTextureStorage2D = (PFNGLTEXTURESTORAGE2DPROC)load("glTextureStorage2D");
+		glad_glTextureSubImage2D = (PFNGLTEXTURESUBIMAGE2DPROC)load("glTextureSubImage2D");
+		glad_glTextureParameteri = (PFNGLTEXTUREPARAMETERIPROC)load("glTextureParameteri");
+		glad_glGenerateTextureMipmap = (PFNGLGENERATETEXTUREMIPMAPPROC)load("glGenerateTextureMipmap");
+		glad_glCreateFramebuffers = (PFNGLCREATEFRAMEBUFFERSPROC)load("glCreateFramebuffers");
+		glad_glNamedFramebufferTexture = (PFNGLNAMEDFRAMEBUFFERTEXTUREPROC)load("glNamedFramebufferTexture");
+		glad_glNamedFramebufferRenderbuffer = (PFNGLNAMEDFRAMEBUFFERRENDERBUFFERPROC)load("glNamedFramebufferRenderbuffer");
+		glad_glNamedFramebufferDrawBuffer = (PFNGLNAMEDFRAMEBUFFERDRAWBUFFERPROC)load("glNamedFramebufferDrawBuffer");
+		glad_glNamedFramebufferReadBuffer = (PFNGLNAMEDFRAMEBUFFERREADBUFFERPROC)load("glNamedFramebufferReadBuffer");
+		glad_glCheckNamedFramebufferStatus = (PFNGLCHECKNAMEDFRAMEBUFFERSTATUSPROC)load("glCheckNamedFramebufferStatus");
+		glad_glCreateRenderbuffers = (PFNGLCREATERENDERBUFFERSPROC)load("glCreateRenderbuffers");
+		glad_glNamedRenderbufferStorage = (PFNGLNAMEDRENDERBUFFERSTORAGEPROC)load("glNamedRenderbufferStorage");
+		glad_glCreateVertexArrays = (PFNGLCREATEVERTEXARRAYSPROC)load("glCreateVertexArrays");
+		glad_glVertexArrayVertexBuffer = (PFNGLVERTEXARRAYVERTEXBUFFERPROC)load("glVertexArrayVertexBuffer");
+		glad_glVertexArrayElementBuffer = (PFNGLVERTEXARRAYELEMENTBUFFERPROC)load("glVertexArrayElementBuffer");
+		glad_glEnableVertexArrayAttrib = (PFNGLENABLEVERTEXARRAYATTRIBPROC)load("glEnableVertexArrayAttrib");
+		glad_glVertexArrayAttribFormat = (PFNGLVERTEXARRAYATTRIBFORMATPROC)load("glVertexArrayAttribFormat");
+		glad_glVertexArrayAttribBinding = (PFNGLVERTEXARRAYATTRIBBINDINGPROC)load("glVertexArrayAttribBinding");
+		capabilities.directStateAccess = glad_glCreateBuffers && glad_glNamedBufferStorage && glad_glCreateTextures && glad_glTextureStorage2D &&
+			glad_glTextureSubImage2D && glad_glTextureParameteri && glad_glGenerateTextureMipmap && glad_glCreateFramebuffers &&
+			glad_glNamedFramebufferTexture && glad_glNamedFramebufferRenderbuffer && glad_glNamedFramebufferDrawBuffer && glad_glNamedFramebufferReadBuffer &&
+			glad_glCheckNamedFramebufferStatus && glad_glCreateRenderbuffers && glad_glNamedRenderbufferStorage && glad_glCreateVertexArrays &&
+			glad_glVertexArrayVertexBuffer && glad_glVertexArrayElementBuffer && glad_glEnableVertexArrayAttrib && glad_glVertexArrayAttribFormat &&
+			glad_glVertexArrayAttribBinding;
+	}
+}
+
+const GLCapabilities& getGLCapabilities()
+{
+	return capabilities;
+}
@@ -0,0 +1,229 @@
+#include "GLResources.h"
+
+#include <algorithm>
+
+#include "GLExtensions.h"
+
+static bool directStateAccess = true;
+
+void setGLDirectStateAccess(bool enabled)
+{
+	directStateAccess = enabled;
+}
+
+bool isGLDirectStateAccess()
+{
+	return directStateAccess && getGLCapabilities().directStateAccess;
+}
+
+int getMipLevelCount(int width, int height)
+{
+	int levels = 1;
+	for (int size = std::max(width, height); size > 1; size >>= 1)
+		levels++;
+	return levels;
+}
+
+unsigned int createTexture2D(GLenum internalFormat, int width, int height, int levels)
+{
+	unsigned int texture;
+	if (isGLDirectStateAccess())
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, levels, internalFormat, width, height);
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, 0);
+		return texture;
+	}
+
+	//Any format and type the internal format accepts will do when there is no data to convert.
+	GLenum format = GL_RGBA;
+	GLenum type = GL_UNSIGNED_BYTE;
+	if (internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F)
+	{
+		format = GL_DEPTH_COMPONENT;
+		type = GL_FLOAT;
+	}
+	else if (internalFormat == GL_DEPTH24_STENCIL8)
+	{
+		format = GL_DEPTH_STENCIL;
+		type = GL_UNSIGNED_INT_24_8;
+	}
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	for (int level = 0; level < levels; level++)
+		glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, width >> level), std::max(1, height >> level), 0, format, type, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+void setTextureParameter(unsigned int texture, GLenum name, GLint value)
+{
+	if (isGLDirectStateAccess())
+	{
+		glTextureParameteri(texture, name, value);
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, name, value);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void uploadTexture2D(unsigned int texture, int level, int x, int y, int width, int height, GLenum format, GLenum type, const void* pixels)
+{
+	if (isGLDirectStateAccess())
+	{
+		glTextureSubImage2D(texture, level, x, y, width, height, format, type, pixels);
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, format, type, pixels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void generateTextureMipmaps(unsigned int texture)
+{
+	if (isGLDirectStateAccess())
+	{
+		glGenerateTextureMipmap(texture);
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+unsigned int createBuffer(GLsizeiptr size, const void* data, GLbitfield flags)
+{
+	unsigned int buffer;
+	if (isGLDirectStateAccess())
+	{
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, size, data, flags);
+		return buffer;
+	}
+
+	//The copy target, so no vertex array or pixel transfer picks the buffer up.
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (getGLCapabilities().bufferStorage)
+	{
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, flags);
+	}
+	else
+	{
+		GLenum usage = GL_STATIC_DRAW;
+		if (flags & GL_MAP_READ_BIT) usage = GL_STREAM_READ;
+		else if (flags & GL_MAP_WRITE_BIT) usage = GL_STREAM_DRAW;
+		else if (flags & GL_DYNAMIC_STORAGE_BIT) usage = GL_DYNAMIC_DRAW;
+		glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+unsigned int createRenderbuffer(GLenum internalFormat, int width, int height)
+{
+	unsigned int renderbuffer;
+	if (isGLDirectStateAccess())
+	{
+		glCreateRenderbuffers(1, &renderbuffer);
+		glNamedRenderbufferStorage(renderbuffer, internalFormat, width, height);
+		return renderbuffer;
+	}
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	return renderbuffer;
+}
+
+unsigned int createFramebuffer()
+{
+	unsigned int framebuffer;
+	//Names from glGenFramebuffers only become framebuffers when first bound, which the fallback edits do.
+	if (isGLDirectStateAccess()) glCreateFramebuffers(1, &framebuffer);
+	else glGenFramebuffers(1, &framebuffer);
+	return framebuffer;
+}
+
+void attachFramebufferTexture(unsigned int framebuffer, GLenum attachment, unsigned int texture)
+{
+	if (isGLDirectStateAccess())
+	{
+		glNamedFramebufferTexture(framebuffer, attachment, texture, 0);
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void attachFramebufferRenderbuffer(unsigned int framebuffer, GLenum attachment, unsigned int renderbuffer)
+{
+	if (isGLDirectStateAccess())
+	{
+		glNamedFramebufferRenderbuffer(framebuffer, attachment, GL_RENDERBUFFER, renderbuffer);
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, renderbuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void setFramebufferBuffers(unsigned int framebuffer, GLenum drawBuffer, GLenum readBuffer)
+{
+	if (isGLDirectStateAccess())
+	{
+		glNamedFramebufferDrawBuffer(framebuffer, drawBuffer);
+		glNamedFramebufferReadBuffer(framebuffer, readBuffer);
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glDrawBuffer(drawBuffer);
+	glReadBuffer(readBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool isFramebufferComplete(unsigned int framebuffer)
+{
+	if (isGLDirectStateAccess()) return glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+unsigned int createVertexArray(unsigned int vertexBuffer, GLsizei stride, unsigned int elementBuffer, std::initializer_list<VertexAttribute> attributes)
+{
+	unsigned int vertexArray;
+	if (isGLDirectStateAccess())
+	{
+		glCreateVertexArrays(1, &vertexArray);
+		glVertexArrayVertexBuffer(vertexArray, 0, vertexBuffer, 0, stride);
+		glVertexArrayElementBuffer(vertexArray, elementBuffer);
+		for (const VertexAttribute& attribute : attributes)
+		{
+			glEnableVertexArrayAttrib(vertexArray, attribute.index);
+			glVertexArrayAttribFormat(vertexArray, attribute.index, attribute.size, attribute.type, GL_FALSE, attribute.offset);
+			glVertexArrayAttribBinding(vertexArray, attribute.index, 0);
+		}
+		return vertexArray;
+	}
+
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+	for (const VertexAttribute& attribute : attributes)
+	{
+		glEnableVertexAttribArray(attribute.index);
+		glVertexAttribPointer(attribute.index, attribute.size, attribute.type, GL_FALSE, stride, (void*)static_cast<size_t>(attribute.offset));
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return vertexArray;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <initializer_list>
+#include <glad/glad.h>
+
+//Creates and edits textures, buffers, vertex arrays and framebuffers. With direct state access objects are edited by
+//name, so nothing is bound and the state cache is left alone, and storage is immutable. Without it the GL 3.3 bind to
+//edit calls give the same result, binding the object and then 0 on the target they use.
+
+//On when the capability is set. Turning it off uses the GL 3.3 calls even where GL 4.5 is available, to compare the two.
+void setGLDirectStateAccess(bool enabled);
+
+bool isGLDirectStateAccess();
+
+//Levels in a full mip chain down to 1x1.
+int getMipLevelCount(int width, int height);
+
+//A GL_TEXTURE_2D with levels mip levels of a sized internal format, contents undefined. Its size, format and level count
+//can't change afterwards, so a resize is a new texture. Filtering defaults to GL_LINEAR with the base level as the only
+//one sampled.
+unsigned int createTexture2D(GLenum internalFormat, int width, int height, int levels = 1);
+
+void setTextureParameter(unsigned int texture, GLenum name, GLint value);
+
+//pixels is an offset into the bound GL_PIXEL_UNPACK_BUFFER if there is one.
+void uploadTexture2D(unsigned int texture, int level, int x, int y, int width, int height, GLenum format, GLenum type, const void* pixels);
+
+void generateTextureMipmaps(unsigned int texture);
+
+//flags are glBufferStorage flags. Storage is immutable wherever buffer storage is available, otherwise the usage hint
+//is picked from the flags.
+unsigned int createBuffer(GLsizeiptr size, const void* data, GLbitfield flags);
+
+//Renderbuffers are never resized in place either.
+unsigned int createRenderbuffer(GLenum internalFormat, int width, int height);
+
+unsigned int createFramebuffer();
+
+void attachFramebufferTexture(unsigned int framebuffer, GLenum attachment, unsigned int texture);
+
+void attachFramebufferRenderbuffer(unsigned int framebuffer, GLenum attachment, unsigned int renderbuffer);
+
+//GL_NONE for both makes a depth only framebuffer complete.
+void setFramebufferBuffers(unsigned int framebuffer, GLenum drawBuffer, GLenum readBuffer);
+
+bool isFramebufferComplete(unsigned int framebuffer);
+
+struct VertexAttribute
+{
+	GLuint index;
+	GLint size;
+	GLenum type;
+	GLuint offset;
+};
+
+//Float attributes read from one interleaved vertex buffer, with indices from elementBuffer.
+unsigned int createVertexArray(unsigned int vertexBuffer, GLsizei stride, unsigned int elementBuffer, std::initializer_list<VertexAttribute> attributes);
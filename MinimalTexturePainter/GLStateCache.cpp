@@ -0,0 +1,250 @@
+#include "GLStateCache.h"
+
+#include "GLCallStats.h"
+#include "GLExtensions.h"
+
+static bool installed = false;
+static bool filtering = true;
+
+//Units and targets outside these are passed through untracked, which is always correct but never filtered.
+static constexpr GLuint trackedUnits = 32;
+static const GLenum trackedTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D,
+	GL_TEXTURE_1D, GL_TEXTURE_RECTANGLE, GL_TEXTURE_BUFFER };
+static constexpr int trackedTargetCount = sizeof(trackedTargets) / sizeof(trackedTargets[0]);
+
+//What is bound, starting from the GL defaults.
+static GLuint currentProgram = 0;
+static GLenum activeTexture = GL_TEXTURE0;
+static GLuint boundTextures[trackedUnits][trackedTargetCount] = {};
+static GLuint drawFramebuffer = 0;
+static GLuint readFramebuffer = 0;
+static GLuint currentVertexArray = 0;
+
+static PFNGLUSEPROGRAMPROC originalUseProgram;
+static PFNGLDELETEPROGRAMPROC originalDeleteProgram;
+static PFNGLACTIVETEXTUREPROC originalActiveTexture;
+static PFNGLBINDTEXTUREPROC originalBindTexture;
+static PFNGLBINDTEXTURESPROC originalBindTextures;
+static PFNGLDELETETEXTURESPROC originalDeleteTextures;
+static PFNGLBINDFRAMEBUFFERPROC originalBindFramebuffer;
+static PFNGLDELETEFRAMEBUFFERSPROC originalDeleteFramebuffers;
+static PFNGLBINDVERTEXARRAYPROC originalBindVertexArray;
+static PFNGLDELETEVERTEXARRAYSPROC originalDeleteVertexArrays;
+
+static GLuint* findTextureBinding(GLenum unit, GLenum target)
+{
+	GLuint index = unit - GL_TEXTURE0;
+	if (index >= trackedUnits) return nullptr;
+	for (int t = 0; t < trackedTargetCount; t++)
+	{
+		if (trackedTargets[t] == target) return &boundTextures[index][t];
+	}
+	return nullptr;
+}
+
+static void APIENTRY cachedUseProgram(GLuint program)
+{
+	countGLCall(&GLCallStats::programBinds);
+	if (program == currentProgram)
+	{
+		countGLCall(&GLCallStats::redundantProgramBinds);
+		if (filtering) return;
+	}
+	currentProgram = program;
+	originalUseProgram(program);
+}
+
+static void APIENTRY cachedDeleteProgram(GLuint program)
+{
+	//The name may come back for a new program, which must not look bound already.
+	if (program == currentProgram) currentProgram = ~0u;
+	originalDeleteProgram(program);
+}
+
+static void APIENTRY cachedActiveTexture(GLenum texture)
+{
+	countGLCall(&GLCallStats::activeTextureSets);
+	if (texture == activeTexture)
+	{
+		countGLCall(&GLCallStats::redundantActiveTextureSets);
+		if (filtering) return;
+	}
+	activeTexture = texture;
+	originalActiveTexture(texture);
+}
+
+static void APIENTRY cachedBindTexture(GLenum target, GLuint texture)
+{
+	countGLCall(&GLCallStats::textureBinds);
+	GLuint* bound = findTextureBinding(activeTexture, target);
+	if (bound && *bound == texture)
+	{
+		countGLCall(&GLCallStats::redundantTextureBinds);
+		if (filtering) return;
+	}
+	if (bound) *bound = texture;
+	originalBindTexture(target, texture);
+}
+
+//Only bindTextures calls this, always with GL_TEXTURE_2D textures, so a non zero name is recorded against that target.
+static void APIENTRY cachedBindTextures(GLuint first, GLsizei count, const GLuint* textures)
+{
+	countGLCall(&GLCallStats::textureBinds);
+	//Narrowed to the units that change.
+	GLsizei begin = count;
+	GLsizei end = 0;
+	for (GLsizei i = 0; i < count; i++)
+	{
+		GLuint* bound = findTextureBinding(GL_TEXTURE0 + first + i, GL_TEXTURE_2D);
+		if (bound && *bound == (textures ? textures[i] : 0)) continue;
+		begin = begin < i ? begin : i;
+		end = i + 1;
+	}
+	if (begin >= end)
+	{
+		countGLCall(&GLCallStats::redundantTextureBinds);
+		if (filtering) return;
+	}
+	if (!filtering || !textures)
+	{
+		begin = 0;
+		end = count;
+	}
+
+	for (GLsizei i = begin; i < end; i++)
+	{
+		GLuint index = first + i;
+		if (index >= trackedUnits) continue;
+		//Zero unbinds every target on the unit.
+		GLuint texture = textures ? textures[i] : 0;
+		for (int t = 0; t < trackedTargetCount; t++)
+		{
+			if (!texture || trackedTargets[t] == GL_TEXTURE_2D) boundTextures[index][t] = texture;
+		}
+	}
+	originalBindTextures(first + begin, end - begin, textures ? textures + begin : nullptr);
+}
+
+static void APIENTRY cachedDeleteTextures(GLsizei n, const GLuint* textures)
+{
+	//Deleting a bound texture binds 0 in its place.
+	for (GLsizei i = 0; i < n; i++)
+	{
+		for (auto& unit : boundTextures)
+		{
+			for (GLuint& bound : unit)
+			{
+				if (bound == textures[i]) bound = 0;
+			}
+		}
+	}
+	originalDeleteTextures(n, textures);
+}
+
+static void APIENTRY cachedBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	countGLCall(&GLCallStats::framebufferBinds);
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if ((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer))
+	{
+		countGLCall(&GLCallStats::redundantFramebufferBinds);
+		if (filtering) return;
+	}
+	if (draw) drawFramebuffer = framebuffer;
+	if (read) readFramebuffer = framebuffer;
+	originalBindFramebuffer(target, framebuffer);
+}
+
+static void APIENTRY cachedDeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		if (drawFramebuffer == framebuffers[i]) drawFramebuffer = 0;
+		if (readFramebuffer == framebuffers[i]) readFramebuffer = 0;
+	}
+	originalDeleteFramebuffers(n, framebuffers);
+}
+
+static void APIENTRY cachedBindVertexArray(GLuint array)
+{
+	countGLCall(&GLCallStats::vertexArrayBinds);
+	if (array == currentVertexArray)
+	{
+		countGLCall(&GLCallStats::redundantVertexArrayBinds);
+		if (filtering) return;
+	}
+	currentVertexArray = array;
+	originalBindVertexArray(array);
+}
+
+static void APIENTRY cachedDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+	for (GLsizei i = 0; i < n; i++)
+	{
+		if (currentVertexArray == arrays[i]) currentVertexArray = 0;
+	}
+	originalDeleteVertexArrays(n, arrays);
+}
+
+template<typename Proc>
+static void wrap(Proc& entryPoint, Proc& original, Proc wrapper)
+{
+	if (!entryPoint) return;
+	original = entryPoint;
+	entryPoint = wrapper;
+}
+
+void installGLStateCache()
+{
+	if (installed) return;
+	installed = true;
+
+	wrap(glad_glUseProgram, originalUseProgram, cachedUseProgram);
+	wrap(glad_glDeleteProgram, originalDeleteProgram, cachedDeleteProgram);
+	wrap(glad_glActiveTexture, originalActiveTexture, cachedActiveTexture);
+	wrap(glad_glBindTexture, originalBindTexture, cachedBindTexture);
+	wrap(glad_glBindTextures, originalBindTextures, cachedBindTextures);
+	wrap(glad_glDeleteTextures, originalDeleteTextures, cachedDeleteTextures);
+	wrap(glad_glBindFramebuffer, originalBindFramebuffer, cachedBindFramebuffer);
+	wrap(glad_glDeleteFramebuffers, originalDeleteFramebuffers, cachedDeleteFramebuffers);
+	wrap(glad_glBindVertexArray, originalBindVertexArray, cachedBindVertexArray);
+	wrap(glad_glDeleteVertexArrays, originalDeleteVertexArrays, cachedDeleteVertexArrays);
+}
+
+void setGLStateFiltering(bool enabled)
+{
+	filtering = enabled;
+}
+
+bool isGLStateFiltering()
+{
+	return filtering;
+}
+
+void bindTextures(GLuint first, GLsizei count, const GLuint* textures)
+{
+	if (getGLCapabilities().multiBind)
+	{
+		glBindTextures(first, count, textures);
+		return;
+	}
+
+	bool changedUnit = false;
+	for (GLsizei i = 0; i < count; i++)
+	{
+		GLenum unit = GL_TEXTURE0 + first + i;
+		//Checked here as well so units that already match don't cost an active texture switch either.
+		GLuint* bound = installed && filtering ? findTextureBinding(unit, GL_TEXTURE_2D) : nullptr;
+		if (bound && *bound == textures[i])
+		{
+			countGLCall(&GLCallStats::textureBinds);
+			countGLCall(&GLCallStats::redundantTextureBinds);
+			continue;
+		}
+		glActiveTexture(unit);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		changedUnit = true;
+	}
+	if (changedUnit) glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <glad/glad.h>
+
+//Keeps a shadow copy of the program, texture, framebuffer and vertex array bindings. installGLStateCache swaps glad's bind
+//entry points for ones that update the copy, so binds from any call site are seen. While filtering is on, a bind that
+//would set what is already bound never reaches the driver. There is one copy for the process, so only install it where a
+//single context is used, from the thread that owns it. ImGui's backend binds through its own loader but restores
+//everything it changes, so the copy stays correct.
+void installGLStateCache();
+
+//On by default. When off, state is still tracked so redundant binds are counted, but every call is sent on.
+void setGLStateFiltering(bool enabled);
+
+bool isGLStateFiltering();
+
+//Binds GL_TEXTURE_2D textures to units first to first + count - 1. Where multi bind is available the units that changed
+//are bound with one glBindTextures call, which leaves the active unit alone. Otherwise they are bound one at a time and
+//the active unit is left at GL_TEXTURE0.
+void bindTextures(GLuint first, GLsizei count, const GLuint* textures);
@@ -0,0 +1,194 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "GLExtensions.h"
+
+GpuProfiler::GpuProfiler(size_t framesInFlight, size_t historyLength):
+	frames(std::max<size_t>(framesInFlight, 2)),
+	historyLength(historyLength)
+{
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	for (Frame& frame : frames)
+	{
+		if (!frame.queries.empty()) glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+	}
+}
+
+unsigned int GpuProfiler::nextQuery(Frame& frame)
+{
+	if (frame.usedQueries == frame.queries.size())
+	{
+		unsigned int query;
+		glGenQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+	return frame.queries[frame.usedQueries++];
+}
+
+void GpuProfiler::collect(Frame& frame)
+{
+	frame.pending = false;
+
+	//Results arrive in order, so the last timestamp being ready means they all are.
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		droppedFrames++;
+		return;
+	}
+
+	std::vector<float> frameMs(passes.size(), 0.f);
+	for (const Scope& scope : frame.scopes)
+	{
+		//Left open when the frame ended.
+		if (!scope.endQuery) continue;
+		GLuint64 begin = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(scope.beginQuery, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(scope.endQuery, GL_QUERY_RESULT, &end);
+		frameMs[scope.pass] += (end - begin) / 1e6f;
+	}
+
+	for (size_t i = 0; i < passes.size(); i++)
+	{
+		Pass& pass = passes[i];
+		pass.history.push_back(frameMs[i]);
+		if (pass.history.size() > historyLength) pass.history.erase(pass.history.begin());
+
+		float total = 0;
+		pass.maxMs = 0;
+		for (float ms : pass.history)
+		{
+			total += ms;
+			pass.maxMs = std::max(pass.maxMs, ms);
+		}
+		pass.averageMs = total / pass.history.size();
+	}
+}
+
+void GpuProfiler::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+}
+
+bool GpuProfiler::isEnabled() const
+{
+	return enabled;
+}
+
+void GpuProfiler::beginFrame()
+{
+	currentFrame = (currentFrame + 1) % frames.size();
+	Frame& frame = frames[currentFrame];
+	if (frame.pending) collect(frame);
+	frame.usedQueries = 0;
+	frame.scopes.clear();
+	recording = enabled;
+}
+
+void GpuProfiler::endFrame()
+{
+	Frame& frame = frames[currentFrame];
+	frame.pending = !frame.scopes.empty();
+	recording = false;
+	openScopes.clear();
+}
+
+void GpuProfiler::beginPass(const char* name)
+{
+	if (!recording)
+	{
+		openScopes.push_back(-1);
+		return;
+	}
+
+	auto inserted = passIndices.try_emplace(name, static_cast<int>(passes.size()));
+	if (inserted.second)
+	{
+		Pass pass;
+		pass.name = name;
+		passes.push_back(pass);
+	}
+
+	Frame& frame = frames[currentFrame];
+	Scope scope;
+	scope.pass = inserted.first->second;
+	scope.beginQuery = nextQuery(frame);
+	scope.endQuery = 0;
+	glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+	openScopes.push_back(static_cast<int>(frame.scopes.size()));
+	frame.scopes.push_back(scope);
+}
+
+void GpuProfiler::endPass()
+{
+	if (openScopes.empty()) return;
+	int scopeIndex = openScopes.back();
+	openScopes.pop_back();
+	if (scopeIndex < 0 || !recording) return;
+
+	Frame& frame = frames[currentFrame];
+	Scope& scope = frame.scopes[scopeIndex];
+	scope.endQuery = nextQuery(frame);
+	glQueryCounter(scope.endQuery, GL_TIMESTAMP);
+}
+
+const std::vector<GpuProfiler::Pass>& GpuProfiler::getPasses() const
+{
+	return passes;
+}
+
+size_t GpuProfiler::getDroppedFrames() const
+{
+	return droppedFrames;
+}
+
+bool GpuProfiler::exportCsv(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	//Passes first seen later have shorter histories, so rows line up on the newest frame.
+	size_t rows = 0;
+	for (const Pass& pass : passes)
+		rows = std::max(rows, pass.history.size());
+
+	fprintf(file, "frame");
+	for (const Pass& pass : passes)
+		fprintf(file, ",%s ms", pass.name.c_str());
+	fprintf(file, "\n");
+	for (size_t row = 0; row < rows; row++)
+	{
+		fprintf(file, "%zu", row);
+		for (const Pass& pass : passes)
+		{
+			size_t missing = rows - pass.history.size();
+			if (row < missing) fprintf(file, ",");
+			else fprintf(file, ",%.4f", pass.history[row - missing]);
+		}
+		fprintf(file, "\n");
+	}
+
+	bool written = !ferror(file);
+	return fclose(file) == 0 && written;
+}
+
+GpuScope::GpuScope(GpuProfiler* profiler, const char* name):
+	profiler(profiler),
+	debugGroup(getGLCapabilities().debugGroups)
+{
+	if (debugGroup) glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+	if (profiler) profiler->beginPass(name);
+}
+
+GpuScope::~GpuScope()
+{
+	if (profiler) profiler->endPass();
+	if (debugGroup) glPopDebugGroup();
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Times render passes on the GPU with timestamp queries. Each frame's queries are read back when its slot in the ring comes
+//round again, framesInFlight frames later, so reading them never waits for the GPU. Timestamps rather than
+//GL_TIME_ELAPSED let passes nest.
+class GpuProfiler
+{
+public:
+	struct Pass
+	{
+		std::string name;
+		//Milliseconds per frame, oldest first. A pass run more than once in a frame is summed, one that didn't run is 0.
+		std::vector<float> history;
+		float averageMs = 0;
+		float maxMs = 0;
+	};
+
+private:
+	struct Scope
+	{
+		int pass;
+		unsigned int beginQuery;
+		unsigned int endQuery;
+	};
+
+	struct Frame
+	{
+		//Grows to the most queries any frame has needed and is reused after that.
+		std::vector<unsigned int> queries;
+		size_t usedQueries = 0;
+		std::vector<Scope> scopes;
+		bool pending = false;
+	};
+
+	std::vector<Frame> frames;
+	size_t currentFrame = 0;
+	size_t historyLength;
+	bool enabled = false;
+	bool recording = false;
+
+	std::vector<Pass> passes;
+	std::unordered_map<std::string, int> passIndices;
+	//Index into the current frame's scopes of each open pass, or -1 if it isn't being timed.
+	std::vector<int> openScopes;
+	size_t droppedFrames = 0;
+
+	unsigned int nextQuery(Frame& frame);
+
+	void collect(Frame& frame);
+
+public:
+	GpuProfiler(size_t framesInFlight = 4, size_t historyLength = 240);
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator=(const GpuProfiler&) = delete;
+	~GpuProfiler();
+
+	//Off by default so the queries cost nothing unless someone is looking.
+	void setEnabled(bool enabled);
+
+	bool isEnabled() const;
+
+	//Reads back the frame recorded framesInFlight frames ago and starts recording this one.
+	void beginFrame();
+
+	void endFrame();
+
+	//Passes are keyed by name and may nest.
+	void beginPass(const char* name);
+
+	void endPass();
+
+	const std::vector<Pass>& getPasses() const;
+
+	//Frames whose queries still weren't done when their slot came round. Their timings are lost.
+	size_t getDroppedFrames() const;
+
+	//One column per pass and one row per frame, oldest first.
+	bool exportCsv(const std::string& path) const;
+};
+
+//Times a pass for as long as it is in scope, and wraps it in a KHR_debug group so capture tools show the pass by name.
+//The profiler may be null, in which case only the group is emitted.
+class GpuScope
+{
+private:
+	GpuProfiler* profiler;
+	bool debugGroup;
+
+public:
+	GpuScope(GpuProfiler* profiler, const char* name);
+	GpuScope(const GpuScope&) = delete;
+	GpuScope& operator=(const GpuScope&) = delete;
+	~GpuScope();
+};
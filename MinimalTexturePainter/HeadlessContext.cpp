@@ -0,0 +1,166 @@
+#include "HeadlessContext.h"
+
+#include <iostream>
+
+#include "GLExtensions.h"
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+//Newest first, so optional paths like persistent mapping and compute brushes are available where the driver has them.
+static constexpr int contextVersions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 }, { 4, 3 }, { 3, 3 } };
+
+bool HeadlessContext::loadFunctions()
+{
+	if (!gladLoadGLLoader(getLoader()))
+	{
+		std::cout << "ERROR::HEADLESS_CONTEXT::GLAD_LOAD_FAILED" << std::endl;
+		return false;
+	}
+	loadGLExtensions(getLoader());
+	return true;
+}
+
+#ifdef __linux__
+
+//Rendering straight to the GPU, or to llvmpipe under LIBGL_ALWAYS_SOFTWARE=1, with no X or Wayland server.
+class EglContext : public HeadlessContext
+{
+private:
+	EGLDisplay display;
+	EGLContext context;
+
+public:
+	EglContext(EGLDisplay display, EGLContext context):
+		display(display),
+		context(context)
+	{
+	}
+
+	~EglContext() override
+	{
+		eglDestroyContext(display, context);
+	}
+
+	bool makeCurrent() override
+	{
+		return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+	}
+
+	void releaseCurrent() override
+	{
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	}
+
+protected:
+	GLADloadproc getLoader() const override
+	{
+		//Mesa looks up core entry points here too, not only extensions.
+		return (GLADloadproc)eglGetProcAddress;
+	}
+};
+
+//Initialised once and kept for the life of the process, as terminating it would take every context with it.
+static EGLDisplay getSurfacelessDisplay()
+{
+	static EGLDisplay display = []()
+		{
+			auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (!getPlatformDisplay) return EGL_NO_DISPLAY;
+			EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (surfaceless == EGL_NO_DISPLAY || !eglInitialize(surfaceless, nullptr, nullptr)) return EGL_NO_DISPLAY;
+			return surfaceless;
+		}();
+	return display;
+}
+
+std::unique_ptr<HeadlessContext> HeadlessContext::create()
+{
+	EGLDisplay display = getSurfacelessDisplay();
+	if (display == EGL_NO_DISPLAY || !eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "ERROR::HEADLESS_CONTEXT::NO_SURFACELESS_DISPLAY" << std::endl;
+		return nullptr;
+	}
+
+	//There are no surfaces, so the config only has to be able to render OpenGL. Drivers with EGL_KHR_no_config_context
+	//don't need one at all.
+	const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) config = EGL_NO_CONFIG_KHR;
+
+	for (const auto& version : contextVersions)
+	{
+		const EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, version[0], EGL_CONTEXT_MINOR_VERSION, version[1],
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+		EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context != EGL_NO_CONTEXT) return std::make_unique<EglContext>(display, context);
+	}
+	std::cout << "ERROR::HEADLESS_CONTEXT::CREATE_FAILED " << std::hex << eglGetError() << std::dec << std::endl;
+	return nullptr;
+}
+
+#else
+
+//Windows has no surfaceless EGL, so a window that is never shown stands in. Needs a desktop session.
+class HiddenWindowContext : public HeadlessContext
+{
+private:
+	GLFWwindow* window;
+
+public:
+	HiddenWindowContext(GLFWwindow* window):
+		window(window)
+	{
+	}
+
+	~HiddenWindowContext() override
+	{
+		glfwDestroyWindow(window);
+	}
+
+	bool makeCurrent() override
+	{
+		glfwMakeContextCurrent(window);
+		return true;
+	}
+
+	void releaseCurrent() override
+	{
+		glfwMakeContextCurrent(NULL);
+	}
+
+protected:
+	GLADloadproc getLoader() const override
+	{
+		return (GLADloadproc)glfwGetProcAddress;
+	}
+};
+
+std::unique_ptr<HeadlessContext> HeadlessContext::create()
+{
+	//Later calls return straight away. GLFW stays initialised until the process exits.
+	if (!glfwInit())
+	{
+		std::cout << "ERROR::HEADLESS_CONTEXT::GLFW_INIT_FAILED" << std::endl;
+		return nullptr;
+	}
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	for (const auto& version : contextVersions)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+		GLFWwindow* window = glfwCreateWindow(64, 64, "MinimalTexturePainter", NULL, NULL);
+		if (window) return std::make_unique<HiddenWindowContext>(window);
+	}
+	std::cout << "ERROR::HEADLESS_CONTEXT::CREATE_FAILED" << std::endl;
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#include <glad/glad.h>
+#include <memory>
+
+//An OpenGL core context with no visible window, for the headless modes. There is no default framebuffer to draw to, only
+//framebuffer objects. On Linux it is a surfaceless EGL context (EGL_PLATFORM_SURFACELESS_MESA), which needs no display
+//server. Elsewhere it is a hidden GLFW window.
+class HeadlessContext
+{
+public:
+	//The newest core context from 4.6 down to 3.3 the driver can create, or null if there is none. Call from the main
+	//thread, where GLFW has to create its windows.
+	static std::unique_ptr<HeadlessContext> create();
+
+	HeadlessContext() = default;
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+	virtual ~HeadlessContext() = default;
+
+	//Makes the context current on the calling thread. A context is current on at most one thread at a time.
+	virtual bool makeCurrent() = 0;
+	//Leaves the calling thread with no current context.
+	virtual void releaseCurrent() = 0;
+
+	//Loads glad and the GL extensions with the context current. Every context comes from the same driver, so loading
+	//through one is enough for all of them.
+	bool loadFunctions();
+
+protected:
+	//The platform's function that looks up GL entry points by name.
+	virtual GLADloadproc getLoader() const = 0;
+};
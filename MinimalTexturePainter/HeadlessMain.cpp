@@ -0,0 +1,46 @@
+#include <cstdio>
+#include <string>
+
+#include "BatchPainter.h"
+#include "Benchmark.h"
+#include "CpuProfiler.h"
+#include "SceneBenchmark.h"
+
+//Entry point of the Linux headless build, which has the modes of main that need no window. See CMakeLists.txt.
+int main(int argc, char* argv[])
+{
+	setProfilerThreadName("Main");
+
+	std::string mode = argc > 1 ? argv[1] : "";
+	if (mode == "--benchmark-encode")
+	{
+		return runEncodeBenchmark();
+	}
+	if (mode == "--benchmark-paint")
+	{
+		return runPaintBenchmark();
+	}
+	if (mode == "--benchmark-micro")
+	{
+		return runMicrobenchmarks(argc, argv);
+	}
+	if (mode == "--benchmark-jobs")
+	{
+		return runJobBenchmark();
+	}
+	if (mode == "--benchmark-bake")
+	{
+		return runBakeBenchmark();
+	}
+	if (mode == "--benchmark-scene")
+	{
+		return runSceneBenchmark(argc, argv);
+	}
+	if (mode == "--batch")
+	{
+		return runBatch(argc, argv);
+	}
+
+	printf("Usage: MinimalTexturePainterHeadless --benchmark-encode|--benchmark-paint|--benchmark-micro|--benchmark-jobs|--benchmark-bake|--benchmark-scene|--batch [options]\n");
+	return 1;
+}
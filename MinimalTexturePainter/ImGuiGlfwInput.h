@@ -0,0 +1,12 @@
+#pragma once
+#include <GLFW/glfw3.h>
+
+#include "imgui/imgui.h"
+
+//Translates GLFW input for ImGui on the render thread. The GLFW backend can't be used there as it calls into GLFW every
+//frame, which may only happen on the main thread.
+
+ImGuiKey glfwKeyToImGuiKey(int key);
+
+//The GLFW standard cursor shape for an ImGui cursor. Shapes GLFW 3.3 doesn't have fall back to the arrow.
+int imGuiCursorToGlfwShape(ImGuiMouseCursor cursor);
@@ -0,0 +1,46 @@
+#include "Image.h"
+
+#include <iostream>
+
+#include "stb_image.h"
+
+bool Image::isValid() const
+{
+	return pixels != nullptr;
+}
+
+size_t Image::getByteSize() const
+{
+	return static_cast<size_t>(width) * height * components;
+}
+
+Image loadImage(const std::string& path, bool flipVertically)
+{
+	Image image;
+
+	//The flip flag is thread local so concurrent loads don't affect each other.
+	stbi_set_flip_vertically_on_load_thread(flipVertically);
+	unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+	if (!data)
+	{
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+		return Image();
+	}
+	image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+	return image;
+}
+
+Image loadImageFromMemory(const unsigned char* data, size_t size, bool flipVertically)
+{
+	Image image;
+
+	stbi_set_flip_vertically_on_load_thread(flipVertically);
+	unsigned char* pixels = stbi_load_from_memory(data, static_cast<int>(size), &image.width, &image.height, &image.components, 0);
+	if (!pixels)
+	{
+		std::cout << "Texture failed to decode: " << stbi_failure_reason() << std::endl;
+		return Image();
+	}
+	image.pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+	return image;
+}
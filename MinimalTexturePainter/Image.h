@@ -0,0 +1,22 @@
+#pragma once
+#include <memory>
+#include <string>
+
+//8 bit per channel image decoded into CPU memory.
+struct Image
+{
+	int width = 0;
+	int height = 0;
+	int components = 0;
+	std::shared_ptr<unsigned char> pixels;
+
+	bool isValid() const;
+
+	size_t getByteSize() const;
+};
+
+//Decodes an image file. Safe to call from worker threads. Returns an invalid image on failure.
+Image loadImage(const std::string& path, bool flipVertically);
+
+//Decodes an encoded image already in memory. Safe to call from worker threads.
+Image loadImageFromMemory(const unsigned char* data, size_t size, bool flipVertically);
@@ -0,0 +1,809 @@
+#include "ImageEncoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+
+//Raw bytes per strip. Large enough that per strip overhead is negligible, small enough to balance across threads.
+constexpr size_t targetStripBytes = 1 << 20;
+
+ImageFormat imageFormatFromPath(const std::string& path)
+{
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) return ImageFormat::Jpeg;
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	return extension == "png" ? ImageFormat::Png : ImageFormat::Jpeg;
+}
+
+static const unsigned char* sourceRow(const unsigned char* pixels, int width, int height, int components, bool flipVertically, int row)
+{
+	size_t stride = static_cast<size_t>(width) * components;
+	return pixels + stride * (flipVertically ? height - 1 - row : row);
+}
+
+static void writeU16(std::vector<unsigned char>& out, unsigned int value)
+{
+	out.push_back(static_cast<unsigned char>(value >> 8));
+	out.push_back(static_cast<unsigned char>(value));
+}
+
+static void writeU32(std::vector<unsigned char>& out, uint32_t value)
+{
+	out.push_back(static_cast<unsigned char>(value >> 24));
+	out.push_back(static_cast<unsigned char>(value >> 16));
+	out.push_back(static_cast<unsigned char>(value >> 8));
+	out.push_back(static_cast<unsigned char>(value));
+}
+
+//JPEG. Baseline encoder based on the one in stb_image_write (itself based on jo_jpeg), reworked so every strip is an independent restart interval.
+
+static const unsigned char jpegZigZag[] = { 0,1,5,6,14,15,27,28,2,4,7,13,16,26,29,42,3,8,12,17,25,30,41,43,9,11,18,
+	24,31,40,44,53,10,19,23,32,39,45,52,54,20,22,33,38,46,51,55,60,21,34,37,47,50,56,59,61,35,36,48,49,57,58,62,63 };
+
+static const unsigned char stdDcLuminanceCodes[] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+static const unsigned char stdDcLuminanceValues[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+static const unsigned char stdAcLuminanceCodes[] = { 0,0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+static const unsigned char stdAcLuminanceValues[] = {
+	0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,
+	0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+	0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+	0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+	0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,
+	0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+	0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
+};
+static const unsigned char stdDcChrominanceCodes[] = { 0,0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+static const unsigned char stdDcChrominanceValues[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+static const unsigned char stdAcChrominanceCodes[] = { 0,0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+static const unsigned char stdAcChrominanceValues[] = {
+	0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
+	0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+	0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,
+	0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+	0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,
+	0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+	0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
+};
+
+static const int jpegLuminanceQuantization[] = { 16,11,10,16,24,40,51,61,12,12,14,19,26,58,60,55,14,13,16,24,40,57,69,56,14,17,22,29,51,87,80,62,18,22,
+	37,56,68,109,103,77,24,35,55,64,81,104,113,92,49,64,78,87,103,121,120,101,72,92,95,98,112,100,103,99 };
+static const int jpegChrominanceQuantization[] = { 17,18,24,47,99,99,99,99,18,21,26,66,99,99,99,99,24,26,56,99,99,99,99,99,47,66,99,99,99,99,99,99,
+	99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
+
+//{ code, length } indexed by symbol, built from the standard tables above.
+struct JpegHuffmanTable
+{
+	unsigned short codes[256][2] = {};
+
+	JpegHuffmanTable(const unsigned char* counts, const unsigned char* values)
+	{
+		unsigned short code = 0;
+		int valueIndex = 0;
+		for (int length = 1; length <= 16; length++)
+		{
+			for (int i = 0; i < counts[length]; i++)
+			{
+				codes[values[valueIndex]][0] = code++;
+				codes[values[valueIndex]][1] = static_cast<unsigned short>(length);
+				valueIndex++;
+			}
+			code <<= 1;
+		}
+	}
+};
+
+struct JpegTables
+{
+	unsigned char luminance[64];
+	unsigned char chrominance[64];
+	float luminanceScale[64];
+	float chrominanceScale[64];
+	bool subsample;
+	JpegHuffmanTable dcLuminance{ stdDcLuminanceCodes, stdDcLuminanceValues };
+	JpegHuffmanTable acLuminance{ stdAcLuminanceCodes, stdAcLuminanceValues };
+	JpegHuffmanTable dcChrominance{ stdDcChrominanceCodes, stdDcChrominanceValues };
+	JpegHuffmanTable acChrominance{ stdAcChrominanceCodes, stdAcChrominanceValues };
+
+	JpegTables(int quality)
+	{
+		static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+			1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
+
+		//Same quality mapping as stb so output matches what the single threaded save produced.
+		quality = quality ? quality : 90;
+		subsample = quality <= 90;
+		quality = std::clamp(quality, 1, 100);
+		quality = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+		for (int i = 0; i < 64; i++)
+		{
+			luminance[jpegZigZag[i]] = static_cast<unsigned char>(std::clamp((jpegLuminanceQuantization[i] * quality + 50) / 100, 1, 255));
+			chrominance[jpegZigZag[i]] = static_cast<unsigned char>(std::clamp((jpegChrominanceQuantization[i] * quality + 50) / 100, 1, 255));
+		}
+		for (int row = 0, k = 0; row < 8; row++)
+		{
+			for (int col = 0; col < 8; col++, k++)
+			{
+				luminanceScale[k] = 1 / (luminance[jpegZigZag[k]] * aasf[row] * aasf[col]);
+				chrominanceScale[k] = 1 / (chrominance[jpegZigZag[k]] * aasf[row] * aasf[col]);
+			}
+		}
+	}
+};
+
+//MSB first bit writer with 0xFF byte stuffing.
+struct JpegBitWriter
+{
+	std::vector<unsigned char>& out;
+	int bitBuffer = 0;
+	int bitCount = 0;
+
+	void write(const unsigned short bits[2])
+	{
+		bitCount += bits[1];
+		bitBuffer |= bits[0] << (24 - bitCount);
+		while (bitCount >= 8)
+		{
+			unsigned char c = (bitBuffer >> 16) & 255;
+			out.push_back(c);
+			if (c == 255) out.push_back(0);
+			bitBuffer <<= 8;
+			bitCount -= 8;
+		}
+	}
+
+	//Pads to a byte boundary with 1 bits as required before a marker.
+	void flush()
+	{
+		static const unsigned short fillBits[] = { 0x7F, 7 };
+		write(fillBits);
+		bitBuffer = 0;
+		bitCount = 0;
+	}
+};
+
+static void jpegDCT(float* d0p, float* d1p, float* d2p, float* d3p, float* d4p, float* d5p, float* d6p, float* d7p)
+{
+	float d0 = *d0p, d1 = *d1p, d2 = *d2p, d3 = *d3p, d4 = *d4p, d5 = *d5p, d6 = *d6p, d7 = *d7p;
+
+	float tmp0 = d0 + d7;
+	float tmp7 = d0 - d7;
+	float tmp1 = d1 + d6;
+	float tmp6 = d1 - d6;
+	float tmp2 = d2 + d5;
+	float tmp5 = d2 - d5;
+	float tmp3 = d3 + d4;
+	float tmp4 = d3 - d4;
+
+	//Even part
+	float tmp10 = tmp0 + tmp3;
+	float tmp13 = tmp0 - tmp3;
+	float tmp11 = tmp1 + tmp2;
+	float tmp12 = tmp1 - tmp2;
+
+	d0 = tmp10 + tmp11;
+	d4 = tmp10 - tmp11;
+
+	float z1 = (tmp12 + tmp13) * 0.707106781f;
+	d2 = tmp13 + z1;
+	d6 = tmp13 - z1;
+
+	//Odd part
+	tmp10 = tmp4 + tmp5;
+	tmp11 = tmp5 + tmp6;
+	tmp12 = tmp6 + tmp7;
+
+	float z5 = (tmp10 - tmp12) * 0.382683433f;
+	float z2 = tmp10 * 0.541196100f + z5;
+	float z4 = tmp12 * 1.306562965f + z5;
+	float z3 = tmp11 * 0.707106781f;
+
+	float z11 = tmp7 + z3;
+	float z13 = tmp7 - z3;
+
+	*d5p = z13 + z2;
+	*d3p = z13 - z2;
+	*d1p = z11 + z4;
+	*d7p = z11 - z4;
+
+	*d0p = d0; *d2p = d2; *d4p = d4; *d6p = d6;
+}
+
+static void jpegCalcBits(int value, unsigned short bits[2])
+{
+	int magnitude = value < 0 ? -value : value;
+	value = value < 0 ? value - 1 : value;
+	bits[1] = 1;
+	while (magnitude >>= 1)
+		bits[1]++;
+	bits[0] = static_cast<unsigned short>(value & ((1 << bits[1]) - 1));
+}
+
+//Transforms, quantizes and entropy codes one 8x8 block. Returns the DC value for the next block's prediction.
+static int jpegProcessBlock(JpegBitWriter& writer, float* block, int stride, const float* scale, int dc,
+	const JpegHuffmanTable& dcTable, const JpegHuffmanTable& acTable)
+{
+	const unsigned short* endOfBlock = acTable.codes[0x00];
+	const unsigned short* sixteenZeroes = acTable.codes[0xF0];
+	int coefficients[64];
+
+	for (int offset = 0; offset < stride * 8; offset += stride)
+	{
+		jpegDCT(&block[offset], &block[offset + 1], &block[offset + 2], &block[offset + 3], &block[offset + 4], &block[offset + 5], &block[offset + 6], &block[offset + 7]);
+	}
+	for (int offset = 0; offset < 8; offset++)
+	{
+		jpegDCT(&block[offset], &block[offset + stride], &block[offset + stride * 2], &block[offset + stride * 3], &block[offset + stride * 4],
+			&block[offset + stride * 5], &block[offset + stride * 6], &block[offset + stride * 7]);
+	}
+	for (int y = 0, j = 0; y < 8; y++)
+	{
+		for (int x = 0; x < 8; x++, j++)
+		{
+			float v = block[y * stride + x] * scale[j];
+			coefficients[jpegZigZag[j]] = static_cast<int>(v < 0 ? v - 0.5f : v + 0.5f);
+		}
+	}
+
+	int difference = coefficients[0] - dc;
+	if (difference == 0)
+	{
+		writer.write(dcTable.codes[0]);
+	}
+	else
+	{
+		unsigned short bits[2];
+		jpegCalcBits(difference, bits);
+		writer.write(dcTable.codes[bits[1]]);
+		writer.write(bits);
+	}
+
+	int lastNonZero = 63;
+	while (lastNonZero > 0 && coefficients[lastNonZero] == 0)
+		lastNonZero--;
+	if (lastNonZero == 0)
+	{
+		writer.write(endOfBlock);
+		return coefficients[0];
+	}
+	for (int i = 1; i <= lastNonZero; i++)
+	{
+		int start = i;
+		while (coefficients[i] == 0 && i <= lastNonZero)
+			i++;
+		int zeroes = i - start;
+		if (zeroes >= 16)
+		{
+			for (int marker = 1; marker <= zeroes >> 4; marker++)
+				writer.write(sixteenZeroes);
+			zeroes &= 15;
+		}
+		unsigned short bits[2];
+		jpegCalcBits(coefficients[i], bits);
+		writer.write(acTable.codes[(zeroes << 4) + bits[1]]);
+		writer.write(bits);
+	}
+	if (lastNonZero != 63)
+		writer.write(endOfBlock);
+	return coefficients[0];
+}
+
+//Entropy codes MCU rows [firstMcuRow, endMcuRow) as one restart interval.
+static void jpegEncodeStrip(const JpegTables& tables, const unsigned char* pixels, int width, int height, int components, bool flipVertically,
+	int firstMcuRow, int endMcuRow, std::vector<unsigned char>& out)
+{
+	JpegBitWriter writer{ out };
+	//DC prediction restarts at zero after each restart marker.
+	int dcY = 0, dcU = 0, dcV = 0;
+	//Grey + alpha uses the grey channel for all three.
+	int offsetG = components > 2 ? 1 : 0;
+	int offsetB = components > 2 ? 2 : 0;
+	int mcuSize = tables.subsample ? 16 : 8;
+
+	for (int y = firstMcuRow * mcuSize; y < endMcuRow * mcuSize; y += mcuSize)
+	{
+		for (int x = 0; x < width; x += mcuSize)
+		{
+			float Y[256], U[256], V[256];
+			for (int row = y, pos = 0; row < y + mcuSize; row++)
+			{
+				//Edge blocks repeat the last row and column.
+				const unsigned char* line = sourceRow(pixels, width, height, components, flipVertically, std::min(row, height - 1));
+				for (int col = x; col < x + mcuSize; col++, pos++)
+				{
+					const unsigned char* p = line + std::min(col, width - 1) * components;
+					float r = p[0], g = p[offsetG], b = p[offsetB];
+					Y[pos] = +0.29900f * r + 0.58700f * g + 0.11400f * b - 128;
+					U[pos] = -0.16874f * r - 0.33126f * g + 0.50000f * b;
+					V[pos] = +0.50000f * r - 0.41869f * g - 0.08131f * b;
+				}
+			}
+
+			if (tables.subsample)
+			{
+				dcY = jpegProcessBlock(writer, Y + 0, 16, tables.luminanceScale, dcY, tables.dcLuminance, tables.acLuminance);
+				dcY = jpegProcessBlock(writer, Y + 8, 16, tables.luminanceScale, dcY, tables.dcLuminance, tables.acLuminance);
+				dcY = jpegProcessBlock(writer, Y + 128, 16, tables.luminanceScale, dcY, tables.dcLuminance, tables.acLuminance);
+				dcY = jpegProcessBlock(writer, Y + 136, 16, tables.luminanceScale, dcY, tables.dcLuminance, tables.acLuminance);
+
+				float subU[64], subV[64];
+				for (int yy = 0, pos = 0; yy < 8; yy++)
+				{
+					for (int xx = 0; xx < 8; xx++, pos++)
+					{
+						int j = yy * 32 + xx * 2;
+						subU[pos] = (U[j + 0] + U[j + 1] + U[j + 16] + U[j + 17]) * 0.25f;
+						subV[pos] = (V[j + 0] + V[j + 1] + V[j + 16] + V[j + 17]) * 0.25f;
+					}
+				}
+				dcU = jpegProcessBlock(writer, subU, 8, tables.chrominanceScale, dcU, tables.dcChrominance, tables.acChrominance);
+				dcV = jpegProcessBlock(writer, subV, 8, tables.chrominanceScale, dcV, tables.dcChrominance, tables.acChrominance);
+			}
+			else
+			{
+				dcY = jpegProcessBlock(writer, Y, 8, tables.luminanceScale, dcY, tables.dcLuminance, tables.acLuminance);
+				dcU = jpegProcessBlock(writer, U, 8, tables.chrominanceScale, dcU, tables.dcChrominance, tables.acChrominance);
+				dcV = jpegProcessBlock(writer, V, 8, tables.chrominanceScale, dcV, tables.dcChrominance, tables.acChrominance);
+			}
+		}
+	}
+	writer.flush();
+}
+
+static void jpegWriteHuffmanTable(std::vector<unsigned char>& out, unsigned char tableClassAndId, const unsigned char* counts, const unsigned char* values, size_t valueCount)
+{
+	out.push_back(tableClassAndId);
+	out.insert(out.end(), counts + 1, counts + 17);
+	out.insert(out.end(), values, values + valueCount);
+}
+
+static bool encodeJpeg(const unsigned char* pixels, int width, int height, int components, bool flipVertically, int quality,
+	ThreadPool& threadPool, std::vector<unsigned char>& encoded, std::atomic<float>* progress, const std::atomic<bool>* cancel)
+{
+	JpegTables tables(quality);
+	int mcuSize = tables.subsample ? 16 : 8;
+	int mcusPerRow = (width + mcuSize - 1) / mcuSize;
+	int mcuRows = (height + mcuSize - 1) / mcuSize;
+	//The restart interval is a 16 bit MCU count.
+	if (mcusPerRow > 65535) return false;
+
+	size_t mcuRowBytes = static_cast<size_t>(width) * mcuSize * components;
+	int mcuRowsPerStrip = static_cast<int>(std::max<size_t>(1, targetStripBytes / mcuRowBytes));
+	mcuRowsPerStrip = std::min(mcuRowsPerStrip, 65535 / mcusPerRow);
+	int stripCount = (mcuRows + mcuRowsPerStrip - 1) / mcuRowsPerStrip;
+
+	std::vector<std::vector<unsigned char>> strips(stripCount);
+	std::atomic<int> finishedStrips{ 0 };
+	threadPool.parallelFor(stripCount, [&](size_t strip)
+		{
+			if (cancel && *cancel) return;
+			int firstMcuRow = static_cast<int>(strip) * mcuRowsPerStrip;
+			int endMcuRow = std::min(firstMcuRow + mcuRowsPerStrip, mcuRows);
+			jpegEncodeStrip(tables, pixels, width, height, components, flipVertically, firstMcuRow, endMcuRow, strips[strip]);
+			if (progress) *progress = static_cast<float>(++finishedStrips) / stripCount;
+		});
+	if (cancel && *cancel) return false;
+
+	//SOI, JFIF header and quantization tables.
+	static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
+	encoded.insert(encoded.end(), head0, head0 + sizeof(head0));
+	encoded.insert(encoded.end(), tables.luminance, tables.luminance + 64);
+	encoded.push_back(1);
+	encoded.insert(encoded.end(), tables.chrominance, tables.chrominance + 64);
+
+	//Frame header.
+	const unsigned char head1[] = { 0xFF,0xC0,0,0x11,8,(unsigned char)(height >> 8),(unsigned char)height,(unsigned char)(width >> 8),(unsigned char)width,
+		3,1,(unsigned char)(tables.subsample ? 0x22 : 0x11),0,2,0x11,1,3,0x11,1 };
+	encoded.insert(encoded.end(), head1, head1 + sizeof(head1));
+
+	//Huffman tables.
+	encoded.push_back(0xFF);
+	encoded.push_back(0xC4);
+	writeU16(encoded, 0x01A2);
+	jpegWriteHuffmanTable(encoded, 0x00, stdDcLuminanceCodes, stdDcLuminanceValues, sizeof(stdDcLuminanceValues));
+	jpegWriteHuffmanTable(encoded, 0x10, stdAcLuminanceCodes, stdAcLuminanceValues, sizeof(stdAcLuminanceValues));
+	jpegWriteHuffmanTable(encoded, 0x01, stdDcChrominanceCodes, stdDcChrominanceValues, sizeof(stdDcChrominanceValues));
+	jpegWriteHuffmanTable(encoded, 0x11, stdAcChrominanceCodes, stdAcChrominanceValues, sizeof(stdAcChrominanceValues));
+
+	//Restart interval, one per strip.
+	encoded.push_back(0xFF);
+	encoded.push_back(0xDD);
+	writeU16(encoded, 4);
+	writeU16(encoded, static_cast<unsigned int>(mcusPerRow * mcuRowsPerStrip));
+
+	//Start of scan.
+	static const unsigned char head2[] = { 0xFF,0xDA,0,0xC,3,1,0,2,0x11,3,0x11,0,0x3F,0 };
+	encoded.insert(encoded.end(), head2, head2 + sizeof(head2));
+
+	for (int strip = 0; strip < stripCount; strip++)
+	{
+		encoded.insert(encoded.end(), strips[strip].begin(), strips[strip].end());
+		if (strip + 1 < stripCount)
+		{
+			encoded.push_back(0xFF);
+			encoded.push_back(static_cast<unsigned char>(0xD0 + strip % 8));
+		}
+	}
+
+	//EOI
+	encoded.push_back(0xFF);
+	encoded.push_back(0xD9);
+	return true;
+}
+
+//PNG. Each strip is filtered and deflated on its own with fixed Huffman codes.
+
+//LSB first bit writer for deflate.
+struct DeflateBitWriter
+{
+	std::vector<unsigned char>& out;
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+
+	void writeBits(uint32_t value, int count)
+	{
+		bitBuffer |= static_cast<uint64_t>(value) << bitCount;
+		bitCount += count;
+		while (bitCount >= 8)
+		{
+			out.push_back(static_cast<unsigned char>(bitBuffer));
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	//Huffman codes are defined MSB first.
+	void writeCode(uint32_t code, int length)
+	{
+		uint32_t reversed = 0;
+		for (int i = 0; i < length; i++)
+		{
+			reversed = (reversed << 1) | (code & 1);
+			code >>= 1;
+		}
+		writeBits(reversed, length);
+	}
+
+	void alignToByte()
+	{
+		if (bitCount > 0)
+		{
+			out.push_back(static_cast<unsigned char>(bitBuffer));
+			bitBuffer = 0;
+			bitCount = 0;
+		}
+	}
+};
+
+static const int deflateLengthBase[] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const int deflateLengthExtra[] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const int deflateDistanceBase[] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const int deflateDistanceExtra[] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+static void deflateWriteSymbol(DeflateBitWriter& writer, int symbol)
+{
+	if (symbol <= 143) writer.writeCode(0x30 + symbol, 8);
+	else if (symbol <= 255) writer.writeCode(0x190 + symbol - 144, 9);
+	else if (symbol <= 279) writer.writeCode(symbol - 256, 7);
+	else writer.writeCode(0xC0 + symbol - 280, 8);
+}
+
+static void deflateWriteMatch(DeflateBitWriter& writer, int length, int distance)
+{
+	int lengthCode = 28;
+	while (deflateLengthBase[lengthCode] > length)
+		lengthCode--;
+	deflateWriteSymbol(writer, 257 + lengthCode);
+	writer.writeBits(length - deflateLengthBase[lengthCode], deflateLengthExtra[lengthCode]);
+
+	int distanceCode = 29;
+	while (deflateDistanceBase[distanceCode] > distance)
+		distanceCode--;
+	writer.writeCode(distanceCode, 5);
+	writer.writeBits(distance - deflateDistanceBase[distanceCode], deflateDistanceExtra[distanceCode]);
+}
+
+//Greedy LZ77 with hash chains. Non final strips end with an empty stored block so the next strip starts byte aligned.
+static void deflateStrip(const std::vector<unsigned char>& data, bool last, std::vector<unsigned char>& out)
+{
+	constexpr int hashBits = 15;
+	constexpr int windowSize = 32768;
+	constexpr int maxChain = 32;
+	constexpr int minMatch = 3;
+	constexpr int maxMatch = 258;
+
+	DeflateBitWriter writer{ out };
+	writer.writeBits(last ? 1 : 0, 1);
+	//Fixed Huffman block.
+	writer.writeBits(1, 2);
+
+	const int size = static_cast<int>(data.size());
+	std::vector<int> head(1 << hashBits, -1);
+	std::vector<int> previous(data.size());
+	auto hash = [&data](int position)
+	{
+		uint32_t value = (data[position] << 16) | (data[position + 1] << 8) | data[position + 2];
+		return (value * 2654435761u) >> (32 - hashBits);
+	};
+	auto insert = [&](int position)
+	{
+		if (position + minMatch > size) return;
+		uint32_t h = hash(position);
+		previous[position] = head[h];
+		head[h] = position;
+	};
+
+	int position = 0;
+	while (position < size)
+	{
+		int bestLength = 0;
+		int bestDistance = 0;
+		if (position + minMatch <= size)
+		{
+			int maxLength = std::min(maxMatch, size - position);
+			int candidate = head[hash(position)];
+			for (int chain = 0; candidate >= 0 && position - candidate <= windowSize && chain < maxChain; chain++)
+			{
+				//Cheap reject before the full compare.
+				if (data[candidate + bestLength] == data[position + bestLength])
+				{
+					int length = 0;
+					while (length < maxLength && data[candidate + length] == data[position + length])
+						length++;
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = position - candidate;
+						if (length == maxLength) break;
+					}
+				}
+				candidate = previous[candidate];
+			}
+		}
+
+		if (bestLength >= minMatch)
+		{
+			deflateWriteMatch(writer, bestLength, bestDistance);
+			for (int i = 0; i < bestLength; i++)
+				insert(position + i);
+			position += bestLength;
+		}
+		else
+		{
+			deflateWriteSymbol(writer, data[position]);
+			insert(position);
+			position++;
+		}
+	}
+
+	//End of block.
+	deflateWriteSymbol(writer, 256);
+	if (!last)
+	{
+		//Sync flush.
+		writer.writeBits(0, 3);
+		writer.alignToByte();
+		out.push_back(0x00);
+		out.push_back(0x00);
+		out.push_back(0xFF);
+		out.push_back(0xFF);
+	}
+	else
+	{
+		writer.alignToByte();
+	}
+}
+
+static uint32_t adler32(const std::vector<unsigned char>& data)
+{
+	constexpr uint32_t base = 65521;
+	//Largest run before the sums can overflow 32 bits.
+	constexpr size_t maxRun = 5552;
+	uint32_t a = 1, b = 0;
+	size_t i = 0;
+	while (i < data.size())
+	{
+		size_t end = std::min(data.size(), i + maxRun);
+		for (; i < end; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= base;
+		b %= base;
+	}
+	return (b << 16) | a;
+}
+
+//Adler of two concatenated buffers from the adlers of each, as zlib's adler32_combine.
+static uint32_t adler32Combine(uint32_t first, uint32_t second, size_t secondLength)
+{
+	constexpr uint64_t base = 65521;
+	uint64_t remainder = secondLength % base;
+	uint64_t sum1 = first & 0xFFFF;
+	uint64_t sum2 = (remainder * sum1) % base;
+	sum1 += (second & 0xFFFF) + base - 1;
+	sum2 += ((first >> 16) & 0xFFFF) + ((second >> 16) & 0xFFFF) + base - remainder;
+	if (sum1 >= base) sum1 -= base;
+	if (sum1 >= base) sum1 -= base;
+	if (sum2 >= (base << 1)) sum2 -= (base << 1);
+	if (sum2 >= base) sum2 -= base;
+	return static_cast<uint32_t>(sum1 | (sum2 << 16));
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+{
+	static const std::vector<uint32_t> table = []()
+	{
+		std::vector<uint32_t> values(256);
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			values[i] = c;
+		}
+		return values;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static unsigned char paeth(int a, int b, int c)
+{
+	int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+	if (pb <= pc) return static_cast<unsigned char>(b);
+	return static_cast<unsigned char>(c);
+}
+
+static void pngFilterRow(const unsigned char* row, const unsigned char* above, int rowBytes, int components, int filter, unsigned char* out)
+{
+	for (int i = 0; i < rowBytes; i++)
+	{
+		int left = i >= components ? row[i - components] : 0;
+		int up = above[i];
+		int upLeft = i >= components ? above[i - components] : 0;
+		switch (filter)
+		{
+		case 0: out[i] = row[i]; break;
+		case 1: out[i] = static_cast<unsigned char>(row[i] - left); break;
+		case 2: out[i] = static_cast<unsigned char>(row[i] - up); break;
+		case 3: out[i] = static_cast<unsigned char>(row[i] - ((left + up) >> 1)); break;
+		case 4: out[i] = static_cast<unsigned char>(row[i] - paeth(left, up, upLeft)); break;
+		}
+	}
+}
+
+//Filters rows [firstRow, endRow) choosing the filter per row with the same sum of absolute values heuristic as stb.
+static void pngFilterStrip(const unsigned char* pixels, int width, int height, int components, bool flipVertically,
+	int firstRow, int endRow, std::vector<unsigned char>& filtered)
+{
+	int rowBytes = width * components;
+	std::vector<unsigned char> zeroRow(rowBytes, 0);
+	std::vector<unsigned char> candidate(rowBytes);
+	filtered.resize(static_cast<size_t>(endRow - firstRow) * (rowBytes + 1));
+
+	for (int row = firstRow; row < endRow; row++)
+	{
+		const unsigned char* current = sourceRow(pixels, width, height, components, flipVertically, row);
+		const unsigned char* above = row > 0 ? sourceRow(pixels, width, height, components, flipVertically, row - 1) : zeroRow.data();
+		unsigned char* out = filtered.data() + static_cast<size_t>(row - firstRow) * (rowBytes + 1);
+
+		int bestFilter = 0;
+		long long bestEstimate = -1;
+		for (int filter = 0; filter < 5; filter++)
+		{
+			pngFilterRow(current, above, rowBytes, components, filter, candidate.data());
+			long long estimate = 0;
+			for (int i = 0; i < rowBytes; i++)
+				estimate += std::abs(static_cast<signed char>(candidate[i]));
+			if (bestEstimate < 0 || estimate < bestEstimate)
+			{
+				bestEstimate = estimate;
+				bestFilter = filter;
+			}
+		}
+		out[0] = static_cast<unsigned char>(bestFilter);
+		pngFilterRow(current, above, rowBytes, components, bestFilter, out + 1);
+	}
+}
+
+static void pngWriteChunk(std::vector<unsigned char>& out, const char* tag, const std::vector<unsigned char>& data, uint32_t crc)
+{
+	writeU32(out, static_cast<uint32_t>(data.size()));
+	out.insert(out.end(), tag, tag + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	writeU32(out, crc);
+}
+
+static bool encodePng(const unsigned char* pixels, int width, int height, int components, bool flipVertically,
+	ThreadPool& threadPool, std::vector<unsigned char>& encoded, std::atomic<float>* progress, const std::atomic<bool>* cancel)
+{
+	static const unsigned char colorTypes[] = { 0, 0, 4, 2, 6 };
+
+	size_t rowBytes = static_cast<size_t>(width) * components + 1;
+	int rowsPerStrip = static_cast<int>(std::max<size_t>(1, targetStripBytes / rowBytes));
+	int stripCount = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+	struct Strip
+	{
+		std::vector<unsigned char> chunk;
+		uint32_t adler;
+		size_t rawSize;
+		uint32_t crc;
+	};
+	std::vector<Strip> strips(stripCount);
+	std::atomic<int> finishedStrips{ 0 };
+
+	threadPool.parallelFor(stripCount, [&](size_t index)
+		{
+			if (cancel && *cancel) return;
+			int firstRow = static_cast<int>(index) * rowsPerStrip;
+			int endRow = std::min(firstRow + rowsPerStrip, height);
+			std::vector<unsigned char> filtered;
+			pngFilterStrip(pixels, width, height, components, flipVertically, firstRow, endRow, filtered);
+
+			Strip& strip = strips[index];
+			strip.adler = adler32(filtered);
+			strip.rawSize = filtered.size();
+			//The zlib header goes in the first chunk.
+			if (index == 0)
+			{
+				strip.chunk.push_back(0x78);
+				strip.chunk.push_back(0x9C);
+			}
+			deflateStrip(filtered, index + 1 == strips.size(), strip.chunk);
+			if (progress) *progress = static_cast<float>(++finishedStrips) / stripCount;
+		});
+	if (cancel && *cancel) return false;
+
+	//The checksum of the whole stream goes at the end of the last chunk.
+	uint32_t adler = strips[0].adler;
+	for (int i = 1; i < stripCount; i++)
+		adler = adler32Combine(adler, strips[i].adler, strips[i].rawSize);
+	writeU32(strips.back().chunk, adler);
+
+	threadPool.parallelFor(stripCount, [&](size_t index)
+		{
+			Strip& strip = strips[index];
+			strip.crc = crc32(strip.chunk.data(), strip.chunk.size(), crc32(reinterpret_cast<const unsigned char*>("IDAT"), 4));
+		});
+
+	static const unsigned char signature[] = { 137,80,78,71,13,10,26,10 };
+	encoded.insert(encoded.end(), signature, signature + sizeof(signature));
+
+	std::vector<unsigned char> header;
+	writeU32(header, width);
+	writeU32(header, height);
+	header.push_back(8);
+	header.push_back(colorTypes[components]);
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	pngWriteChunk(encoded, "IHDR", header, crc32(header.data(), header.size(), crc32(reinterpret_cast<const unsigned char*>("IHDR"), 4)));
+
+	for (const Strip& strip : strips)
+		pngWriteChunk(encoded, "IDAT", strip.chunk, strip.crc);
+
+	pngWriteChunk(encoded, "IEND", {}, crc32(reinterpret_cast<const unsigned char*>("IEND"), 4));
+	return true;
+}
+
+bool encodeImage(ImageFormat format, const unsigned char* pixels, int width, int height, int components, bool flipVertically,
+	int jpegQuality, ThreadPool& threadPool, std::vector<unsigned char>& encoded, std::atomic<float>* progress,
+	const std::atomic<bool>* cancel)
+{
+	if (!pixels || width <= 0 || height <= 0 || components < 1 || components > 4) return false;
+	//Both formats store dimensions in 16 or 31 bits. JPEG is the tighter limit.
+	if (format == ImageFormat::Jpeg && (width > 65535 || height > 65535)) return false;
+
+	if (format == ImageFormat::Png)
+		return encodePng(pixels, width, height, components, flipVertically, threadPool, encoded, progress, cancel);
+	return encodeJpeg(pixels, width, height, components, flipVertically, jpegQuality, threadPool, encoded, progress, cancel);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+enum class ImageFormat
+{
+	Png,
+	Jpeg
+};
+
+//Picks the format from the file extension, defaulting to JPEG.
+ImageFormat imageFormatFromPath(const std::string& path);
+
+//Encodes 8 bit pixels by splitting the image into horizontal strips that are compressed in parallel.
+//JPEG strips are separated by restart markers. PNG strips are deflated independently, written as separate IDAT chunks and joined with sync flushes into one zlib stream.
+//Progress is advanced as strips finish. Strips not yet started are skipped once cancel is set.
+//Returns false on invalid input or when cancelled.
+bool encodeImage(ImageFormat format, const unsigned char* pixels, int width, int height, int components, bool flipVertically,
+	int jpegQuality, ThreadPool& threadPool, std::vector<unsigned char>& encoded, std::atomic<float>* progress = nullptr,
+	const std::atomic<bool>* cancel = nullptr);
@@ -0,0 +1,28 @@
+#pragma once
+
+//A window event as GLFW reported it on the main thread, passed to the render thread to act on.
+struct InputEvent
+{
+	enum class Type
+	{
+		CursorMove,
+		MouseButton,
+		Scroll,
+		Key,
+		Char,
+		Resize,
+	};
+
+	Type type;
+	//glfwGetTime when the callback ran.
+	double time;
+	//Cursor position, also given with mouse buttons, scroll offsets or framebuffer size.
+	double x = 0;
+	double y = 0;
+	//Mouse button or key, and GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT.
+	int button = 0;
+	int scancode = 0;
+	int action = 0;
+	int mods = 0;
+	unsigned int codepoint = 0;
+};
@@ -0,0 +1,301 @@
+#include "LayerStack.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "GLResources.h"
+
+static bool isSRGBFormat(GLint internalFormat)
+{
+	return internalFormat == GL_SRGB || internalFormat == GL_SRGB8 || internalFormat == GL_SRGB_ALPHA || internalFormat == GL_SRGB8_ALPHA8;
+}
+
+LayerStack::LayerStack(Shader& compositeShader, unsigned int baseTexture):
+	compositeShader(compositeShader)
+{
+	this->baseTexture = baseTexture;
+
+	GLint internalFormat;
+	glBindTexture(GL_TEXTURE_2D, baseTexture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+	srgb = isSRGBFormat(internalFormat);
+
+	//Composite keeps the base's colour space so the material shader samples it the same way. RGB sRGB isn't renderable, so always RGBA.
+	compositeTexture = createTexture2D(srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height);
+
+	compositeFramebuffer = createFramebuffer();
+	attachFramebufferTexture(compositeFramebuffer, GL_COLOR_ATTACHMENT0, compositeTexture);
+
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	dirtyTiles.assign(static_cast<size_t>(tilesX) * tilesY, false);
+
+	float quadVert[12] = { 1.f, 1.f, 0,
+					1.f, -1.f, 0,
+					-1.f, -1.f, 0,
+					-1.f, 1.f, 0 };
+
+	unsigned int quadElem[6] = { 0, 1, 3,
+						1, 2, 3 };
+
+	//Gen buffers
+	quadVBO = createBuffer(sizeof(quadVert), &quadVert, 0);
+	quadEBO = createBuffer(sizeof(quadElem), &quadElem, 0);
+	quadVAO = createVertexArray(quadVBO, 3 * sizeof(float), quadEBO, { { 0, 3, GL_FLOAT, 0 } });
+
+	addLayer();
+}
+
+void LayerStack::addLayer()
+{
+	Layer layer;
+	layer.name = "Layer " + std::to_string(++layerCounter);
+
+	//Paint layers hold premultiplied linear colour.
+	layer.texture = createTexture2D(GL_RGBA8, width, height);
+
+	//Clear to transparent through the composite framebuffer, then put the composite back.
+	glBindFramebuffer(GL_FRAMEBUFFER, compositeFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer.texture, 0);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositeTexture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	size_t index = layers.empty() ? 0 : activeLayer + 1;
+	layers.insert(layers.begin() + index, layer);
+	activeLayer = index;
+	//An empty layer doesn't change the result, except for the very first composite.
+	if (layers.size() == 1) markAllDirty();
+}
+
+void LayerStack::removeLayer(size_t index)
+{
+	if (layers.size() <= 1 || index >= layers.size()) return;
+
+	glDeleteTextures(1, &layers[index].texture);
+	layers.erase(layers.begin() + index);
+	activeLayer = std::min(activeLayer, layers.size() - 1);
+	markAllDirty();
+}
+
+void LayerStack::setActiveLayer(size_t index)
+{
+	if (index < layers.size()) activeLayer = index;
+}
+
+size_t LayerStack::getActiveLayer() const
+{
+	return activeLayer;
+}
+
+unsigned int LayerStack::getActiveLayerTexture() const
+{
+	return layers[activeLayer].texture;
+}
+
+std::vector<LayerStack::Layer>& LayerStack::getLayers()
+{
+	return layers;
+}
+
+void LayerStack::markAllDirty()
+{
+	std::fill(dirtyTiles.begin(), dirtyTiles.end(), true);
+	anyDirty = true;
+}
+
+void LayerStack::markDirty(glm::vec2 uv, float uvRadius)
+{
+	markDirtyPixels(static_cast<int>(std::floor((uv.x - uvRadius) * width)), static_cast<int>(std::floor((uv.y - uvRadius) * height)),
+		static_cast<int>(std::ceil((uv.x + uvRadius) * width)) + 1, static_cast<int>(std::ceil((uv.y + uvRadius) * height)) + 1);
+}
+
+void LayerStack::markDirtyPixels(int x0, int y0, int x1, int y1)
+{
+	if (x1 <= 0 || y1 <= 0) return;
+	int minX = std::max(x0, 0) / tileSize;
+	int maxX = std::min((x1 - 1) / tileSize, tilesX - 1);
+	int minY = std::max(y0, 0) / tileSize;
+	int maxY = std::min((y1 - 1) / tileSize, tilesY - 1);
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		for (int x = minX; x <= maxX; x++)
+		{
+			dirtyTiles[static_cast<size_t>(y) * tilesX + x] = true;
+			anyDirty = true;
+		}
+	}
+}
+
+void LayerStack::setStroke(const StrokeBuffer* stroke, float opacity)
+{
+	this->stroke = stroke;
+	strokeOpacity = opacity;
+}
+
+void LayerStack::commitStroke()
+{
+	if (!stroke) return;
+	const StrokeBuffer* committed = stroke;
+	stroke = nullptr;
+	if (committed->isEmpty()) return;
+
+	//Draws into the active layer through the composite framebuffer, then puts the composite back.
+	glBindFramebuffer(GL_FRAMEBUFFER, compositeFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layers[activeLayer].texture, 0);
+	glViewport(0, 0, width, height);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(committed->getMinX(), committed->getMinY(), committed->getMaxX() - committed->getMinX(), committed->getMaxY() - committed->getMinY());
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	compositeShader.useProgram();
+	compositeShader.setInt("mode", 5);
+	setStrokeUniforms(*committed);
+	//Nothing may sample the layer being drawn to.
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindVertexArray(quadVAO);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBlendFunc(GL_ONE, GL_ZERO);
+	glDisable(GL_BLEND);
+	glDisable(GL_SCISSOR_TEST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositeTexture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	markDirtyPixels(committed->getMinX(), committed->getMinY(), committed->getMaxX(), committed->getMaxY());
+}
+
+void LayerStack::setStrokeUniforms(const StrokeBuffer& strokeBuffer)
+{
+	compositeShader.setInt("stroke", 1);
+	compositeShader.setFloat("strokeOpacity", strokeOpacity);
+	compositeShader.setVec2("strokeOffset", glm::vec2(strokeBuffer.getOriginX(), strokeBuffer.getOriginY()) / glm::vec2(width, height));
+	compositeShader.setVec2("strokeScale", glm::vec2(width, height) / glm::vec2(strokeBuffer.getCapacityWidth(), strokeBuffer.getCapacityHeight()));
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, strokeBuffer.getTexture());
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void LayerStack::drawRect(int x, int y, int rectWidth, int rectHeight)
+{
+	glScissor(x, y, rectWidth, rectHeight);
+
+	//Base replaces whatever was cached for the rect.
+	glDisable(GL_BLEND);
+	compositeShader.setInt("mode", 0);
+	glBindTexture(GL_TEXTURE_2D, baseTexture);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+	//Layers go bottom to top. Alpha is left as the base's.
+	glEnable(GL_BLEND);
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		const Layer& layer = layers[i];
+		if (!layer.visible || layer.opacity <= 0.f) continue;
+
+		switch (layer.blendMode)
+		{
+		case BlendMode::Normal: glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE); break;
+		case BlendMode::Multiply: glBlendFuncSeparate(GL_ZERO, GL_SRC_COLOR, GL_ZERO, GL_ONE); break;
+		case BlendMode::Add: glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE); break;
+		case BlendMode::Screen: glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC_COLOR, GL_ZERO, GL_ONE); break;
+		}
+		compositeShader.setInt("mode", static_cast<int>(layer.blendMode) + 1);
+		compositeShader.setBool("strokeActive", stroke && !stroke->isEmpty() && i == activeLayer);
+		compositeShader.setFloat("opacity", layer.opacity);
+		glBindTexture(GL_TEXTURE_2D, layer.texture);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+	}
+}
+
+void LayerStack::update()
+{
+	if (!anyDirty) return;
+	anyDirty = false;
+
+	glViewport(0, 0, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, compositeFramebuffer);
+	glEnable(GL_SCISSOR_TEST);
+	//Blend in linear space for sRGB channels.
+	if (srgb) glEnable(GL_FRAMEBUFFER_SRGB);
+
+	compositeShader.useProgram();
+	compositeShader.setInt("layer", 0);
+	if (stroke && !stroke->isEmpty()) setStrokeUniforms(*stroke);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(quadVAO);
+
+	//Runs of dirty tiles along a row are drawn as one rect.
+	for (int y = 0; y < tilesY; y++)
+	{
+		int x = 0;
+		while (x < tilesX)
+		{
+			if (!dirtyTiles[static_cast<size_t>(y) * tilesX + x])
+			{
+				x++;
+				continue;
+			}
+			int start = x;
+			while (x < tilesX && dirtyTiles[static_cast<size_t>(y) * tilesX + x])
+			{
+				dirtyTiles[static_cast<size_t>(y) * tilesX + x] = false;
+				x++;
+			}
+			drawRect(start * tileSize, y * tileSize, (x - start) * tileSize, tileSize);
+		}
+	}
+
+	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBlendFunc(GL_ONE, GL_ZERO);
+	glDisable(GL_BLEND);
+	glDisable(GL_FRAMEBUFFER_SRGB);
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+unsigned int LayerStack::getCompositeTexture() const
+{
+	return compositeTexture;
+}
+
+unsigned int LayerStack::getCompositeFramebuffer() const
+{
+	return compositeFramebuffer;
+}
+
+int LayerStack::getWidth() const
+{
+	return width;
+}
+
+int LayerStack::getHeight() const
+{
+	return height;
+}
+
+LayerStack::~LayerStack()
+{
+	for (const Layer& layer : layers)
+		glDeleteTextures(1, &layer.texture);
+	glDeleteTextures(1, &compositeTexture);
+	glDeleteFramebuffers(1, &compositeFramebuffer);
+	glDeleteVertexArrays(1, &quadVAO);
+	glDeleteBuffers(1, &quadVBO);
+	glDeleteBuffers(1, &quadEBO);
+}
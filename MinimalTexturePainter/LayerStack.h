@@ -0,0 +1,113 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "StrokeBuffer.h"
+
+//Paint layers on top of a read only base texture for one material channel.
+//The flattened result is kept in a composite texture that the renderer samples. It is split into tiles and only
+//tiles marked dirty are recomposited, so an untouched stack costs nothing per frame however many layers it has.
+class LayerStack
+{
+public:
+	enum class BlendMode
+	{
+		Normal,
+		Multiply,
+		Add,
+		Screen
+	};
+
+	struct Layer
+	{
+		std::string name;
+		unsigned int texture;
+		float opacity = 1.f;
+		BlendMode blendMode = BlendMode::Normal;
+		bool visible = true;
+	};
+
+	static constexpr int tileSize = 256;
+
+private:
+	Shader& compositeShader;
+	unsigned int baseTexture;
+	unsigned int compositeTexture;
+	unsigned int compositeFramebuffer;
+	int width;
+	int height;
+	bool srgb;
+
+	std::vector<Layer> layers;
+	size_t activeLayer = 0;
+	int layerCounter = 0;
+
+	int tilesX;
+	int tilesY;
+	std::vector<bool> dirtyTiles;
+	bool anyDirty = false;
+
+	//Stroke being painted on the active layer, shown in the composite until it is committed.
+	const StrokeBuffer* stroke = nullptr;
+	float strokeOpacity = 1.f;
+
+	unsigned int quadVBO;
+	unsigned int quadVAO;
+	unsigned int quadEBO;
+
+	void drawRect(int x, int y, int rectWidth, int rectHeight);
+
+	void setStrokeUniforms(const StrokeBuffer& strokeBuffer);
+
+	//Max is exclusive.
+	void markDirtyPixels(int x0, int y0, int x1, int y1);
+
+public:
+	//The base texture is only sampled, never written. It stays owned by the caller.
+	LayerStack(Shader& compositeShader, unsigned int baseTexture);
+	LayerStack(const LayerStack&) = delete;
+	LayerStack& operator=(const LayerStack&) = delete;
+
+	//Adds a transparent paint layer above the active one and makes it active.
+	void addLayer();
+
+	//The last paint layer can't be removed.
+	void removeLayer(size_t index);
+
+	void setActiveLayer(size_t index);
+
+	size_t getActiveLayer() const;
+
+	unsigned int getActiveLayerTexture() const;
+
+	std::vector<Layer>& getLayers();
+
+	//Call after changing a layer's opacity, blend mode or visibility.
+	void markAllDirty();
+
+	//Marks the tiles under a circle in UV space.
+	void markDirty(glm::vec2 uv, float uvRadius);
+
+	//Previews the stroke over the active layer. Dabs still need marking dirty as they are painted.
+	void setStroke(const StrokeBuffer* stroke, float opacity);
+
+	//Composites the stroke onto the active layer at its opacity and stops the preview.
+	void commitStroke();
+
+	//Recomposites dirty tiles. Cheap when nothing changed.
+	void update();
+
+	unsigned int getCompositeTexture() const;
+
+	//Renders into the composite texture. update leaves it bound.
+	unsigned int getCompositeFramebuffer() const;
+
+	int getWidth() const;
+
+	int getHeight() const;
+
+	~LayerStack();
+};
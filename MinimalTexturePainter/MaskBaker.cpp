@@ -0,0 +1,355 @@
+#include "MaskBaker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "CpuProfiler.h"
+
+//Square tiles baked as one job each. Small enough to balance across threads, large enough that the border rasterised a
+//second time for curvature is a small share of the work.
+constexpr int tileSize = 64;
+//Neighbouring texels further apart on the surface than this many texels' worth are on different UV islands.
+constexpr float neighbourTexels = 3.f;
+//Slack on the edge tests, so texel centres on an edge two triangles share aren't missed by both.
+constexpr float edgeSlack = 1e-5f;
+
+struct BakeTriangle
+{
+	uint32_t mesh;
+	uint32_t triangle;
+};
+
+//Surface under one texel.
+struct SurfaceTexel
+{
+	glm::vec3 position;
+	//Interpolated from the vertices.
+	glm::vec3 normal;
+	//Of the triangle, turned to the same side as normal.
+	glm::vec3 faceNormal;
+	//Length of surface one texel spans. 0 where no triangle covers the texel.
+	float texelLength = 0;
+};
+
+//A bake in progress, shared by the tile jobs.
+struct MaskBake
+{
+	const std::vector<BakeMesh>& meshes;
+	const BakeSettings& settings;
+	std::vector<uint8_t>& pixels;
+	//Triangles over each tile or its border, row by row.
+	std::vector<std::vector<BakeTriangle>> tileTriangles{};
+	int tilesX = 0;
+	//Texels covered by a triangle, grown by the padding afterwards.
+	std::vector<uint8_t> covered{};
+	float maxDistance = 0.f;
+	float bias = 0.f;
+	float curvatureRadius = 0.f;
+	std::atomic<size_t> texels{ 0 };
+	std::atomic<size_t> tilesDone{ 0 };
+	TaskProgress* progress = nullptr;
+};
+
+double getTexelsPerThreadSecond(const BakeStats& stats)
+{
+	if (stats.seconds <= 0 || stats.threads == 0) return 0;
+	return stats.texels / stats.seconds / stats.threads;
+}
+
+static float cross2(glm::vec2 a, glm::vec2 b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+static uint8_t toByte(float value)
+{
+	return static_cast<uint8_t>(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+}
+
+//Each texel turns its ray pattern by a different amount, which leaves fine noise instead of banding.
+static float getTexelRotation(int x, int y)
+{
+	uint32_t hash = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u;
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
+	hash *= 0x846ca68bu;
+	hash ^= hash >> 16;
+	return (hash >> 8) * (1.f / 16777216.f);
+}
+
+//Texel range, inclusive, whose centres can fall in a triangle with these texel space corners.
+static void getTexelBounds(glm::vec2 a, glm::vec2 b, glm::vec2 c, glm::ivec2& first, glm::ivec2& last)
+{
+	glm::vec2 lower = glm::min(glm::min(a, b), c);
+	glm::vec2 upper = glm::max(glm::max(a, b), c);
+	first = glm::ivec2(glm::ceil(lower - 0.5f));
+	last = glm::ivec2(glm::floor(upper - 0.5f));
+}
+
+//Fills surface, width by height texels from origin, with the nearest triangles' positions and normals. Where UV islands
+//overlap the last triangle wins.
+static void rasteriseTile(const MaskBake& bake, const std::vector<BakeTriangle>& triangles, glm::ivec2 origin, int width, int height,
+	std::vector<SurfaceTexel>& surface)
+{
+	surface.assign(static_cast<size_t>(width) * height, SurfaceTexel{});
+	float size = static_cast<float>(bake.settings.size);
+	for (const BakeTriangle& triangle : triangles)
+	{
+		const vector<Vertex>& vertices = *bake.meshes[triangle.mesh].vertices;
+		const vector<unsigned int>& indices = *bake.meshes[triangle.mesh].indices;
+		const Vertex& a = vertices[indices[triangle.triangle * 3]];
+		const Vertex& b = vertices[indices[triangle.triangle * 3 + 1]];
+		const Vertex& c = vertices[indices[triangle.triangle * 3 + 2]];
+		glm::vec2 ta = a.texCoords * size;
+		glm::vec2 tb = b.texCoords * size;
+		glm::vec2 tc = c.texCoords * size;
+		float uvArea = cross2(tb - ta, tc - ta);
+		glm::vec3 faceNormal = glm::cross(b.position - a.position, c.position - a.position);
+		float worldArea = glm::length(faceNormal);
+		if (std::abs(uvArea) < 1e-12f || worldArea <= 0) continue;
+		float texelLength = std::sqrt(worldArea / std::abs(uvArea));
+		faceNormal /= worldArea;
+
+		glm::ivec2 first, last;
+		getTexelBounds(ta, tb, tc, first, last);
+		first = glm::max(first, origin);
+		last = glm::min(last, origin + glm::ivec2(width - 1, height - 1));
+		for (int y = first.y; y <= last.y; y++)
+		{
+			for (int x = first.x; x <= last.x; x++)
+			{
+				glm::vec2 centre(x + 0.5f, y + 0.5f);
+				float u = cross2(centre - ta, tc - ta) / uvArea;
+				float v = cross2(tb - ta, centre - ta) / uvArea;
+				if (u < -edgeSlack || v < -edgeSlack || u + v > 1.f + edgeSlack) continue;
+
+				SurfaceTexel& texel = surface[static_cast<size_t>(y - origin.y) * width + (x - origin.x)];
+				texel.position = a.position * (1.f - u - v) + b.position * u + c.position * v;
+				glm::vec3 normal = a.normal * (1.f - u - v) + b.normal * u + c.normal * v;
+				float normalLength = glm::length(normal);
+				texel.normal = normalLength > 0 ? normal / normalLength : faceNormal;
+				texel.faceNormal = glm::dot(faceNormal, texel.normal) < 0 ? -faceNormal : faceNormal;
+				texel.texelLength = texelLength;
+			}
+		}
+	}
+}
+
+//Share of cosine weighted rays that escape. The rays spiral out from the normal, so a few of them cover the hemisphere
+//evenly.
+static float getOcclusion(const MaskBake& bake, const SurfaceTexel& texel, float rotation)
+{
+	//Orthonormal basis around the normal without a branch, from Duff et al.
+	const glm::vec3& normal = texel.normal;
+	float sign = std::copysign(1.f, normal.z);
+	float a = -1.f / (sign + normal.z);
+	float b = normal.x * normal.y * a;
+	glm::vec3 tangent(1.f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+	//Off the surface by part of a texel, so rays don't hit the triangle they start on.
+	glm::vec3 origin = texel.position + texel.faceNormal * (texel.texelLength * 0.1f + bake.bias);
+	int rayCount = bake.settings.rayCount;
+	int hits = 0;
+	for (int i = 0; i < rayCount; i++)
+	{
+		float height = (i + 0.5f) / rayCount;
+		float radius = std::sqrt(height);
+		float angle = 6.2831853f * (i * 0.6180340f + rotation);
+		glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + normal * std::sqrt(1.f - height);
+		//Smooth normals lean away from the face, so some rays would start into it. Those are mirrored back out.
+		float below = glm::dot(direction, texel.faceNormal);
+		if (below < 0) direction -= 2.f * below * texel.faceNormal;
+
+		for (const BakeMesh& mesh : bake.meshes)
+		{
+			if (mesh.bvh->occluded(origin, direction, bake.maxDistance))
+			{
+				hits++;
+				break;
+			}
+		}
+	}
+	return 1.f - static_cast<float>(hits) / rayCount;
+}
+
+//Positive where the surface is convex. The normal turns towards the step to each neighbour by the step over the radius of
+//curvature, averaged over the neighbours on the same island.
+static float getCurvature(const std::vector<SurfaceTexel>& surface, int width, int x, int y)
+{
+	const SurfaceTexel& texel = surface[static_cast<size_t>(y) * width + x];
+	const glm::ivec2 offsets[] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	float curvature = 0;
+	int neighbours = 0;
+	for (glm::ivec2 offset : offsets)
+	{
+		const SurfaceTexel& other = surface[static_cast<size_t>(y + offset.y) * width + x + offset.x];
+		if (other.texelLength <= 0) continue;
+		glm::vec3 step = other.position - texel.position;
+		float distanceSquared = glm::dot(step, step);
+		float limit = neighbourTexels * std::max(texel.texelLength, other.texelLength);
+		if (distanceSquared <= 0 || distanceSquared > limit * limit) continue;
+		curvature += glm::dot(other.normal - texel.normal, step) / distanceSquared;
+		neighbours++;
+	}
+	return neighbours > 0 ? curvature / neighbours : 0.f;
+}
+
+static void bakeTile(MaskBake& bake, size_t tile)
+{
+	if (bake.progress && bake.progress->cancelled) return;
+	PROFILE_ZONE("Bake Tile");
+
+	int size = bake.settings.size;
+	glm::ivec2 tileStart(static_cast<int>(tile % bake.tilesX) * tileSize, static_cast<int>(tile / bake.tilesX) * tileSize);
+	glm::ivec2 tileEnd = glm::min(tileStart + tileSize, glm::ivec2(size));
+	//One texel of border all round for the neighbours curvature looks at.
+	glm::ivec2 origin = tileStart - 1;
+	int width = tileEnd.x - tileStart.x + 2;
+	int height = tileEnd.y - tileStart.y + 2;
+	std::vector<SurfaceTexel> surface;
+	rasteriseTile(bake, bake.tileTriangles[tile], origin, width, height, surface);
+
+	size_t texels = 0;
+	for (int y = tileStart.y; y < tileEnd.y; y++)
+	{
+		for (int x = tileStart.x; x < tileEnd.x; x++)
+		{
+			int localX = x - origin.x;
+			int localY = y - origin.y;
+			const SurfaceTexel& texel = surface[static_cast<size_t>(localY) * width + localX];
+			if (texel.texelLength <= 0) continue;
+			texels++;
+
+			float curvature = getCurvature(surface, width, localX, localY) * bake.curvatureRadius;
+			size_t index = static_cast<size_t>(y) * size + x;
+			uint8_t* pixel = &bake.pixels[index * 4];
+			pixel[BakeOcclusion] = toByte(getOcclusion(bake, texel, getTexelRotation(x, y)));
+			pixel[BakeConvexity] = toByte(curvature);
+			pixel[BakeConcavity] = toByte(-curvature);
+			bake.covered[index] = 1;
+		}
+	}
+	bake.texels += texels;
+
+	size_t done = ++bake.tilesDone;
+	if (bake.progress) bake.progress->fraction = static_cast<float>(done) / bake.tileTriangles.size();
+}
+
+//Grows every island by a texel, each new texel the average of the covered ones around it. Only texels not yet covered
+//are written, and only covered ones are read, so rows can be done in parallel.
+static void padIslands(MaskBake& bake, ThreadPool& threadPool)
+{
+	int size = bake.settings.size;
+	std::vector<uint8_t> grown = bake.covered;
+	threadPool.parallelFor((size + tileSize - 1) / tileSize, [&bake, &grown, size](size_t band)
+		{
+			int rowEnd = std::min(static_cast<int>(band + 1) * tileSize, size);
+			for (int y = static_cast<int>(band) * tileSize; y < rowEnd; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					size_t index = static_cast<size_t>(y) * size + x;
+					if (bake.covered[index]) continue;
+					int sum[BakeChannelCount] = {};
+					int count = 0;
+					for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, size - 1); ny++)
+					{
+						for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, size - 1); nx++)
+						{
+							size_t neighbour = static_cast<size_t>(ny) * size + nx;
+							if (!bake.covered[neighbour]) continue;
+							for (int c = 0; c < BakeChannelCount; c++)
+								sum[c] += bake.pixels[neighbour * 4 + c];
+							count++;
+						}
+					}
+					if (count == 0) continue;
+					for (int c = 0; c < BakeChannelCount; c++)
+						bake.pixels[index * 4 + c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+					grown[index] = 1;
+				}
+			}
+		});
+	bake.covered.swap(grown);
+}
+
+bool bakeMasks(const std::vector<BakeMesh>& meshes, const BakeSettings& settings, ThreadPool& threadPool, std::vector<uint8_t>& pixels,
+	BakeStats& stats, TaskProgress* progress)
+{
+	PROFILE_ZONE("Bake Masks");
+	auto start = std::chrono::steady_clock::now();
+	stats = BakeStats{};
+	stats.threads = threadPool.getThreadCount();
+	int size = settings.size;
+	if (size <= 0 || settings.rayCount <= 0) return false;
+
+	//Open and flat wherever nothing is baked.
+	pixels.assign(static_cast<size_t>(size) * size * 4, 0);
+	for (size_t i = 0; i < pixels.size(); i += 4)
+	{
+		pixels[i + BakeOcclusion] = 255;
+		pixels[i + 3] = 255;
+	}
+
+	MaskBake bake{ meshes, settings, pixels };
+	bake.tilesX = (size + tileSize - 1) / tileSize;
+	bake.tileTriangles.resize(static_cast<size_t>(bake.tilesX) * bake.tilesX);
+	bake.covered.assign(static_cast<size_t>(size) * size, 0);
+	bake.progress = progress;
+
+	//Distances scale with the model, so the same settings suit any model.
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+	{
+		PROFILE_ZONE("Bin Triangles");
+		for (uint32_t m = 0; m < meshes.size(); m++)
+		{
+			const vector<Vertex>& vertices = *meshes[m].vertices;
+			const vector<unsigned int>& indices = *meshes[m].indices;
+			for (const Vertex& vertex : vertices)
+			{
+				boundsMin = glm::min(boundsMin, vertex.position);
+				boundsMax = glm::max(boundsMax, vertex.position);
+			}
+			for (uint32_t t = 0; t < indices.size() / 3; t++)
+			{
+				glm::ivec2 first, last;
+				getTexelBounds(vertices[indices[t * 3]].texCoords * static_cast<float>(size),
+					vertices[indices[t * 3 + 1]].texCoords * static_cast<float>(size),
+					vertices[indices[t * 3 + 2]].texCoords * static_cast<float>(size), first, last);
+				//Tiles whose border the triangle covers need it too.
+				first = glm::max(first - 1, glm::ivec2(0));
+				last = glm::min(last + 1, glm::ivec2(size - 1));
+				if (first.x > last.x || first.y > last.y) continue;
+				for (int ty = first.y / tileSize; ty <= last.y / tileSize; ty++)
+				{
+					for (int tx = first.x / tileSize; tx <= last.x / tileSize; tx++)
+						bake.tileTriangles[static_cast<size_t>(ty) * bake.tilesX + tx].push_back(BakeTriangle{ m, t });
+				}
+			}
+		}
+	}
+	float diagonal = boundsMin.x <= boundsMax.x ? glm::length(boundsMax - boundsMin) : 1.f;
+	bake.maxDistance = settings.occlusionDistance * diagonal;
+	bake.bias = 1e-5f * diagonal;
+	bake.curvatureRadius = settings.curvatureRadius * diagonal;
+
+	threadPool.parallelFor(bake.tileTriangles.size(), [&bake](size_t tile) { bakeTile(bake, tile); });
+	if (progress && progress->cancelled) return false;
+
+	{
+		PROFILE_ZONE("Pad Islands");
+		for (int i = 0; i < settings.padding; i++)
+			padIslands(bake, threadPool);
+	}
+
+	stats.texels = bake.texels;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (progress) progress->fraction = 1.f;
+	return true;
+}
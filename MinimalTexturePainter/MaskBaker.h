@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+#include "TaskProgress.h"
+#include "ThreadPool.h"
+
+//What the baker reads of one mesh. The meshes of a model share its model space and its UV space.
+struct BakeMesh
+{
+	const vector<Vertex>* vertices;
+	const vector<unsigned int>* indices;
+	const MeshBVH* bvh;
+};
+
+struct BakeSettings
+{
+	//Width and height of the baked image.
+	int size = 2048;
+	//Occlusion rays per texel.
+	int rayCount = 32;
+	//How far occlusion rays reach, as a fraction of the model's bounding box diagonal.
+	float occlusionDistance = 0.1f;
+	//Convexity and concavity are full strength where the surface curves this tightly or more, also a fraction of the
+	//diagonal.
+	float curvatureRadius = 0.01f;
+	//Texels the bake is grown by past the edge of each UV island, so filtering doesn't pull in the background.
+	int padding = 4;
+};
+
+//Channels of the baked RGBA8 image. Texels no triangle covers are open and flat: occlusion 1, the others 0.
+enum BakeChannel
+{
+	//1 where every ray escapes, 0 where every ray hits something.
+	BakeOcclusion,
+	//Edges that stick out.
+	BakeConvexity,
+	//Creases and crevices.
+	BakeConcavity,
+	BakeChannelCount
+};
+
+struct BakeStats
+{
+	//Texels covered by a triangle, the ones rays were cast from.
+	size_t texels = 0;
+	double seconds = 0;
+	unsigned int threads = 0;
+};
+
+//Covered texels baked per second by each thread, to budget a bake of a given size by.
+double getTexelsPerThreadSecond(const BakeStats& stats);
+
+//Bakes ambient occlusion and curvature into UV space for use as brush masks. Each tile of the image is rasterised from
+//the triangles over it to get a position and normal per texel, then occlusion rays are cast from every covered texel
+//against the meshes' BVHs and curvature is measured from how the normals turn between neighbouring texels. Tiles are baked
+//in parallel on threadPool, so call it from a pool task for every thread to take part. pixels is size * size RGBA8 with the
+//first row at v = 0, as a GL texture is laid out. Tiles not yet started are skipped once progress is cancelled, and then
+//it returns false.
+bool bakeMasks(const std::vector<BakeMesh>& meshes, const BakeSettings& settings, ThreadPool& threadPool, std::vector<uint8_t>& pixels,
+	BakeStats& stats, TaskProgress* progress = nullptr);
@@ -1,24 +1,32 @@
 #include "Mesh.h"
 
+#include <algorithm>
+
+#include "GLResources.h"
+#include "GLStateCache.h"
+
 //Mostly copied impl with minor additions.
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MeshBVH bvh)
 {
     this->vertices = vertices;
     this->indices = indices;
     this->textures = textures;
+    this->bvh = std::move(bvh);
     setupMesh();
 }
 
 void Mesh::draw(Shader& shader) const
 {
-    //Bind textures
+    //Bind textures. Unit 15 is kept for the shadow map.
+    constexpr unsigned int maxTextures = 15;
+    GLuint textureIds[maxTextures];
+    unsigned int textureCount = static_cast<unsigned int>(std::min<size_t>(textures.size(), maxTextures));
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     unsigned int normalNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++)
+    for (unsigned int i = 0; i < textureCount; i++)
     {
-        glActiveTexture(GL_TEXTURE0 + i); //Increment texture suffix to use different texture units
         string number;
         string name = textures[i].type;
         if (name == "texture_diffuse")
@@ -30,43 +38,25 @@ void Mesh::draw(Shader& shader) const
 
         //Get the texture unit and bind.
         glUniform1i(glGetUniformLocation(shader.getID(), (("material." + name).append(number)).c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        textureIds[i] = textures[i].id;
     }
+    bindTextures(0, textureCount, textureIds);
 
-    //Draw
+    //Draw. The VAO stays bound for the next mesh to replace, nothing binds an element buffer without binding its own VAO first.
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    //Reset
-    glActiveTexture(GL_TEXTURE0);
 }
 
 void Mesh::setupMesh()
 {
-    //Gen buffers
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    
-    //Buffer vertices
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-    //Buffer element data
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    //Never written again, so neither buffer needs any storage flags.
+    VBO = createBuffer(vertices.size() * sizeof(Vertex), &vertices[0], 0);
+    EBO = createBuffer(indices.size() * sizeof(unsigned int), &indices[0], 0);
 
-    //Set VAOs
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(1);
     //Layout is same in buffer as struct.
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent));
-    glBindVertexArray(0);
+    VAO = createVertexArray(VBO, sizeof(Vertex), EBO, {
+        { 0, 3, GL_FLOAT, offsetof(Vertex, position) },
+        { 1, 3, GL_FLOAT, offsetof(Vertex, normal) },
+        { 2, 2, GL_FLOAT, offsetof(Vertex, texCoords) },
+        { 3, 3, GL_FLOAT, offsetof(Vertex, tangent) } });
 }
@@ -2,7 +2,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include "shader.h"
+#include "Shader.h"
+#include "MeshBVH.h"
 #include <string>
 #include <vector>
 
@@ -28,8 +29,10 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    //Over the vertices in model space, for picking and baking.
+    MeshBVH bvh;
 
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures);
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MeshBVH bvh);
 
     void draw(Shader& shader) const;
 
@@ -0,0 +1,360 @@
+#include "MeshBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//SSE2 is part of x64, so the four wide test needs no check for CPU support.
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MESH_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+//Relative costs the surface area heuristic weighs splits with. A pack tests four triangles for the price of one.
+static constexpr float traversalCost = 1.f;
+static constexpr float packCost = 1.f;
+static constexpr uint32_t maxLeafTriangles = 4;
+
+static float getPackCost(uint32_t triangleCount)
+{
+	return packCost * ((triangleCount + 3) / 4);
+}
+
+struct BuildTriangle
+{
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 centroid;
+	uint32_t triangle;
+};
+
+//Half the surface area, which is all the heuristic needs.
+static float halfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.f));
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+MeshBVH::MeshBVH(const glm::vec3* positions, size_t stride, const std::vector<unsigned int>& indices)
+{
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (triangleCount == 0) return;
+	auto position = [positions, stride](unsigned int index)
+	{
+		return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const char*>(positions) + index * stride);
+	};
+
+	std::vector<BuildTriangle> triangles(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		glm::vec3 a = position(indices[i * 3]);
+		glm::vec3 b = position(indices[i * 3 + 1]);
+		glm::vec3 c = position(indices[i * 3 + 2]);
+		BuildTriangle& triangle = triangles[i];
+		triangle.boundsMin = glm::min(a, glm::min(b, c));
+		triangle.boundsMax = glm::max(a, glm::max(b, c));
+		triangle.centroid = (triangle.boundsMin + triangle.boundsMax) * 0.5f;
+		triangle.triangle = i;
+	}
+
+	struct Range
+	{
+		uint32_t node;
+		uint32_t begin;
+		uint32_t end;
+		int depth;
+	};
+	nodes.reserve(triangleCount * 2 / maxLeafTriangles + 1);
+	nodes.push_back(Node{});
+	std::vector<Range> ranges{ Range{ 0, 0, triangleCount, 0 } };
+	while (!ranges.empty())
+	{
+		Range range = ranges.back();
+		ranges.pop_back();
+		uint32_t count = range.end - range.begin;
+
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+		glm::vec3 centroidMin = boundsMin;
+		glm::vec3 centroidMax = boundsMax;
+		for (uint32_t i = range.begin; i < range.end; i++)
+		{
+			boundsMin = glm::min(boundsMin, triangles[i].boundsMin);
+			boundsMax = glm::max(boundsMax, triangles[i].boundsMax);
+			centroidMin = glm::min(centroidMin, triangles[i].centroid);
+			centroidMax = glm::max(centroidMax, triangles[i].centroid);
+		}
+		nodes[range.node].boundsMin = boundsMin;
+		nodes[range.node].boundsMax = boundsMax;
+
+		//Cheapest split between bins on any axis.
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = std::numeric_limits<float>::max();
+		float parentArea = halfArea(boundsMin, boundsMax);
+		for (int axis = 0; axis < 3 && count > 1; axis++)
+		{
+			float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0) continue;
+			struct Bin
+			{
+				glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+				glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+				uint32_t count = 0;
+			};
+			Bin bins[binCount];
+			float scale = binCount / extent;
+			for (uint32_t i = range.begin; i < range.end; i++)
+			{
+				int bin = std::min(static_cast<int>((triangles[i].centroid[axis] - centroidMin[axis]) * scale), binCount - 1);
+				bins[bin].boundsMin = glm::min(bins[bin].boundsMin, triangles[i].boundsMin);
+				bins[bin].boundsMax = glm::max(bins[bin].boundsMax, triangles[i].boundsMax);
+				bins[bin].count++;
+			}
+
+			//Sweep from the right for the area and count right of each split, then from the left to cost them.
+			float rightArea[binCount];
+			uint32_t rightCount[binCount];
+			Bin right;
+			for (int split = binCount - 1; split > 0; split--)
+			{
+				right.boundsMin = glm::min(right.boundsMin, bins[split].boundsMin);
+				right.boundsMax = glm::max(right.boundsMax, bins[split].boundsMax);
+				right.count += bins[split].count;
+				rightArea[split] = halfArea(right.boundsMin, right.boundsMax);
+				rightCount[split] = right.count;
+			}
+			Bin left;
+			for (int split = 1; split < binCount; split++)
+			{
+				left.boundsMin = glm::min(left.boundsMin, bins[split - 1].boundsMin);
+				left.boundsMax = glm::max(left.boundsMax, bins[split - 1].boundsMax);
+				left.count += bins[split - 1].count;
+				if (left.count == 0 || rightCount[split] == 0) continue;
+				float cost = traversalCost + (halfArea(left.boundsMin, left.boundsMax) * getPackCost(left.count) +
+					rightArea[split] * getPackCost(rightCount[split])) / parentArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		bool leaf = range.depth == maxDepth - 1 || count <= 1 ||
+			(count <= maxLeafTriangles && (bestAxis < 0 || getPackCost(count) <= bestCost));
+		if (leaf)
+		{
+			Node& node = nodes[range.node];
+			node.first = static_cast<uint32_t>(packs.size());
+			node.packCount = (count + 3) / 4;
+			for (uint32_t i = 0; i < count; i += 4)
+			{
+				TrianglePack pack = {};
+				for (uint32_t lane = 0; lane < 4; lane++)
+				{
+					if (i + lane >= count)
+					{
+						pack.triangles[lane] = std::numeric_limits<uint32_t>::max();
+						continue;
+					}
+					uint32_t triangle = triangles[range.begin + i + lane].triangle;
+					glm::vec3 a = position(indices[triangle * 3]);
+					glm::vec3 edge1 = position(indices[triangle * 3 + 1]) - a;
+					glm::vec3 edge2 = position(indices[triangle * 3 + 2]) - a;
+					for (int axis = 0; axis < 3; axis++)
+					{
+						pack.corner[axis][lane] = a[axis];
+						pack.edge1[axis][lane] = edge1[axis];
+						pack.edge2[axis][lane] = edge2[axis];
+					}
+					pack.triangles[lane] = triangle;
+				}
+				packs.push_back(pack);
+			}
+			continue;
+		}
+
+		uint32_t middle;
+		if (bestAxis >= 0)
+		{
+			float centroidStart = centroidMin[bestAxis];
+			float scale = binCount / (centroidMax[bestAxis] - centroidStart);
+			auto split = std::partition(triangles.begin() + range.begin, triangles.begin() + range.end, [&](const BuildTriangle& triangle)
+				{
+					return std::min(static_cast<int>((triangle.centroid[bestAxis] - centroidStart) * scale), binCount - 1) < bestSplit;
+				});
+			middle = static_cast<uint32_t>(split - triangles.begin());
+		}
+		else
+		{
+			//Every centroid is in the same place, so any split is as good as another.
+			middle = range.begin + count / 2;
+		}
+
+		uint32_t children = static_cast<uint32_t>(nodes.size());
+		nodes[range.node].first = children;
+		nodes[range.node].packCount = 0;
+		nodes.push_back(Node{});
+		nodes.push_back(Node{});
+		ranges.push_back(Range{ children, range.begin, middle, range.depth + 1 });
+		ranges.push_back(Range{ children + 1, middle, range.end, range.depth + 1 });
+	}
+}
+
+bool MeshBVH::intersectBounds(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry) const
+{
+	glm::vec3 toMin = (node.boundsMin - origin) * inverseDirection;
+	glm::vec3 toMax = (node.boundsMax - origin) * inverseDirection;
+	glm::vec3 nearest = glm::min(toMin, toMax);
+	glm::vec3 farthest = glm::max(toMin, toMax);
+	entry = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.f));
+	float exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+	return entry <= exit;
+}
+
+bool MeshBVH::intersectPack(const TrianglePack& pack, const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, Hit& hit) const
+{
+	//Moller-Trumbore on four triangles. Lanes with no area divide by zero, and the NaNs fail every comparison.
+	float distances[4];
+	float us[4];
+	float vs[4];
+	int hits;
+#if defined(MESH_BVH_SSE)
+	__m128 dx = _mm_set1_ps(direction.x);
+	__m128 dy = _mm_set1_ps(direction.y);
+	__m128 dz = _mm_set1_ps(direction.z);
+	__m128 e1x = _mm_load_ps(pack.edge1[0]);
+	__m128 e1y = _mm_load_ps(pack.edge1[1]);
+	__m128 e1z = _mm_load_ps(pack.edge1[2]);
+	__m128 e2x = _mm_load_ps(pack.edge2[0]);
+	__m128 e2y = _mm_load_ps(pack.edge2[1]);
+	__m128 e2z = _mm_load_ps(pack.edge2[2]);
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inverse = _mm_div_ps(_mm_set1_ps(1.f), determinant);
+
+	__m128 tx = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_load_ps(pack.corner[0]));
+	__m128 ty = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_load_ps(pack.corner[1]));
+	__m128 tz = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_load_ps(pack.corner[2]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverse);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 inside = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+	inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+	__m128 inRange = _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, _mm_set1_ps(maxDistance)));
+	hits = _mm_movemask_ps(_mm_and_ps(inside, inRange));
+	if (!hits) return false;
+	_mm_storeu_ps(distances, t);
+	_mm_storeu_ps(us, u);
+	_mm_storeu_ps(vs, v);
+#else
+	hits = 0;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		glm::vec3 edge1(pack.edge1[0][lane], pack.edge1[1][lane], pack.edge1[2][lane]);
+		glm::vec3 edge2(pack.edge2[0][lane], pack.edge2[1][lane], pack.edge2[2][lane]);
+		glm::vec3 p = glm::cross(direction, edge2);
+		float inverse = 1.f / glm::dot(edge1, p);
+		glm::vec3 toOrigin = origin - glm::vec3(pack.corner[0][lane], pack.corner[1][lane], pack.corner[2][lane]);
+		glm::vec3 q = glm::cross(toOrigin, edge1);
+		us[lane] = glm::dot(toOrigin, p) * inverse;
+		vs[lane] = glm::dot(direction, q) * inverse;
+		distances[lane] = glm::dot(edge2, q) * inverse;
+		if (us[lane] >= 0 && vs[lane] >= 0 && us[lane] + vs[lane] <= 1 && distances[lane] >= 0 && distances[lane] <= maxDistance)
+			hits |= 1 << lane;
+	}
+	if (!hits) return false;
+#endif
+
+	for (int lane = 0; lane < 4; lane++)
+	{
+		if (!(hits & (1 << lane)) || distances[lane] > maxDistance) continue;
+		maxDistance = distances[lane];
+		hit.distance = distances[lane];
+		hit.barycentrics = glm::vec2(us[lane], vs[lane]);
+		hit.triangle = pack.triangles[lane];
+	}
+	return true;
+}
+
+bool MeshBVH::traverse(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, bool anyHit, Hit& hit) const
+{
+	if (nodes.empty()) return false;
+	//Axes the ray is parallel to divide to infinity, which the slab test handles.
+	glm::vec3 inverseDirection = 1.f / direction;
+	float entry;
+	if (!intersectBounds(nodes[0], origin, inverseDirection, maxDistance, entry)) return false;
+
+	//Nearer child first, the other waits on the stack with its entry distance in case a hit rules it out.
+	uint32_t stack[maxDepth];
+	float stackEntry[maxDepth];
+	int stackSize = 0;
+	uint32_t current = 0;
+	bool found = false;
+	while (true)
+	{
+		const Node& node = nodes[current];
+		if (node.packCount == 0)
+		{
+			float leftEntry;
+			float rightEntry;
+			bool hitLeft = intersectBounds(nodes[node.first], origin, inverseDirection, maxDistance, leftEntry);
+			bool hitRight = intersectBounds(nodes[node.first + 1], origin, inverseDirection, maxDistance, rightEntry);
+			if (hitLeft && hitRight)
+			{
+				bool leftFirst = leftEntry <= rightEntry;
+				stack[stackSize] = leftFirst ? node.first + 1 : node.first;
+				stackEntry[stackSize++] = leftFirst ? rightEntry : leftEntry;
+				current = leftFirst ? node.first : node.first + 1;
+				continue;
+			}
+			if (hitLeft || hitRight)
+			{
+				current = hitLeft ? node.first : node.first + 1;
+				continue;
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < node.packCount; i++)
+			{
+				if (!intersectPack(packs[node.first + i], origin, direction, maxDistance, hit)) continue;
+				if (anyHit) return true;
+				found = true;
+			}
+		}
+
+		while (stackSize > 0 && stackEntry[stackSize - 1] > maxDistance)
+			stackSize--;
+		if (stackSize == 0) break;
+		current = stack[--stackSize];
+	}
+	return found;
+}
+
+bool MeshBVH::intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit& hit) const
+{
+	return traverse(origin, direction, maxDistance, false, hit);
+}
+
+bool MeshBVH::occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+	Hit hit;
+	return traverse(origin, direction, maxDistance, true, hit);
+}
+
+size_t MeshBVH::getNodeCount() const
+{
+	return nodes.size();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+//Bounding volume hierarchy over a mesh's triangles in model space, for casting rays at it on the CPU. Splits are chosen by
+//the surface area heuristic over binned centroids. Leaf triangles are stored four to a pack with one triangle per lane,
+//so a single SSE test checks four triangles at once.
+class MeshBVH
+{
+public:
+	struct Hit
+	{
+		//Along the ray in units of its direction, so a hit keeps the same distance in any space the ray is moved to.
+		float distance;
+		//Weights of the triangle's second and third corners. The first corner gets the rest.
+		glm::vec2 barycentrics;
+		//Index of the triangle. Its corners are indices 3 * triangle to 3 * triangle + 2.
+		uint32_t triangle;
+	};
+
+	//Deeper nodes become leaves of several packs, so traversal can use a fixed stack.
+	static constexpr int maxDepth = 64;
+	static constexpr int binCount = 16;
+
+private:
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		//Inner nodes: the first child, the second follows it. Leaves: the first triangle pack.
+		uint32_t first;
+		glm::vec3 boundsMax;
+		//0 for inner nodes.
+		uint32_t packCount;
+	};
+
+	//Each triangle as a corner and the edges from it to the other two. Lanes past the end of a leaf have no area and never hit.
+	struct alignas(16) TrianglePack
+	{
+		float corner[3][4];
+		float edge1[3][4];
+		float edge2[3][4];
+		uint32_t triangles[4];
+	};
+
+	std::vector<Node> nodes;
+	std::vector<TrianglePack> packs;
+
+	//Entry distance of the ray into the node's bounds, if it enters before maxDistance.
+	bool intersectBounds(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry) const;
+
+	//Updates hit and maxDistance if a triangle in the pack is nearer.
+	bool intersectPack(const TrianglePack& pack, const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, Hit& hit) const;
+
+	//Stops at the first hit found rather than the nearest if anyHit is set.
+	bool traverse(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, bool anyHit, Hit& hit) const;
+
+public:
+	MeshBVH() = default;
+
+	//positions points at the first vertex position, stride is the bytes from one to the next, as for a vertex attribute.
+	//Every three indices make a triangle.
+	MeshBVH(const glm::vec3* positions, size_t stride, const std::vector<unsigned int>& indices);
+
+	//Nearest hit along origin + t * direction for t in [0, maxDistance]. Triangles are hit from either side.
+	bool intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Hit& hit) const;
+
+	//Whether anything is hit in the same range, for shadow and occlusion rays, which don't need the nearest hit.
+	bool occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+	size_t getNodeCount() const;
+};
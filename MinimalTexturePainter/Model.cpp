@@ -1,47 +1,279 @@
 #include "Model.h"
-#include "stb_image.h"
+
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#if USE_ASSIMP
+#include <assimp/ProgressHandler.hpp>
+#else
+#include "ObjReader.h"
+#endif
 
 //Mostly copied impl with minor additions.
 
+Model::~Model()
+{
+	for (const Texture& texture : textures_loaded)
+		textureCache.releaseTexture(texture.id);
+}
+
 void Model::draw(Shader& shader) const
 {
 	for (unsigned int i = 0; i < meshes.size(); i++)
 		meshes[i].draw(shader);
 }
 
-void Model::loadModel(string path)
+void Model::replaceTexture(unsigned int original, unsigned int replacement)
 {
-	Assimp::Importer import;
-	const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate |
-		aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
-		!scene->mRootNode)
+	for (Mesh& mesh : meshes)
+	{
+		for (Texture& texture : mesh.textures)
+		{
+			if (texture.id == original)
+				texture.id = replacement;
+		}
+	}
+}
+
+struct Model::LoadState
+{
+#if USE_ASSIMP
+	Assimp::Importer importer;
+	vector<const aiMesh*> sceneMeshes;
+#else
+	vector<ObjMesh> objMeshes;
+#endif
+	vector<vector<size_t>> meshTextures;
+	vector<CachedImage> images;
+	vector<MeshData> meshData;
+	ThreadPool::JobHandle parse;
+	//Set by the parse job.
+	ThreadPool::JobHandle finished;
+	std::shared_ptr<TaskProgress> progress;
+	std::function<void(bool)> onLoaded;
+	bool failed = false;
+	//Parsing is the first fifth of the progress bar, the steps after it share the rest.
+	std::atomic<size_t> stepsDone{ 0 };
+	size_t stepCount = 0;
+
+	void finishStep()
+	{
+		progress->fraction = 0.2f + 0.8f * ++stepsDone / stepCount;
+	}
+};
+
+#if USE_ASSIMP
+//Reports parse progress and aborts the import once the load is cancelled.
+class LoadProgressHandler : public Assimp::ProgressHandler
+{
+private:
+	std::shared_ptr<TaskProgress> progress;
+
+public:
+	LoadProgressHandler(std::shared_ptr<TaskProgress> progress):
+		progress(std::move(progress))
+	{
+	}
+
+	bool Update(float percentage) override
 	{
-		std::cout << "ERROR::ASSIMP::" << import.GetErrorString() << std::endl;
-		return;
+		if (percentage >= 0) progress->fraction = 0.2f * std::min(percentage, 1.f);
+		return !progress->cancelled;
 	}
-	directory = path.substr(0, path.find_last_of('\\'));
-	processNode(scene->mRootNode, scene);
+};
+#endif
+
+Model::Model(const char* path, ThreadPool& threadPool, TextureCache& textureCache):
+	textureCache(textureCache)
+{
+	std::shared_ptr<LoadState> state = loadModel(path, threadPool, std::make_shared<TaskProgress>(), nullptr);
+	threadPool.wait(state->parse);
+	threadPool.wait(state->finished);
+}
+
+Model::Model(const string& path, ThreadPool& threadPool, TextureCache& textureCache, std::shared_ptr<TaskProgress> progress,
+	std::function<void(bool)> onLoaded):
+	textureCache(textureCache)
+{
+	loadModel(path, threadPool, std::move(progress), std::move(onLoaded));
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+std::shared_ptr<Model::LoadState> Model::loadModel(const string& path, ThreadPool& threadPool, std::shared_ptr<TaskProgress> progress,
+	std::function<void(bool)> onLoaded)
+{
+	PROFILE_ZONE("Load Model");
+	std::shared_ptr<LoadState> state = std::make_shared<LoadState>();
+	state->progress = progress;
+	state->onLoaded = std::move(onLoaded);
+#if USE_ASSIMP
+	//The importer owns its progress handler.
+	state->importer.SetProgressHandler(new LoadProgressHandler(progress));
+#endif
+	ThreadPool* pool = &threadPool;
+	//OpenGL work is pinned to this thread, which has the context.
+	std::thread::id glThread = std::this_thread::get_id();
+
+	//Parse, then convert meshes and decode textures in parallel, uploading each texture as its decode finishes. The meshes
+	//are built once everything else is done. Steps started after a cancel return straight away.
+	state->parse = threadPool.schedule([this, state, path, pool, glThread]()
+		{
+			vector<ThreadPool::JobHandle> steps;
+#if USE_ASSIMP
+			const aiScene* scene;
+			{
+				PROFILE_ZONE("Import Scene");
+				scene = state->importer.ReadFile(path, aiProcess_Triangulate |
+					aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+			}
+			if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+				!scene->mRootNode)
+			{
+				//A cancelled import is aborted by the progress handler, which isn't an error.
+				if (!state->progress->cancelled)
+					std::cout << "ERROR::ASSIMP::" << state->importer.GetErrorString() << std::endl;
+				state->failed = true;
+			}
+			else
+			{
+				processNode(scene->mRootNode, scene, state->sceneMeshes);
+
+				//Resolve materials first so every unique texture is known before decoding starts.
+				state->meshTextures.reserve(state->sceneMeshes.size());
+				for (const aiMesh* mesh : state->sceneMeshes)
+				{
+					vector<size_t> textureIndices;
+					if (mesh->mMaterialIndex >= 0)
+					{
+						aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+						vector<size_t> diffuseMaps = loadMaterialTextures(material,
+							aiTextureType_DIFFUSE, "texture_diffuse", texturePathIndices, textures_loaded);
+						textureIndices.insert(textureIndices.end(), diffuseMaps.begin(), diffuseMaps.end());
+						vector<size_t> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", texturePathIndices, textures_loaded);
+						textureIndices.insert(textureIndices.end(), specularMaps.begin(),
+							specularMaps.end());
+						vector<size_t> normalMaps = loadMaterialTextures(material, aiTextureType_NORMALS, "texture_normal", texturePathIndices, textures_loaded);
+						textureIndices.insert(textureIndices.end(), normalMaps.begin(),
+							normalMaps.end());
+					}
+					state->meshTextures.push_back(std::move(textureIndices));
+				}
+				state->meshData.resize(state->sceneMeshes.size());
+			}
+#else
+			string error;
+			if (!readObj(path, state->objMeshes, error))
+			{
+				if (!state->progress->cancelled)
+					std::cout << "ERROR::OBJ::" << error << std::endl;
+				state->failed = true;
+			}
+			else
+			{
+				state->meshTextures.reserve(state->objMeshes.size());
+				for (const ObjMesh& mesh : state->objMeshes)
+				{
+					vector<size_t> textureIndices;
+					if (!mesh.diffusePath.empty()) textureIndices.push_back(addTexturePath(mesh.diffusePath, "texture_diffuse", texturePathIndices, textures_loaded));
+					if (!mesh.specularPath.empty()) textureIndices.push_back(addTexturePath(mesh.specularPath, "texture_specular", texturePathIndices, textures_loaded));
+					if (!mesh.normalPath.empty()) textureIndices.push_back(addTexturePath(mesh.normalPath, "texture_normal", texturePathIndices, textures_loaded));
+					state->meshTextures.push_back(std::move(textureIndices));
+				}
+				state->meshData.resize(state->objMeshes.size());
+			}
+#endif
+			if (!state->failed)
+			{
+				//Either separator, so models load the same on Linux.
+				size_t separator = path.find_last_of("/\\");
+				directory = separator == string::npos ? "." : path.substr(0, separator);
+
+				state->images.resize(textures_loaded.size());
+				state->stepCount = textures_loaded.size() + state->meshData.size();
+				for (size_t i = 0; i < textures_loaded.size(); i++)
+				{
+					string filename = directory + '/' + textures_loaded[i].path;
+					TextureCache* cache = &textureCache;
+					ThreadPool::JobHandle decode = pool->schedule([state, cache, filename, i]()
+						{
+							if (!state->progress->cancelled) state->images[i] = cache->loadImage(filename);
+						});
+					//Material textures are painted into, so each gets its own GL texture even if another has the same content.
+					steps.push_back(pool->schedule([this, state, i]()
+						{
+							if (!state->progress->cancelled)
+								textures_loaded[i].id = textureCache.createTexture(state->images[i], textures_loaded[i].type == "texture_diffuse", GL_LINEAR);
+							//Only the cache's reference to the pixels is left, for as long as it keeps them.
+							state->images[i] = CachedImage();
+							state->finishStep();
+						}, { decode }, glThread));
+				}
+				for (size_t i = 0; i < state->meshData.size(); i++)
+				{
+					steps.push_back(pool->schedule([state, i]()
+						{
+							if (!state->progress->cancelled)
+							{
+#if USE_ASSIMP
+								state->meshData[i] = processMesh(state->sceneMeshes[i]);
+#else
+								ObjMesh& mesh = state->objMeshes[i];
+								state->meshData[i].vertices = std::move(mesh.vertices);
+								state->meshData[i].indices = std::move(mesh.indices);
+								buildBVH(state->meshData[i]);
+#endif
+							}
+							state->finishStep();
+						}));
+				}
+			}
+
+			state->finished = pool->schedule([this, state]()
+				{
+					if (state->progress->cancelled) state->failed = true;
+					if (!state->failed)
+					{
+						meshes.reserve(state->meshData.size());
+						for (size_t i = 0; i < state->meshData.size(); i++)
+						{
+							MeshData& data = state->meshData[i];
+							vector<Texture> textures;
+							for (size_t textureIndex : state->meshTextures[i])
+							{
+								textures.push_back(textures_loaded[textureIndex]);
+							}
+							meshes.emplace_back(std::move(data.vertices), std::move(data.indices), std::move(textures), std::move(data.bvh));
+						}
+						state->progress->fraction = 1.f;
+					}
+					//Last, the callback may destroy the model.
+					if (state->onLoaded) state->onLoaded(!state->failed);
+				}, steps, glThread);
+		});
+
+	return state;
+}
+
+void Model::processNode(aiNode* node, const aiScene* scene, vector<const aiMesh*>& sceneMeshes)
 {
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, sceneMeshes);
 	}
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+Model::MeshData Model::processMesh(const aiMesh* mesh)
 {
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
-	vector<Texture> textures;
+	PROFILE_ZONE("Convert Mesh");
+	MeshData data;
+	vector<Vertex>& vertices = data.vertices;
+	vector<unsigned int>& indices = data.indices;
+	vertices.reserve(mesh->mNumVertices);
+	//Meshes are triangulated on import.
+	indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
 		Vertex vertex;
@@ -77,111 +309,88 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	//Process indices
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
+		const aiFace& face = mesh->mFaces[i];
 		for (unsigned int j = 0; j < face.mNumIndices; j++)
 			indices.push_back(face.mIndices[j]);
 	}
 
-	//Process material
-	if (mesh->mMaterialIndex >= 0)
-	{
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-		vector<Texture> diffuseMaps = loadMaterialTextures(material,
-			aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(),
-			specularMaps.end());
-		vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_NORMALS, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(),
-			normalMaps.end());
-	}
+	buildBVH(data);
+	return data;
+}
 
-	return Mesh(vertices, indices, textures);
+void Model::buildBVH(MeshData& data)
+{
+	//Built here so picking costs nothing on the context thread.
+	PROFILE_ZONE("Build BVH");
+	if (!data.vertices.empty()) data.bvh = MeshBVH(&data.vertices[0].position, sizeof(Vertex), data.indices);
 }
 
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type,
-	string typeName)
+size_t Model::addTexturePath(const string& path, const string& typeName, std::unordered_map<string, size_t>& pathIndices,
+	vector<Texture>& textures)
 {
-	vector<Texture> textures;
-	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
-	{
-		aiString str;
-		mat->GetTexture(type, i, &str);
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (std::strcmp(textures_loaded[j].path.data(),
-				str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if (!skip)
-		{ // if texture hasnt been loaded already, load it
-			Texture texture;
-			texture.id = textureFromFile(str.C_Str(), directory, typeName == "texture_diffuse");
-			texture.type = typeName;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			textures_loaded.push_back(texture); // add to loaded textures
-		}
+	auto inserted = pathIndices.try_emplace(path, textures.size());
+	if (inserted.second)
+	{ //Texture is decoded and uploaded later in loadModel.
+		Texture texture;
+		texture.type = typeName;
+		texture.path = path;
+		textures.push_back(texture);
 	}
-	return textures;
+	return inserted.first->second;
 }
 
-unsigned int Model::textureFromFile(const char* path, const string& directory, bool useSRGB)
+bool Model::readMaterialTextures(const string& path, vector<Texture>& textures, string& error)
 {
-	string filename = string(path);
-	filename = directory + '\\' + filename;
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	//Textures are flipped.
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
+	PROFILE_ZONE("Read Material Textures");
+	textures.clear();
+	std::unordered_map<string, size_t> pathIndices;
+#if USE_ASSIMP
+	//Meshes in the order loadModel visits them, as that is the order their textures are added in.
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(path, 0);
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
-		GLenum format = 0;
-		GLenum internalFormat = 0;
-		if (nrComponents == 1)
-		{
-			format = GL_RED;
-			internalFormat = GL_RED;
-		}
-		else if (nrComponents == 3)
-		{
-			format = GL_RGB;
-			internalFormat = useSRGB ? GL_SRGB : GL_RGB;
-		}
-		else if (nrComponents == 4)
-		{
-			format = GL_RGBA;
-			internalFormat = useSRGB ? GL_SRGB_ALPHA : GL_RGBA;
-		}
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, (int)internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		stbi_image_free(data);
-
+		error = importer.GetErrorString();
+		return false;
+	}
+	vector<const aiMesh*> sceneMeshes;
+	processNode(scene->mRootNode, scene, sceneMeshes);
+	for (const aiMesh* mesh : sceneMeshes)
+	{
+		const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+		loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", pathIndices, textures);
+		loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", pathIndices, textures);
+		loadMaterialTextures(material, aiTextureType_NORMALS, "texture_normal", pathIndices, textures);
 	}
-	else
+#else
+	vector<ObjMesh> objMeshes;
+	if (!readObj(path, objMeshes, error)) return false;
+	for (const ObjMesh& mesh : objMeshes)
 	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		if (!mesh.diffusePath.empty()) addTexturePath(mesh.diffusePath, "texture_diffuse", pathIndices, textures);
+		if (!mesh.specularPath.empty()) addTexturePath(mesh.specularPath, "texture_specular", pathIndices, textures);
+		if (!mesh.normalPath.empty()) addTexturePath(mesh.normalPath, "texture_normal", pathIndices, textures);
 	}
+#endif
+
+	size_t separator = path.find_last_of("/\\");
+	string directory = separator == string::npos ? "." : path.substr(0, separator);
+	for (Texture& texture : textures)
+		texture.path = directory + '/' + texture.path;
+	return true;
+}
 
-	return textureID;
-}
\ No newline at end of file
+#if USE_ASSIMP
+vector<size_t> Model::loadMaterialTextures(const aiMaterial* mat, aiTextureType type, const string& typeName,
+	std::unordered_map<string, size_t>& pathIndices, vector<Texture>& textures)
+{
+	vector<size_t> indices;
+	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+	{
+		aiString str;
+		mat->GetTexture(type, i, &str);
+		indices.push_back(addTexturePath(str.C_Str(), typeName, pathIndices, textures));
+	}
+	return indices;
+}
+#endif
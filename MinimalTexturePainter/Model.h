@@ -1,7 +1,19 @@
 #pragma once
 #include "Shader.h"
 #include "Mesh.h"
-#include "stb_image.h"
+#include "TaskProgress.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+//Define USE_ASSIMP as 0 to build without the assimp library, as the Linux headless build does where it isn't installed.
+//Models are then read with readObj, so only OBJ loads. The assimp headers are still used for the types processMesh reads.
+#ifndef USE_ASSIMP
+#define USE_ASSIMP 1
+#endif
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -10,22 +22,61 @@
 class Model
 {
 public:
-	Model(const char* path)
-	{
-		loadModel(path);
-	}
+	//Loads synchronously, running the load's OpenGL steps on the calling thread while it waits.
+	Model(const char* path, ThreadPool& threadPool, TextureCache& textureCache);
+	//Starts loading and returns straight away. The OpenGL steps are pinned to the calling thread, which has to keep running
+	//its pinned jobs. onLoaded runs there last, with whether the model loaded, and until then the model must be kept alive
+	//and not drawn. Cancelling through progress skips the steps not yet started and fails the load.
+	Model(const string& path, ThreadPool& threadPool, TextureCache& textureCache, std::shared_ptr<TaskProgress> progress,
+		std::function<void(bool)> onLoaded);
+	//Textures are reference counted in the cache so a model must not be copied.
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+	~Model();
 	void draw(Shader& shader) const;
 
+	//Makes meshes sample replacement wherever they used original, e.g. a layer composite.
+	//textures_loaded keeps the original so it is still released to the cache.
+	void replaceTexture(unsigned int original, unsigned int replacement);
+
 	vector<Mesh> meshes;
 	vector<Texture> textures_loaded;
 
+	//Mesh converted on a worker thread, waiting for its OpenGL objects.
+	struct MeshData
+	{
+		vector<Vertex> vertices;
+		vector<unsigned int> indices;
+		MeshBVH bvh;
+	};
+
+	//The import steps that don't need a context are static so they can be run on their own, e.g. by the microbenchmarks.
+	static MeshData processMesh(const aiMesh* mesh);
+	//Returns the index into textures of path's texture. A path already in pathIndices reuses its texture. New textures are
+	//added with no id until they are decoded and uploaded.
+	static size_t addTexturePath(const string& path, const string& typeName, std::unordered_map<string, size_t>& pathIndices,
+		vector<Texture>& textures);
+	//Lists the textures of path's materials as a load would add them to textures_loaded, with no ids and paths joined to the
+	//model's directory, without converting meshes or loading anything. For painting with no context. Returns false with a
+	//message if the model can't be read.
+	static bool readMaterialTextures(const string& path, vector<Texture>& textures, string& error);
+#if USE_ASSIMP
+	//Returns indices into textures, added as addTexturePath does.
+	static vector<size_t> loadMaterialTextures(const aiMaterial* mat, aiTextureType type, const string& typeName,
+		std::unordered_map<string, size_t>& pathIndices, vector<Texture>& textures);
+#endif
+
 private:
 	string directory;
+	TextureCache& textureCache;
+	//Index into textures_loaded for each texture path in the model's materials.
+	std::unordered_map<string, size_t> texturePathIndices;
+
+	//Shared by a load's jobs, which keep it alive between them.
+	struct LoadState;
 
-	void loadModel(string path);
-	void processNode(aiNode* node, const aiScene* scene);
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-	vector<Texture> loadMaterialTextures(aiMaterial* mat,
-		aiTextureType type, string typeName);
-	unsigned int textureFromFile(const char* path, const string& directory, bool useSRGB);
-};
\ No newline at end of file
+	std::shared_ptr<LoadState> loadModel(const string& path, ThreadPool& threadPool, std::shared_ptr<TaskProgress> progress,
+		std::function<void(bool)> onLoaded);
+	static void processNode(aiNode* node, const aiScene* scene, vector<const aiMesh*>& sceneMeshes);
+	static void buildBVH(MeshData& data);
+};
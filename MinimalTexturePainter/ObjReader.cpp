@@ -0,0 +1,326 @@
+#include "ObjReader.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "CpuProfiler.h"
+
+struct ObjMaterial
+{
+	string diffusePath;
+	string specularPath;
+	string normalPath;
+};
+
+//Position, texture coordinate and normal indices of a face corner, -1 where it has none.
+struct ObjCorner
+{
+	int position;
+	int texCoord;
+	int normal;
+
+	bool operator==(const ObjCorner& other) const
+	{
+		return position == other.position && texCoord == other.texCoord && normal == other.normal;
+	}
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& corner) const
+	{
+		size_t hash = static_cast<size_t>(corner.position) * 0x9E3779B97F4A7C15ull;
+		hash ^= static_cast<size_t>(corner.texCoord) + 0x7F4A7C15ull + (hash << 6) + (hash >> 2);
+		hash ^= static_cast<size_t>(corner.normal) + 0x7F4A7C15ull + (hash << 6) + (hash >> 2);
+		return hash;
+	}
+};
+
+//The last word of the rest of the line, as texture maps give their options before the path.
+static string lastWord(std::istringstream& stream)
+{
+	string word;
+	string last;
+	while (stream >> word)
+		last = word;
+	return last;
+}
+
+static void readMaterialLibrary(const string& path, std::unordered_map<string, ObjMaterial>& materials)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		//The meshes still load, untextured, as with assimp.
+		std::cout << "ERROR::OBJ::MISSING_MATERIAL_LIBRARY " << path << std::endl;
+		return;
+	}
+
+	ObjMaterial* material = nullptr;
+	string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		string command;
+		if (!(stream >> command)) continue;
+		if (command == "newmtl")
+		{
+			string name;
+			stream >> name;
+			material = &materials[name];
+		}
+		else if (!material) continue;
+		else if (command == "map_Kd") material->diffusePath = lastWord(stream);
+		else if (command == "map_Ks") material->specularPath = lastWord(stream);
+		else if (command == "map_Bump" || command == "map_bump" || command == "bump" || command == "norm") material->normalPath = lastWord(stream);
+	}
+}
+
+//Parses "v", "v/vt", "v//vn" or "v/vt/vn" at text into zero based indices and advances text past it. Negative indices count
+//back from the last element read so far.
+static bool parseCorner(const char*& text, size_t positionCount, size_t texCoordCount, size_t normalCount, ObjCorner& corner)
+{
+	auto parseIndex = [&text](size_t count, int& index)
+	{
+		char* end;
+		long value = strtol(text, &end, 10);
+		if (end == text) return false;
+		text = end;
+		if (value < 0) value += static_cast<long>(count);
+		else value--;
+		if (value < 0 || value >= static_cast<long>(count)) return false;
+		index = static_cast<int>(value);
+		return true;
+	};
+
+	corner = { -1, -1, -1 };
+	if (!parseIndex(positionCount, corner.position)) return false;
+	if (*text != '/') return true;
+	text++;
+	if (*text != '/' && !parseIndex(texCoordCount, corner.texCoord)) return false;
+	if (*text != '/') return true;
+	text++;
+	return parseIndex(normalCount, corner.normal);
+}
+
+//Area weighted face normals, for meshes the file gives no normals for.
+static void computeNormals(ObjMesh& mesh)
+{
+	for (Vertex& vertex : mesh.vertices)
+		vertex.normal = glm::vec3(0.f);
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		Vertex& a = mesh.vertices[mesh.indices[i]];
+		Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+		Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+		glm::vec3 normal = glm::cross(b.position - a.position, c.position - a.position);
+		a.normal += normal;
+		b.normal += normal;
+		c.normal += normal;
+	}
+	for (Vertex& vertex : mesh.vertices)
+	{
+		float length = glm::length(vertex.normal);
+		vertex.normal = length > 0.f ? vertex.normal / length : glm::vec3(0.f, 0.f, 1.f);
+	}
+}
+
+//Tangents along increasing U, summed over the triangles at each vertex and made perpendicular to its normal.
+static void computeTangents(ObjMesh& mesh)
+{
+	for (Vertex& vertex : mesh.vertices)
+		vertex.tangent = glm::vec3(0.f);
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		Vertex& a = mesh.vertices[mesh.indices[i]];
+		Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+		Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+		glm::vec3 edge1 = b.position - a.position;
+		glm::vec3 edge2 = c.position - a.position;
+		glm::vec2 uv1 = b.texCoords - a.texCoords;
+		glm::vec2 uv2 = c.texCoords - a.texCoords;
+		float determinant = uv1.x * uv2.y - uv2.x * uv1.y;
+		if (std::abs(determinant) < 1e-12f) continue;
+		glm::vec3 tangent = (edge1 * uv2.y - edge2 * uv1.y) / determinant;
+		a.tangent += tangent;
+		b.tangent += tangent;
+		c.tangent += tangent;
+	}
+	for (Vertex& vertex : mesh.vertices)
+	{
+		glm::vec3 tangent = vertex.tangent - vertex.normal * glm::dot(vertex.normal, vertex.tangent);
+		float length = glm::length(tangent);
+		if (length < 1e-12f)
+		{
+			//No usable UVs here, any direction along the surface will do.
+			tangent = glm::cross(vertex.normal, std::abs(vertex.normal.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f));
+			length = glm::length(tangent);
+		}
+		vertex.tangent = tangent / length;
+	}
+}
+
+bool readObj(const std::string& path, std::vector<ObjMesh>& meshes, std::string& error)
+{
+	PROFILE_ZONE("Read OBJ");
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = "Can't open " + path;
+		return false;
+	}
+	size_t separator = path.find_last_of("/\\");
+	string directory = separator == string::npos ? "." : path.substr(0, separator);
+
+	meshes.clear();
+	vector<glm::vec3> positions;
+	vector<glm::vec3> normals;
+	vector<glm::vec2> texCoords;
+	std::unordered_map<string, ObjMaterial> materials;
+	ObjMaterial noMaterial;
+	const ObjMaterial* material = &noMaterial;
+	//Which meshes had a normal at every corner. The others get computed ones.
+	vector<bool> hasNormals;
+	//Vertex of each distinct corner in the last mesh.
+	std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> cornerVertices;
+	vector<unsigned int> polygon;
+
+	//Starts a mesh unless the last one is still empty, which takes on the new material instead.
+	auto startMesh = [&]()
+	{
+		if (meshes.empty() || !meshes.back().indices.empty())
+		{
+			meshes.emplace_back();
+			hasNormals.push_back(true);
+			cornerVertices.clear();
+		}
+		meshes.back().diffusePath = material->diffusePath;
+		meshes.back().specularPath = material->specularPath;
+		meshes.back().normalPath = material->normalPath;
+	};
+
+	string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		auto fail = [&](const std::string& message)
+		{
+			error = path + ":" + std::to_string(lineNumber) + ": " + message;
+			return false;
+		};
+
+		//Vertex data and faces are nearly all of a large file, so they are parsed in place.
+		const char* text = line.c_str();
+		while (*text == ' ' || *text == '\t')
+			text++;
+		if (text[0] == 'v' && (text[1] == ' ' || text[1] == '\t'))
+		{
+			char* end;
+			glm::vec3 position;
+			position.x = strtof(text + 2, &end);
+			position.y = strtof(end, &end);
+			position.z = strtof(end, &end);
+			positions.push_back(position);
+		}
+		else if (text[0] == 'v' && text[1] == 't')
+		{
+			char* end;
+			glm::vec2 texCoord;
+			texCoord.x = strtof(text + 2, &end);
+			//Flipped as aiProcess_FlipUVs does, to match the texture upload.
+			texCoord.y = 1.f - strtof(end, &end);
+			texCoords.push_back(texCoord);
+		}
+		else if (text[0] == 'v' && text[1] == 'n')
+		{
+			char* end;
+			glm::vec3 normal;
+			normal.x = strtof(text + 2, &end);
+			normal.y = strtof(end, &end);
+			normal.z = strtof(end, &end);
+			normals.push_back(normal);
+		}
+		else if (text[0] == 'f' && (text[1] == ' ' || text[1] == '\t'))
+		{
+			if (meshes.empty()) startMesh();
+			ObjMesh& mesh = meshes.back();
+			polygon.clear();
+			text++;
+			while (true)
+			{
+				while (*text == ' ' || *text == '\t' || *text == '\r')
+					text++;
+				if (!*text) break;
+				ObjCorner corner;
+				if (!parseCorner(text, positions.size(), texCoords.size(), normals.size(), corner)) return fail("bad face corner");
+				auto inserted = cornerVertices.try_emplace(corner, static_cast<unsigned int>(mesh.vertices.size()));
+				if (inserted.second)
+				{
+					Vertex vertex;
+					vertex.position = positions[corner.position];
+					vertex.normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.f);
+					vertex.texCoords = corner.texCoord >= 0 ? texCoords[corner.texCoord] : glm::vec2(0.f);
+					vertex.tangent = glm::vec3(0.f);
+					mesh.vertices.push_back(vertex);
+					if (corner.normal < 0) hasNormals.back() = false;
+				}
+				polygon.push_back(inserted.first->second);
+			}
+			if (polygon.size() < 3) return fail("face with fewer than three corners");
+			//Fanned out into triangles.
+			for (size_t i = 1; i + 1 < polygon.size(); i++)
+			{
+				mesh.indices.push_back(polygon[0]);
+				mesh.indices.push_back(polygon[i]);
+				mesh.indices.push_back(polygon[i + 1]);
+			}
+		}
+		else
+		{
+			std::istringstream stream(line);
+			string command;
+			if (!(stream >> command)) continue;
+			if (command == "mtllib")
+			{
+				string library;
+				while (stream >> library)
+					readMaterialLibrary(directory + '/' + library, materials);
+			}
+			else if (command == "usemtl")
+			{
+				string name;
+				stream >> name;
+				auto found = materials.find(name);
+				material = found == materials.end() ? &noMaterial : &found->second;
+				startMesh();
+			}
+			else if (command == "o" || command == "g")
+			{
+				startMesh();
+			}
+		}
+	}
+
+	//A trailing empty mesh is left behind by a group or material change after the last face.
+	if (!meshes.empty() && meshes.back().indices.empty())
+	{
+		meshes.pop_back();
+		hasNormals.pop_back();
+	}
+	if (meshes.empty())
+	{
+		error = path + " has no faces";
+		return false;
+	}
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (!hasNormals[i]) computeNormals(meshes[i]);
+		computeTangents(meshes[i]);
+	}
+	return true;
+}
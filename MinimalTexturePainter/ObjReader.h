@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+
+//A part of an OBJ file with one material. Texture paths are as the material library gives them, relative to the OBJ's
+//directory, and empty where the material has no such map.
+struct ObjMesh
+{
+	vector<Vertex> vertices;
+	vector<unsigned int> indices;
+	string diffusePath;
+	string specularPath;
+	string normalPath;
+};
+
+//Reads a Wavefront OBJ for builds without assimp, see USE_ASSIMP. Covers what exporters commonly write: positions, normals,
+//texture coordinates, polygons, objects and groups, and map_Kd, map_Ks and map_Bump or norm from the material libraries.
+//A new mesh starts wherever the object, group or material changes. The result matches what Model asks assimp for:
+//triangles, V flipped and tangents computed, with normals computed too when the file has none. Returns false with a message
+//naming the line on failure.
+bool readObj(const std::string& path, std::vector<ObjMesh>& meshes, std::string& error);
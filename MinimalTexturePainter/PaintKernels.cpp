@@ -0,0 +1,559 @@
+#include "PaintKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PAINT_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//MSVC allows any intrinsic anywhere. GCC and Clang need the functions using them marked, so the rest of the file stays baseline.
+#if defined(PAINT_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#else
+#define TARGET_SSE4
+#define TARGET_AVX2
+#endif
+
+static uint32_t floatBits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float bitsFloat(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+//Exact for every half, denormals included.
+static float halfToFloat(uint16_t half)
+{
+	uint32_t expMant = half & 0x7fffu;
+	float scaled = bitsFloat(expMant << 13) * bitsFloat((254u - 15u) << 23);
+	uint32_t bits = floatBits(scaled) | (static_cast<uint32_t>(half & 0x8000u) << 16);
+	if (expMant > 0x7bffu) bits |= 255u << 23;
+	return bitsFloat(bits);
+}
+
+//Rounds to nearest even, which is what F16C does, so the AVX2 set can use the hardware conversion.
+static uint16_t floatToHalf(float value)
+{
+	const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+	uint32_t bits = floatBits(value);
+	uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	uint32_t half;
+	if (bits >= (127u + 16u) << 23)
+	{
+		//Too big for a half, or already infinity or NaN.
+		half = bits > 255u << 23 ? 0x7e00u : 0x7c00u;
+	}
+	else if (bits < 113u << 23)
+	{
+		//Denormal or zero. Adding the magic number lines the mantissa up and lets the FPU round it.
+		half = floatBits(bitsFloat(bits) + bitsFloat(denormMagic)) - denormMagic;
+	}
+	else
+	{
+		uint32_t mantissaOdd = (bits >> 13) & 1u;
+		bits += ((15u - 127u) << 23) + 0xfffu;
+		bits += mantissaOdd;
+		half = bits >> 13;
+	}
+	return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+//Scalar
+
+static void unpackRGBA8Scalar(const uint8_t* in, float* out, int count)
+{
+	for (int i = 0; i < count * 4; i++)
+		out[i] = in[i] / 255.f;
+}
+
+static void packRGBA8Scalar(const float* in, uint8_t* out, int count)
+{
+	for (int i = 0; i < count * 4; i++)
+		out[i] = static_cast<uint8_t>(std::nearbyint(std::min(std::max(in[i], 0.f), 1.f) * 255.f));
+}
+
+static void unpackRGBA16FScalar(const uint16_t* in, float* out, int count)
+{
+	for (int i = 0; i < count * 4; i++)
+		out[i] = halfToFloat(in[i]);
+}
+
+static void packRGBA16FScalar(const float* in, uint16_t* out, int count)
+{
+	for (int i = 0; i < count * 4; i++)
+		out[i] = floatToHalf(in[i]);
+}
+
+static void dabScalar(const float* source, float* stroke, int count, int x, int y, const DabRowParams& params)
+{
+	float dv = (static_cast<float>(y) + 0.5f) * params.invHeight - params.centreV;
+	float dv2 = dv * dv;
+	for (int i = 0; i < count; i++)
+	{
+		//Pixel centres, same as the GPU brush's fragments.
+		float du = (static_cast<float>(x + i) + 0.5f) * params.invWidth - params.centreU;
+		float distance = std::sqrt(du * du + dv2);
+		float ramp = std::min(std::max((params.uvRadius - distance) * params.falloffScale, 0.f), 1.f);
+		float coverage = distance < params.uvRadius ? source[i * 4 + 3] * params.alpha * ramp : 0.f;
+
+		float dab[4] = { source[i * 4] * coverage, source[i * 4 + 1] * coverage, source[i * 4 + 2] * coverage, coverage };
+		float* pixel = &stroke[i * 4];
+		if (params.flow)
+		{
+			float keep = 1.f - coverage;
+			for (int c = 0; c < 4; c++)
+				pixel[c] = dab[c] + pixel[c] * keep;
+		}
+		else
+		{
+			for (int c = 0; c < 4; c++)
+				pixel[c] = std::max(pixel[c], dab[c]);
+		}
+	}
+}
+
+static void overScalar(const float* top, float* bottom, int count, float opacity)
+{
+	for (int i = 0; i < count; i++)
+	{
+		float keep = 1.f - top[i * 4 + 3] * opacity;
+		for (int c = 0; c < 4; c++)
+			bottom[i * 4 + c] = top[i * 4 + c] * opacity + bottom[i * 4 + c] * keep;
+	}
+}
+
+static const PaintKernels scalarKernels = { unpackRGBA8Scalar, packRGBA8Scalar, unpackRGBA16FScalar, packRGBA16FScalar, dabScalar, overScalar };
+
+#if defined(PAINT_KERNELS_X86)
+
+//SSE4.1. Dabs work on four pixels at a time, transposed so each register holds one channel.
+
+TARGET_SSE4 static __m128 halfToFloatSSE4(__m128i half)
+{
+	__m128i expMant = _mm_and_si128(half, _mm_set1_epi32(0x7fff));
+	__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+	__m128i sign = _mm_slli_epi32(_mm_xor_si128(half, expMant), 16);
+	__m128i infNaN = _mm_and_si128(_mm_cmpgt_epi32(expMant, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+	return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNaN)));
+}
+
+TARGET_SSE4 static __m128i floatToHalfSSE4(__m128 value)
+{
+	const __m128i denormMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+
+	__m128i bits = _mm_castps_si128(value);
+	__m128i sign = _mm_and_si128(bits, _mm_set1_epi32(static_cast<int>(0x80000000u)));
+	bits = _mm_xor_si128(bits, sign);
+
+	__m128i infNaN = _mm_blendv_epi8(_mm_set1_epi32(0x7c00), _mm_set1_epi32(0x7e00), _mm_cmpgt_epi32(bits, _mm_set1_epi32(255 << 23)));
+	__m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(denormMagic))), denormMagic);
+	__m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+	__m128i normal = _mm_add_epi32(bits, _mm_set1_epi32(static_cast<int>(((15u - 127u) << 23) + 0xfffu)));
+	normal = _mm_srli_epi32(_mm_add_epi32(normal, mantissaOdd), 13);
+
+	__m128i half = _mm_blendv_epi8(normal, denormal, _mm_cmplt_epi32(bits, _mm_set1_epi32(113 << 23)));
+	half = _mm_blendv_epi8(half, infNaN, _mm_cmpgt_epi32(bits, _mm_set1_epi32(((127 + 16) << 23) - 1)));
+	return _mm_or_si128(half, _mm_srli_epi32(sign, 16));
+}
+
+TARGET_SSE4 static void unpackRGBA8SSE4(const uint8_t* in, float* out, int count)
+{
+	const __m128 scale = _mm_set1_ps(255.f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4));
+		_mm_storeu_ps(out + i * 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes)), scale));
+		_mm_storeu_ps(out + i * 4 + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4))), scale));
+		_mm_storeu_ps(out + i * 4 + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), scale));
+		_mm_storeu_ps(out + i * 4 + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12))), scale));
+	}
+	unpackRGBA8Scalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_SSE4 static void packRGBA8SSE4(const float* in, uint8_t* out, int count)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 scale = _mm_set1_ps(255.f);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i pixels[4];
+		for (int p = 0; p < 4; p++)
+			pixels[p] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + (i + p) * 4), zero), one), scale));
+		__m128i packed = _mm_packus_epi16(_mm_packus_epi32(pixels[0], pixels[1]), _mm_packus_epi32(pixels[2], pixels[3]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), packed);
+	}
+	packRGBA8Scalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_SSE4 static void unpackRGBA16FSSE4(const uint16_t* in, float* out, int count)
+{
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4));
+		_mm_storeu_ps(out + i * 4, halfToFloatSSE4(_mm_cvtepu16_epi32(halves)));
+		_mm_storeu_ps(out + i * 4 + 4, halfToFloatSSE4(_mm_cvtepu16_epi32(_mm_srli_si128(halves, 8))));
+	}
+	unpackRGBA16FScalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_SSE4 static void packRGBA16FSSE4(const float* in, uint16_t* out, int count)
+{
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i packed = _mm_packus_epi32(floatToHalfSSE4(_mm_loadu_ps(in + i * 4)), floatToHalfSSE4(_mm_loadu_ps(in + i * 4 + 4)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), packed);
+	}
+	packRGBA16FScalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_SSE4 static void dabSSE4(const float* source, float* stroke, int count, int x, int y, const DabRowParams& params)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 invWidth = _mm_set1_ps(params.invWidth);
+	const __m128 centreU = _mm_set1_ps(params.centreU);
+	const __m128 radius = _mm_set1_ps(params.uvRadius);
+	const __m128 falloffScale = _mm_set1_ps(params.falloffScale);
+	const __m128 alpha = _mm_set1_ps(params.alpha);
+	const __m128i laneOffsets = _mm_setr_epi32(0, 1, 2, 3);
+
+	float dv = (static_cast<float>(y) + 0.5f) * params.invHeight - params.centreV;
+	const __m128 dv2 = _mm_set1_ps(dv * dv);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 pixelX = _mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x + i), laneOffsets)), _mm_set1_ps(0.5f));
+		__m128 du = _mm_sub_ps(_mm_mul_ps(pixelX, invWidth), centreU);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(du, du), dv2));
+		__m128 ramp = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(radius, distance), falloffScale), zero), one);
+		__m128 inside = _mm_cmplt_ps(distance, radius);
+
+		__m128 r = _mm_loadu_ps(source + i * 4);
+		__m128 g = _mm_loadu_ps(source + i * 4 + 4);
+		__m128 b = _mm_loadu_ps(source + i * 4 + 8);
+		__m128 a = _mm_loadu_ps(source + i * 4 + 12);
+		_MM_TRANSPOSE4_PS(r, g, b, a);
+		__m128 coverage = _mm_and_ps(_mm_mul_ps(_mm_mul_ps(a, alpha), ramp), inside);
+		r = _mm_mul_ps(r, coverage);
+		g = _mm_mul_ps(g, coverage);
+		b = _mm_mul_ps(b, coverage);
+
+		__m128 strokeR = _mm_loadu_ps(stroke + i * 4);
+		__m128 strokeG = _mm_loadu_ps(stroke + i * 4 + 4);
+		__m128 strokeB = _mm_loadu_ps(stroke + i * 4 + 8);
+		__m128 strokeA = _mm_loadu_ps(stroke + i * 4 + 12);
+		_MM_TRANSPOSE4_PS(strokeR, strokeG, strokeB, strokeA);
+		if (params.flow)
+		{
+			__m128 keep = _mm_sub_ps(one, coverage);
+			strokeR = _mm_add_ps(r, _mm_mul_ps(strokeR, keep));
+			strokeG = _mm_add_ps(g, _mm_mul_ps(strokeG, keep));
+			strokeB = _mm_add_ps(b, _mm_mul_ps(strokeB, keep));
+			strokeA = _mm_add_ps(coverage, _mm_mul_ps(strokeA, keep));
+		}
+		else
+		{
+			//Operand order keeps the stroke's value on ties, like std::max.
+			strokeR = _mm_max_ps(r, strokeR);
+			strokeG = _mm_max_ps(g, strokeG);
+			strokeB = _mm_max_ps(b, strokeB);
+			strokeA = _mm_max_ps(coverage, strokeA);
+		}
+		_MM_TRANSPOSE4_PS(strokeR, strokeG, strokeB, strokeA);
+		_mm_storeu_ps(stroke + i * 4, strokeR);
+		_mm_storeu_ps(stroke + i * 4 + 4, strokeG);
+		_mm_storeu_ps(stroke + i * 4 + 8, strokeB);
+		_mm_storeu_ps(stroke + i * 4 + 12, strokeA);
+	}
+	dabScalar(source + i * 4, stroke + i * 4, count - i, x + i, y, params);
+}
+
+TARGET_SSE4 static void overSSE4(const float* top, float* bottom, int count, float opacity)
+{
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 opacityVector = _mm_set1_ps(opacity);
+	for (int i = 0; i < count; i++)
+	{
+		__m128 scaled = _mm_mul_ps(_mm_loadu_ps(top + i * 4), opacityVector);
+		__m128 keep = _mm_sub_ps(one, _mm_shuffle_ps(scaled, scaled, _MM_SHUFFLE(3, 3, 3, 3)));
+		_mm_storeu_ps(bottom + i * 4, _mm_add_ps(scaled, _mm_mul_ps(_mm_loadu_ps(bottom + i * 4), keep)));
+	}
+}
+
+static const PaintKernels sse4Kernels = { unpackRGBA8SSE4, packRGBA8SSE4, unpackRGBA16FSSE4, packRGBA16FSSE4, dabSSE4, overSSE4 };
+
+//AVX2 with F16C. Dabs work on eight pixels at a time. Pixels i and i + 4 share a register and are transposed within each
+//128 bit lane, which leaves each channel register in pixel order.
+
+TARGET_AVX2 static void transposeLanes(__m256& r, __m256& g, __m256& b, __m256& a)
+{
+	__m256 t0 = _mm256_unpacklo_ps(r, g);
+	__m256 t1 = _mm256_unpackhi_ps(r, g);
+	__m256 t2 = _mm256_unpacklo_ps(b, a);
+	__m256 t3 = _mm256_unpackhi_ps(b, a);
+	r = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	g = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	b = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	a = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+TARGET_AVX2 static void loadPixels8(const float* pixels, __m256& r, __m256& g, __m256& b, __m256& a)
+{
+	r = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels)), _mm_loadu_ps(pixels + 16), 1);
+	g = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 4)), _mm_loadu_ps(pixels + 20), 1);
+	b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 8)), _mm_loadu_ps(pixels + 24), 1);
+	a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pixels + 12)), _mm_loadu_ps(pixels + 28), 1);
+	transposeLanes(r, g, b, a);
+}
+
+TARGET_AVX2 static void storePixels8(float* pixels, __m256 r, __m256 g, __m256 b, __m256 a)
+{
+	transposeLanes(r, g, b, a);
+	_mm_storeu_ps(pixels, _mm256_castps256_ps128(r));
+	_mm_storeu_ps(pixels + 4, _mm256_castps256_ps128(g));
+	_mm_storeu_ps(pixels + 8, _mm256_castps256_ps128(b));
+	_mm_storeu_ps(pixels + 12, _mm256_castps256_ps128(a));
+	_mm_storeu_ps(pixels + 16, _mm256_extractf128_ps(r, 1));
+	_mm_storeu_ps(pixels + 20, _mm256_extractf128_ps(g, 1));
+	_mm_storeu_ps(pixels + 24, _mm256_extractf128_ps(b, 1));
+	_mm_storeu_ps(pixels + 28, _mm256_extractf128_ps(a, 1));
+}
+
+TARGET_AVX2 static void unpackRGBA8AVX2(const uint8_t* in, float* out, int count)
+{
+	const __m256 scale = _mm256_set1_ps(255.f);
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i * 4)));
+		_mm256_storeu_ps(out + i * 4, _mm256_div_ps(_mm256_cvtepi32_ps(values), scale));
+	}
+	unpackRGBA8Scalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_AVX2 static void packRGBA8AVX2(const float* in, uint8_t* out, int count)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 scale = _mm256_set1_ps(255.f);
+	//Packing works within lanes, this puts the pixels back in order.
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i pairs[4];
+		for (int p = 0; p < 4; p++)
+			pairs[p] = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + (i + p * 2) * 4), zero), one), scale));
+		__m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(pairs[0], pairs[1]), _mm256_packus_epi32(pairs[2], pairs[3]));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), _mm256_permutevar8x32_epi32(packed, order));
+	}
+	packRGBA8Scalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_AVX2 static void unpackRGBA16FAVX2(const uint16_t* in, float* out, int count)
+{
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+		_mm256_storeu_ps(out + i * 4, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 4))));
+	unpackRGBA16FScalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_AVX2 static void packRGBA16FAVX2(const float* in, uint16_t* out, int count)
+{
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), _mm256_cvtps_ph(_mm256_loadu_ps(in + i * 4), _MM_FROUND_TO_NEAREST_INT));
+	packRGBA16FScalar(in + i * 4, out + i * 4, count - i);
+}
+
+TARGET_AVX2 static void dabAVX2(const float* source, float* stroke, int count, int x, int y, const DabRowParams& params)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 invWidth = _mm256_set1_ps(params.invWidth);
+	const __m256 centreU = _mm256_set1_ps(params.centreU);
+	const __m256 radius = _mm256_set1_ps(params.uvRadius);
+	const __m256 falloffScale = _mm256_set1_ps(params.falloffScale);
+	const __m256 alpha = _mm256_set1_ps(params.alpha);
+	const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	float dv = (static_cast<float>(y) + 0.5f) * params.invHeight - params.centreV;
+	const __m256 dv2 = _mm256_set1_ps(dv * dv);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 pixelX = _mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x + i), laneOffsets)), _mm256_set1_ps(0.5f));
+		__m256 du = _mm256_sub_ps(_mm256_mul_ps(pixelX, invWidth), centreU);
+		__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(du, du), dv2));
+		__m256 ramp = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(radius, distance), falloffScale), zero), one);
+		__m256 inside = _mm256_cmp_ps(distance, radius, _CMP_LT_OQ);
+
+		__m256 r, g, b, a;
+		loadPixels8(source + i * 4, r, g, b, a);
+		__m256 coverage = _mm256_and_ps(_mm256_mul_ps(_mm256_mul_ps(a, alpha), ramp), inside);
+		r = _mm256_mul_ps(r, coverage);
+		g = _mm256_mul_ps(g, coverage);
+		b = _mm256_mul_ps(b, coverage);
+
+		__m256 strokeR, strokeG, strokeB, strokeA;
+		loadPixels8(stroke + i * 4, strokeR, strokeG, strokeB, strokeA);
+		if (params.flow)
+		{
+			__m256 keep = _mm256_sub_ps(one, coverage);
+			strokeR = _mm256_add_ps(r, _mm256_mul_ps(strokeR, keep));
+			strokeG = _mm256_add_ps(g, _mm256_mul_ps(strokeG, keep));
+			strokeB = _mm256_add_ps(b, _mm256_mul_ps(strokeB, keep));
+			strokeA = _mm256_add_ps(coverage, _mm256_mul_ps(strokeA, keep));
+		}
+		else
+		{
+			strokeR = _mm256_max_ps(r, strokeR);
+			strokeG = _mm256_max_ps(g, strokeG);
+			strokeB = _mm256_max_ps(b, strokeB);
+			strokeA = _mm256_max_ps(coverage, strokeA);
+		}
+		storePixels8(stroke + i * 4, strokeR, strokeG, strokeB, strokeA);
+	}
+	dabScalar(source + i * 4, stroke + i * 4, count - i, x + i, y, params);
+}
+
+TARGET_AVX2 static void overAVX2(const float* top, float* bottom, int count, float opacity)
+{
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 opacityVector = _mm256_set1_ps(opacity);
+	int i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(top + i * 4), opacityVector);
+		__m256 keep = _mm256_sub_ps(one, _mm256_permute_ps(scaled, _MM_SHUFFLE(3, 3, 3, 3)));
+		_mm256_storeu_ps(bottom + i * 4, _mm256_add_ps(scaled, _mm256_mul_ps(_mm256_loadu_ps(bottom + i * 4), keep)));
+	}
+	overScalar(top + i * 4, bottom + i * 4, count - i, opacity);
+}
+
+static const PaintKernels avx2Kernels = { unpackRGBA8AVX2, packRGBA8AVX2, unpackRGBA16FAVX2, packRGBA16FAVX2, dabAVX2, overAVX2 };
+
+static uint64_t readXCR0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+}
+
+#endif
+
+struct CpuFeatures
+{
+	bool sse41 = false;
+	bool avx2 = false;
+};
+
+static CpuFeatures detectCpuFeatures()
+{
+	CpuFeatures features;
+#if defined(PAINT_KERNELS_X86)
+	unsigned int leaf1[4] = {};
+	unsigned int leaf7[4] = {};
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	for (int i = 0; i < 4; i++) leaf1[i] = static_cast<unsigned int>(info[i]);
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		for (int i = 0; i < 4; i++) leaf7[i] = static_cast<unsigned int>(info[i]);
+	}
+#else
+	unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+	__get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+	if (maxLeaf >= 7) __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+	bool osxsave = leaf1[2] & (1u << 27);
+	bool avx = leaf1[2] & (1u << 28);
+	bool f16c = leaf1[2] & (1u << 29);
+	features.sse41 = leaf1[2] & (1u << 19);
+	//The OS has to save the YMM registers as well as the CPU having AVX.
+	bool ymmEnabled = osxsave && (readXCR0() & 6) == 6;
+	features.avx2 = ymmEnabled && avx && f16c && (leaf7[1] & (1u << 5));
+#endif
+	return features;
+}
+
+static const CpuFeatures& getCpuFeatures()
+{
+	static const CpuFeatures features = detectCpuFeatures();
+	return features;
+}
+
+bool isPaintKernelSetSupported(PaintKernelSet set)
+{
+	switch (set)
+	{
+	case PaintKernelSet::Scalar: return true;
+	case PaintKernelSet::SSE4: return getCpuFeatures().sse41;
+	case PaintKernelSet::AVX2: return getCpuFeatures().avx2;
+	}
+	return false;
+}
+
+PaintKernelSet getBestPaintKernelSet()
+{
+	if (isPaintKernelSetSupported(PaintKernelSet::AVX2)) return PaintKernelSet::AVX2;
+	if (isPaintKernelSetSupported(PaintKernelSet::SSE4)) return PaintKernelSet::SSE4;
+	return PaintKernelSet::Scalar;
+}
+
+const PaintKernels& getPaintKernels(PaintKernelSet set)
+{
+#if defined(PAINT_KERNELS_X86)
+	if (isPaintKernelSetSupported(set))
+	{
+		if (set == PaintKernelSet::AVX2) return avx2Kernels;
+		if (set == PaintKernelSet::SSE4) return sse4Kernels;
+	}
+#endif
+	return scalarKernels;
+}
+
+const char* getPaintKernelSetName(PaintKernelSet set)
+{
+	switch (set)
+	{
+	case PaintKernelSet::Scalar: return "scalar";
+	case PaintKernelSet::SSE4: return "sse4";
+	case PaintKernelSet::AVX2: return "avx2";
+	}
+	return "unknown";
+}
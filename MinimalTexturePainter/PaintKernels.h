@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+
+//Row kernels behind CpuPaintEngine, in scalar, SSE4.1 and AVX2 versions.
+//Every set does the same float operations in the same order, so they agree bit for bit and scalar is the reference.
+enum class PaintKernelSet
+{
+	Scalar,
+	SSE4,
+	AVX2
+};
+
+//One dab, prepared by CpuPaintEngine. Positions are in target UVs like the GPU brush.
+struct DabRowParams
+{
+	float centreU;
+	float centreV;
+	float invWidth;
+	float invHeight;
+	float uvRadius;
+	//Turns the distance inside the edge into a 0 to 1 ramp. Very large for a hard edge.
+	float falloffScale;
+	float alpha;
+	bool flow;
+};
+
+//Pixels are interleaved RGBA. Paint maths happens on float rows, the pack and unpack kernels convert tile storage.
+struct PaintKernels
+{
+	void (*unpackRGBA8)(const uint8_t* in, float* out, int count);
+	void (*packRGBA8)(const float* in, uint8_t* out, int count);
+	void (*unpackRGBA16F)(const uint16_t* in, float* out, int count);
+	void (*packRGBA16F)(const float* in, uint16_t* out, int count);
+	//Accumulates a dab into a premultiplied stroke row that starts at target pixel (x, y). Source is straight colour.
+	void (*dab)(const float* source, float* stroke, int count, int x, int y, const DabRowParams& params);
+	//Premultiplied top over bottom, with top scaled by opacity first.
+	void (*over)(const float* top, float* bottom, int count, float opacity);
+};
+
+bool isPaintKernelSetSupported(PaintKernelSet set);
+
+PaintKernelSet getBestPaintKernelSet();
+
+//Falls back to scalar for sets the CPU doesn't support.
+const PaintKernels& getPaintKernels(PaintKernelSet set);
+
+const char* getPaintKernelSetName(PaintKernelSet set);
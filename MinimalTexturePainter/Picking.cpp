@@ -0,0 +1,47 @@
+#include "Picking.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+void getCursorRay(const glm::mat4& view, const glm::mat4& projection, double x, double y, int width, int height, glm::vec3& start, glm::vec3& end)
+{
+	//unProject takes window coordinates with y up and depth in [0, 1].
+	glm::vec4 viewport(0, 0, width, height);
+	glm::vec2 window(static_cast<float>(x), static_cast<float>(height - y));
+	start = glm::unProject(glm::vec3(window, 0.f), view, projection, viewport);
+	end = glm::unProject(glm::vec3(window, 1.f), view, projection, viewport);
+}
+
+bool pickObjects(const std::vector<WorldObject>& objects, const glm::vec3& start, const glm::vec3& end, PickHit& hit)
+{
+	bool found = false;
+	float nearest = 1.f;
+	for (size_t o = 0; o < objects.size(); o++)
+	{
+		//An affine transform keeps distances along the segment, so hits in different objects compare directly.
+		glm::mat4 toModel = glm::inverse(objects[o].getTransform());
+		glm::vec3 origin = glm::vec3(toModel * glm::vec4(start, 1.f));
+		glm::vec3 direction = glm::vec3(toModel * glm::vec4(end - start, 0.f));
+
+		const Model& model = objects[o].getModel();
+		for (size_t m = 0; m < model.meshes.size(); m++)
+		{
+			const Mesh& mesh = model.meshes[m];
+			MeshBVH::Hit meshHit;
+			if (!mesh.bvh.intersect(origin, direction, nearest, meshHit)) continue;
+			nearest = meshHit.distance;
+			found = true;
+
+			const glm::vec2& uv0 = mesh.vertices[mesh.indices[meshHit.triangle * 3]].texCoords;
+			const glm::vec2& uv1 = mesh.vertices[mesh.indices[meshHit.triangle * 3 + 1]].texCoords;
+			const glm::vec2& uv2 = mesh.vertices[mesh.indices[meshHit.triangle * 3 + 2]].texCoords;
+			glm::vec2 weights = meshHit.barycentrics;
+			hit.object = o;
+			hit.mesh = m;
+			hit.triangle = meshHit.triangle;
+			hit.barycentrics = weights;
+			hit.uv = uv0 * (1.f - weights.x - weights.y) + uv1 * weights.x + uv2 * weights.y;
+			hit.distance = meshHit.distance;
+		}
+	}
+	return found;
+}
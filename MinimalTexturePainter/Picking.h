@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "WorldObject.h"
+
+//The nearest surface under a ray, found on the CPU through each mesh's BVH.
+struct PickHit
+{
+	//Index into the objects, of the mesh in the object's model and of the triangle in the mesh.
+	size_t object;
+	size_t mesh;
+	uint32_t triangle;
+	//Weights of the triangle's second and third corners. The first corner gets the rest.
+	glm::vec2 barycentrics;
+	//Texture coordinates interpolated at the hit.
+	glm::vec2 uv;
+	//0 at the start of the segment and 1 at its end.
+	float distance;
+};
+
+//The segment through a point in the window from the camera's near plane to its far plane, so picking finds what the
+//camera shows there. x and y are window coordinates with y down, as GLFW gives the cursor.
+void getCursorRay(const glm::mat4& view, const glm::mat4& projection, double x, double y, int width, int height, glm::vec3& start, glm::vec3& end);
+
+//Nearest hit on the segment from start to end. The BVHs are in model space, so the segment is moved into each object's
+//space rather than any triangles out of it.
+bool pickObjects(const std::vector<WorldObject>& objects, const glm::vec3& start, const glm::vec3& end, PickHit& hit);
@@ -4,7 +4,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "CpuProfiler.h"
 #include "DirectionalLight.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
 #include "Shader.h"
 #include "WorldObject.h"
 
@@ -14,38 +17,41 @@ Renderer::Renderer(const Shader mainShader, const Shader shadowShader, const uns
 {
 	this->shadowWidth = shadowWidth;
 	this->shadowHeight = shadowHeight;
-	glGenFramebuffers(1, &shadowMapFramebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFramebuffer);
-	glGenTextures(1, &shadowMapTexture);
-	glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowWidth, shadowHeight, 0, GL_DEPTH_COMPONENT,
-	             GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMapTexture, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	shadowMapTexture = createTexture2D(GL_DEPTH_COMPONENT24, shadowWidth, shadowHeight);
+	setTextureParameter(shadowMapTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	setTextureParameter(shadowMapTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	setTextureParameter(shadowMapTexture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	setTextureParameter(shadowMapTexture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	shadowMapFramebuffer = createFramebuffer();
+	attachFramebufferTexture(shadowMapFramebuffer, GL_DEPTH_ATTACHMENT, shadowMapTexture);
+	setFramebufferBuffers(shadowMapFramebuffer, GL_NONE, GL_NONE);
 }
 
-void Renderer::render(const unsigned int framebuffer, const CameraParams& cameraParams, const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight, const int width, const int height)
+glm::mat4 Renderer::getLightSpace(const DirectionalLight& directionalLight)
 {
-	//Shadow mapping pass.
-	glViewport(0, 0, shadowWidth, shadowHeight);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFramebuffer);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	shadowShader.useProgram();
-
 	constexpr float nearPlane = 1.0f;
 	constexpr float farPlane = 20.0f;
 	glm::mat4 lightProjection = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, nearPlane, farPlane);
 	glm::mat4 lightView = glm::lookAt(-glm::normalize(directionalLight.direction) * 10.f,
 		glm::vec3(0.0f),
 		glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 lightSpace = lightProjection * lightView;
-	shadowShader.setMat4("lightSpaceMatrix", lightSpace);
+	return lightProjection * lightView;
+}
+
+void Renderer::render(const unsigned int framebuffer, const CameraParams& cameraParams, const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight, const int width, const int height)
+{
+	renderShadowPass(objects, directionalLight);
+	renderMainPass(framebuffer, cameraParams, objects, directionalLight, width, height);
+}
+
+void Renderer::renderShadowPass(const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight)
+{
+	PROFILE_ZONE("Shadow Submit");
+	glViewport(0, 0, shadowWidth, shadowHeight);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFramebuffer);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	shadowShader.useProgram();
+	shadowShader.setMat4("lightSpaceMatrix", getLightSpace(directionalLight));
 
 	for (const WorldObject& object : objects)
 	{
@@ -56,9 +62,16 @@ void Renderer::render(const unsigned int framebuffer, const CameraParams& camera
 		object.getModel().draw(shadowShader);
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	shadowMapValid = true;
+	shadowLightDirection = directionalLight.direction;
+	shadowCasters.clear();
+	for (const WorldObject& object : objects)
+		shadowCasters.emplace_back(&object.getModel(), object.getTransform());
+}
 
-	//Main pass.
+void Renderer::renderMainPass(const unsigned int framebuffer, const CameraParams& cameraParams, const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight, const int width, const int height)
+{
+	PROFILE_ZONE("Main Submit");
 	glViewport(0, 0, width, height);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -77,12 +90,10 @@ void Renderer::render(const unsigned int framebuffer, const CameraParams& camera
 	mainShader.setVec3("dirLight.diffuse", directionalLight.diffuse);
 	mainShader.setVec3("dirLight.specular", directionalLight.specular);
 
-	glActiveTexture(GL_TEXTURE15);
 	glUniform1i(glGetUniformLocation(mainShader.getID(), "shadowMap"), 15);
-	glBindTexture(GL_TEXTURE_2D, shadowMapTexture);
-	glActiveTexture(GL_TEXTURE0);
+	bindTextures(15, 1, &shadowMapTexture);
 
-	mainShader.setMat4("lightSpaceMatrix", lightSpace);
+	mainShader.setMat4("lightSpaceMatrix", getLightSpace(directionalLight));
 
 	for (const WorldObject& object : objects)
 	{
@@ -92,6 +103,39 @@ void Renderer::render(const unsigned int framebuffer, const CameraParams& camera
 
 		object.getModel().draw(mainShader);
 	}
+}
+
+bool Renderer::isShadowMapCurrent(const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight) const
+{
+	if (!shadowMapValid || shadowLightDirection != directionalLight.direction || shadowCasters.size() != objects.size()) return false;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (shadowCasters[i].first != &objects[i].getModel() || shadowCasters[i].second != objects[i].getTransform()) return false;
+	}
+	return true;
+}
+
+void Renderer::invalidateShadowMap()
+{
+	shadowMapValid = false;
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+unsigned int Renderer::getShadowMapTexture() const
+{
+	return shadowMapTexture;
+}
+
+unsigned int Renderer::getShadowMapFramebuffer() const
+{
+	return shadowMapFramebuffer;
+}
+
+unsigned int Renderer::getShadowWidth() const
+{
+	return shadowWidth;
+}
+
+unsigned int Renderer::getShadowHeight() const
+{
+	return shadowHeight;
 }
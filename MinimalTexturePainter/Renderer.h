@@ -1,10 +1,12 @@
 #pragma once
+#include <utility>
 #include <vector>
 #include <glm/glm.hpp>
 
 #include "Shader.h"
 
 struct DirectionalLight;
+class Model;
 class WorldObject;
 
 struct CameraParams
@@ -26,9 +28,38 @@ private:
 	Shader mainShader;
 	Shader shadowShader;
 
+	//What the shadow map was last rendered from.
+	bool shadowMapValid = false;
+	glm::vec3 shadowLightDirection;
+	std::vector<std::pair<const Model*, glm::mat4>> shadowCasters;
+
+	static glm::mat4 getLightSpace(const DirectionalLight& directionalLight);
+
 public:
 	Renderer(const Shader mainShader, const Shader shadowShader, const unsigned int shadowWidth, const unsigned int shadowHeight);
 
+	//Shadow pass followed by the main pass.
 	void render(const unsigned int framebuffer, const CameraParams& cameraParams, const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight, const int width, const int height);
+
+	//Renders the objects' depth from the light into the shadow map. Both passes leave their framebuffer bound.
+	void renderShadowPass(const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight);
+
+	//Renders the lit objects into framebuffer using the shadow map from the last shadow pass.
+	void renderMainPass(const unsigned int framebuffer, const CameraParams& cameraParams, const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight, const int width, const int height);
+
+	//Whether the last shadow pass was rendered with the same light and the same models at the same transforms, so the
+	//shadow map would come out the same. Models are compared by address.
+	bool isShadowMapCurrent(const std::vector<WorldObject>& objects, const DirectionalLight& directionalLight) const;
+
+	//Call when a model is replaced, since the new one can be given the old one's address.
+	void invalidateShadowMap();
+
+	unsigned int getShadowMapTexture() const;
+
+	unsigned int getShadowMapFramebuffer() const;
+
+	unsigned int getShadowWidth() const;
+
+	unsigned int getShadowHeight() const;
 };
 
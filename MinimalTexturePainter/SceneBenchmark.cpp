@@ -0,0 +1,689 @@
+#include "SceneBenchmark.h"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "CpuProfiler.h"
+#include "DirectionalLight.h"
+#include "GLCallStats.h"
+#include "GLStateCache.h"
+#include "GLExtensions.h"
+#include "GLResources.h"
+#include "HeadlessContext.h"
+#include "Picking.h"
+#include "Image.h"
+#include "ImageEncoder.h"
+#include "LayerStack.h"
+#include "Renderer.h"
+#include "StrokeLog.h"
+#include "StrokeScript.h"
+#include "TextureBlender.h"
+#include "TextureCache.h"
+#include "TextureExporter.h"
+#include "TextureUploader.h"
+#include "ThreadPool.h"
+#include "WorldObject.h"
+
+static constexpr int width = 1280;
+static constexpr int height = 720;
+static constexpr int warmupFrames = 10;
+//Frames for one turn of the camera around the model.
+static constexpr int orbitFrames = 240;
+//Same brush scale as the editor.
+static constexpr unsigned int brushTexSize = 4096;
+
+enum Pass
+{
+	PassPick,
+	PassShadow,
+	PassMain,
+	PassBlend,
+	PassResolve,
+	PassFrame,
+	passCount
+};
+
+static const char* passNames[passCount] = { "pick", "shadow", "main", "blend", "resolve", "frame" };
+
+//UV sphere of rings * segments quads.
+struct ReferenceModel
+{
+	const char* name;
+	int rings;
+	int segments;
+	//Rows of rings are split evenly into this many OBJ objects, which Assimp loads as separate meshes.
+	int meshes;
+};
+
+//About 16K, 1M and 5M triangles in one mesh, then 64K split into 1024 meshes for per draw overhead.
+static const ReferenceModel referenceModels[] = { { "small", 64, 128, 1 }, { "1m", 512, 1024, 1 }, { "5m", 1152, 2176, 1 }, { "many", 1024, 32, 1024 } };
+
+struct SceneBenchmarkOptions
+{
+	std::string outputPath = "benchmark.json";
+	std::string strokesPath;
+	//CPU zones of the whole run as a Chrome trace, if set.
+	std::string tracePath;
+	int frames = 300;
+	bool stateFiltering = true;
+	bool directStateAccess = true;
+	std::vector<std::string> referenceModels = { "small", "1m", "5m", "many" };
+	std::vector<std::string> models;
+};
+
+struct ModelResult
+{
+	std::string name;
+	size_t triangles = 0;
+	double loadSeconds = 0;
+	double saveSeconds = 0;
+	size_t peakMemoryBytes = 0;
+	std::vector<double> passMs[passCount];
+	//CPU time to issue each pass's calls, before waiting for the GPU.
+	std::vector<double> submitMs[passCount];
+	//Summed over the measured frames.
+	GLCallStats glCalls;
+};
+
+//Everything that holds GL objects for one model's run, so nothing cached by an earlier model makes a later one faster.
+struct BenchmarkScene
+{
+	Shader blendShader;
+	Shader compositeShader;
+	Renderer renderer;
+	TextureUploader textureUploader;
+	TextureCache textureCache;
+	TextureExporter textureExporter;
+
+	unsigned int mainFramebuffer, mainTexture, mainDepth;
+	//A headless context has no default framebuffer, so the render is put on this instead of the screen.
+	unsigned int screenFramebuffer, screenTexture, screenDepth;
+
+	static void createRenderTarget(GLenum internalFormat, unsigned int& framebuffer, unsigned int& texture, unsigned int& depth)
+	{
+		framebuffer = createFramebuffer();
+		texture = createTexture2D(internalFormat, width, height);
+		attachFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, texture);
+		depth = createRenderbuffer(GL_DEPTH24_STENCIL8, width, height);
+		attachFramebufferRenderbuffer(framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, depth);
+	}
+
+	BenchmarkScene(ThreadPool& threadPool):
+		blendShader("blend.vert", "blend.frag"),
+		compositeShader("composite.vert", "composite.frag"),
+		renderer(Shader("default.vert", "default.frag"), Shader("shadow.vert", "shadow.frag"), 4096, 4096),
+		textureCache(textureUploader),
+		textureExporter(threadPool)
+	{
+		//Same format as the editor's main target.
+		createRenderTarget(GL_RGB8, mainFramebuffer, mainTexture, mainDepth);
+		createRenderTarget(GL_RGBA8, screenFramebuffer, screenTexture, screenDepth);
+	}
+
+	~BenchmarkScene()
+	{
+		glDeleteRenderbuffers(1, &mainDepth);
+		glDeleteTextures(1, &mainTexture);
+		glDeleteFramebuffers(1, &mainFramebuffer);
+		glDeleteRenderbuffers(1, &screenDepth);
+		glDeleteTextures(1, &screenTexture);
+		glDeleteFramebuffers(1, &screenFramebuffer);
+	}
+};
+
+//Peak resident memory of the whole process so far, so it never goes down from one model to the next.
+static size_t getPeakMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	//Kilobytes on Linux.
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Gradients with noise, written once and shared by every reference model.
+static bool writeReferenceTexture(const std::filesystem::path& path, ThreadPool& threadPool)
+{
+	if (std::filesystem::exists(path)) return true;
+
+	constexpr int size = 2048;
+	std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 3);
+	unsigned int seed = 12345;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			unsigned char* pixel = &pixels[(static_cast<size_t>(y) * size + x) * 3];
+			for (int c = 0; c < 3; c++)
+				pixel[c] = static_cast<unsigned char>(((x >> 3) * (c + 1) + (y >> 4) + ((seed >> 24) & 15)) & 255);
+		}
+	}
+	std::vector<unsigned char> encoded;
+	if (!encodeImage(ImageFormat::Png, pixels.data(), size, size, 3, false, 100, threadPool, encoded)) return false;
+
+	FILE* file = fopen(path.u8string().c_str(), "wb");
+	if (!file) return false;
+	bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+	return fclose(file) == 0 && written;
+}
+
+//Writes the reference model as OBJ unless an earlier run already has. It is written under a temporary name first so an
+//interrupted run doesn't leave half a model behind.
+static bool writeReferenceModel(const ReferenceModel& reference, const std::filesystem::path& directory, ThreadPool& threadPool,
+	std::filesystem::path& path)
+{
+	if (!writeReferenceTexture(directory / "reference_diffuse.png", threadPool)) return false;
+	std::filesystem::path materialPath = directory / "reference.mtl";
+	if (!std::filesystem::exists(materialPath))
+	{
+		FILE* material = fopen(materialPath.u8string().c_str(), "w");
+		if (!material) return false;
+		fprintf(material, "newmtl reference\nKd 1 1 1\nmap_Kd reference_diffuse.png\n");
+		fclose(material);
+	}
+
+	path = directory / (std::string("reference_") + reference.name + "_v1.obj");
+	if (std::filesystem::exists(path)) return true;
+
+	std::filesystem::path temporaryPath = path;
+	temporaryPath += ".tmp";
+	FILE* file = fopen(temporaryPath.u8string().c_str(), "w");
+	if (!file) return false;
+	std::vector<char> buffer(1 << 20);
+	setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+	fprintf(file, "mtllib reference.mtl\n");
+	constexpr float pi = 3.14159265358979f;
+	for (int ring = 0; ring <= reference.rings; ring++)
+	{
+		float theta = pi * ring / reference.rings;
+		for (int segment = 0; segment <= reference.segments; segment++)
+		{
+			float phi = 2.f * pi * segment / reference.segments;
+			glm::vec3 position(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			fprintf(file, "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\nvt %.6f %.6f\n", position.x, position.y, position.z,
+				position.x, position.y, position.z, static_cast<float>(segment) / reference.segments, 1.f - static_cast<float>(ring) / reference.rings);
+		}
+	}
+	fprintf(file, "usemtl reference\n");
+	int rowLength = reference.segments + 1;
+	int group = -1;
+	for (int ring = 0; ring < reference.rings; ring++)
+	{
+		if (reference.meshes > 1 && ring * reference.meshes / reference.rings != group)
+		{
+			group = ring * reference.meshes / reference.rings;
+			fprintf(file, "o part%d\n", group);
+		}
+		for (int segment = 0; segment < reference.segments; segment++)
+		{
+			//OBJ indices start at 1.
+			int a = ring * rowLength + segment + 1;
+			int b = a + 1;
+			int c = a + rowLength;
+			int d = c + 1;
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, d, d, d, b, b, b, a, a, a, c, c, c, d, d, d);
+		}
+	}
+	bool written = !ferror(file);
+	written &= fclose(file) == 0;
+	if (!written) return false;
+
+	std::error_code renameError;
+	std::filesystem::rename(temporaryPath, path, renameError);
+	return !renameError;
+}
+
+//Zigzags across the texture in both accumulation modes, used when no strokes are given.
+static std::vector<LoggedStroke> makeCannedStrokes()
+{
+	constexpr int strokeCount = 8;
+	constexpr int samplesPerStroke = 60;
+	std::vector<LoggedStroke> strokes(strokeCount);
+	for (int i = 0; i < strokeCount; i++)
+	{
+		LoggedStroke& stroke = strokes[i];
+		bool flow = i % 2 == 1;
+		stroke.settings.channels = StrokeChannelDiffuse;
+		stroke.settings.accumulation = flow ? TextureBlender::Accumulation::Flow : TextureBlender::Accumulation::Max;
+		stroke.settings.brushSize = 16.f + 8.f * i;
+		stroke.settings.opacity = 0.8f;
+		for (int s = 0; s < samplesPerStroke; s++)
+		{
+			float t = static_cast<float>(s) / (samplesPerStroke - 1);
+			glm::vec2 uv(0.05f + 0.9f * t, (i + 0.5f) / strokeCount + 0.04f * std::sin(t * 12.f));
+			stroke.samples.push_back(StrokeSample{ s / 60.f, uv, flow ? 0.05f : 1.f });
+		}
+	}
+	return strokes;
+}
+
+//Reads a stroke log, or a stroke script with one sample per dab.
+static bool loadStrokes(const std::string& path, std::vector<LoggedStroke>& strokes, std::string& error)
+{
+	if (std::filesystem::u8path(path).extension() == ".mtps") return readStrokeLog(path, strokes, error);
+
+	std::vector<ScriptStroke> script;
+	if (!loadStrokeScript(path, script, error)) return false;
+	strokes.clear();
+	for (const ScriptStroke& scriptStroke : script)
+	{
+		LoggedStroke stroke;
+		stroke.settings.channels = StrokeChannelDiffuse;
+		stroke.settings.accumulation = scriptStroke.accumulation;
+		stroke.settings.opacity = scriptStroke.opacity;
+		stroke.settings.brushSize = scriptStroke.brushSize;
+		stroke.settings.sourceScale = scriptStroke.sourceScale;
+		float alpha = scriptStroke.accumulation == TextureBlender::Accumulation::Max ? 1.f : scriptStroke.alpha;
+		for (size_t i = 0; i < scriptStroke.dabs.size(); i++)
+			stroke.samples.push_back(StrokeSample{ i / 60.f, scriptStroke.dabs[i], alpha });
+		strokes.push_back(std::move(stroke));
+	}
+	return true;
+}
+
+//Orbits the model, bobbing up and down, at the editor's field of view.
+static CameraParams getOrbitCamera(int frame)
+{
+	constexpr float pi = 3.14159265358979f;
+	float angle = 2.f * pi * frame / orbitFrames;
+	glm::vec3 position(3.f * std::sin(angle), 0.8f * std::sin(angle * 2.f), 3.f * std::cos(angle));
+	return CameraParams{ position, glm::normalize(-position), glm::vec3(0.0f, 1.0f, 0.0f), glm::radians(60.f), (float)width / (float)height };
+}
+
+static unsigned int createBrushTexture(TextureUploader& textureUploader)
+{
+	constexpr int size = 512;
+	Image brush;
+	brush.width = size;
+	brush.height = size;
+	brush.components = 3;
+	brush.pixels = std::shared_ptr<unsigned char>(new unsigned char[size * size * 3], std::default_delete<unsigned char[]>());
+	for (int i = 0; i < size * size * 3; i++)
+		brush.pixels.get()[i] = static_cast<unsigned char>((i * 2654435761u) >> 24);
+	unsigned int texture = textureUploader.createTexture(brush, true, GL_LINEAR_MIPMAP_LINEAR);
+	textureUploader.flush();
+	return texture;
+}
+
+static bool benchmarkModel(ThreadPool& threadPool, const std::string& modelPath, const std::vector<LoggedStroke>& strokes, int frames,
+	const std::filesystem::path& directory, ModelResult& result, std::string& error)
+{
+	BenchmarkScene scene(threadPool);
+	unsigned int brush = createBrushTexture(scene.textureUploader);
+
+	auto loadStart = std::chrono::steady_clock::now();
+	std::vector<WorldObject> worldObjects;
+	worldObjects.emplace_back(glm::mat4(1.f), std::make_shared<Model>(modelPath.c_str(), threadPool, scene.textureCache));
+	scene.textureUploader.flush();
+	Model& model = worldObjects.front().getModel();
+	if (model.meshes.empty())
+	{
+		glDeleteTextures(1, &brush);
+		error = "Failed to load " + modelPath;
+		return false;
+	}
+
+	//Only diffuse is painted, the reference models have nothing else.
+	std::unique_ptr<LayerStack> layers;
+	std::unique_ptr<TextureBlender> blender;
+	for (const Texture& texture : model.textures_loaded)
+	{
+		if (texture.type != "texture_diffuse" || !texture.id) continue;
+		layers = std::make_unique<LayerStack>(scene.compositeShader, texture.id);
+		model.replaceTexture(texture.id, layers->getCompositeTexture());
+		blender = std::make_unique<TextureBlender>(scene.blendShader, layers->getWidth(), layers->getHeight(), brush);
+		break;
+	}
+	glFinish();
+	result.loadSeconds = millisecondsSince(loadStart) / 1000.0;
+	for (const Mesh& mesh : model.meshes)
+		result.triangles += mesh.indices.size() / 3;
+	if (!layers) printf("%s has no diffuse texture, nothing will be painted\n", modelPath.c_str());
+
+	DirectionalLight dirLight{ glm::normalize(glm::vec3(1, -0.5f, 0.3f)),
+		glm::vec3(0.1f, 0.1f, 0.1f),
+		glm::vec3(1.6f, 1.6f, 1.6f),
+		glm::vec3(2.0f, 2.0f, 2.0f) };
+
+	glEnable(GL_DEPTH_TEST);
+	size_t strokeIndex = 0;
+	size_t sampleIndex = 0;
+	for (int frame = 0; frame < warmupFrames + frames; frame++)
+	{
+		CameraParams cameraParams = getOrbitCamera(frame);
+		double passMs[passCount] = {};
+		double submitMs[passCount] = {};
+		resetGLCallStats();
+		auto frameStart = std::chrono::steady_clock::now();
+		auto passStart = frameStart;
+		//Waiting for the GPU at the end of each pass puts its work in that pass. It serialises the frame, so totals are
+		//higher than in the editor, but they compare between runs.
+		auto endPass = [&](Pass pass)
+		{
+			submitMs[pass] += millisecondsSince(passStart);
+			glFinish();
+			passMs[pass] += millisecondsSince(passStart);
+			passStart = std::chrono::steady_clock::now();
+		};
+
+		//Same CPU ray cast as the editor, through the middle of the screen. The painted UVs come from the strokes, so the
+		//result is unused.
+		{
+			glm::mat4 view = glm::lookAt(cameraParams.position, cameraParams.position + cameraParams.forward, cameraParams.up);
+			glm::mat4 projection = glm::perspective(cameraParams.fov, cameraParams.aspect, 0.1f, 100.0f);
+			glm::vec3 start, end;
+			getCursorRay(view, projection, width * 0.5, height * 0.5, width, height, start, end);
+			PickHit hit;
+			pickObjects(worldObjects, start, end, hit);
+		}
+		endPass(PassPick);
+
+		//One sample per frame, like the editor.
+		if (blender)
+		{
+			const LoggedStroke& stroke = strokes[strokeIndex];
+			const StrokeSettings& settings = stroke.settings;
+			if (sampleIndex == 0)
+			{
+				blender->beginStroke();
+				layers->setStroke(&blender->getStrokeBuffer(), settings.opacity);
+			}
+			const StrokeSample& sample = stroke.samples[sampleIndex];
+			blender->blend(sample.uv, settings.brushSize, sample.alpha, settings.sourceScale, brushTexSize, settings.accumulation);
+			layers->markDirty(sample.uv, settings.brushSize / brushTexSize);
+			if (++sampleIndex == stroke.samples.size())
+			{
+				layers->commitStroke();
+				sampleIndex = 0;
+				strokeIndex = (strokeIndex + 1) % strokes.size();
+			}
+		}
+		endPass(PassBlend);
+
+		//Resolve is the layer recomposite before the main pass plus getting the render on screen after it.
+		if (layers) layers->update();
+		endPass(PassResolve);
+
+		scene.renderer.renderShadowPass(worldObjects, dirLight);
+		endPass(PassShadow);
+
+		scene.renderer.renderMainPass(scene.mainFramebuffer, cameraParams, worldObjects, dirLight, width, height);
+		endPass(PassMain);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, scene.mainFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scene.screenFramebuffer);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		endPass(PassResolve);
+
+		passMs[PassFrame] = millisecondsSince(frameStart);
+		for (int pass = 0; pass < PassFrame; pass++)
+			submitMs[PassFrame] += submitMs[pass];
+		if (frame < warmupFrames) continue;
+		for (int pass = 0; pass < passCount; pass++)
+		{
+			result.passMs[pass].push_back(passMs[pass]);
+			result.submitMs[pass].push_back(submitMs[pass]);
+		}
+		result.glCalls += getGLCallStats();
+	}
+
+	//Saves the painted texture, or the last frame if there was nothing to paint.
+	if (layers && sampleIndex != 0) layers->commitStroke();
+	auto saveStart = std::chrono::steady_clock::now();
+	if (layers) layers->update();
+	std::string savePath = (directory / (result.name + "_saved.png")).u8string();
+	scene.textureExporter.exportTexture(layers ? layers->getCompositeTexture() : scene.mainTexture, savePath);
+	scene.textureExporter.flush();
+	result.saveSeconds = millisecondsSince(saveStart) / 1000.0;
+	bool saved = scene.textureExporter.getLastFinished().stage != TextureExporter::Stage::Failed;
+
+	blender.reset();
+	layers.reset();
+	worldObjects.clear();
+	glDeleteTextures(1, &brush);
+	result.peakMemoryBytes = getPeakMemoryBytes();
+
+	if (!saved)
+	{
+		error = "Failed to write " + savePath;
+		return false;
+	}
+	return true;
+}
+
+//Nearest rank percentile of sorted values.
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+static std::string jsonString(const std::string& value)
+{
+	std::string escaped = "\"";
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\') escaped += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20) escaped += c;
+	}
+	return escaped + "\"";
+}
+
+static bool writeResults(const std::string& path, int frames, const std::vector<ModelResult>& results)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+	const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+	fprintf(file, "{\n  \"version\": 1,\n  \"renderer\": %s,\n  \"glVersion\": %s,\n", jsonString(renderer ? renderer : "").c_str(),
+		jsonString(version ? version : "").c_str());
+	fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n  \"warmupFrames\": %d,\n  \"frames\": %d,\n  \"stateFiltering\": %s,\n  \"directStateAccess\": %s,\n  \"models\": [\n",
+		width, height, warmupFrames, frames, isGLStateFiltering() ? "true" : "false", isGLDirectStateAccess() ? "true" : "false");
+	for (size_t m = 0; m < results.size(); m++)
+	{
+		const ModelResult& result = results[m];
+		fprintf(file, "    {\n      \"name\": %s,\n      \"triangles\": %zu,\n      \"loadSeconds\": %.4f,\n      \"saveSeconds\": %.4f,\n"
+			"      \"peakMemoryBytes\": %zu,\n      \"passes\": {\n", jsonString(result.name).c_str(), result.triangles, result.loadSeconds,
+			result.saveSeconds, result.peakMemoryBytes);
+		for (int pass = 0; pass < passCount; pass++)
+		{
+			std::vector<double> sorted = result.passMs[pass];
+			std::sort(sorted.begin(), sorted.end());
+			double mean = 0;
+			for (double ms : sorted)
+				mean += ms / sorted.size();
+			double submitMean = 0;
+			for (double ms : result.submitMs[pass])
+				submitMean += ms / result.submitMs[pass].size();
+			fprintf(file, "        \"%s\": { \"meanMs\": %.4f, \"p50Ms\": %.4f, \"p90Ms\": %.4f, \"p99Ms\": %.4f, \"maxMs\": %.4f, \"submitMeanMs\": %.4f }%s\n",
+				passNames[pass], mean, percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), sorted.back(), submitMean,
+				pass + 1 < passCount ? "," : "");
+		}
+		const GLCallStats& calls = result.glCalls;
+		double perFrame = 1.0 / std::max(frames, 1);
+		fprintf(file, "      },\n      \"glCallsPerFrame\": { \"draws\": %.1f, \"dispatches\": %.1f, \"programBinds\": %.1f, \"redundantProgramBinds\": %.1f,\n"
+			"        \"textureBinds\": %.1f, \"redundantTextureBinds\": %.1f, \"activeTextureSets\": %.1f, \"redundantActiveTextureSets\": %.1f,\n"
+			"        \"framebufferBinds\": %.1f, \"redundantFramebufferBinds\": %.1f, \"vertexArrayBinds\": %.1f, \"redundantVertexArrayBinds\": %.1f,\n"
+			"        \"bufferBinds\": %.1f, \"uniformUploads\": %.1f }\n    }%s\n",
+			calls.draws * perFrame, calls.dispatches * perFrame, calls.programBinds * perFrame, calls.redundantProgramBinds * perFrame,
+			calls.textureBinds * perFrame, calls.redundantTextureBinds * perFrame, calls.activeTextureSets * perFrame,
+			calls.redundantActiveTextureSets * perFrame, calls.framebufferBinds * perFrame, calls.redundantFramebufferBinds * perFrame,
+			calls.vertexArrayBinds * perFrame, calls.redundantVertexArrayBinds * perFrame, calls.bufferBinds * perFrame,
+			calls.uniformUploads * perFrame, m + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	bool written = !ferror(file);
+	return fclose(file) == 0 && written;
+}
+
+static bool parseOptions(int argc, char* argv[], SceneBenchmarkOptions& options)
+{
+	//argv[1] is --benchmark-scene.
+	bool explicitReferences = false;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--out" && hasValue) options.outputPath = argv[++i];
+		else if (argument == "--frames" && hasValue) options.frames = std::max(atoi(argv[++i]), 1);
+		else if (argument == "--strokes" && hasValue) options.strokesPath = argv[++i];
+		else if (argument == "--trace" && hasValue) options.tracePath = argv[++i];
+		else if (argument == "--no-state-filter") options.stateFiltering = false;
+		else if (argument == "--no-dsa") options.directStateAccess = false;
+		else if (argument == "--models" && hasValue)
+		{
+			explicitReferences = true;
+			options.referenceModels.clear();
+			std::string list = argv[++i];
+			for (size_t start = 0; start <= list.size();)
+			{
+				size_t comma = std::min(list.find(',', start), list.size());
+				std::string name = list.substr(start, comma - start);
+				bool known = std::any_of(std::begin(referenceModels), std::end(referenceModels), [&name](const ReferenceModel& reference) { return name == reference.name; });
+				if (!known) return false;
+				options.referenceModels.push_back(name);
+				start = comma + 1;
+			}
+		}
+		else if (argument.rfind("--", 0) == 0) return false;
+		else options.models.push_back(argument);
+	}
+	//Models given by path replace the reference set unless it was asked for too.
+	if (!options.models.empty() && !explicitReferences) options.referenceModels.clear();
+	return true;
+}
+
+int runSceneBenchmark(int argc, char* argv[])
+{
+	SceneBenchmarkOptions options;
+	if (!parseOptions(argc, argv, options))
+	{
+		printf("Usage: --benchmark-scene [--out results.json] [--frames N] [--strokes log.mtps|script.txt] [--trace trace.json] [--no-state-filter] [--no-dsa] [--models small,1m,5m,many] [model.obj]...\n");
+		return 1;
+	}
+
+	std::vector<LoggedStroke> strokes;
+	std::string error;
+	if (options.strokesPath.empty())
+	{
+		strokes = makeCannedStrokes();
+	}
+	else if (!loadStrokes(options.strokesPath, strokes, error))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+	strokes.erase(std::remove_if(strokes.begin(), strokes.end(), [](const LoggedStroke& stroke) { return stroke.samples.empty(); }), strokes.end());
+	if (strokes.empty())
+	{
+		printf("No strokes to paint\n");
+		return 1;
+	}
+
+	std::unique_ptr<HeadlessContext> context = HeadlessContext::create();
+	if (!context)
+	{
+		printf("Failed to create an OpenGL context.\n");
+		return 1;
+	}
+	if (!context->makeCurrent() || !context->loadFunctions())
+	{
+		printf("Failed to initialize GLAD.\n");
+		return 1;
+	}
+	installGLCallCounters();
+	setGLStateFiltering(options.stateFiltering);
+	setGLDirectStateAccess(options.directStateAccess);
+	printf("Renderer: %s\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+	ThreadPool threadPool;
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "MinimalTexturePainterBenchmark";
+	std::error_code directoryError;
+	std::filesystem::create_directories(directory, directoryError);
+
+	std::vector<std::pair<std::string, std::string>> models;
+	for (const std::string& name : options.referenceModels)
+	{
+		const ReferenceModel& reference = *std::find_if(std::begin(referenceModels), std::end(referenceModels),
+			[&name](const ReferenceModel& model) { return name == model.name; });
+		std::filesystem::path path;
+		if (!writeReferenceModel(reference, directory, threadPool, path))
+		{
+			printf("Failed to write the %s reference model to %s\n", reference.name, directory.u8string().c_str());
+			return 1;
+		}
+		models.emplace_back(reference.name, path.u8string());
+	}
+	for (const std::string& path : options.models)
+		models.emplace_back(std::filesystem::u8path(path).stem().u8string(), path);
+
+	std::vector<ModelResult> results;
+	int failures = 0;
+	for (const auto& model : models)
+	{
+		ModelResult result;
+		result.name = model.first;
+		std::string modelError;
+		if (!benchmarkModel(threadPool, model.second, strokes, options.frames, directory, result, modelError))
+		{
+			printf("%s\n", modelError.c_str());
+			failures++;
+			continue;
+		}
+		std::vector<double> frameMs = result.passMs[PassFrame];
+		std::sort(frameMs.begin(), frameMs.end());
+		printf("%s: %zu triangles, load %.2fs, save %.2fs, frame p50 %.2fms p99 %.2fms\n", result.name.c_str(), result.triangles,
+			result.loadSeconds, result.saveSeconds, percentile(frameMs, 50), percentile(frameMs, 99));
+		results.push_back(std::move(result));
+	}
+
+	if (!writeResults(options.outputPath, options.frames, results))
+	{
+		printf("Failed to write %s\n", options.outputPath.c_str());
+		failures++;
+	}
+	else
+	{
+		printf("Wrote %s\n", options.outputPath.c_str());
+	}
+	if (!options.tracePath.empty() && !writeCpuTrace(options.tracePath))
+	{
+		printf("Failed to write %s\n", options.tracePath.c_str());
+		failures++;
+	}
+
+	context->releaseCurrent();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+//Loads reference models with a HeadlessContext and paints recorded strokes onto them while orbiting a fixed camera path,
+//then writes per pass frame time percentiles, load time, save time and peak memory as JSON.
+//  --benchmark-scene [--out results.json] [--frames N] [--strokes log.mtps|script.txt] [--trace trace.json] [--no-state-filter] [--models small,1m,5m,many] [model.obj]...
+//The reference models are generated into the temp directory on first use. Everything is driven by the frame index, never the
+//clock, so runs on the same machine and driver do the same work. On Linux the context is surfaceless EGL, so no display is
+//needed, and under Mesa LIBGL_ALWAYS_SOFTWARE=1 runs it on llvmpipe. Returns the process exit code.
+int runSceneBenchmark(int argc, char* argv[]);
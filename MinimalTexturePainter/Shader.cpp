@@ -1,6 +1,8 @@
 #include "Shader.h"
 #include <glm/gtc/type_ptr.hpp>
 
+#include "GLExtensions.h"
+
 //Mostly copied impl with minor additions.
 
 Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath)
@@ -73,6 +75,54 @@ Shader::Shader(const char* vertexShaderPath, const char* fragmentShaderPath)
 	glDeleteShader(fragment);
 }
 
+Shader::Shader(const char* computeShaderPath)
+{
+	//IO
+	std::string computeCode;
+	std::ifstream computeFile;
+	computeFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try
+	{
+		computeFile.open(computeShaderPath);
+		std::stringstream computeStream;
+		computeStream << computeFile.rdbuf();
+		computeFile.close();
+		computeCode = computeStream.str();
+	}
+	catch (std::ifstream::failure e)
+	{
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+	}
+
+	const char* computeCodePtr = computeCode.c_str();
+
+	//Compile
+	unsigned int compute;
+	int success;
+	char infoLog[512];
+	compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &computeCodePtr, NULL);
+	glCompileShader(compute);
+	glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(compute, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" <<
+			infoLog << std::endl;
+	};
+	ID = glCreateProgram();
+	glAttachShader(ID, compute);
+	glLinkProgram(ID);
+	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(ID, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" <<
+			infoLog << std::endl;
+	}
+	glDeleteShader(compute);
+}
+
 unsigned int Shader::getID()
 {
 	return ID;
@@ -121,4 +171,14 @@ void Shader::setVec3(const std::string& name, glm::vec3 value) const
 void Shader::setVec2(const std::string& name, glm::vec2 value) const
 {
 	glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+}
+
+void Shader::setVec4(const std::string& name, glm::vec4 value) const
+{
+	glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+}
+
+void Shader::setIVec2(const std::string& name, glm::ivec2 value) const
+{
+	glUniform2iv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
 }
\ No newline at end of file
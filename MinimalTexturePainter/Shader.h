@@ -14,6 +14,9 @@ private:
 public:
 	Shader(const char* vertexShaderPath, const char* fragmentShaderPath);
 
+	//Compute program. Only valid when the context supports compute shaders.
+	Shader(const char* computeShaderPath);
+
 	unsigned int getID();
 
 	void useProgram();
@@ -33,5 +36,9 @@ public:
 	void setVec3(const std::string& name, glm::vec3 value) const;
 
 	void setVec2(const std::string& name, glm::vec2 value) const;
+
+	void setVec4(const std::string& name, glm::vec4 value) const;
+
+	void setIVec2(const std::string& name, glm::ivec2 value) const;
 };
 
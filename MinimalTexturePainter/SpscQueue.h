@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//Fixed capacity queue for exactly one producer thread and one consumer thread. Neither side locks or waits, so pushing
+//from a callback that must return quickly is safe. Capacity is rounded up to a power of two.
+template<typename T>
+class SpscQueue
+{
+private:
+	std::vector<T> slots;
+	size_t mask;
+	//Only the consumer moves head and only the producer moves tail. Kept on separate cache lines so the two threads don't
+	//invalidate each other's line on every push and pop.
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) std::atomic<size_t> tail{ 0 };
+
+public:
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		slots.resize(size);
+		mask = size - 1;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	//Producer only. Returns false without queuing value when the queue is full.
+	bool push(const T& value)
+	{
+		size_t back = tail.load(std::memory_order_relaxed);
+		if (back - head.load(std::memory_order_acquire) == slots.size()) return false;
+		slots[back & mask] = value;
+		tail.store(back + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Consumer only. Returns false when the queue is empty.
+	bool pop(T& value)
+	{
+		size_t front = head.load(std::memory_order_relaxed);
+		if (front == tail.load(std::memory_order_acquire)) return false;
+		value = slots[front & mask];
+		head.store(front + 1, std::memory_order_release);
+		return true;
+	}
+};
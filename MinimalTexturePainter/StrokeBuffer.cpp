@@ -0,0 +1,168 @@
+#include "StrokeBuffer.h"
+
+#include <algorithm>
+
+#include "GLResources.h"
+
+StrokeBuffer::StrokeBuffer(int targetWidth, int targetHeight)
+{
+	this->targetWidth = targetWidth;
+	this->targetHeight = targetHeight;
+	framebuffer = createFramebuffer();
+}
+
+void StrokeBuffer::reallocate(int x, int y, int width, int height)
+{
+	//Half float so low flow dabs still build up smoothly.
+	unsigned int newTexture = createTexture2D(GL_RGBA16F, width, height);
+	//Sampled one to one with the target.
+	setTextureParameter(newTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	setTextureParameter(newTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	setTextureParameter(newTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	setTextureParameter(newTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	unsigned int newFramebuffer = createFramebuffer();
+	attachFramebufferTexture(newFramebuffer, GL_COLOR_ATTACHMENT0, newTexture);
+	glBindFramebuffer(GL_FRAMEBUFFER, newFramebuffer);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	//Only the area the stroke has touched holds anything.
+	if (texture && !empty)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, newFramebuffer);
+		glBlitFramebuffer(minX - originX, minY - originY, maxX - originX, maxY - originY,
+			minX - x, minY - y, maxX - x, maxY - y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glDeleteTextures(1, &texture);
+	glDeleteFramebuffers(1, &framebuffer);
+	texture = newTexture;
+	framebuffer = newFramebuffer;
+	originX = x;
+	originY = y;
+	capacityWidth = width;
+	capacityHeight = height;
+}
+
+void StrokeBuffer::begin()
+{
+	if (texture && !empty)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(minX - originX, minY - originY, maxX - minX, maxY - minY);
+		glClearColor(0.f, 0.f, 0.f, 0.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	empty = true;
+}
+
+void StrokeBuffer::include(int x0, int y0, int x1, int y1)
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, targetWidth);
+	y1 = std::min(y1, targetHeight);
+	if (x0 >= x1 || y0 >= y1) return;
+
+	int newMinX = empty ? x0 : std::min(minX, x0);
+	int newMinY = empty ? y0 : std::min(minY, y0);
+	int newMaxX = empty ? x1 : std::max(maxX, x1);
+	int newMaxY = empty ? y1 : std::max(maxY, y1);
+
+	bool fits = texture && newMinX >= originX && newMinY >= originY &&
+		newMaxX <= originX + capacityWidth && newMaxY <= originY + capacityHeight;
+	if (!fits)
+	{
+		//Leave room around the stroke so it doesn't reallocate on every dab.
+		int marginX = std::max(256, (newMaxX - newMinX) / 2);
+		int marginY = std::max(256, (newMaxY - newMinY) / 2);
+		int x = std::max(newMinX - marginX, 0);
+		int y = std::max(newMinY - marginY, 0);
+		int width = std::min(newMaxX + marginX, targetWidth) - x;
+		int height = std::min(newMaxY + marginY, targetHeight) - y;
+		reallocate(x, y, width, height);
+	}
+
+	empty = false;
+	minX = newMinX;
+	minY = newMinY;
+	maxX = newMaxX;
+	maxY = newMaxY;
+}
+
+bool StrokeBuffer::isEmpty() const
+{
+	return empty;
+}
+
+unsigned int StrokeBuffer::getTexture() const
+{
+	return texture;
+}
+
+unsigned int StrokeBuffer::getFramebuffer() const
+{
+	return framebuffer;
+}
+
+int StrokeBuffer::getOriginX() const
+{
+	return originX;
+}
+
+int StrokeBuffer::getOriginY() const
+{
+	return originY;
+}
+
+int StrokeBuffer::getCapacityWidth() const
+{
+	return capacityWidth;
+}
+
+int StrokeBuffer::getCapacityHeight() const
+{
+	return capacityHeight;
+}
+
+int StrokeBuffer::getMinX() const
+{
+	return minX;
+}
+
+int StrokeBuffer::getMinY() const
+{
+	return minY;
+}
+
+int StrokeBuffer::getMaxX() const
+{
+	return maxX;
+}
+
+int StrokeBuffer::getMaxY() const
+{
+	return maxY;
+}
+
+int StrokeBuffer::getTargetWidth() const
+{
+	return targetWidth;
+}
+
+int StrokeBuffer::getTargetHeight() const
+{
+	return targetHeight;
+}
+
+StrokeBuffer::~StrokeBuffer()
+{
+	glDeleteTextures(1, &texture);
+	glDeleteFramebuffers(1, &framebuffer);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <glad/glad.h>
+
+//Scratch texture that a single stroke's dabs accumulate into before being composited onto a layer in one go.
+//It only covers the area the stroke has touched so far and grows as the stroke moves, keeping what was already painted.
+//Pixels map one to one onto the target, offset by the origin.
+class StrokeBuffer
+{
+private:
+	unsigned int texture = 0;
+	unsigned int framebuffer = 0;
+	int targetWidth;
+	int targetHeight;
+	int originX = 0;
+	int originY = 0;
+	int capacityWidth = 0;
+	int capacityHeight = 0;
+
+	//Area touched by the current stroke in target pixels. Max is exclusive.
+	bool empty = true;
+	int minX = 0;
+	int minY = 0;
+	int maxX = 0;
+	int maxY = 0;
+
+	//Reallocates to cover the rect and copies the current stroke over.
+	void reallocate(int x, int y, int width, int height);
+
+public:
+	StrokeBuffer(int targetWidth, int targetHeight);
+	StrokeBuffer(const StrokeBuffer&) = delete;
+	StrokeBuffer& operator=(const StrokeBuffer&) = delete;
+
+	//Clears what the last stroke left. The allocation is kept for the next one.
+	void begin();
+
+	//Grows the buffer so the rect, in target pixels, can be drawn into.
+	void include(int x0, int y0, int x1, int y1);
+
+	bool isEmpty() const;
+
+	unsigned int getTexture() const;
+
+	unsigned int getFramebuffer() const;
+
+	int getOriginX() const;
+
+	int getOriginY() const;
+
+	int getCapacityWidth() const;
+
+	int getCapacityHeight() const;
+
+	int getMinX() const;
+
+	int getMinY() const;
+
+	int getMaxX() const;
+
+	int getMaxY() const;
+
+	int getTargetWidth() const;
+
+	int getTargetHeight() const;
+
+	~StrokeBuffer();
+};
@@ -0,0 +1,289 @@
+#include "StrokeLog.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+static const char magic[4] = { 'M', 'T', 'P', 'S' };
+static constexpr uint16_t version = 3;
+
+enum RecordTag : uint8_t
+{
+	RecordBrush = 1,
+	RecordBegin = 2,
+	RecordSample = 3,
+	RecordEnd = 4
+};
+
+//Fields are copied as they are in memory, which is little endian on every platform this builds for.
+template<typename T>
+static void append(std::vector<unsigned char>& buffer, T value)
+{
+	unsigned char bytes[sizeof(T)];
+	memcpy(bytes, &value, sizeof(T));
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+//Reads fields from a buffer, failing once it runs out.
+class RecordReader
+{
+private:
+	const std::vector<unsigned char>& data;
+	size_t position;
+
+public:
+	RecordReader(const std::vector<unsigned char>& data, size_t position):
+		data(data),
+		position(position)
+	{
+	}
+
+	template<typename T>
+	bool read(T& value)
+	{
+		if (data.size() - position < sizeof(T)) return false;
+		memcpy(&value, &data[position], sizeof(T));
+		position += sizeof(T);
+		return true;
+	}
+
+	bool readString(std::string& value, size_t length)
+	{
+		if (data.size() - position < length) return false;
+		value.assign(reinterpret_cast<const char*>(&data[position]), length);
+		position += length;
+		return true;
+	}
+
+	size_t getPosition() const
+	{
+		return position;
+	}
+
+	bool atEnd() const
+	{
+		return position == data.size();
+	}
+};
+
+//Checks the header of a whole log and returns false with a message if it isn't one this build can read.
+static bool readHeader(RecordReader& reader, const std::string& path, std::string& error)
+{
+	char header[4];
+	uint16_t fileVersion;
+	uint16_t reserved;
+	if (!reader.read(header) || memcmp(header, magic, sizeof(magic)) != 0 || !reader.read(fileVersion) || !reader.read(reserved))
+	{
+		error = path + " is not a stroke log";
+		return false;
+	}
+	if (fileVersion != version)
+	{
+		error = path + " is stroke log version " + std::to_string(fileVersion);
+		return false;
+	}
+	return true;
+}
+
+//Reads the records after the header into every complete stroke. A stroke cut off by a crash is dropped, and validSize is
+//left where the last complete stroke ends, the header if there is none. Returns false with a message at a record that is
+//all there but bad, with the strokes before it read.
+static bool readRecords(RecordReader& reader, const std::string& path, std::vector<LoggedStroke>& strokes, size_t& validSize, std::string& error)
+{
+	BrushSource brushes[strokeChannelCount];
+	LoggedStroke stroke;
+	bool inStroke = false;
+	validSize = reader.getPosition();
+	//Stops at the first record that doesn't fit, which is where a crash cut the file.
+	while (!reader.atEnd())
+	{
+		size_t recordPosition = reader.getPosition();
+		uint8_t tag;
+		reader.read(tag);
+		if (tag == RecordBrush)
+		{
+			uint8_t channel;
+			uint64_t contentHash;
+			uint32_t length;
+			std::string brushPath;
+			if (!reader.read(channel) || !reader.read(contentHash) || !reader.read(length) || !reader.readString(brushPath, length)) break;
+			if (channel >= strokeChannelCount) break;
+			brushes[channel] = BrushSource{ brushPath, contentHash };
+		}
+		else if (tag == RecordBegin)
+		{
+			stroke = LoggedStroke();
+			uint8_t tool, accumulation, computeBrush, maskMode;
+			StrokeSettings& settings = stroke.settings;
+			if (!reader.read(stroke.startTime) || !reader.read(tool) || !reader.read(accumulation) || !reader.read(computeBrush) ||
+				!reader.read(settings.channels) || !reader.read(settings.opacity) || !reader.read(settings.brushSize) || !reader.read(settings.sourceScale) ||
+				!reader.read(maskMode) || !reader.read(settings.maskWeights.x) || !reader.read(settings.maskWeights.y) ||
+				!reader.read(settings.maskWeights.z) || !reader.read(settings.maskWeights.w) || !reader.read(settings.maskOffset)) break;
+			//Values this build doesn't know would reach paintAt as out of range enums.
+			if (tool > static_cast<uint8_t>(BrushTool::Overlay) || accumulation > static_cast<uint8_t>(TextureBlender::Accumulation::Flow) ||
+				maskMode > static_cast<uint8_t>(BrushMaskMode::ConcaveEdges))
+			{
+				error = path + " has a bad record at byte " + std::to_string(recordPosition);
+				return false;
+			}
+			settings.tool = static_cast<BrushTool>(tool);
+			settings.accumulation = static_cast<TextureBlender::Accumulation>(accumulation);
+			settings.computeBrush = computeBrush != 0;
+			settings.maskMode = static_cast<BrushMaskMode>(maskMode);
+			for (int c = 0; c < strokeChannelCount; c++)
+				stroke.brushes[c] = brushes[c];
+			inStroke = true;
+		}
+		else if (tag == RecordSample && inStroke)
+		{
+			StrokeSample sample;
+			if (!reader.read(sample.time) || !reader.read(sample.uv.x) || !reader.read(sample.uv.y) || !reader.read(sample.alpha)) break;
+			stroke.samples.push_back(sample);
+		}
+		else if (tag == RecordEnd && inStroke)
+		{
+			strokes.push_back(std::move(stroke));
+			inStroke = false;
+			validSize = reader.getPosition();
+		}
+		else
+		{
+			error = path + " has a bad record at byte " + std::to_string(recordPosition);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool StrokeLogWriter::open(const std::string& path)
+{
+	close();
+
+	//An existing log is only appended to if it is one of this version, with nothing bad in it, as the reader stops at the
+	//first bad record and would never reach the new strokes. A stroke cut off by a crash is cut from the file for the same
+	//reason.
+	std::ifstream existing(path, std::ios::binary);
+	bool isNew = true;
+	if (existing)
+	{
+		std::vector<unsigned char> data((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+		existing.close();
+		if (!data.empty())
+		{
+			RecordReader reader(data, 0);
+			std::vector<LoggedStroke> strokes;
+			size_t validSize;
+			std::string error;
+			if (!readHeader(reader, path, error) || !readRecords(reader, path, strokes, validSize, error)) return false;
+			std::error_code resizeError;
+			if (validSize < data.size()) std::filesystem::resize_file(path, validSize, resizeError);
+			if (resizeError) return false;
+			isNew = false;
+		}
+	}
+
+	file.open(path, std::ios::binary | std::ios::app);
+	if (!file) return false;
+	if (isNew)
+	{
+		std::vector<unsigned char> header(magic, magic + sizeof(magic));
+		append<uint16_t>(header, version);
+		append<uint16_t>(header, 0);
+		file.write(reinterpret_cast<const char*>(header.data()), header.size());
+		file.flush();
+	}
+
+	//Brushes are written again at the first stroke so each session's records stand on their own.
+	for (BrushSource& brush : writtenBrushes)
+		brush = BrushSource();
+	return true;
+}
+
+bool StrokeLogWriter::isOpen() const
+{
+	return file.is_open();
+}
+
+void StrokeLogWriter::beginStroke(double startTime, const StrokeSettings& settings, const BrushSource brushes[strokeChannelCount])
+{
+	if (!file.is_open()) return;
+	pending.clear();
+	inStroke = true;
+
+	for (int c = 0; c < strokeChannelCount; c++)
+	{
+		if (!(settings.channels & (1 << c))) continue;
+		const BrushSource& brush = brushes[c];
+		if (brush.contentHash == writtenBrushes[c].contentHash && brush.path == writtenBrushes[c].path) continue;
+
+		append<uint8_t>(pending, RecordBrush);
+		append<uint8_t>(pending, static_cast<uint8_t>(c));
+		append<uint64_t>(pending, brush.contentHash);
+		append<uint32_t>(pending, static_cast<uint32_t>(brush.path.size()));
+		pending.insert(pending.end(), brush.path.begin(), brush.path.end());
+		writtenBrushes[c] = brush;
+	}
+
+	append<uint8_t>(pending, RecordBegin);
+	append<double>(pending, startTime);
+	append<uint8_t>(pending, static_cast<uint8_t>(settings.tool));
+	append<uint8_t>(pending, static_cast<uint8_t>(settings.accumulation));
+	append<uint8_t>(pending, settings.computeBrush ? 1 : 0);
+	append<uint8_t>(pending, settings.channels);
+	append<float>(pending, settings.opacity);
+	append<float>(pending, settings.brushSize);
+	append<float>(pending, settings.sourceScale);
+	append<uint8_t>(pending, static_cast<uint8_t>(settings.maskMode));
+	for (int i = 0; i < 4; i++)
+		append<float>(pending, settings.maskWeights[i]);
+	append<float>(pending, settings.maskOffset);
+}
+
+void StrokeLogWriter::addSample(const StrokeSample& sample)
+{
+	if (!inStroke) return;
+	append<uint8_t>(pending, RecordSample);
+	append<float>(pending, sample.time);
+	append<float>(pending, sample.uv.x);
+	append<float>(pending, sample.uv.y);
+	append<float>(pending, sample.alpha);
+}
+
+void StrokeLogWriter::endStroke()
+{
+	if (!inStroke) return;
+	inStroke = false;
+	append<uint8_t>(pending, RecordEnd);
+	file.write(reinterpret_cast<const char*>(pending.data()), pending.size());
+	file.flush();
+	pending.clear();
+}
+
+void StrokeLogWriter::close()
+{
+	inStroke = false;
+	pending.clear();
+	if (file.is_open()) file.close();
+}
+
+StrokeLogWriter::~StrokeLogWriter()
+{
+	close();
+}
+
+bool readStrokeLog(const std::string& path, std::vector<LoggedStroke>& strokes, std::string& error)
+{
+	strokes.clear();
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		error = "Can't open " + path;
+		return false;
+	}
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	RecordReader reader(data, 0);
+	if (!readHeader(reader, path, error)) return false;
+	size_t validSize;
+	return readRecords(reader, path, strokes, validSize, error);
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ComputeBrush.h"
+#include "TextureBlender.h"
+
+//Material channels a stroke can paint, as bits of StrokeSettings::channels.
+enum StrokeChannel : uint8_t
+{
+	StrokeChannelDiffuse = 1 << 0,
+	StrokeChannelSpecular = 1 << 1,
+	StrokeChannelNormal = 1 << 2
+};
+
+constexpr int strokeChannelCount = 3;
+
+//Where a brush texture came from. The hash is TextureCache's content hash, so a replay can tell if the file changed.
+struct BrushSource
+{
+	std::string path;
+	uint64_t contentHash = 0;
+};
+
+//Everything about a stroke that is fixed while it is painted.
+struct StrokeSettings
+{
+	BrushTool tool = BrushTool::Paint;
+	TextureBlender::Accumulation accumulation = TextureBlender::Accumulation::Max;
+	bool computeBrush = false;
+	uint8_t channels = 0;
+	float opacity = 1.f;
+	float brushSize = 1.f;
+	float sourceScale = 1.f;
+	//The mask the stroke was painted with, without its texture, which is the model's baked masks. The weights and offset
+	//are what is painted, the mode only says where they came from.
+	BrushMaskMode maskMode = BrushMaskMode::None;
+	glm::vec4 maskWeights = glm::vec4(0.f);
+	float maskOffset = 1.f;
+};
+
+//One dab. Alpha is as painted, already scaled by the frame time, so replaying doesn't depend on timing.
+struct StrokeSample
+{
+	//Seconds since the stroke started.
+	float time;
+	glm::vec2 uv;
+	float alpha;
+};
+
+struct LoggedStroke
+{
+	//Seconds since recording started.
+	double startTime = 0.0;
+	StrokeSettings settings;
+	//Brushes of the painted channels when the stroke started, indexed like the channel bits.
+	BrushSource brushes[strokeChannelCount];
+	std::vector<StrokeSample> samples;
+};
+
+//Appends strokes to a binary log as they are painted. Each stroke reaches the file when it ends, so a crash loses at most
+//the stroke in progress. Brushes are only written when they change.
+//Layout, little endian: "MTPS", u16 version, u16 reserved, then tagged records:
+//  1 brush:  u8 channel, u64 content hash, u32 path length, path
+//  2 begin:  f64 start time, u8 tool, u8 accumulation, u8 compute brush, u8 channels, f32 opacity, f32 brush size, f32 source scale,
+//            u8 mask mode, 4 f32 mask weights, f32 mask offset
+//  3 sample: f32 time, f32 u, f32 v, f32 alpha
+//  4 end
+class StrokeLogWriter
+{
+private:
+	std::ofstream file;
+	std::vector<unsigned char> pending;
+	BrushSource writtenBrushes[strokeChannelCount];
+	bool inStroke = false;
+
+public:
+	//Appends to an existing log, or starts a new one. A stroke cut off by a crash is cut from the end of the log first, so
+	//the new strokes can be read. Returns false if the file can't be written, isn't a log of this version or has a bad
+	//record in it.
+	bool open(const std::string& path);
+
+	bool isOpen() const;
+
+	//Brushes are indexed like the channel bits. Only painted channels are looked at.
+	void beginStroke(double startTime, const StrokeSettings& settings, const BrushSource brushes[strokeChannelCount]);
+
+	void addSample(const StrokeSample& sample);
+
+	void endStroke();
+
+	//Drops a stroke in progress.
+	void close();
+
+	~StrokeLogWriter();
+};
+
+//Reads every complete stroke in a log. A stroke cut off by a crash is dropped. Returns false with a message if the file
+//isn't a stroke log, or at a bad record, in which case strokes holds the ones before it.
+bool readStrokeLog(const std::string& path, std::vector<LoggedStroke>& strokes, std::string& error);
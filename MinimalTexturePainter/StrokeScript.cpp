@@ -0,0 +1,95 @@
+#include "StrokeScript.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+bool loadStrokeScript(const std::string& path, std::vector<ScriptStroke>& strokes, std::string& error)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		error = "Can't open " + path;
+		return false;
+	}
+
+	strokes.clear();
+	ScriptStroke settings;
+	bool inStroke = false;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		std::istringstream stream(line);
+		std::string command;
+		if (!(stream >> command)) continue;
+
+		auto fail = [&](const std::string& message)
+		{
+			error = path + ":" + std::to_string(lineNumber) + ": " + message;
+			return false;
+		};
+
+		bool parsed = true;
+		if (command == "size") parsed = static_cast<bool>(stream >> settings.brushSize);
+		else if (command == "opacity") parsed = static_cast<bool>(stream >> settings.opacity);
+		else if (command == "alpha") parsed = static_cast<bool>(stream >> settings.alpha);
+		else if (command == "scale") parsed = static_cast<bool>(stream >> settings.sourceScale);
+		else if (command == "accumulation")
+		{
+			std::string mode;
+			stream >> mode;
+			if (mode == "max") settings.accumulation = TextureBlender::Accumulation::Max;
+			else if (mode == "flow") settings.accumulation = TextureBlender::Accumulation::Flow;
+			else return fail("accumulation must be max or flow");
+		}
+		else if (command == "stroke")
+		{
+			if (inStroke) return fail("stroke inside a stroke");
+			inStroke = true;
+			strokes.push_back(settings);
+			strokes.back().dabs.clear();
+		}
+		else if (command == "end")
+		{
+			if (!inStroke) return fail("end without a stroke");
+			inStroke = false;
+		}
+		else if (command == "dab")
+		{
+			if (!inStroke) return fail("dab outside a stroke");
+			glm::vec2 uv;
+			parsed = static_cast<bool>(stream >> uv.x >> uv.y);
+			if (parsed) strokes.back().dabs.push_back(uv);
+		}
+		else if (command == "line")
+		{
+			if (!inStroke) return fail("line outside a stroke");
+			glm::vec2 from, to;
+			parsed = static_cast<bool>(stream >> from.x >> from.y >> to.x >> to.y);
+			if (parsed)
+			{
+				const ScriptStroke& stroke = strokes.back();
+				float spacing = std::max(stroke.brushSize / strokeScriptTexSize * 0.25f, 1e-4f);
+				int steps = std::max(static_cast<int>(std::ceil(glm::length(to - from) / spacing)), 1);
+				for (int i = 0; i <= steps; i++)
+					strokes.back().dabs.push_back(from + (to - from) * (static_cast<float>(i) / steps));
+			}
+		}
+		else
+		{
+			return fail("unknown command " + command);
+		}
+		if (!parsed) return fail("bad arguments to " + command);
+	}
+
+	if (inStroke)
+	{
+		error = path + ": stroke not ended";
+		return false;
+	}
+	return true;
+}
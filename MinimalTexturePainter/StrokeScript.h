@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TextureBlender.h"
+
+//Brush size is in pixels of a 4096 texture, like the toolbar's Brush Size.
+constexpr unsigned int strokeScriptTexSize = 4096;
+
+//A stroke with the settings it was painted with. Dabs are in texture UVs so a script applies to any model.
+struct ScriptStroke
+{
+	float brushSize = 1.f;
+	float opacity = 1.f;
+	//Per dab, only used by flow accumulation.
+	float alpha = 1.f;
+	float sourceScale = 1.f;
+	TextureBlender::Accumulation accumulation = TextureBlender::Accumulation::Max;
+	std::vector<glm::vec2> dabs;
+};
+
+//Reads a text stroke script. One command per line, # starts a comment.
+//  size <pixels>, opacity <0 to 1>, alpha <value>, scale <value>, accumulation max|flow
+//      Settings for the strokes that follow.
+//  stroke
+//      Starts a stroke.
+//  dab <u> <v>
+//  line <u0> <v0> <u1> <v1>
+//      Dabs a quarter of the brush radius apart from one point to the other.
+//  end
+//      Ends the stroke.
+//Returns false with a message naming the line on failure.
+bool loadStrokeScript(const std::string& path, std::vector<ScriptStroke>& strokes, std::string& error);
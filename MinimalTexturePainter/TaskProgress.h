@@ -0,0 +1,11 @@
+#pragma once
+#include <atomic>
+
+//How far along work running off the render thread is, shared by the jobs doing it and the toolbar showing it.
+struct TaskProgress
+{
+	//0 to 1.
+	std::atomic<float> fraction{ 0 };
+	//Set to stop the work early. It is checked between steps, so the work still finishes, sooner and as a failure.
+	std::atomic<bool> cancelled{ false };
+};
@@ -1,42 +1,78 @@
 #include "TextureBlender.h"
 
-TextureBlender::TextureBlender(const Shader blendShader, unsigned int targetTexture, unsigned int sourceTexture):
-	blendShader(blendShader)
+#include <cmath>
+
+#include "GLResources.h"
+
+TextureBlender::TextureBlender(const Shader blendShader, int targetWidth, int targetHeight, unsigned int sourceTexture):
+	blendShader(blendShader),
+	strokeBuffer(targetWidth, targetHeight)
 {
-	glGenFramebuffers(1, &targetFramebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
-	glBindTexture(GL_TEXTURE_2D, targetTexture);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTexture, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	this->targetTexture = targetTexture;
 	this->sourceTexture = sourceTexture;
 
 	//Gen buffers
-	glGenVertexArrays(1, &quadVAO);
-	glGenBuffers(1, &quadVBO);
-	glGenBuffers(1, &quadEBO);
+	quadVBO = createBuffer(sizeof(quadVert), &quadVert, 0);
+	quadEBO = createBuffer(sizeof(quadElem), &quadElem, 0);
+	quadVAO = createVertexArray(quadVBO, 3 * sizeof(float), quadEBO, { { 0, 3, GL_FLOAT, 0 } });
+}
 
-	//Buffer vertices
-	glBindVertexArray(quadVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVert), &quadVert, GL_STATIC_DRAW);
+void TextureBlender::setComputeBrush(ComputeBrush* computeBrush)
+{
+	this->computeBrush = computeBrush;
+}
 
-	//Buffer element data
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadElem), &quadElem, GL_STATIC_DRAW);
+void TextureBlender::setMask(const BrushMask& mask)
+{
+	this->mask = mask;
+}
 
-	//Set VAOs
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glBindVertexArray(0);
+void TextureBlender::beginStroke()
+{
+	strokeBuffer.begin();
+	hasLastDab = false;
 }
 
-void TextureBlender::blend(glm::vec2 uv, float pixelRadius, float alpha, float sourceScale, unsigned int texSize)
+void TextureBlender::blend(glm::vec2 uv, float pixelRadius, float alpha, float sourceScale, unsigned int texSize, Accumulation accumulation)
 {
-	glViewport(0, 0, texSize, texSize);
-	glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+	int targetWidth = strokeBuffer.getTargetWidth();
+	int targetHeight = strokeBuffer.getTargetHeight();
+
+	//Dab bounds in target pixels.
+	float uvRadius = pixelRadius / texSize;
+	int x0 = static_cast<int>(std::floor((uv.x - uvRadius) * targetWidth));
+	int y0 = static_cast<int>(std::floor((uv.y - uvRadius) * targetHeight));
+	int x1 = static_cast<int>(std::ceil((uv.x + uvRadius) * targetWidth)) + 1;
+	int y1 = static_cast<int>(std::ceil((uv.y + uvRadius) * targetHeight)) + 1;
+	strokeBuffer.include(x0, y0, x1, y1);
+	if (strokeBuffer.isEmpty()) return;
+
+	if (computeBrush)
+	{
+		computeBrush->paint(strokeBuffer, sourceTexture, x0, y0, x1, y1, uv, pixelRadius, alpha, sourceScale, texSize,
+			accumulation == Accumulation::Flow, mask);
+		return;
+	}
+
+	//Viewport is the whole target shifted by the buffer's origin, so texCoords in the shader are still target UVs.
+	//The scissor keeps the fragments to the dab.
+	int originX = strokeBuffer.getOriginX();
+	int originY = strokeBuffer.getOriginY();
+	glBindFramebuffer(GL_FRAMEBUFFER, strokeBuffer.getFramebuffer());
+	glViewport(-originX, -originY, targetWidth, targetHeight);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x0 - originX, y0 - originY, x1 - x0, y1 - y0);
+
+	//The buffer is premultiplied. Colour at a pixel is the same for every dab, so max on all channels keeps it premultiplied.
 	glEnable(GL_BLEND);
-	//Don't clear existing.
+	if (accumulation == Accumulation::Max)
+	{
+		glBlendEquation(GL_MAX);
+	}
+	else
+	{
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
 	blendShader.useProgram();
 
 	blendShader.setVec2("uv", uv);
@@ -44,19 +80,58 @@ void TextureBlender::blend(glm::vec2 uv, float pixelRadius, float alpha, float s
 	blendShader.setFloat("alpha", alpha);
 	blendShader.setFloat("sourceScale", sourceScale);
 	blendShader.setInt("texSize", (int)texSize);
+	blendShader.setVec4("maskWeights", mask.weights);
+	blendShader.setFloat("maskOffset", mask.offset);
 
 	glActiveTexture(GL_TEXTURE0);
 	glUniform1i(glGetUniformLocation(blendShader.getID(), "sourceTexture"), 0);
 	glBindTexture(GL_TEXTURE_2D, sourceTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glUniform1i(glGetUniformLocation(blendShader.getID(), "maskTexture"), 1);
+	glBindTexture(GL_TEXTURE_2D, mask.texture);
 
 	glBindVertexArray(quadVAO);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFunc(GL_ONE, GL_ZERO);
 	glDisable(GL_BLEND);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+void TextureBlender::applyTool(BrushTool tool, unsigned int layerTexture, glm::vec2 uv, float pixelRadius, float strength, float sourceScale, unsigned int texSize)
+{
+	if (!computeBrush) return;
+
+	int targetWidth = strokeBuffer.getTargetWidth();
+	int targetHeight = strokeBuffer.getTargetHeight();
+	float uvRadius = pixelRadius / texSize;
+	int x0 = static_cast<int>(std::floor((uv.x - uvRadius) * targetWidth));
+	int y0 = static_cast<int>(std::floor((uv.y - uvRadius) * targetHeight));
+	int x1 = static_cast<int>(std::ceil((uv.x + uvRadius) * targetWidth)) + 1;
+	int y1 = static_cast<int>(std::ceil((uv.y + uvRadius) * targetHeight)) + 1;
+
+	glm::ivec2 dabPixel(static_cast<int>(uv.x * targetWidth), static_cast<int>(uv.y * targetHeight));
+	glm::ivec2 smudgeOffset = hasLastDab ? lastDabPixel - dabPixel : glm::ivec2(0);
+	lastDabPixel = dabPixel;
+	hasLastDab = true;
+
+	computeBrush->applyTool(tool, layerTexture, targetWidth, targetHeight, sourceTexture, x0, y0, x1, y1,
+		uv, pixelRadius, strength, sourceScale, texSize, smudgeOffset, mask);
+}
+
+const StrokeBuffer& TextureBlender::getStrokeBuffer() const
+{
+	return strokeBuffer;
 }
 
 TextureBlender::~TextureBlender()
 {
-	glDeleteFramebuffers(1, &targetFramebuffer);
+	glDeleteVertexArrays(1, &quadVAO);
+	glDeleteBuffers(1, &quadVBO);
+	glDeleteBuffers(1, &quadEBO);
 }
@@ -2,15 +2,35 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "ComputeBrush.h"
 #include "Shader.h"
+#include "StrokeBuffer.h"
 
+//Paints dabs of a brush texture into a stroke buffer sized to the target.
+//The stroke is only applied to a layer once it ends, see LayerStack::commitStroke.
 class TextureBlender
 {
+public:
+	//How overlapping dabs within one stroke combine.
+	enum class Accumulation
+	{
+		//Coverage is the highest of any dab, so retracing a stroke doesn't darken it.
+		Max,
+		//Each dab is layered over the last, building up towards full coverage.
+		Flow
+	};
+
 private:
-	unsigned int targetFramebuffer;
-	unsigned int targetTexture;
 	unsigned int sourceTexture;
 	Shader blendShader;
+	StrokeBuffer strokeBuffer;
+	//Null when dabs go through the raster path.
+	ComputeBrush* computeBrush = nullptr;
+	BrushMask mask;
+
+	//Previous dab of the stroke in target pixels, for smudging.
+	glm::ivec2 lastDabPixel;
+	bool hasLastDab = false;
 
 	float quadVert[12] = { 1.f, 1.f, 0,
 					1.f, -1.f, 0,
@@ -25,10 +45,23 @@ private:
 	unsigned int quadEBO;
 
 public:
-	TextureBlender(const Shader blendShader, unsigned int targetTexture, unsigned int sourceTexture);
+	TextureBlender(const Shader blendShader, int targetWidth, int targetHeight, unsigned int sourceTexture);
+
+	//Switches between the compute and raster paths. Pass null for raster.
+	void setComputeBrush(ComputeBrush* computeBrush);
+
+	//Applies to every dab and tool from now on, on either path.
+	void setMask(const BrushMask& mask);
 
-	void blend(glm::vec2 uv, float pixelRadius, float alpha, float sourceScale, unsigned int texSize);
+	void beginStroke();
+
+	//Accumulates one dab into the stroke buffer. Only the dab's bounds are drawn.
+	void blend(glm::vec2 uv, float pixelRadius, float alpha, float sourceScale, unsigned int texSize, Accumulation accumulation);
+
+	//Applies a tool that reads the layer it changes, straight to that layer. Needs the compute path.
+	void applyTool(BrushTool tool, unsigned int layerTexture, glm::vec2 uv, float pixelRadius, float strength, float sourceScale, unsigned int texSize);
+
+	const StrokeBuffer& getStrokeBuffer() const;
 
 	~TextureBlender();
 };
-
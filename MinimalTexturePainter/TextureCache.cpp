@@ -0,0 +1,204 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "CpuProfiler.h"
+
+//64 bit multiply-xorshift hash over 8 byte words. Content hashes only need to tell files apart, not resist attacks.
+static uint64_t hashBytes(const std::vector<unsigned char>& bytes)
+{
+	constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+	uint64_t hash = bytes.size() * multiplier;
+	size_t words = bytes.size() / 8;
+	for (size_t i = 0; i < words; i++)
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes.data() + i * 8, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 32;
+	}
+	for (size_t i = words * 8; i < bytes.size(); i++)
+	{
+		hash = (hash ^ bytes[i]) * multiplier;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+TextureCache::TextureCache(TextureUploader& textureUploader, size_t byteBudget):
+	textureUploader(textureUploader)
+{
+	this->byteBudget = byteBudget;
+}
+
+std::string TextureCache::canonicalPath(const std::string& path)
+{
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::u8path(path), error);
+	std::string result = error ? path : canonical.u8string();
+#ifdef _WIN32
+	//Windows paths are case insensitive.
+	std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return std::tolower(c); });
+#endif
+	return result;
+}
+
+uint64_t TextureCache::textureKey(uint64_t contentHash, bool useSRGB, GLint minFilter)
+{
+	uint64_t format = (static_cast<uint64_t>(minFilter) << 1) | (useSRGB ? 1 : 0);
+	return contentHash ^ (format * 0xC2B2AE3D27D4EB4Full);
+}
+
+void TextureCache::touch(ImageEntry& entry)
+{
+	lru.splice(lru.begin(), lru, entry.lruPosition);
+}
+
+void TextureCache::evict()
+{
+	//Always keep the most recent image even if it is over budget on its own.
+	while (cachedBytes > byteBudget && lru.size() > 1)
+	{
+		uint64_t contentHash = lru.back();
+		lru.pop_back();
+		auto it = images.find(contentHash);
+		cachedBytes -= it->second.image.getByteSize();
+		images.erase(it);
+	}
+}
+
+bool TextureCache::findImage(const std::string& key, std::filesystem::file_time_type lastWriteTime, CachedImage& image)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto pathIt = paths.find(key);
+	if (pathIt == paths.end() || pathIt->second.lastWriteTime != lastWriteTime) return false;
+
+	auto imageIt = images.find(pathIt->second.contentHash);
+	if (imageIt == images.end()) return false;
+
+	touch(imageIt->second);
+	image = CachedImage{ imageIt->first, imageIt->second.image };
+	return true;
+}
+
+CachedImage TextureCache::loadImage(const std::string& path)
+{
+	PROFILE_ZONE("Load Image");
+	std::string key = canonicalPath(path);
+	std::error_code timeError;
+	std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(std::filesystem::u8path(key), timeError);
+
+	CachedImage cached;
+	if (!timeError && findImage(key, lastWriteTime, cached)) return cached;
+
+	std::ifstream file(std::filesystem::u8path(key), std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+		return CachedImage();
+	}
+	std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+	uint64_t contentHash = hashBytes(bytes);
+
+	//Same contents may already be decoded under another path.
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		paths[key] = PathEntry{ contentHash, lastWriteTime };
+		auto imageIt = images.find(contentHash);
+		if (imageIt != images.end())
+		{
+			touch(imageIt->second);
+			return CachedImage{ contentHash, imageIt->second.image };
+		}
+	}
+
+	//Textures are flipped.
+	Image image = loadImageFromMemory(bytes.data(), bytes.size(), true);
+	if (!image.isValid())
+	{
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+		return CachedImage();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto inserted = images.try_emplace(contentHash);
+	ImageEntry& entry = inserted.first->second;
+	if (inserted.second)
+	{
+		entry.image = image;
+		lru.push_front(contentHash);
+		entry.lruPosition = lru.begin();
+		cachedBytes += image.getByteSize();
+		evict();
+	}
+	else
+	{
+		//Another thread decoded it at the same time.
+		touch(entry);
+	}
+	return CachedImage{ contentHash, image };
+}
+
+unsigned int TextureCache::acquireTexture(const CachedImage& image, bool useSRGB, GLint minFilter)
+{
+	//Failed loads get an empty texture that isn't shared.
+	if (!image.image.isValid())
+		return textureUploader.createTexture(image.image, useSRGB, minFilter);
+
+	uint64_t key = textureKey(image.contentHash, useSRGB, minFilter);
+	auto it = texturesByKey.find(key);
+	if (it != texturesByKey.end())
+	{
+		textures[it->second].refCount++;
+		return it->second;
+	}
+
+	unsigned int texture = textureUploader.createTexture(image.image, useSRGB, minFilter);
+	texturesByKey[key] = texture;
+	textures[texture] = TextureEntry{ key, 1 };
+	return texture;
+}
+
+unsigned int TextureCache::acquireTexture(const std::string& path, bool useSRGB, GLint minFilter)
+{
+	return acquireTexture(loadImage(path), useSRGB, minFilter);
+}
+
+unsigned int TextureCache::createTexture(const CachedImage& image, bool useSRGB, GLint minFilter)
+{
+	return textureUploader.createTexture(image.image, useSRGB, minFilter);
+}
+
+void TextureCache::releaseTexture(unsigned int texture)
+{
+	if (texture == 0) return;
+
+	//Textures that aren't shared are deleted straight away.
+	auto it = textures.find(texture);
+	if (it == textures.end())
+	{
+		textureUploader.cancel(texture);
+		glDeleteTextures(1, &texture);
+		return;
+	}
+
+	if (--it->second.refCount > 0) return;
+
+	textureUploader.cancel(texture);
+	glDeleteTextures(1, &texture);
+	texturesByKey.erase(it->second.key);
+	textures.erase(it);
+}
+
+size_t TextureCache::getCachedBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return cachedBytes;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <glad/glad.h>
+
+#include "Image.h"
+#include "TextureUploader.h"
+
+//Decoded image along with the hash of the file contents it came from.
+struct CachedImage
+{
+	uint64_t contentHash = 0;
+	Image image;
+};
+
+//Process wide texture cache shared by models and brushes.
+//Decoded images are kept in an LRU tier keyed by content hash so reopening a file skips the disk and the decode.
+//OpenGL textures are reference counted and shared between every user of the same content and format. Textures that get
+//painted are never shared, as painting one would change every other user of the same content.
+class TextureCache
+{
+private:
+	struct PathEntry
+	{
+		uint64_t contentHash;
+		std::filesystem::file_time_type lastWriteTime;
+	};
+
+	struct ImageEntry
+	{
+		Image image;
+		std::list<uint64_t>::iterator lruPosition;
+	};
+
+	struct TextureEntry
+	{
+		uint64_t key;
+		unsigned int refCount;
+	};
+
+	TextureUploader& textureUploader;
+
+	//CPU tier. Guarded by mutex as images are decoded on worker threads.
+	std::mutex mutex;
+	std::unordered_map<std::string, PathEntry> paths;
+	std::unordered_map<uint64_t, ImageEntry> images;
+	std::list<uint64_t> lru;
+	size_t cachedBytes = 0;
+	size_t byteBudget;
+
+	//GPU tier. Only touched from the thread that owns the context.
+	std::unordered_map<uint64_t, unsigned int> texturesByKey;
+	std::unordered_map<unsigned int, TextureEntry> textures;
+
+	static std::string canonicalPath(const std::string& path);
+
+	static uint64_t textureKey(uint64_t contentHash, bool useSRGB, GLint minFilter);
+
+	//Returns the cached image for a path that hasn't changed on disk since it was hashed, without reading the file.
+	bool findImage(const std::string& key, std::filesystem::file_time_type lastWriteTime, CachedImage& image);
+
+	//Caller must hold mutex.
+	void touch(ImageEntry& entry);
+
+	//Caller must hold mutex.
+	void evict();
+
+public:
+	TextureCache(TextureUploader& textureUploader, size_t byteBudget = size_t(2) * 1024 * 1024 * 1024);
+
+	//Returns the decoded, vertically flipped image for a file. Safe to call from worker threads.
+	CachedImage loadImage(const std::string& path);
+
+	//Returns a texture for the image with an added reference. Must be called on the context thread.
+	unsigned int acquireTexture(const CachedImage& image, bool useSRGB, GLint minFilter);
+
+	unsigned int acquireTexture(const std::string& path, bool useSRGB, GLint minFilter);
+
+	//Returns a texture only the caller uses, for paint targets. The decoded image is still shared. Release it as usual.
+	unsigned int createTexture(const CachedImage& image, bool useSRGB, GLint minFilter);
+
+	//Drops a reference and deletes the texture once nothing uses it. The decoded image stays cached.
+	void releaseTexture(unsigned int texture);
+
+	size_t getCachedBytes();
+};
@@ -0,0 +1,202 @@
+#include "TextureExporter.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "CpuProfiler.h"
+#include "GLResources.h"
+#include "ImageEncoder.h"
+
+TextureExporter::TextureExporter(ThreadPool& threadPool):
+	threadPool(threadPool)
+{
+}
+
+void TextureExporter::exportTexture(unsigned int texture, const std::string& path)
+{
+	Export exportData;
+	exportData.path = path;
+	exportData.progress = std::make_shared<TaskProgress>();
+	exportData.stage = Stage::ReadingBack;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &exportData.width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &exportData.height);
+
+	//The copy into the buffer is queued on the GPU, glGetTexImage returns without waiting for it.
+	GLsizeiptr size = static_cast<GLsizeiptr>(exportData.width) * exportData.height * 3;
+	exportData.buffer = createBuffer(size, nullptr, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, exportData.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	exportData.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	exports.push_back(std::move(exportData));
+}
+
+bool TextureExporter::encode(const std::string& path, const unsigned char* pixels, int width, int height, ThreadPool& threadPool, TaskProgress& progress)
+{
+	PROFILE_ZONE("Encode Texture");
+	std::filesystem::path finalPath = std::filesystem::u8path(path);
+	std::filesystem::path temporaryPath = std::filesystem::u8path(path + ".tmp");
+
+	//Strips are spread over the pool, this worker takes some of them too. Quality 100 matches what the synchronous save used.
+	//Readback rows are bottom up so the image is flipped while encoding.
+	std::vector<unsigned char> encoded;
+	if (!encodeImage(imageFormatFromPath(path), pixels, width, height, 3, true, 100, threadPool, encoded, &progress.fraction, &progress.cancelled))
+		return false;
+
+	bool written;
+	{
+		std::ofstream file(temporaryPath, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+		written = static_cast<bool>(file);
+	}
+	if (!written)
+	{
+		std::error_code error;
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	//Rename replaces the destination in one step so readers never see a partial file.
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, finalPath, error);
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	progress.fraction = 1.f;
+	return true;
+}
+
+void TextureExporter::release(Export& exportData)
+{
+	if (exportData.fence)
+	{
+		glDeleteSync(exportData.fence);
+		exportData.fence = nullptr;
+	}
+	if (exportData.mappedPixels)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, exportData.buffer);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		exportData.mappedPixels = nullptr;
+	}
+	glDeleteBuffers(1, &exportData.buffer);
+}
+
+void TextureExporter::update()
+{
+	for (auto it = exports.begin(); it != exports.end();)
+	{
+		Export& exportData = *it;
+		if (exportData.stage == Stage::ReadingBack)
+		{
+			GLenum result = glClientWaitSync(exportData.fence, 0, 0);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+			{
+				glDeleteSync(exportData.fence);
+				exportData.fence = nullptr;
+
+				//The worker reads straight from the mapping. It stays mapped until the encode finishes.
+				GLsizeiptr size = static_cast<GLsizeiptr>(exportData.width) * exportData.height * 3;
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, exportData.buffer);
+				exportData.mappedPixels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+				if (exportData.mappedPixels)
+				{
+					exportData.stage = Stage::Encoding;
+					std::string path = exportData.path;
+					const unsigned char* pixels = exportData.mappedPixels;
+					int width = exportData.width;
+					int height = exportData.height;
+					std::shared_ptr<TaskProgress> progress = exportData.progress;
+					ThreadPool* pool = &threadPool;
+					exportData.encoded = threadPool.submit([path, pixels, width, height, pool, progress]()
+						{
+							return encode(path, pixels, width, height, *pool, *progress);
+						});
+				}
+				else
+				{
+					exportData.stage = Stage::Failed;
+				}
+			}
+			else if (result == GL_WAIT_FAILED)
+			{
+				exportData.stage = Stage::Failed;
+			}
+		}
+		else if (exportData.stage == Stage::Encoding &&
+			exportData.encoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			bool written = exportData.encoded.get();
+			exportData.stage = written ? Stage::Done : exportData.progress->cancelled ? Stage::Cancelled : Stage::Failed;
+		}
+
+		if (exportData.stage == Stage::Done || exportData.stage == Stage::Failed || exportData.stage == Stage::Cancelled)
+		{
+			lastFinished = Status{ exportData.path, exportData.stage, 1.f };
+			release(exportData);
+			it = exports.erase(it);
+			continue;
+		}
+		++it;
+	}
+}
+
+void TextureExporter::flush()
+{
+	while (!exports.empty())
+	{
+		for (Export& exportData : exports)
+		{
+			if (exportData.stage == Stage::ReadingBack)
+				glClientWaitSync(exportData.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			else if (exportData.stage == Stage::Encoding)
+				exportData.encoded.wait();
+		}
+		update();
+	}
+}
+
+bool TextureExporter::isBusy() const
+{
+	return !exports.empty();
+}
+
+std::vector<TextureExporter::Status> TextureExporter::getStatus() const
+{
+	std::vector<Status> status;
+	for (const Export& exportData : exports)
+	{
+		status.push_back(Status{ exportData.path, exportData.stage, exportData.progress->fraction.load() });
+	}
+	return status;
+}
+
+void TextureExporter::cancel(size_t index)
+{
+	if (index >= exports.size()) return;
+	Export& exportData = *std::next(exports.begin(), index);
+	exportData.progress->cancelled = true;
+	//The worker still reads the mapping of an encode, so that is released once it stops.
+	if (exportData.stage == Stage::ReadingBack) exportData.stage = Stage::Cancelled;
+}
+
+const TextureExporter::Status& TextureExporter::getLastFinished() const
+{
+	return lastFinished;
+}
+
+TextureExporter::~TextureExporter()
+{
+	flush();
+}
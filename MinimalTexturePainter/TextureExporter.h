@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <future>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include "TaskProgress.h"
+#include "ThreadPool.h"
+
+//Saves textures without stalling the frame.
+//Pixels are read back into a pixel pack buffer behind a fence, then encoded and written on a worker thread.
+class TextureExporter
+{
+public:
+	enum class Stage
+	{
+		ReadingBack,
+		Encoding,
+		Done,
+		Failed,
+		Cancelled
+	};
+
+	struct Status
+	{
+		std::string path;
+		Stage stage;
+		float progress;
+	};
+
+private:
+	struct Export
+	{
+		std::string path;
+		int width;
+		int height;
+		unsigned int buffer;
+		GLsync fence;
+		const unsigned char* mappedPixels = nullptr;
+		std::future<bool> encoded;
+		//Written by the worker, read and cancelled by the toolbar.
+		std::shared_ptr<TaskProgress> progress;
+		Stage stage;
+	};
+
+	ThreadPool& threadPool;
+	std::list<Export> exports;
+	Status lastFinished{ "", Stage::Done, 1.f };
+
+	void release(Export& exportData);
+
+public:
+	//Encodes RGB rows in readback order, bottom up, and writes them to path, going through a temporary file so a failed save
+	//never leaves a truncated texture behind. Exports run it on a worker. It needs no context, so pixels painted on the CPU
+	//are saved with it directly.
+	static bool encode(const std::string& path, const unsigned char* pixels, int width, int height, ThreadPool& threadPool, TaskProgress& progress);
+
+	TextureExporter(ThreadPool& threadPool);
+
+	//Queues a readback of the texture's base level to be saved at path. The format follows the extension, PNG or JPEG.
+	void exportTexture(unsigned int texture, const std::string& path);
+
+	//Hands finished readbacks to workers and cleans up finished encodes. Call once per frame.
+	void update();
+
+	//Blocks until every queued export has been written.
+	void flush();
+
+	bool isBusy() const;
+
+	//In the order of the exports still running.
+	std::vector<Status> getStatus() const;
+
+	//Stops the export at index in getStatus. A readback is dropped at once, an encode at its next strip, and nothing is
+	//written either way.
+	void cancel(size_t index);
+
+	const Status& getLastFinished() const;
+
+	~TextureExporter();
+};
@@ -0,0 +1,288 @@
+#include "TextureUploader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "GLExtensions.h"
+#include "GLResources.h"
+
+//Largest dimension of the placeholder mip level shown while streaming.
+constexpr int placeholderSize = 64;
+
+TextureUploader::TextureUploader(size_t slotSize, size_t slotCount, float frameBudgetMs)
+{
+	this->slotSize = slotSize;
+	this->frameBudgetMs = frameBudgetMs;
+	slots.resize(slotCount);
+
+	GLsizeiptr ringSize = static_cast<GLsizeiptr>(slotSize * slotCount);
+	if (getGLCapabilities().bufferStorage)
+	{
+		//Map once and keep it mapped. Fences stop us overwriting a slot the GPU is still reading.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		ringBuffer = createBuffer(ringSize, nullptr, flags);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+		persistentMapping = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringSize, flags));
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	else
+	{
+		ringBuffer = createBuffer(ringSize, nullptr, GL_MAP_WRITE_BIT);
+	}
+}
+
+unsigned int TextureUploader::createTexture(const Image& image, bool useSRGB, GLint minFilter)
+{
+	if (!image.isValid())
+	{
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		return textureID;
+	}
+
+	GLenum format = 0;
+	GLenum internalFormat = 0;
+	if (image.components == 1)
+	{
+		format = GL_RED;
+		internalFormat = GL_R8;
+	}
+	else if (image.components == 3)
+	{
+		format = GL_RGB;
+		internalFormat = useSRGB ? GL_SRGB8 : GL_RGB8;
+	}
+	else if (image.components == 4)
+	{
+		format = GL_RGBA;
+		internalFormat = useSRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+
+	//The whole chain is allocated now so the texture name stays the same once streaming is done.
+	unsigned int textureID = createTexture2D(internalFormat, image.width, image.height, getMipLevelCount(image.width, image.height));
+
+	Upload upload{ textureID, image, format, 0, 0 };
+	int largestDimension = std::max(image.width, image.height);
+	while ((largestDimension >> upload.placeholderLevel) > placeholderSize)
+		upload.placeholderLevel++;
+
+	setTextureParameter(textureID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	setTextureParameter(textureID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	setTextureParameter(textureID, GL_TEXTURE_MIN_FILTER, minFilter);
+	//Rows of RGB images are not 4 byte aligned.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	size_t rowBytes = static_cast<size_t>(image.width) * image.components;
+	if (upload.placeholderLevel == 0 || rowBytes > slotSize)
+	{
+		//Small enough to upload directly, or a single row does not fit in a slot.
+		uploadTexture2D(textureID, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, image.pixels.get());
+		setTextureParameter(textureID, GL_TEXTURE_MAX_LEVEL, 1000);
+		generateTextureMipmaps(textureID);
+	}
+	else
+	{
+		uploadPlaceholder(upload);
+		setTextureParameter(textureID, GL_TEXTURE_BASE_LEVEL, upload.placeholderLevel);
+		setTextureParameter(textureID, GL_TEXTURE_MAX_LEVEL, upload.placeholderLevel);
+
+		queuedBytes += image.getByteSize();
+		streamingTextures.insert(textureID);
+		pending.push_back(upload);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	return textureID;
+}
+
+void TextureUploader::uploadPlaceholder(const Upload& upload)
+{
+	const Image& image = upload.image;
+	int width = std::max(1, image.width >> upload.placeholderLevel);
+	int height = std::max(1, image.height >> upload.placeholderLevel);
+	int components = image.components;
+
+	//Average a 4x4 grid of samples in each block instead of every pixel to keep this cheap for 8K images.
+	constexpr int samples = 4;
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * components);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			unsigned int sums[4] = { 0, 0, 0, 0 };
+			for (int sy = 0; sy < samples; sy++)
+			{
+				int sourceY = std::min(image.height - 1, (y * samples + sy) * image.height / (height * samples));
+				for (int sx = 0; sx < samples; sx++)
+				{
+					int sourceX = std::min(image.width - 1, (x * samples + sx) * image.width / (width * samples));
+					const unsigned char* texel = image.pixels.get() + (static_cast<size_t>(sourceY) * image.width + sourceX) * components;
+					for (int c = 0; c < components; c++)
+						sums[c] += texel[c];
+				}
+			}
+			unsigned char* target = pixels.data() + (static_cast<size_t>(y) * width + x) * components;
+			for (int c = 0; c < components; c++)
+				target[c] = static_cast<unsigned char>(sums[c] / (samples * samples));
+		}
+	}
+
+	uploadTexture2D(upload.texture, upload.placeholderLevel, 0, 0, width, height, upload.format, GL_UNSIGNED_BYTE, pixels.data());
+}
+
+bool TextureUploader::streamChunk(Upload& upload, bool wait)
+{
+	Slot& slot = slots[nextSlot];
+	if (slot.fence)
+	{
+		GLenum result = wait ?
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) :
+			glClientWaitSync(slot.fence, 0, 0);
+		//GL_WAIT_FAILED says nothing about the GPU being done with the slot, so treat it like a timeout.
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) return false;
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+	}
+
+	const Image& image = upload.image;
+	size_t rowBytes = static_cast<size_t>(image.width) * image.components;
+	int rows = std::min(static_cast<int>(slotSize / rowBytes), image.height - upload.nextRow);
+	size_t bytes = rows * rowBytes;
+	size_t offset = nextSlot * slotSize;
+	const unsigned char* source = image.pixels.get() + upload.nextRow * rowBytes;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+	if (persistentMapping)
+	{
+		std::memcpy(persistentMapping + offset, source, bytes);
+	}
+	else
+	{
+		//Unsynchronized is safe because the slot fence has already been waited on.
+		void* target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!target)
+		{
+			std::cout << "ERROR::TEXTURE_UPLOADER::MAP_FAILED" << std::endl;
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return false;
+		}
+		std::memcpy(target, source, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	uploadTexture2D(upload.texture, 0, 0, upload.nextRow, image.width, rows, upload.format, GL_UNSIGNED_BYTE, (void*)offset);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	nextSlot = (nextSlot + 1) % slots.size();
+
+	upload.nextRow += rows;
+	uploadedBytes += bytes;
+	return true;
+}
+
+void TextureUploader::finish(Upload& upload)
+{
+	setTextureParameter(upload.texture, GL_TEXTURE_BASE_LEVEL, 0);
+	setTextureParameter(upload.texture, GL_TEXTURE_MAX_LEVEL, 1000);
+	generateTextureMipmaps(upload.texture);
+	streamingTextures.erase(upload.texture);
+}
+
+void TextureUploader::update()
+{
+	auto start = std::chrono::steady_clock::now();
+	while (!pending.empty())
+	{
+		Upload& upload = pending.front();
+		if (upload.nextRow >= upload.image.height)
+		{
+			finish(upload);
+			pending.pop_front();
+			continue;
+		}
+
+		if (!streamChunk(upload, false)) break;
+
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= frameBudgetMs) break;
+	}
+
+	if (pending.empty())
+	{
+		queuedBytes = 0;
+		uploadedBytes = 0;
+	}
+}
+
+void TextureUploader::flush()
+{
+	while (!pending.empty())
+	{
+		Upload& upload = pending.front();
+		if (upload.nextRow >= upload.image.height)
+		{
+			finish(upload);
+			pending.pop_front();
+			continue;
+		}
+		if (!streamChunk(upload, true))
+		{
+			//The slot never signalled or could not be mapped. Leave the texture at its placeholder rather than spin.
+			std::cout << "ERROR::TEXTURE_UPLOADER::FLUSH_FAILED" << std::endl;
+			streamingTextures.erase(upload.texture);
+			pending.pop_front();
+		}
+	}
+	queuedBytes = 0;
+	uploadedBytes = 0;
+}
+
+void TextureUploader::cancel(unsigned int texture)
+{
+	auto it = std::find_if(pending.begin(), pending.end(), [texture](const Upload& upload) { return upload.texture == texture; });
+	if (it == pending.end()) return;
+
+	//Fences for chunks already submitted stay in their slots, the GL objects outlive the texture name.
+	queuedBytes -= it->image.getByteSize();
+	uploadedBytes -= std::min(uploadedBytes, it->nextRow * static_cast<size_t>(it->image.width) * it->image.components);
+	streamingTextures.erase(texture);
+	pending.erase(it);
+}
+
+bool TextureUploader::isResident(unsigned int texture) const
+{
+	return streamingTextures.find(texture) == streamingTextures.end();
+}
+
+bool TextureUploader::isIdle() const
+{
+	return pending.empty();
+}
+
+float TextureUploader::getProgress() const
+{
+	if (queuedBytes == 0) return 1.f;
+	return static_cast<float>(uploadedBytes) / static_cast<float>(queuedBytes);
+}
+
+TextureUploader::~TextureUploader()
+{
+	for (Slot& slot : slots)
+	{
+		if (slot.fence) glDeleteSync(slot.fence);
+	}
+	if (persistentMapping)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &ringBuffer);
+}
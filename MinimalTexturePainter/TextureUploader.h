@@ -0,0 +1,70 @@
+#pragma once
+#include <deque>
+#include <unordered_set>
+#include <vector>
+#include <glad/glad.h>
+
+#include "Image.h"
+
+//Streams decoded images into textures over several frames through a ring of pixel unpack buffers.
+//A low resolution placeholder is shown by clamping the base mip level until the full chain is resident.
+class TextureUploader
+{
+private:
+	struct Upload
+	{
+		unsigned int texture;
+		Image image;
+		GLenum format;
+		int placeholderLevel;
+		int nextRow;
+	};
+
+	struct Slot
+	{
+		GLsync fence = nullptr;
+	};
+
+	unsigned int ringBuffer;
+	unsigned char* persistentMapping = nullptr;
+	size_t slotSize;
+	std::vector<Slot> slots;
+	size_t nextSlot = 0;
+	float frameBudgetMs;
+
+	std::deque<Upload> pending;
+	std::unordered_set<unsigned int> streamingTextures;
+	size_t queuedBytes = 0;
+	size_t uploadedBytes = 0;
+
+	void uploadPlaceholder(const Upload& upload);
+
+	//Returns false if the next slot is still in use by the GPU.
+	bool streamChunk(Upload& upload, bool wait);
+
+	void finish(Upload& upload);
+
+public:
+	TextureUploader(size_t slotSize = 4 * 1024 * 1024, size_t slotCount = 4, float frameBudgetMs = 2.f);
+
+	//Creates the texture and queues the image for streaming. The returned name is valid immediately.
+	unsigned int createTexture(const Image& image, bool useSRGB, GLint minFilter);
+
+	//Streams queued rows until the frame budget is used up. Call once per frame.
+	void update();
+
+	//Stops streaming into a texture that is about to be deleted.
+	void cancel(unsigned int texture);
+
+	//Blocks until every queued upload is resident.
+	void flush();
+
+	bool isResident(unsigned int texture) const;
+
+	bool isIdle() const;
+
+	//Fraction of queued bytes that have been uploaded.
+	float getProgress() const;
+
+	~TextureUploader();
+};
@@ -0,0 +1,280 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+
+#include "CpuProfiler.h"
+
+//Which pool and worker the current thread belongs to, so jobs scheduled from a worker go on its own deque.
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local int currentWorker = -1;
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	//hardware_concurrency may return 0 if it can't be determined.
+	threadCount = std::max(threadCount, 1u);
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+int ThreadPool::getWorkerIndex() const
+{
+	return currentPool == this ? currentWorker : -1;
+}
+
+void ThreadPool::workerLoop(unsigned int index)
+{
+	setProfilerThreadName("Worker " + std::to_string(index));
+	currentPool = this;
+	currentWorker = static_cast<int>(index);
+	while (true)
+	{
+		JobHandle job = takeJob(index);
+		if (job)
+		{
+			PROFILE_ZONE("Pool task");
+			runJob(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		workAvailable.wait(lock, [this]() { return stopping || queuedJobs.load() > 0; });
+		if (stopping && queuedJobs.load() == 0) return;
+	}
+}
+
+ThreadPool::JobHandle ThreadPool::schedule(std::function<void()> task, const std::vector<JobHandle>& dependencies, std::thread::id thread)
+{
+	JobHandle job = std::make_shared<Job>();
+	job->task = std::move(task);
+	job->thread = thread;
+	for (const JobHandle& dependency : dependencies)
+	{
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->finished) continue;
+		job->waitingOn++;
+		dependency->dependents.push_back(job);
+	}
+	release(job);
+	return job;
+}
+
+void ThreadPool::release(const JobHandle& job)
+{
+	if (--job->waitingOn == 0) enqueue(job);
+}
+
+void ThreadPool::enqueue(const JobHandle& job)
+{
+	if (job->thread != std::thread::id())
+	{
+		{
+			std::lock_guard<std::mutex> lock(pinnedMutex);
+			pinnedJobs[job->thread].push_back(job);
+		}
+		//The thread may be blocked in wait for something that needs this job first.
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		jobFinished.notify_all();
+		return;
+	}
+
+	int worker = getWorkerIndex();
+	size_t index = worker >= 0 ? static_cast<size_t>(worker) : nextQueue++ % queues.size();
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->jobs.push_back(job);
+	}
+	queuedJobs++;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	workAvailable.notify_one();
+	//Workers blocked in wait help with queued jobs.
+	if (blockedWaiters.load() > 0) jobFinished.notify_all();
+}
+
+ThreadPool::JobHandle ThreadPool::takeJob(unsigned int worker)
+{
+	if (queuedJobs.load() == 0) return nullptr;
+	for (size_t i = 0; i < queues.size(); i++)
+	{
+		WorkerQueue& queue = *queues[(worker + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty()) continue;
+		JobHandle job;
+		if (i == 0)
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+		}
+		else
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+		}
+		queuedJobs--;
+		return job;
+	}
+	return nullptr;
+}
+
+ThreadPool::JobHandle ThreadPool::takePinnedJob()
+{
+	std::lock_guard<std::mutex> lock(pinnedMutex);
+	auto found = pinnedJobs.find(std::this_thread::get_id());
+	if (found == pinnedJobs.end() || found->second.empty()) return nullptr;
+	JobHandle job = std::move(found->second.front());
+	found->second.pop_front();
+	return job;
+}
+
+void ThreadPool::runJob(const JobHandle& job)
+{
+	try
+	{
+		job->task();
+	}
+	catch (...)
+	{
+		job->exception = std::current_exception();
+	}
+	//Frees whatever the task captured now rather than when the last handle goes.
+	job->task = nullptr;
+
+	std::vector<JobHandle> dependents;
+	{
+		std::lock_guard<std::mutex> lock(job->mutex);
+		job->finished = true;
+		dependents.swap(job->dependents);
+	}
+	for (const JobHandle& dependent : dependents)
+		release(dependent);
+
+	if (blockedWaiters.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		jobFinished.notify_all();
+	}
+}
+
+bool ThreadPool::isFinished(const JobHandle& job) const
+{
+	std::lock_guard<std::mutex> lock(job->mutex);
+	return job->finished;
+}
+
+void ThreadPool::wait(const JobHandle& job)
+{
+	int worker = getWorkerIndex();
+	auto hasPinnedJob = [this]()
+	{
+		std::lock_guard<std::mutex> lock(pinnedMutex);
+		auto found = pinnedJobs.find(std::this_thread::get_id());
+		return found != pinnedJobs.end() && !found->second.empty();
+	};
+	while (!isFinished(job))
+	{
+		JobHandle next = takePinnedJob();
+		if (!next && worker >= 0) next = takeJob(worker);
+		if (next)
+		{
+			runJob(next);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		blockedWaiters++;
+		jobFinished.wait(lock, [&]() { return isFinished(job) || hasPinnedJob() || (worker >= 0 && queuedJobs.load() > 0); });
+		blockedWaiters--;
+	}
+	if (job->exception) std::rethrow_exception(job->exception);
+}
+
+void ThreadPool::runPinnedJobs()
+{
+	JobHandle job;
+	while ((job = takePinnedJob()))
+	{
+		PROFILE_ZONE("Pinned task");
+		runJob(job);
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& function)
+{
+	if (count == 0) return;
+
+	//Shared with helper tasks that may only start after the loop is done, so it can't live on this stack.
+	struct State
+	{
+		std::atomic<size_t> nextIndex{ 0 };
+		std::atomic<size_t> finished{ 0 };
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::exception_ptr exception;
+	};
+	auto state = std::make_shared<State>();
+	const std::function<void(size_t)>* functionPtr = &function;
+
+	//Only touches function after claiming a valid index, which can't happen once every index is finished.
+	auto runIndices = [state, functionPtr, count]()
+	{
+		size_t index;
+		while ((index = state->nextIndex.fetch_add(1)) < count)
+		{
+			try
+			{
+				(*functionPtr)(index);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (!state->exception) state->exception = std::current_exception();
+			}
+			if (state->finished.fetch_add(1) + 1 == count)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->condition.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(count - 1, workers.size());
+	for (size_t i = 0; i < helpers; i++)
+		schedule(runIndices);
+
+	runIndices();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->condition.wait(lock, [&state, count]() { return state->finished.load() == count; });
+	if (state->exception) std::rethrow_exception(state->exception);
+}
+
+unsigned int ThreadPool::getThreadCount() const
+{
+	return static_cast<unsigned int>(workers.size());
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//Fixed size pool of worker threads for CPU work, scheduled by work stealing. Each worker has its own deque. Jobs a worker
+//schedules go on the back of its deque and it takes the newest first, so nested work stays in its cache. An idle worker
+//steals the oldest job from another worker's deque. Jobs can wait on other jobs, and jobs pinned to a thread only run there,
+//which is how GL work joins a graph. Tasks that aren't pinned must not touch OpenGL as the context is only current on the
+//render thread.
+class ThreadPool
+{
+public:
+	struct Job;
+	typedef std::shared_ptr<Job> JobHandle;
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	//Ready jobs that must run on a particular thread, kept until that thread runs them.
+	std::mutex pinnedMutex;
+	std::unordered_map<std::thread::id, std::deque<JobHandle>> pinnedJobs;
+	//Ready jobs in the worker deques.
+	std::atomic<size_t> queuedJobs{ 0 };
+	//Where jobs scheduled from outside the pool go next.
+	std::atomic<size_t> nextQueue{ 0 };
+	//Threads blocked in wait, so finishing a job only has to wake anyone when someone is waiting.
+	std::atomic<int> blockedWaiters{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable jobFinished;
+	bool stopping = false;
+
+	void workerLoop(unsigned int index);
+
+	//Queues a job whose dependencies have all finished.
+	void enqueue(const JobHandle& job);
+
+	//Drops one of the job's outstanding dependencies and queues it when none are left.
+	void release(const JobHandle& job);
+
+	//The back of the worker's own deque, otherwise the front of another's.
+	JobHandle takeJob(unsigned int worker);
+
+	JobHandle takePinnedJob();
+
+	void runJob(const JobHandle& job);
+
+	//Index of the calling thread among this pool's workers, or -1.
+	int getWorkerIndex() const;
+
+public:
+	ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency());
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//Runs task once every dependency has finished. A pinned job only runs on thread, inside its runPinnedJobs or wait calls,
+	//e.g. GL work for the thread the context is current on. Otherwise any worker runs it.
+	JobHandle schedule(std::function<void()> task, const std::vector<JobHandle>& dependencies = {}, std::thread::id thread = std::thread::id());
+
+	//Blocks until job has finished and rethrows anything it threw. Meanwhile the calling thread runs its pinned jobs, and a
+	//worker runs other jobs, so waiting from inside a job or on the thread a job is pinned to can't deadlock.
+	void wait(const JobHandle& job);
+
+	bool isFinished(const JobHandle& job) const;
+
+	//Runs the calling thread's pinned jobs that are ready. The render thread calls it once a frame.
+	void runPinnedJobs();
+
+	//Queues a task and returns a future for its result.
+	template<typename F>
+	auto submit(F&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> future = packaged->get_future();
+		schedule([packaged]() { (*packaged)(); });
+		return future;
+	}
+
+	//Runs function(i) for every i in [0, count) across the pool and blocks until all are done.
+	//The calling thread takes indices too, so this is safe to call from inside a pool task.
+	void parallelFor(size_t count, const std::function<void(size_t)>& function);
+
+	unsigned int getThreadCount() const;
+
+	//Jobs not yet ready or still pinned when the pool is destroyed never run.
+	~ThreadPool();
+};
+
+struct ThreadPool::Job
+{
+	std::function<void()> task;
+	std::thread::id thread;
+	//Dependencies not finished yet, plus one while schedule is still adding them.
+	std::atomic<int> waitingOn{ 1 };
+	std::mutex mutex;
+	bool finished = false;
+	std::vector<JobHandle> dependents;
+	std::exception_ptr exception;
+};
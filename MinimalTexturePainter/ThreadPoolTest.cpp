@@ -0,0 +1,221 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+//Standalone checks of ThreadPool's guarantees, built as ThreadPoolTest by CMakeLists.txt and run by ctest. Prints each
+//failure and exits non-zero if there were any. A deadlock shows up as the test timing out.
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what)
+{
+	if (condition) return;
+	printf("FAILED: %s\n", what.c_str());
+	failures++;
+}
+
+//A random graph where each job depends on up to three earlier ones and checks they have all finished before it runs.
+static void testDependencyOrder(ThreadPool& pool)
+{
+	constexpr int jobCount = 2000;
+	std::vector<ThreadPool::JobHandle> jobs;
+	std::vector<std::atomic<bool>> done(jobCount);
+	std::atomic<int> misordered{ 0 };
+	unsigned int seed = 12345;
+	for (int i = 0; i < jobCount; i++)
+	{
+		std::vector<ThreadPool::JobHandle> dependencies;
+		std::vector<int> dependencyIndices;
+		for (int j = 0; i > 0 && j < 3; j++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			int dependency = (seed >> 8) % i;
+			dependencies.push_back(jobs[dependency]);
+			dependencyIndices.push_back(dependency);
+		}
+		jobs.push_back(pool.schedule([&done, &misordered, dependencyIndices, i]()
+			{
+				for (int dependency : dependencyIndices)
+				{
+					if (!done[dependency]) misordered++;
+				}
+				done[i] = true;
+			}, dependencies));
+	}
+	for (const ThreadPool::JobHandle& job : jobs)
+		pool.wait(job);
+	check(misordered == 0, std::to_string(misordered.load()) + " jobs ran before their dependencies");
+
+	//Dependencies that finished before the job was scheduled don't hold it back.
+	ThreadPool::JobHandle first = pool.schedule([]() {});
+	pool.wait(first);
+	bool ran = false;
+	pool.wait(pool.schedule([&ran]() { ran = true; }, { first }));
+	check(ran, "job depending on a finished job never ran");
+}
+
+//Pinned jobs run on their thread and only inside its runPinnedJobs or wait calls, whatever they depend on.
+static void testPinnedAffinity(ThreadPool& pool)
+{
+	std::thread::id mainThread = std::this_thread::get_id();
+	std::atomic<int> wrongThread{ 0 };
+	std::vector<ThreadPool::JobHandle> pinned;
+	for (int i = 0; i < 100; i++)
+	{
+		ThreadPool::JobHandle work = pool.schedule([]() {});
+		pinned.push_back(pool.schedule([&wrongThread, mainThread]()
+			{
+				if (std::this_thread::get_id() != mainThread) wrongThread++;
+			}, { work }, mainThread));
+	}
+	//The workers finish the dependencies, but the pinned jobs have to wait for this thread.
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	for (const ThreadPool::JobHandle& job : pinned)
+		check(!pool.isFinished(job), "pinned job ran before its thread ran pinned jobs");
+	pool.runPinnedJobs();
+	for (const ThreadPool::JobHandle& job : pinned)
+		check(pool.isFinished(job), "runPinnedJobs left a ready pinned job");
+	check(wrongThread == 0, "pinned job ran off the main thread");
+
+	//Pinned to another thread, which only runs them through wait. A worker job in between makes the chain hop threads.
+	std::thread::id otherId;
+	std::atomic<bool> idKnown{ false };
+	std::atomic<ThreadPool::JobHandle*> target{ nullptr };
+	std::thread other([&pool, &otherId, &idKnown, &target]()
+		{
+			otherId = std::this_thread::get_id();
+			idKnown = true;
+			while (!target) std::this_thread::yield();
+			pool.wait(*target);
+		});
+	while (!idKnown) std::this_thread::yield();
+	std::thread::id ranOn;
+	ThreadPool::JobHandle a = pool.schedule([&ranOn]() { ranOn = std::this_thread::get_id(); }, {}, otherId);
+	ThreadPool::JobHandle b = pool.schedule([]() {}, { a });
+	std::thread::id lastRanOn;
+	ThreadPool::JobHandle c = pool.schedule([&lastRanOn]() { lastRanOn = std::this_thread::get_id(); }, { b }, otherId);
+	target = &c;
+	other.join();
+	check(pool.isFinished(c), "wait returned before its job finished");
+	check(ranOn == otherId && lastRanOn == otherId, "job pinned to another thread ran off it");
+}
+
+static void testExceptions(ThreadPool& pool)
+{
+	ThreadPool::JobHandle throwing = pool.schedule([]() { throw std::runtime_error("job failed"); });
+	bool caught = false;
+	try
+	{
+		pool.wait(throwing);
+	}
+	catch (const std::runtime_error& error)
+	{
+		caught = std::string(error.what()) == "job failed";
+	}
+	check(caught, "wait didn't rethrow the job's exception");
+	check(pool.isFinished(throwing), "a job that threw isn't finished");
+
+	//The exception doesn't hold back the job's dependents, they are still released.
+	bool dependentRan = false;
+	pool.wait(pool.schedule([&dependentRan]() { dependentRan = true; }, { throwing }));
+	check(dependentRan, "dependent of a job that threw never ran");
+
+	caught = false;
+	try
+	{
+		pool.wait(pool.schedule([]() { throw std::logic_error("pinned job failed"); }, {}, std::this_thread::get_id()));
+	}
+	catch (const std::logic_error&)
+	{
+		caught = true;
+	}
+	check(caught, "wait didn't rethrow a pinned job's exception");
+
+	caught = false;
+	try
+	{
+		pool.parallelFor(64, [](size_t i)
+			{
+				if (i == 37) throw std::runtime_error("index failed");
+			});
+	}
+	catch (const std::runtime_error&)
+	{
+		caught = true;
+	}
+	check(caught, "parallelFor didn't rethrow");
+
+	std::future<int> future = pool.submit([]() -> int { throw std::runtime_error("submit failed"); });
+	caught = false;
+	try
+	{
+		future.get();
+	}
+	catch (const std::runtime_error&)
+	{
+		caught = true;
+	}
+	check(caught, "submit's future didn't carry the exception");
+}
+
+//Jobs that wait on jobs they schedule, and parallelFor inside parallelFor, more deeply than there are workers.
+static void testNesting(ThreadPool& pool)
+{
+	std::atomic<int> leaves{ 0 };
+	std::function<void(int)> spawn = [&pool, &leaves, &spawn](int depth)
+		{
+			if (depth == 0)
+			{
+				leaves++;
+				return;
+			}
+			ThreadPool::JobHandle left = pool.schedule([&spawn, depth]() { spawn(depth - 1); });
+			ThreadPool::JobHandle right = pool.schedule([&spawn, depth]() { spawn(depth - 1); });
+			pool.wait(left);
+			pool.wait(right);
+		};
+	pool.wait(pool.schedule([&spawn]() { spawn(8); }));
+	check(leaves == 256, "nested waits ran " + std::to_string(leaves.load()) + " of 256 leaves");
+
+	std::vector<std::atomic<int>> counts(16 * 16);
+	pool.wait(pool.schedule([&pool, &counts]()
+		{
+			pool.parallelFor(16, [&pool, &counts](size_t i)
+				{
+					pool.parallelFor(16, [&counts, i](size_t j) { counts[i * 16 + j]++; });
+				});
+		}));
+	bool once = true;
+	for (const std::atomic<int>& count : counts)
+		once &= count == 1;
+	check(once, "nested parallelFor didn't run every index exactly once");
+
+	//A job waiting on a job pinned to the thread that is waiting on it.
+	std::thread::id mainThread = std::this_thread::get_id();
+	bool pinnedRan = false;
+	ThreadPool::JobHandle pinned = pool.schedule([&pinnedRan]() { pinnedRan = true; }, {}, mainThread);
+	pool.wait(pool.schedule([&pool, pinned]() { pool.wait(pinned); }));
+	check(pinnedRan, "wait from a job on a pinned job didn't finish");
+}
+
+int main()
+{
+	for (unsigned int threadCount : { 1u, 4u })
+	{
+		printf("%u worker threads\n", threadCount);
+		ThreadPool pool(threadCount);
+		testDependencyOrder(pool);
+		testPinnedAffinity(pool);
+		testExceptions(pool);
+		testNesting(pool);
+	}
+	if (failures) printf("%d checks failed\n", failures);
+	else printf("All checks passed\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+#include "TiledImage.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "PaintKernels.h"
+
+TiledImage::TiledImage(int width, int height, Format format)
+{
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	tiles.resize(static_cast<size_t>(tilesX) * tilesY);
+}
+
+unsigned char* TiledImage::getTile(int tileX, int tileY)
+{
+	std::unique_ptr<unsigned char[]>& tile = tiles[static_cast<size_t>(tileY) * tilesX + tileX];
+	if (!tile)
+	{
+		//Zero bits are transparent black for both formats.
+		size_t bytes = static_cast<size_t>(tileSize) * tileSize * getPixelSize();
+		tile.reset(new unsigned char[bytes]);
+		memset(tile.get(), 0, bytes);
+	}
+	return tile.get();
+}
+
+const unsigned char* TiledImage::findTile(int tileX, int tileY) const
+{
+	return tiles[static_cast<size_t>(tileY) * tilesX + tileX].get();
+}
+
+void TiledImage::clear()
+{
+	for (std::unique_ptr<unsigned char[]>& tile : tiles)
+		tile.reset();
+}
+
+void TiledImage::readRGBA8(std::vector<unsigned char>& pixels) const
+{
+	pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+	const PaintKernels& kernels = getPaintKernels(getBestPaintKernelSet());
+	std::vector<float> row(static_cast<size_t>(tileSize) * 4);
+	size_t tileRowBytes = static_cast<size_t>(tileSize) * getPixelSize();
+
+	for (int tileY = 0; tileY < tilesY; tileY++)
+	{
+		for (int tileX = 0; tileX < tilesX; tileX++)
+		{
+			const unsigned char* tile = findTile(tileX, tileY);
+			if (!tile) continue;
+			int columns = std::min(tileSize, width - tileX * tileSize);
+			int rows = std::min(tileSize, height - tileY * tileSize);
+			for (int y = 0; y < rows; y++)
+			{
+				const unsigned char* in = tile + y * tileRowBytes;
+				unsigned char* out = &pixels[(static_cast<size_t>(tileY * tileSize + y) * width + tileX * tileSize) * 4];
+				if (format == Format::RGBA8)
+				{
+					memcpy(out, in, static_cast<size_t>(columns) * 4);
+				}
+				else
+				{
+					kernels.unpackRGBA16F(reinterpret_cast<const uint16_t*>(in), row.data(), columns);
+					kernels.packRGBA8(row.data(), out, columns);
+				}
+			}
+		}
+	}
+}
+
+int TiledImage::getWidth() const
+{
+	return width;
+}
+
+int TiledImage::getHeight() const
+{
+	return height;
+}
+
+TiledImage::Format TiledImage::getFormat() const
+{
+	return format;
+}
+
+int TiledImage::getTilesX() const
+{
+	return tilesX;
+}
+
+int TiledImage::getTilesY() const
+{
+	return tilesY;
+}
+
+int TiledImage::getPixelSize() const
+{
+	return format == Format::RGBA8 ? 4 : 8;
+}
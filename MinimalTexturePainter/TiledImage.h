@@ -0,0 +1,54 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+//RGBA image in CPU memory split into square tiles. Tiles are only allocated once written, untouched ones read as transparent.
+//Rows go upwards from v = 0 like a GL texture, so pixels line up with the GPU path's textures.
+class TiledImage
+{
+public:
+	enum class Format
+	{
+		RGBA8,
+		//Stored as halves, same as StrokeBuffer.
+		RGBA16F
+	};
+
+	static constexpr int tileSize = 64;
+
+private:
+	int width;
+	int height;
+	Format format;
+	int tilesX;
+	int tilesY;
+	std::vector<std::unique_ptr<unsigned char[]>> tiles;
+
+public:
+	TiledImage(int width, int height, Format format);
+
+	//Allocates the tile cleared to transparent if it isn't yet. Not thread safe, allocate before handing tiles to workers.
+	unsigned char* getTile(int tileX, int tileY);
+
+	//Null for tiles that were never written.
+	const unsigned char* findTile(int tileX, int tileY) const;
+
+	//Frees every tile.
+	void clear();
+
+	//Copies to a contiguous RGBA8 buffer in the same row order as glGetTexImage. Half floats are clamped and rounded.
+	void readRGBA8(std::vector<unsigned char>& pixels) const;
+
+	int getWidth() const;
+
+	int getHeight() const;
+
+	Format getFormat() const;
+
+	int getTilesX() const;
+
+	int getTilesY() const;
+
+	//Bytes per pixel.
+	int getPixelSize() const;
+};
@@ -26,6 +26,11 @@ const Model& WorldObject::getModel() const
     return *model;
 }
 
+Model& WorldObject::getModel()
+{
+    return *model;
+}
+
 void WorldObject::setModel(const std::shared_ptr<Model>& model)
 {
     this->model = model;
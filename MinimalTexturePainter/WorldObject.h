@@ -22,5 +22,7 @@ public:
 
 	const Model& getModel() const;
 
+	Model& getModel();
+
 	void setModel(const std::shared_ptr<Model>& model);
 };
\ No newline at end of file
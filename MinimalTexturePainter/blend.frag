@@ -9,6 +9,10 @@ uniform float alpha;
 uniform float sourceScale;
 uniform int texSize;
 uniform sampler2D sourceTexture;
+//See BrushMask. The mask covers the target's UV space, it isn't tiled by sourceScale.
+uniform sampler2D maskTexture;
+uniform vec4 maskWeights;
+uniform float maskOffset;
 
 void main()
 {
@@ -21,5 +25,8 @@ void main()
 	if (multiplier < 0.99) discard;
 
 	FragColor = texture(sourceTexture, texCoords / sourceScale) * multiplier;
-	FragColor = vec4(FragColor.rgb, FragColor.a * alpha);
+	//Premultiplied for the stroke buffer.
+	float mask = clamp(dot(texture(maskTexture, texCoords), maskWeights) + maskOffset, 0.0, 1.0);
+	float coverage = FragColor.a * alpha * mask;
+	FragColor = vec4(FragColor.rgb * coverage, coverage);
 }
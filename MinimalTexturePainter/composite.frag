@@ -0,0 +1,61 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+
+//0 copies the base, 1 to 4 match LayerStack::BlendMode + 1, 5 outputs only the stroke.
+uniform int mode;
+uniform float opacity;
+uniform sampler2D layer;
+
+//Stroke in progress on this layer. The buffer only covers part of the texture.
+uniform bool strokeActive;
+uniform sampler2D stroke;
+uniform vec2 strokeOffset;
+uniform vec2 strokeScale;
+uniform float strokeOpacity;
+
+vec4 sampleStroke(vec2 texCoords)
+{
+	vec2 strokeCoords = (texCoords - strokeOffset) * strokeScale;
+	if (any(lessThan(strokeCoords, vec2(0.0))) || any(greaterThan(strokeCoords, vec2(1.0)))) return vec4(0.0);
+	return texture(stroke, strokeCoords) * strokeOpacity;
+}
+
+void main()
+{
+	vec2 texCoords = (FragPos.xy + vec2(1, 1))/2;
+
+	if (mode == 5)
+	{
+		FragColor = sampleStroke(texCoords);
+		return;
+	}
+
+	vec4 texel = texture(layer, texCoords);
+
+	if (mode == 0)
+	{
+		FragColor = texel;
+		return;
+	}
+
+	//Preview the stroke as if it were already part of the layer.
+	if (strokeActive)
+	{
+		vec4 strokeTexel = sampleStroke(texCoords);
+		texel = strokeTexel + texel * (1.0 - strokeTexel.a);
+	}
+
+	//Paint layers are premultiplied. The blend function set for each mode does the rest.
+	texel *= opacity;
+	if (mode == 2)
+	{
+		//Multiply. Destination is scaled by this colour.
+		FragColor = vec4(vec3(1.0 - texel.a) + texel.rgb, texel.a);
+	}
+	else
+	{
+		FragColor = texel;
+	}
+}
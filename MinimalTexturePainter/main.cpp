@@ -1,20 +1,43 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
-#include <nfd/nfd.h>
+#include <thread>
 
+#include "BackgroundTasks.h"
+#include "BatchPainter.h"
+#include "Benchmark.h"
+#include "ComputeBrush.h"
+#include "CpuProfiler.h"
 #include "DirectionalLight.h"
+#include "FrameGraph.h"
+#include "GLCallStats.h"
+#include "GLExtensions.h"
+#include "GLResources.h"
+#include "GLStateCache.h"
+#include "GpuProfiler.h"
+#include "ImGuiGlfwInput.h"
+#include "InputEvent.h"
+#include "LayerStack.h"
+#include "MaskBaker.h"
+#include "Picking.h"
 #include "Renderer.h"
+#include "SceneBenchmark.h"
+#include "SpscQueue.h"
+#include "StrokeLog.h"
 #include "TextureBlender.h"
+#include "TextureCache.h"
+#include "TextureExporter.h"
+#include "TextureUploader.h"
+#include "ThreadPool.h"
 #include "WorldObject.h"
 #include "imgui/imgui.h"
-#include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
-#include "stb_image_write.h"
 
 unsigned int screen_width = 1280;
 unsigned int screen_height = 720;
@@ -32,19 +55,21 @@ unsigned int quadVBO;
 unsigned int quadVAO;
 unsigned int quadEBO;
 
-unsigned int mainFramebuffer;
-unsigned int mainTexture;
-
-unsigned int uvRenderFramebuffer;
-unsigned int uvRenderTexture;
-
 unsigned int currentBrushDiffuse;
 unsigned int currentBrushSpecular;
 unsigned int currentBrushNormal;
 
 float brushSize = 1;
 float brushAlpha = 1;
+float strokeOpacity = 1;
+TextureBlender::Accumulation strokeAccumulation = TextureBlender::Accumulation::Max;
+BrushTool brushTool = BrushTool::Paint;
+bool useComputeBrush = true;
+bool stroking = false;
 float brushSourceScale = 1;
+//Fixed when a stroke begins, so the toolbar can't change a stroke halfway.
+StrokeSettings activeStroke;
+double strokeStartTime = 0;
 
 float lightYaw = 0;
 float lightPitch = 0;
@@ -62,66 +87,214 @@ float lastY = 0.0f;
 float uvMouseX = 0.0f;
 float uvMouseY = 0.0f;
 
-GLfloat* uvPixels;
-
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 6.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
 
 std::vector<WorldObject> worldObjects{};
 
+std::unique_ptr<ThreadPool> threadPool;
+std::unique_ptr<TextureUploader> textureUploader;
+std::unique_ptr<TextureCache> textureCache;
+std::unique_ptr<TextureExporter> textureExporter;
+std::unique_ptr<BackgroundTasks> backgroundTasks;
+
 std::unique_ptr<Shader> blendShader;
 std::unique_ptr<TextureBlender> diffuseBlender;
 std::unique_ptr<TextureBlender> specularBlender;
 std::unique_ptr<TextureBlender> normalBlender;
+std::unique_ptr<Shader> compositeShader;
+//Only created when the context supports compute shaders.
+std::unique_ptr<ComputeBrush> computeBrush;
+std::unique_ptr<GpuProfiler> gpuProfiler;
+//The profiler only records while its window is open.
+bool showGpuProfiler = false;
+//Counted over the whole of the previous frame.
+GLCallStats lastFrameCalls;
+bool showGLCallStats = false;
+std::unique_ptr<FrameGraph> frameGraph;
+bool showFrameGraph = false;
+std::unique_ptr<LayerStack> diffuseLayers;
+std::unique_ptr<LayerStack> specularLayers;
+std::unique_ptr<LayerStack> normalLayers;
+//Layer stacks are built from the model's textures once they have finished streaming.
+bool layerStacksPending = false;
+//A model loading in the background. The current one stays up until it has loaded.
+std::shared_ptr<Model> loadingModel;
 string diffuseName;
 string specularName;
 string normalName;
+//Where each brush came from, indexed like the stroke channel bits.
+BrushSource brushSources[strokeChannelCount];
+//Occlusion and curvature of the model in its UV space, see BakeChannel. 0 until baked.
+unsigned int maskTexture = 0;
+BakeSettings bakeSettings;
+bool baking = false;
+string bakeStatus;
+//A BrushMaskMode, as an int for the toolbar's combo. The mask is fixed for each stroke when it begins.
+int brushMaskMode = 0;
+
+StrokeLogWriter strokeLog;
+string strokeLogName;
+double recordingStartTime = 0;
 
 bool toolbarActive;
 
+//Filled by the GLFW callbacks on the main thread and drained by the render thread at the start of each frame.
+SpscQueue<InputEvent> inputEvents(4096);
+std::atomic<size_t> droppedInputEvents{ 0 };
+std::atomic<bool> quitRequested{ false };
+//Button state as of the last event the render thread processed.
+bool mouseButtons[GLFW_MOUSE_BUTTON_LAST + 1] = {};
+//Time of the newest cursor or button event processed, what a dab painted now responds to.
+double lastPointerEventTime = 0;
+//Input time of the first dab painted this frame, or -1.
+double dabInputTime = -1;
+//Cursor moves and left button events since the last frame, in order. Each move made while painting is a dab.
+std::vector<InputEvent> pointerEvents;
+//When the previous dab of the stroke was painted, so flow builds up by time rather than by how many samples arrived.
+double lastDabTime = -1;
+//Longest an event processed this frame waited in the queue, in milliseconds.
+float inputQueueWait = 0;
+//Milliseconds per frame, oldest first.
+std::vector<float> dabLatencyHistory;
+std::vector<float> queueWaitHistory;
+constexpr size_t latencyHistoryLength = 240;
+bool showInputLatency = false;
+
+//ImGui's cursor shape whenever it changes, from the render thread to the main thread, which is the only one that may set it.
+SpscQueue<ImGuiMouseCursor> cursorChanges(16);
+
+//GLFW callbacks, on the main thread. They only timestamp and queue the event.
+void cursor_callback(GLFWwindow* window, double xpos, double ypos);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void char_callback(GLFWwindow* window, unsigned int codepoint);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
-void processInput(GLFWwindow* window, float deltaTime);
+void queueInputEvent(const InputEvent& event);
 
-void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+//Owns the GL context and runs every frame until the main thread asks it to stop.
+int renderLoop(GLFWwindow* window);
+
+//Applies the queued events to ImGui, the camera and the button state.
+void processEvents();
+
+void resize(int width, int height);
+
+void processInput(float deltaTime);
+
+void moveCursor(double xpos, double ypos);
+void scrollCamera(double yoffset);
 
 void start(Shader& mainShader, Shader& shadowShader, Shader& quadShader, Renderer& renderer);
 
-void tick(float deltaTime, Shader& mainShader, Shader& shadowShader, Shader& quadShader, Shader& uvRenderShader, Renderer& renderer);
+void tick(float deltaTime, Shader& mainShader, Shader& shadowShader, Shader& quadShader, Renderer& renderer);
+
+void openModel(Renderer& renderer);
+
+void loadModel(const std::string& path, Renderer& renderer);
+
+//Channels are indexed like the stroke channel bits.
+void openBrushTexture(int channel);
+
+void loadBrush(int channel, const std::string& path);
+
+void setBrush(int channel, const std::string& path, const CachedImage& image);
+
+void setBrush(int channel, const std::string& path);
+
+void saveTexture(int channel);
+
+//Bakes the masks of the model in the background and swaps them in when done.
+void startMaskBake();
+
+BrushMask currentBrushMask();
+
+string fileName(const std::string& path);
+
+void createLayerStacks();
+
+void layerStackUI(const char* label, LayerStack& layers);
+
+void gpuProfilerUI();
+
+void glCallStatsUI();
 
-void generateMainFramebufferAttachments();
+void inputLatencyUI();
 
-void generateUVFramebufferAttachements();
+void addLatency(std::vector<float>& history, float ms);
 
-void openModel();
+void frameGraphUI();
 
-void openDiffuseTexture();
+void exportGpuTimings();
 
-void openSpecularTexture();
+void saveCpuTrace();
 
-void openNormalTexture();
+StrokeSettings currentStrokeSettings();
 
-unsigned int loadTextureFromFile(const char* path, bool useSRGB);
+void beginStroke(const StrokeSettings& settings, double startTime);
 
-void saveDiffuseTexture();
+void endStroke();
 
-void saveSpecularTexture();
+//Paints a dab where the cursor was at time. Returns false if there was nothing to paint there.
+bool paint(double x, double y, double time, float deltaTime);
 
-void saveNormalTexture();
+void paintAt(const StrokeSample& sample);
 
-void paint(float deltaTime);
+void recordStrokes();
 
-int main()
+void replayStrokes();
+
+int main(int argc, char* argv[])
 {
+	setProfilerThreadName("Main");
+
+	//Headless modes, no visible window.
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-encode")
+	{
+		return runEncodeBenchmark();
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-paint")
+	{
+		return runPaintBenchmark();
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-micro")
+	{
+		return runMicrobenchmarks(argc, argv);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-jobs")
+	{
+		return runJobBenchmark();
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-bake")
+	{
+		return runBakeBenchmark();
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark-scene")
+	{
+		return runSceneBenchmark(argc, argv);
+	}
+	if (argc > 1 && std::string(argv[1]) == "--batch")
+	{
+		return runBatch(argc, argv);
+	}
+
 	//GLFW init.
 	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	GLFWwindow* window = glfwCreateWindow(screen_width, screen_height, "MinimalTexturePainter", NULL, NULL);
+	//Ask for the newest context so optional paths like persistent mapping are available, falling back to 3.3.
+	constexpr int contextVersions[][2] = { { 4, 6 }, { 4, 5 }, { 4, 4 }, { 4, 3 }, { 3, 3 } };
+	GLFWwindow* window = NULL;
+	for (const auto& version : contextVersions)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+		window = glfwCreateWindow(screen_width, screen_height, "MinimalTexturePainter", NULL, NULL);
+		if (window) break;
+	}
 	if (window == NULL)
 	{
 		std::cout << "Failed to create GLFW window." << std::endl;
@@ -129,147 +302,575 @@ int main()
 		return -1;
 	}
 
-	glfwMakeContextCurrent(window);
-
+	//Input is handled on this thread and everything touching GL on the render thread, so a slow frame doesn't hold up
+	//input and the callbacks never wait on rendering.
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetCursorPosCallback(window, cursor_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	glfwSetScrollCallback(window, scroll_callback);
-
+	glfwSetKeyCallback(window, key_callback);
+	glfwSetCharCallback(window, char_callback);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
+	GLFWcursor* cursors[ImGuiMouseCursor_COUNT];
+	for (int cursor = 0; cursor < ImGuiMouseCursor_COUNT; cursor++)
+	{
+		cursors[cursor] = glfwCreateStandardCursor(imGuiCursorToGlfwShape(cursor));
+	}
+
+	int result = 0;
+	std::thread renderThread([window, &result]() { result = renderLoop(window); });
+	while (!glfwWindowShouldClose(window))
+	{
+		glfwWaitEvents();
+
+		ImGuiMouseCursor cursor;
+		while (cursorChanges.pop(cursor))
+		{
+			if (cursor == ImGuiMouseCursor_None)
+			{
+				glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
+				continue;
+			}
+			glfwSetCursor(window, cursors[cursor]);
+			glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+		}
+	}
+	quitRequested = true;
+	renderThread.join();
+
+	for (GLFWcursor* cursor : cursors)
+	{
+		glfwDestroyCursor(cursor);
+	}
+
+	glfwTerminate();
+	return result;
+}
+
+int renderLoop(GLFWwindow* window)
+{
+	setProfilerThreadName("Render");
+	glfwMakeContextCurrent(window);
+
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
 		std::cout << "Failed to initialize GLAD." << std::endl;
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+		glfwPostEmptyEvent();
 		return -1;
 	}
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+	installGLCallCounters();
 
 	//IMGUI init.
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO();
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
-	ImGui_ImplGlfw_InitForOpenGL(window, true);
+	//The GLFW backend calls into GLFW every frame, which may only happen on the main thread. Input comes from the event
+	//queue instead, and cursor shapes go back the other way through cursorChanges.
+	io.BackendFlags |= ImGuiBackendFlags_HasMouseCursors;
+	io.BackendPlatformName = "MinimalTexturePainter";
 	ImGui_ImplOpenGL3_Init();
 
 	Shader mainShader("default.vert", "default.frag");
 	Shader shadowShader("shadow.vert", "shadow.frag");
-	Shader uvRenderShader("uvrender.vert", "uvrender.frag");
 	blendShader = std::make_unique<Shader>("blend.vert", "blend.frag");
+	compositeShader = std::make_unique<Shader>("composite.vert", "composite.frag");
+	if (getGLCapabilities().computeShader)
+	{
+		computeBrush = std::make_unique<ComputeBrush>();
+	}
+	gpuProfiler = std::make_unique<GpuProfiler>();
+	frameGraph = std::make_unique<FrameGraph>();
 	Shader quadShader("quad.vert", "quad.frag");
 	Renderer renderer(mainShader, shadowShader, 4096, 4096);
 
+	threadPool = std::make_unique<ThreadPool>();
+	textureUploader = std::make_unique<TextureUploader>();
+	textureCache = std::make_unique<TextureCache>(*textureUploader);
+	textureExporter = std::make_unique<TextureExporter>(*threadPool);
+	backgroundTasks = std::make_unique<BackgroundTasks>(*threadPool);
+
 	float deltaTime = 0.0f;
 	float lastFrame = 0.0f;
-
-	uvPixels = new GLfloat[screen_width * screen_height * 3];
+	ImGuiMouseCursor lastCursor = ImGuiMouseCursor_Arrow;
 
 	start(mainShader, shadowShader, quadShader, renderer);
 
-	while (!glfwWindowShouldClose(window))
+	while (!quitRequested)
 	{
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		PROFILE_ZONE("Frame");
+		lastFrameCalls = getGLCallStats();
+		resetGLCallStats();
+
+		{
+			PROFILE_ZONE("Process Events");
+			processEvents();
+		}
 
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
+		{
+			PROFILE_ZONE("ImGui New Frame");
+			ImGui_ImplOpenGL3_NewFrame();
+			io.DisplaySize = ImVec2(static_cast<float>(screen_width), static_cast<float>(screen_height));
+			io.DeltaTime = std::max(deltaTime, 0.0001f);
+			ImGui::NewFrame();
+		}
 
-		processInput(window, deltaTime);
+		gpuProfiler->setEnabled(showGpuProfiler);
+		gpuProfiler->beginFrame();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		{
+			PROFILE_ZONE("Uploads and Saves");
+			threadPool->runPinnedJobs();
+			textureUploader->update();
+			textureExporter->update();
+			if (layerStacksPending && textureUploader->isIdle())
+			{
+				createLayerStacks();
+			}
+		}
 
-		tick(deltaTime, mainShader, shadowShader, quadShader, uvRenderShader, renderer);
+		{
+			PROFILE_ZONE("Process Input");
+			processInput(deltaTime);
+		}
 
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		//The resolve at the end of tick clears and covers the whole window.
+		tick(deltaTime, mainShader, shadowShader, quadShader, renderer);
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		{
+			PROFILE_ZONE("ImGui Render");
+			ImGui::Render();
+			GpuScope scope(gpuProfiler.get(), "UI");
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		}
+
+		ImGuiMouseCursor cursor = ImGui::GetMouseCursor();
+		if (cursor != lastCursor && cursorChanges.push(cursor))
+		{
+			lastCursor = cursor;
+			//Wakes the main thread out of glfwWaitEvents to apply it.
+			glfwPostEmptyEvent();
+		}
+		gpuProfiler->endFrame();
+
+		{
+			PROFILE_ZONE("Swap Buffers");
+			glfwSwapBuffers(window);
+		}
+
+		//Input to the frame that shows it leaving for the screen.
+		if (dabInputTime >= 0)
+		{
+			addLatency(dabLatencyHistory, static_cast<float>((glfwGetTime() - dabInputTime) * 1000));
+			dabInputTime = -1;
+		}
+		addLatency(queueWaitHistory, inputQueueWait);
 	}
 
+	//Lets loads still in flight wind down, then finishes any saves.
+	backgroundTasks.reset();
+	loadingModel.reset();
+	textureExporter.reset();
+	glDeleteTextures(1, &maskTexture);
+	diffuseBlender.reset();
+	specularBlender.reset();
+	normalBlender.reset();
+	computeBrush.reset();
+	gpuProfiler.reset();
+	frameGraph.reset();
+	diffuseLayers.reset();
+	specularLayers.reset();
+	normalLayers.reset();
+	worldObjects.clear();
+	textureCache.reset();
+	textureUploader.reset();
+	threadPool.reset();
+
 	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
-	glfwTerminate();
+	glfwMakeContextCurrent(NULL);
 	return 0;
 }
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+void createLayerStacks()
 {
-	glViewport(0, 0, width, height);
-	screen_width = width;
-	screen_height = height;
+	layerStacksPending = false;
+	if (worldObjects.empty()) return;
+
+	//The model samples each composite in place of its original texture, which stays untouched in the cache.
+	Model& model = worldObjects.front().getModel();
+	for (const Texture& texture : model.textures_loaded)
+	{
+		std::unique_ptr<LayerStack>* layers = nullptr;
+		if (texture.type == "texture_diffuse") layers = &diffuseLayers;
+		else if (texture.type == "texture_specular") layers = &specularLayers;
+		else if (texture.type == "texture_normal") layers = &normalLayers;
+		if (!layers || *layers || !texture.id) continue;
+
+		*layers = std::make_unique<LayerStack>(*compositeShader, texture.id);
+		model.replaceTexture(texture.id, (*layers)->getCompositeTexture());
+	}
+
+	//Brushes opened before the model finished loading.
+	if (diffuseLayers && currentBrushDiffuse)
+	{
+		diffuseBlender = std::make_unique<TextureBlender>(*blendShader, diffuseLayers->getWidth(), diffuseLayers->getHeight(), currentBrushDiffuse);
+	}
+	if (specularLayers && currentBrushSpecular)
+	{
+		specularBlender = std::make_unique<TextureBlender>(*blendShader, specularLayers->getWidth(), specularLayers->getHeight(), currentBrushSpecular);
+	}
+	if (normalLayers && currentBrushNormal)
+	{
+		normalBlender = std::make_unique<TextureBlender>(*blendShader, normalLayers->getWidth(), normalLayers->getHeight(), currentBrushNormal);
+	}
+}
 
-	//Need to change render resolution.
-	glBindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
-	generateMainFramebufferAttachments();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void layerStackUI(const char* label, LayerStack& layers)
+{
+	static const char* blendModes[] = { "Normal", "Multiply", "Add", "Screen" };
 
-	glBindFramebuffer(GL_FRAMEBUFFER, uvRenderFramebuffer);
-	generateUVFramebufferAttachements();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!ImGui::TreeNode(label)) return;
 
-	uvPixels = new GLfloat[screen_width * screen_height * 3];
+	bool changed = false;
+	size_t activeLayer = layers.getActiveLayer();
+	std::vector<LayerStack::Layer>& stack = layers.getLayers();
+	//Listed top down.
+	for (size_t i = stack.size(); i-- > 0;)
+	{
+		LayerStack::Layer& layer = stack[i];
+		ImGui::PushID(static_cast<int>(i));
+		if (ImGui::RadioButton(layer.name.c_str(), activeLayer == i))
+		{
+			activeLayer = i;
+		}
+		ImGui::SameLine();
+		changed |= ImGui::Checkbox("Visible", &layer.visible);
+		changed |= ImGui::SliderFloat("Opacity", &layer.opacity, 0, 1);
+		int blendMode = static_cast<int>(layer.blendMode);
+		if (ImGui::Combo("Blend", &blendMode, blendModes, IM_ARRAYSIZE(blendModes)))
+		{
+			layer.blendMode = static_cast<LayerStack::BlendMode>(blendMode);
+			changed = true;
+		}
+		ImGui::PopID();
+	}
+	ImGui::Text("Base");
+
+	if (ImGui::Button("Add Layer"))
+	{
+		layers.addLayer();
+		activeLayer = layers.getActiveLayer();
+	}
+	ImGui::SameLine();
+	ImGui::BeginDisabled(stack.size() <= 1);
+	if (ImGui::Button("Remove Layer"))
+	{
+		layers.removeLayer(activeLayer);
+		activeLayer = layers.getActiveLayer();
+	}
+	ImGui::EndDisabled();
+
+	layers.setActiveLayer(activeLayer);
+	if (changed) layers.markAllDirty();
+
+	ImGui::TreePop();
 }
 
-void paint(float deltaTime)
+void queueInputEvent(const InputEvent& event)
 {
-	glBindTexture(GL_TEXTURE_2D, uvRenderTexture);
-	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, uvPixels);
+	if (!inputEvents.push(event)) droppedInputEvents++;
+}
 
-	GLfloat r, g, b;
+void cursor_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	InputEvent event{ InputEvent::Type::CursorMove, glfwGetTime() };
+	event.x = xpos;
+	event.y = ypos;
+	queueInputEvent(event);
+}
 
-	size_t x = uvMouseX;
-	size_t y = screen_height - uvMouseY;
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	InputEvent event{ InputEvent::Type::MouseButton, glfwGetTime() };
+	glfwGetCursorPos(window, &event.x, &event.y);
+	event.button = button;
+	event.action = action;
+	event.mods = mods;
+	queueInputEvent(event);
+}
 
-	size_t elmes_per_line = screen_width * 3;
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	InputEvent event{ InputEvent::Type::Scroll, glfwGetTime() };
+	event.x = xoffset;
+	event.y = yoffset;
+	queueInputEvent(event);
+}
 
-	size_t row = y * elmes_per_line;
-	size_t col = x * 3;
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	InputEvent event{ InputEvent::Type::Key, glfwGetTime() };
+	event.button = key;
+	event.scancode = scancode;
+	event.action = action;
+	event.mods = mods;
+	queueInputEvent(event);
+}
 
-	r = uvPixels[row + col];
-	g = uvPixels[row + col + 1];
-	b = uvPixels[row + col + 2];
+void char_callback(GLFWwindow* window, unsigned int codepoint)
+{
+	InputEvent event{ InputEvent::Type::Char, glfwGetTime() };
+	event.codepoint = codepoint;
+	queueInputEvent(event);
+}
 
-	glm::vec2 uv(r, g);
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	InputEvent event{ InputEvent::Type::Resize, glfwGetTime() };
+	event.x = width;
+	event.y = height;
+	queueInputEvent(event);
+}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+void processEvents()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	double now = glfwGetTime();
+	inputQueueWait = 0;
+	pointerEvents.clear();
+	InputEvent event;
+	while (inputEvents.pop(event))
+	{
+		inputQueueWait = std::max(inputQueueWait, static_cast<float>((now - event.time) * 1000));
+		switch (event.type)
+		{
+		case InputEvent::Type::CursorMove:
+			io.AddMousePosEvent(static_cast<float>(event.x), static_cast<float>(event.y));
+			moveCursor(event.x, event.y);
+			lastPointerEventTime = event.time;
+			pointerEvents.push_back(event);
+			break;
+		case InputEvent::Type::MouseButton:
+			io.AddKeyEvent(ImGuiMod_Ctrl, (event.mods & GLFW_MOD_CONTROL) != 0);
+			io.AddKeyEvent(ImGuiMod_Shift, (event.mods & GLFW_MOD_SHIFT) != 0);
+			io.AddKeyEvent(ImGuiMod_Alt, (event.mods & GLFW_MOD_ALT) != 0);
+			io.AddKeyEvent(ImGuiMod_Super, (event.mods & GLFW_MOD_SUPER) != 0);
+			if (event.button < ImGuiMouseButton_COUNT) io.AddMouseButtonEvent(event.button, event.action == GLFW_PRESS);
+			if (event.button <= GLFW_MOUSE_BUTTON_LAST) mouseButtons[event.button] = event.action == GLFW_PRESS;
+			lastPointerEventTime = event.time;
+			if (event.button == GLFW_MOUSE_BUTTON_1) pointerEvents.push_back(event);
+			break;
+		case InputEvent::Type::Scroll:
+			io.AddMouseWheelEvent(static_cast<float>(event.x), static_cast<float>(event.y));
+			scrollCamera(event.y);
+			break;
+		case InputEvent::Type::Key:
+			io.AddKeyEvent(ImGuiMod_Ctrl, (event.mods & GLFW_MOD_CONTROL) != 0);
+			io.AddKeyEvent(ImGuiMod_Shift, (event.mods & GLFW_MOD_SHIFT) != 0);
+			io.AddKeyEvent(ImGuiMod_Alt, (event.mods & GLFW_MOD_ALT) != 0);
+			io.AddKeyEvent(ImGuiMod_Super, (event.mods & GLFW_MOD_SUPER) != 0);
+			io.AddKeyEvent(glfwKeyToImGuiKey(event.button), event.action != GLFW_RELEASE);
+			break;
+		case InputEvent::Type::Char:
+			io.AddInputCharacter(event.codepoint);
+			break;
+		case InputEvent::Type::Resize:
+			resize(static_cast<int>(event.x), static_cast<int>(event.y));
+			break;
+		}
+	}
+}
+
+void resize(int width, int height)
+{
+	//A minimized window reports no area. Keep rendering at the old size until it comes back.
+	if (width == 0 || height == 0) return;
+	glViewport(0, 0, width, height);
+	screen_width = width;
+	screen_height = height;
+
+	//The frame graph's targets follow the screen size by themselves.
+}
+
+bool paint(double x, double y, double time, float deltaTime)
+{
+	PROFILE_ZONE("Paint");
+	//Dragging past the edge still reports the cursor, outside the window.
+	if (x < 0 || y < 0 || x >= screen_width || y >= screen_height) return false;
+
+	//Cast on the CPU with the camera as it is now, so nothing waits on the GPU and the sample's own position is used.
+	PickHit hit;
+	{
+		PROFILE_ZONE("Pick");
+		glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+		glm::mat4 projection = glm::perspective(glm::radians(60.f), (float)screen_width / (float)screen_height, 0.1f, 100.0f);
+		glm::vec3 start, end;
+		getCursorRay(view, projection, x, y, screen_width, screen_height, start, end);
+		if (!pickObjects(worldObjects, start, end, hit)) return false;
+	}
+	glm::vec2 uv = hit.uv;
+
+	//A brush still streaming in only has its placeholder level, which would paint a blurred average of it. Other uploads,
+	//like a model loading in the background, don't hold painting up.
+	unsigned int brushes[] = { currentBrushDiffuse, currentBrushSpecular, currentBrushNormal };
+	for (int c = 0; c < strokeChannelCount; c++)
+	{
+		if ((activeStroke.channels & (1 << c)) && !textureUploader->isResident(brushes[c])) return false;
+	}
+
+	//Max coverage builds to full straight away, flow builds up over time. Either way the stroke opacity caps it.
+	float elapsed = lastDabTime < 0 ? deltaTime : static_cast<float>(time - lastDabTime);
+	float alpha = activeStroke.accumulation == TextureBlender::Accumulation::Max ? 1.f : brushAlpha * elapsed;
+	paintAt(StrokeSample{ static_cast<float>(time - strokeStartTime), uv, alpha });
+	lastDabTime = time;
+	return true;
+}
 
-	//b is used to indicate if the uv is valid.
-	if (b < 0.99) return;
+//Paints one dab of the active stroke. Replay calls this directly with the logged samples.
+void paintAt(const StrokeSample& sample)
+{
+	const StrokeSettings& settings = activeStroke;
+	ComputeBrush* activeComputeBrush = settings.computeBrush ? computeBrush.get() : nullptr;
+	//Tools other than paint need the compute path, which a replaying context may not have.
+	if (settings.tool != BrushTool::Paint && !activeComputeBrush) return;
+
+	PROFILE_ZONE("Paint Dab");
+	GpuScope scope(gpuProfiler.get(), "Blend");
+	std::pair<LayerStack*, TextureBlender*> channels[] = { { diffuseLayers.get(), diffuseBlender.get() },
+		{ specularLayers.get(), specularBlender.get() },
+		{ normalLayers.get(), normalBlender.get() } };
+	for (int c = 0; c < strokeChannelCount; c++)
+	{
+		LayerStack* layers = channels[c].first;
+		TextureBlender* blender = channels[c].second;
+		if (!(settings.channels & (1 << c)) || !layers || !blender) continue;
+		blender->setComputeBrush(activeComputeBrush);
+		if (settings.tool == BrushTool::Paint)
+		{
+			blender->blend(sample.uv, settings.brushSize, sample.alpha, settings.sourceScale, 4096, settings.accumulation);
+		}
+		else
+		{
+			//Tools change the layer directly, the stroke opacity is their strength.
+			blender->applyTool(settings.tool, layers->getActiveLayerTexture(), sample.uv, settings.brushSize, settings.opacity, settings.sourceScale, 4096);
+		}
+		layers->markDirty(sample.uv, settings.brushSize / 4096.f);
+	}
+
+	if (strokeLog.isOpen()) strokeLog.addSample(sample);
+}
 
-	if (diffuseBlender)
+//Settings for a new stroke from the toolbar. Only channels with both a layer stack and a brush are painted.
+StrokeSettings currentStrokeSettings()
+{
+	StrokeSettings settings;
+	settings.tool = brushTool;
+	settings.accumulation = strokeAccumulation;
+	settings.computeBrush = useComputeBrush && computeBrush;
+	settings.opacity = strokeOpacity;
+	settings.brushSize = brushSize;
+	settings.sourceScale = brushSourceScale;
+	BrushMask mask = currentBrushMask();
+	if (mask.texture)
 	{
-		diffuseBlender->blend(uv, brushSize, brushAlpha * deltaTime, brushSourceScale, 4096);
+		settings.maskMode = static_cast<BrushMaskMode>(brushMaskMode);
+		settings.maskWeights = mask.weights;
+		settings.maskOffset = mask.offset;
 	}
-	if (specularBlender)
+	if (diffuseLayers && diffuseBlender) settings.channels |= StrokeChannelDiffuse;
+	if (specularLayers && specularBlender) settings.channels |= StrokeChannelSpecular;
+	if (normalLayers && normalBlender) settings.channels |= StrokeChannelNormal;
+	return settings;
+}
+
+void beginStroke(const StrokeSettings& settings, double startTime)
+{
+	stroking = true;
+	activeStroke = settings;
+	strokeStartTime = startTime;
+	lastDabTime = -1;
+	//The stroke's own mask rather than the toolbar's, so a replay paints with the one it was recorded with.
+	BrushMask mask;
+	if (settings.maskMode != BrushMaskMode::None && maskTexture)
 	{
-		specularBlender->blend(uv, brushSize, brushAlpha * deltaTime, brushSourceScale, 4096);
+		mask.texture = maskTexture;
+		mask.weights = settings.maskWeights;
+		mask.offset = settings.maskOffset;
 	}
-	if (normalBlender)
+	std::pair<LayerStack*, TextureBlender*> channels[] = { { diffuseLayers.get(), diffuseBlender.get() },
+		{ specularLayers.get(), specularBlender.get() },
+		{ normalLayers.get(), normalBlender.get() } };
+	for (int c = 0; c < strokeChannelCount; c++)
 	{
-		normalBlender->blend(uv, brushSize, brushAlpha * deltaTime, brushSourceScale, 4096);
+		LayerStack* layers = channels[c].first;
+		TextureBlender* blender = channels[c].second;
+		if (!(settings.channels & (1 << c)) || !layers || !blender) continue;
+		blender->setMask(mask);
+		blender->beginStroke();
+		layers->setStroke(&blender->getStrokeBuffer(), settings.opacity);
 	}
+
+	if (strokeLog.isOpen()) strokeLog.beginStroke(strokeStartTime - recordingStartTime, settings, brushSources);
 }
 
-void processInput(GLFWwindow* window, float deltaTime)
+void endStroke()
 {
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) == GLFW_PRESS)
+	if (!stroking) return;
+	stroking = false;
+	PROFILE_ZONE("Commit Stroke");
+	GpuScope scope(gpuProfiler.get(), "Commit Stroke");
+	for (LayerStack* layers : { diffuseLayers.get(), specularLayers.get(), normalLayers.get() })
 	{
-		paint(deltaTime);
+		if (layers) layers->commitStroke();
 	}
+
+	if (strokeLog.isOpen()) strokeLog.endStroke();
 }
 
-void mouse_callback(GLFWwindow* window, double xpos, double ypos)
+void processInput(float deltaTime)
+{
+	//Every sample since the last frame is painted at the time and place it was taken, so a stroke keeps all the detail
+	//the input device gives whatever the frame rate.
+	bool sampled = false;
+	for (const InputEvent& event : pointerEvents)
+	{
+		if (event.type == InputEvent::Type::MouseButton)
+		{
+			if (event.action == GLFW_RELEASE)
+			{
+				endStroke();
+				continue;
+			}
+			//Clicks on the toolbar shouldn't start a stroke.
+			if (stroking || ImGui::GetIO().WantCaptureMouse) continue;
+			beginStroke(currentStrokeSettings(), event.time);
+		}
+		if (!stroking) continue;
+		sampled = true;
+		if (paint(event.x, event.y, event.time, deltaTime) && dabInputTime < 0) dabInputTime = event.time;
+	}
+
+	//Held still, flow keeps building up under the cursor.
+	if (stroking && !sampled)
+	{
+		if (paint(uvMouseX, uvMouseY, glfwGetTime(), deltaTime) && dabInputTime < 0) dabInputTime = lastPointerEventTime;
+	}
+}
+
+void moveCursor(double xpos, double ypos)
 {
 	uvMouseX = xpos;
 	uvMouseY = ypos;
 
 	//Handle rotation.
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2) == GLFW_PRESS) {
+	if (mouseButtons[GLFW_MOUSE_BUTTON_2]) {
 		if (firstRightMouse)
 		{
 			lastX = xpos;
@@ -296,13 +897,13 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 		direction.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
 		cameraFront = glm::normalize(direction);
 	}
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2) == GLFW_RELEASE)
+	if (!mouseButtons[GLFW_MOUSE_BUTTON_2])
 	{
 		firstRightMouse = true;
 	}
 
 	//Handle pan.
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_3) == GLFW_PRESS) {
+	if (mouseButtons[GLFW_MOUSE_BUTTON_3]) {
 		if (firstMiddleMouse)
 		{
 			lastX = xpos;
@@ -323,13 +924,13 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 		cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * xoffset;
 		cameraPos -= glm::normalize(glm::cross(glm::cross(cameraFront, cameraUp), cameraFront)) * yoffset;
 	}
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_3) == GLFW_RELEASE)
+	if (!mouseButtons[GLFW_MOUSE_BUTTON_3])
 	{
 		firstMiddleMouse = true;
 	}
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+void scrollCamera(double yoffset)
 {
 	float sensitivity = 0.2f;
 	cameraPos += cameraFront * (float)yoffset * sensitivity;
@@ -339,62 +940,30 @@ void start(Shader& mainShader, Shader& shadowShader, Shader& quadShader, Rendere
 {
 	glEnable(GL_DEPTH_TEST);
 
-	//Setup main framebuffer.
-	glGenFramebuffers(1, &mainFramebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
-
-	generateMainFramebufferAttachments();
-
-	//Check if framebuffer is complete.
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" <<
-		std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	//Setup uv render framebuffer.
-	glGenFramebuffers(1, &uvRenderFramebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, uvRenderFramebuffer);
-
-	generateUVFramebufferAttachements();
-
-	//Check if framebuffer is complete.
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" <<
-		std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	//The render targets belong to the frame graph.
 
 	//Setup quad
 	//Gen buffers
-	glGenVertexArrays(1, &quadVAO);
-	glGenBuffers(1, &quadVBO);
-	glGenBuffers(1, &quadEBO);
-
-	//Buffer vertices
-	glBindVertexArray(quadVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVert), &quadVert, GL_STATIC_DRAW);
-
-	//Buffer element data
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadElem), &quadElem, GL_STATIC_DRAW);
-
-	//Set VAOs
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	glBindVertexArray(0);
+	quadVBO = createBuffer(sizeof(quadVert), &quadVert, 0);
+	quadEBO = createBuffer(sizeof(quadElem), &quadElem, 0);
+	quadVAO = createVertexArray(quadVBO, 3 * sizeof(float), quadEBO, { { 0, 3, GL_FLOAT, 0 } });
 }
 
-void tick(float deltaTime, Shader& mainShader, Shader& shadowShader, Shader& quadShader, Shader& uvRenderShader, Renderer& renderer)
+void tick(float deltaTime, Shader& mainShader, Shader& shadowShader, Shader& quadShader, Renderer& renderer)
 {
+	PROFILE_ZONE("Tick");
 	//Draw UI
 	ImGuiWindowFlags flags = ImGuiWindowFlags_AlwaysAutoResize;
 	ImGui::Begin("Toolbar", &toolbarActive, flags);
+	backgroundTasks->drawUI();
 	if (worldObjects.empty())
 	{
+		ImGui::BeginDisabled(loadingModel != nullptr);
 		if (ImGui::Button("Open Model"))
 		{
-			openModel();
+			openModel(renderer);
 		}
+		ImGui::EndDisabled();
 	}
 	else
 	{
@@ -415,40 +984,156 @@ void tick(float deltaTime, Shader& mainShader, Shader& shadowShader, Shader& qua
 		ImGui::Text("Diffuse texture: %s", diffuseName.c_str());
 		if (ImGui::Button("Open Diffuse"))
 		{
-			openDiffuseTexture();
+			openBrushTexture(0);
 		}
 		ImGui::Text("Specular texture: %s", specularName.c_str());
 		if (ImGui::Button("Open Specular"))
 		{
-			openSpecularTexture();
+			openBrushTexture(1);
 		}
 		ImGui::Text("Normal texture: %s", normalName.c_str());
 		if (ImGui::Button("Open Normal"))
 		{
-			openNormalTexture();
+			openBrushTexture(2);
 		}
 		ImGui::SliderFloat("Brush Size", &brushSize, 1, 100);
+		ImGui::BeginDisabled(!computeBrush);
+		ImGui::Checkbox("Compute Brush", &useComputeBrush);
+		ImGui::EndDisabled();
+		//Tools other than paint read the layer, which needs the compute path.
+		if (!computeBrush || !useComputeBrush) brushTool = BrushTool::Paint;
+		const char* brushTools[] = { "Paint", "Smudge", "Blur", "Overlay" };
+		int tool = static_cast<int>(brushTool);
+		ImGui::BeginDisabled(!computeBrush || !useComputeBrush);
+		if (ImGui::Combo("Tool", &tool, brushTools, IM_ARRAYSIZE(brushTools)))
+		{
+			brushTool = static_cast<BrushTool>(tool);
+		}
+		ImGui::EndDisabled();
+		const char* accumulationModes[] = { "Max", "Flow" };
+		int accumulation = static_cast<int>(strokeAccumulation);
+		if (ImGui::Combo("Accumulation", &accumulation, accumulationModes, IM_ARRAYSIZE(accumulationModes)))
+		{
+			strokeAccumulation = static_cast<TextureBlender::Accumulation>(accumulation);
+		}
+		ImGui::SliderFloat("Stroke Opacity", &strokeOpacity, 0, 1);
+		ImGui::BeginDisabled(strokeAccumulation != TextureBlender::Accumulation::Flow);
 		ImGui::SliderFloat("Brush Alpha", &brushAlpha, 0.1f, 10);
+		ImGui::EndDisabled();
 		ImGui::SliderFloat("Brush Source Scale", &brushSourceScale, 0.1f, 10);
+		const char* maskModes[] = { "None", "Crevices", "Exposed", "Convex Edges", "Concave Edges" };
+		ImGui::BeginDisabled(!maskTexture);
+		ImGui::Combo("Mask", &brushMaskMode, maskModes, IM_ARRAYSIZE(maskModes));
+		ImGui::EndDisabled();
+		ImGui::Spacing();
+		ImGui::Text("BAKE");
+		const int bakeSizes[] = { 1024, 2048, 4096 };
+		const char* bakeSizeNames[] = { "1024", "2048", "4096" };
+		int bakeSize = static_cast<int>(std::find(std::begin(bakeSizes), std::end(bakeSizes), bakeSettings.size) - std::begin(bakeSizes));
+		if (ImGui::Combo("Bake Size", &bakeSize, bakeSizeNames, IM_ARRAYSIZE(bakeSizeNames)))
+		{
+			bakeSettings.size = bakeSizes[bakeSize];
+		}
+		ImGui::SliderInt("Occlusion Rays", &bakeSettings.rayCount, 4, 256);
+		ImGui::SliderFloat("Occlusion Distance", &bakeSettings.occlusionDistance, 0.01f, 1, "%.2f");
+		ImGui::SliderFloat("Curvature Radius", &bakeSettings.curvatureRadius, 0.001f, 0.1f, "%.3f");
+		ImGui::BeginDisabled(baking);
+		if (ImGui::Button("Bake Masks"))
+		{
+			startMaskBake();
+		}
+		ImGui::EndDisabled();
+		if (!bakeStatus.empty()) ImGui::Text("%s", bakeStatus.c_str());
+		ImGui::Spacing();
+		ImGui::Text("LAYERS");
+		if (diffuseLayers) layerStackUI("Diffuse", *diffuseLayers);
+		if (specularLayers) layerStackUI("Specular", *specularLayers);
+		if (normalLayers) layerStackUI("Normal", *normalLayers);
+		ImGui::Spacing();
+		ImGui::Text("RECORD");
+		if (strokeLog.isOpen())
+		{
+			ImGui::Text("Recording: %s", strokeLogName.c_str());
+			if (ImGui::Button("Stop Recording"))
+			{
+				strokeLog.close();
+			}
+		}
+		else if (ImGui::Button("Record Strokes"))
+		{
+			recordStrokes();
+		}
+		//Brushes still loading would be swapped in partway through the replay.
+		ImGui::BeginDisabled(!textureUploader->isIdle() || backgroundTasks->isBusy());
+		if (ImGui::Button("Replay Strokes"))
+		{
+			replayStrokes();
+		}
+		ImGui::EndDisabled();
 		ImGui::Spacing();
 		ImGui::Text("SAVE");
+		if (!textureUploader->isIdle())
+		{
+			ImGui::ProgressBar(textureUploader->getProgress(), ImVec2(0, 0), "Uploading textures");
+		}
+		//Saving or painting a texture that is still streaming would use incomplete data.
+		ImGui::BeginDisabled(!textureUploader->isIdle());
 		if (ImGui::Button("Save Diffuse"))
 		{
-			saveDiffuseTexture();
+			saveTexture(0);
 		}
 		if (ImGui::Button("Save Specular"))
 		{
-			saveSpecularTexture();
+			saveTexture(1);
 		}
 		if (ImGui::Button("Save Normal"))
 		{
-			saveNormalTexture();
+			saveTexture(2);
+		}
+		ImGui::EndDisabled();
+		std::vector<TextureExporter::Status> saves = textureExporter->getStatus();
+		for (size_t i = 0; i < saves.size(); i++)
+		{
+			const TextureExporter::Status& status = saves[i];
+			const char* stage = status.stage == TextureExporter::Stage::ReadingBack ? "Reading back" : "Encoding";
+			ImGui::PushID(static_cast<int>(i));
+			ImGui::Text("%s: %s", stage, status.path.c_str());
+			ImGui::ProgressBar(status.progress, ImVec2(200, 0));
+			ImGui::SameLine();
+			if (ImGui::Button("Cancel"))
+			{
+				textureExporter->cancel(i);
+			}
+			ImGui::PopID();
+		}
+		const TextureExporter::Status& lastSave = textureExporter->getLastFinished();
+		if (!lastSave.path.empty())
+		{
+			const char* result = lastSave.stage == TextureExporter::Stage::Done ? "Saved: %s" :
+				lastSave.stage == TextureExporter::Stage::Cancelled ? "Cancelled saving: %s" : "Failed to save: %s";
+			ImGui::Text(result, lastSave.path.c_str());
 		}
 	}
-
+	ImGui::Spacing();
+	ImGui::Text("PROFILE");
+	ImGui::Checkbox("GPU Timings", &showGpuProfiler);
+	ImGui::Checkbox("GL Calls", &showGLCallStats);
+	ImGui::Checkbox("Frame Graph", &showFrameGraph);
+	ImGui::Checkbox("Input Latency", &showInputLatency);
+#if CPU_PROFILER
+	if (ImGui::Button("Save CPU Trace"))
+	{
+		saveCpuTrace();
+	}
+#endif
 
 	ImGui::End();
 
+	if (showGpuProfiler) gpuProfilerUI();
+	if (showGLCallStats) glCallStatsUI();
+	if (showFrameGraph) frameGraphUI();
+	if (showInputLatency) inputLatencyUI();
+
 	//Set common params.
 	CameraParams cameraParams{cameraPos,
 		cameraFront,
@@ -463,445 +1148,526 @@ void tick(float deltaTime, Shader& mainShader, Shader& shadowShader, Shader& qua
 		glm::vec3(1.6f, 1.6f, 1.6f),
 		glm::vec3(2.0f, 2.0f, 2.0f)};
 
-	//UV render to get the UV to paint the texture on.
-	glViewport(0, 0, screen_width, screen_height);
-	glBindFramebuffer(GL_FRAMEBUFFER, uvRenderFramebuffer);
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	uvRenderShader.useProgram();
-	glm::mat4 view = glm::lookAt(cameraParams.position, cameraParams.position + cameraParams.forward, cameraParams.up);
-	glm::mat4 projection = glm::perspective(cameraParams.fov, cameraParams.aspect, 0.1f, 100.0f);
-	uvRenderShader.setMat4("view", view);
-	uvRenderShader.setMat4("projection", projection);
-
-	for (const WorldObject& object : worldObjects)
+	//Passes only run if the screen depends on them.
+	FrameGraph::TextureDesc screenColor{ GL_RGB8, static_cast<int>(screen_width), static_cast<int>(screen_height) };
+	FrameGraph::TextureDesc screenDepth{ GL_DEPTH24_STENCIL8, static_cast<int>(screen_width), static_cast<int>(screen_height) };
+	FrameGraph::Resource screen = frameGraph->importFramebuffer("Screen", 0, screen_width, screen_height);
+	frameGraph->markOutput(screen);
+
+	//Recomposite layers where they changed before the model samples them.
+	std::vector<FrameGraph::Resource> mainReads;
+	std::pair<const char*, LayerStack*> composites[] = { { "Composite Diffuse", diffuseLayers.get() },
+		{ "Composite Specular", specularLayers.get() }, { "Composite Normal", normalLayers.get() } };
+	for (const std::pair<const char*, LayerStack*>& composite : composites)
 	{
-		glm::mat4 model = object.getTransform();
-
-		uvRenderShader.setMat4("model", model);
-
-		object.getModel().draw(uvRenderShader);
+		LayerStack* layers = composite.second;
+		if (!layers) continue;
+		FrameGraph::Resource texture = frameGraph->importTexture(composite.first, layers->getCompositeTexture(), layers->getWidth(),
+			layers->getHeight(), layers->getCompositeFramebuffer());
+		mainReads.push_back(texture);
+		frameGraph->addPass(composite.first, {}, { texture }, [layers]()
+			{
+				PROFILE_ZONE("Composite");
+				layers->update();
+			});
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	//The shadow map keeps its contents between frames, so it is only rendered when the light or the models moved.
+	FrameGraph::Resource shadowMap = frameGraph->importTexture("Shadow Map", renderer.getShadowMapTexture(), renderer.getShadowWidth(),
+		renderer.getShadowHeight(), renderer.getShadowMapFramebuffer());
+	mainReads.push_back(shadowMap);
+	if (!renderer.isShadowMapCurrent(worldObjects, dirLight))
+	{
+		frameGraph->addPass("Shadow", {}, { shadowMap }, [&]()
+			{
+				renderer.renderShadowPass(worldObjects, dirLight);
+			});
+	}
 
 	//Main render
-	renderer.render(mainFramebuffer, cameraParams, worldObjects, dirLight, screen_width, screen_height);
+	FrameGraph::Resource mainColor = frameGraph->createTexture("Main Color", screenColor);
+	FrameGraph::Resource mainDepth = frameGraph->createTexture("Main Depth", screenDepth);
+	frameGraph->addPass("Main", mainReads, { mainColor, mainDepth }, [&]()
+		{
+			renderer.renderMainPass(frameGraph->getFramebuffer(), cameraParams, worldObjects, dirLight, screen_width, screen_height);
+		});
 
 	//Draw render to screen
-	glViewport(0, 0, screen_width, screen_height);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	quadShader.useProgram();
-	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(glGetUniformLocation(quadShader.getID(), "render"), 0);
-	glBindTexture(GL_TEXTURE_2D, mainTexture);
-
-	glBindVertexArray(quadVAO);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE0);
-}
-
-void generateMainFramebufferAttachments()
-{
-	// generate texture
-	glGenTextures(1, &mainTexture);
-	glBindTexture(GL_TEXTURE_2D, mainTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, screen_width, screen_height, 0, GL_RGB,
-		GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// attach it to currently bound framebuffer object
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-		mainTexture, 0);
-
-	//Add render buffer for depth and stencil.
-	unsigned int rbo;
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screen_width, screen_height);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-		GL_RENDERBUFFER, rbo);
-}
-
-void generateUVFramebufferAttachements()
-{
-	// generate texture
-	glGenTextures(1, &uvRenderTexture);
-	glBindTexture(GL_TEXTURE_2D, uvRenderTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, screen_width, screen_height, 0, GL_RGB,
-		GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// attach it to currently bound framebuffer object
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-		uvRenderTexture, 0);
-
-	//Add render buffer for depth and stencil.
-	unsigned int rbo;
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screen_width, screen_height);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-		GL_RENDERBUFFER, rbo);
-}
-
-void openModel()
-{
-	NFD_Init();
-
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "OBJ file", "obj" }};
-	nfdopendialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_OpenDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
-	{
-		//Create WorldObject.
-		worldObjects.clear();
-		worldObjects.emplace_back(glm::mat4(1.f), std::make_shared<Model>(outPath));
-
-		NFD_FreePathU8(outPath);
-	}
-	else if (result == NFD_CANCEL)
-	{
-	}
-	else
-	{
-		printf("Error: %s\n", NFD_GetError());
-	}
+	frameGraph->addPass("Resolve", { mainColor }, { screen }, [&]()
+		{
+			PROFILE_ZONE("Resolve Submit");
+			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	NFD_Quit();
-}
+			quadShader.useProgram();
+			glActiveTexture(GL_TEXTURE0);
+			glUniform1i(glGetUniformLocation(quadShader.getID(), "render"), 0);
+			glBindTexture(GL_TEXTURE_2D, frameGraph->getTexture(mainColor));
 
-void openDiffuseTexture()
-{
-	NFD_Init();
+			glBindVertexArray(quadVAO);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "Texture file", "png,jpg" } };
-	nfdopendialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_OpenDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
-	{
-		glDeleteTextures(1, &currentBrushDiffuse);
-		currentBrushDiffuse = loadTextureFromFile(outPath, true);
+			glBindVertexArray(0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0);
+		});
 
-		//Create texture blender.
-		const vector<Texture>& textures = worldObjects.front().getModel().textures_loaded;
-		for (const auto& texture : textures)
+	frameGraph->execute(gpuProfiler.get());
+}
+
+void openModel(Renderer& renderer)
+{
+	Renderer* shadowRenderer = &renderer;
+	backgroundTasks->openFileDialog(false, { { "OBJ file", "obj" } }, [shadowRenderer](const std::string& path)
 		{
-			if (texture.type == "texture_diffuse")
-			{
-				diffuseBlender = std::make_unique<TextureBlender>(*blendShader, texture.id, currentBrushDiffuse);
-				break;
-			}
-		}
+			loadModel(path, *shadowRenderer);
+		});
+}
 
-		string path = outPath;
-		int backslash = path.find_last_of('\\');
-		diffuseName = path.substr(backslash + 1, path.size() - backslash - 1);
+//Painting carries on with the current model while the new one loads, then it is swapped in.
+void loadModel(const std::string& path, Renderer& renderer)
+{
+	std::shared_ptr<TaskProgress> progress = backgroundTasks->beginTask("Loading " + fileName(path));
+	Renderer* shadowRenderer = &renderer;
+	loadingModel = std::make_shared<Model>(path, *threadPool, *textureCache, progress, [progress, shadowRenderer](bool loaded)
+		{
+			backgroundTasks->finishTask(progress);
+			std::shared_ptr<Model> model = std::move(loadingModel);
+			if (!loaded) return;
+
+			//Layers belong to the old model's textures.
+			endStroke();
+			//Logged UVs belong to the old model too.
+			strokeLog.close();
+			diffuseBlender.reset();
+			specularBlender.reset();
+			normalBlender.reset();
+			diffuseLayers.reset();
+			specularLayers.reset();
+			normalLayers.reset();
+
+			//Create WorldObject.
+			worldObjects.clear();
+			worldObjects.emplace_back(glm::mat4(1.f), model);
+			layerStacksPending = true;
+			//The new model can be given the old one's address.
+			shadowRenderer->invalidateShadowMap();
+		});
+}
 
-		NFD_FreePathU8(outPath);
-	}
-	else if (result == NFD_CANCEL)
-	{
-	}
-	else
-	{
-		printf("Error: %s\n", NFD_GetError());
-	}
+void openBrushTexture(int channel)
+{
+	backgroundTasks->openFileDialog(false, { { "Texture file", "png,jpg" } }, [channel](const std::string& path)
+		{
+			loadBrush(channel, path);
+		});
+}
 
-	NFD_Quit();
+//Decodes on a worker and swaps the brush in once it is ready, painting carries on with the old one meanwhile.
+void loadBrush(int channel, const std::string& path)
+{
+	std::shared_ptr<TaskProgress> progress = backgroundTasks->beginTask("Loading " + fileName(path));
+	std::shared_ptr<CachedImage> image = std::make_shared<CachedImage>();
+	TextureCache* cache = textureCache.get();
+	ThreadPool::JobHandle decode = threadPool->schedule([cache, path, image, progress]()
+		{
+			if (!progress->cancelled) *image = cache->loadImage(path);
+			progress->fraction = 1.f;
+		});
+	threadPool->schedule([channel, path, image, progress]()
+		{
+			backgroundTasks->finishTask(progress);
+			if (!progress->cancelled && image->image.isValid()) setBrush(channel, path, *image);
+		}, { decode }, std::this_thread::get_id());
 }
 
-void openSpecularTexture()
+void startMaskBake()
 {
-	NFD_Init();
+	if (worldObjects.empty() || baking) return;
+	baking = true;
 
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "Texture file", "png,jpg" } };
-	nfdopendialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_OpenDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
+	//A model can only be opened while none is loaded, so these meshes outlive the bake.
+	const Model& model = worldObjects.front().getModel();
+	std::shared_ptr<std::vector<BakeMesh>> meshes = std::make_shared<std::vector<BakeMesh>>();
+	for (const Mesh& mesh : model.meshes)
 	{
-		glDeleteTextures(1, &currentBrushSpecular);
-		currentBrushSpecular = loadTextureFromFile(outPath, false);
-
-		//Create texture blender.
-		const vector<Texture>& textures = worldObjects.front().getModel().textures_loaded;
-		for (const auto& texture : textures)
+		meshes->push_back(BakeMesh{ &mesh.vertices, &mesh.indices, &mesh.bvh });
+	}
+	struct BakeOutput
+	{
+		std::vector<uint8_t> pixels;
+		BakeStats stats;
+		bool baked = false;
+	};
+	std::shared_ptr<BakeOutput> output = std::make_shared<BakeOutput>();
+	std::shared_ptr<TaskProgress> progress = backgroundTasks->beginTask("Baking masks");
+	BakeSettings settings = bakeSettings;
+	ThreadPool* pool = threadPool.get();
+	//Run as a job, so every worker takes tiles and the render thread takes none.
+	ThreadPool::JobHandle bake = threadPool->schedule([meshes, settings, output, progress, pool]()
+		{
+			output->baked = bakeMasks(*meshes, settings, *pool, output->pixels, output->stats, progress.get());
+		});
+	threadPool->schedule([settings, output, progress]()
 		{
-			if (texture.type == "texture_specular")
+			backgroundTasks->finishTask(progress);
+			baking = false;
+			if (!output->baked)
 			{
-				specularBlender = std::make_unique<TextureBlender>(*blendShader, texture.id, currentBrushSpecular);
-				break;
+				bakeStatus = progress->cancelled ? "Bake cancelled" : "Bake failed";
+				return;
 			}
-		}
 
-		string path = outPath;
-		int backslash = path.find_last_of('\\');
-		specularName = path.substr(backslash + 1, path.size() - backslash - 1);
+			//Mipmapped, as the mask is sampled at the size of whichever layer is painted.
+			glDeleteTextures(1, &maskTexture);
+			maskTexture = createTexture2D(GL_RGBA8, settings.size, settings.size, getMipLevelCount(settings.size, settings.size));
+			uploadTexture2D(maskTexture, 0, 0, 0, settings.size, settings.size, GL_RGBA, GL_UNSIGNED_BYTE, output->pixels.data());
+			generateTextureMipmaps(maskTexture);
+			setTextureParameter(maskTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+			const BakeStats& stats = output->stats;
+			char status[160];
+			snprintf(status, sizeof(status), "Baked %dx%d in %.1fs, %.2f Mtexels/s per thread on %u threads", settings.size, settings.size,
+				stats.seconds, getTexelsPerThreadSecond(stats) / 1e6, stats.threads);
+			bakeStatus = status;
+		}, { bake }, std::this_thread::get_id());
+}
 
-		NFD_FreePathU8(outPath);
-	}
-	else if (result == NFD_CANCEL)
+//The toolbar's mask as weights on the baked channels, see BrushMask.
+BrushMask currentBrushMask()
+{
+	BrushMask mask;
+	BrushMaskMode mode = static_cast<BrushMaskMode>(brushMaskMode);
+	if (!maskTexture || mode == BrushMaskMode::None) return mask;
+	mask.texture = maskTexture;
+	mask.offset = 0.f;
+	switch (mode)
 	{
+	case BrushMaskMode::Crevices:
+		mask.weights[BakeOcclusion] = -1.f;
+		mask.offset = 1.f;
+		break;
+	case BrushMaskMode::Exposed:
+		mask.weights[BakeOcclusion] = 1.f;
+		break;
+	case BrushMaskMode::ConvexEdges:
+		mask.weights[BakeConvexity] = 1.f;
+		break;
+	case BrushMaskMode::ConcaveEdges:
+		mask.weights[BakeConcavity] = 1.f;
+		break;
+	default:
+		break;
 	}
-	else
+	return mask;
+}
+
+//Swaps in the brush texture for a channel, indexed like the stroke channel bits.
+void setBrush(int channel, const std::string& path, const CachedImage& image)
+{
+	unsigned int* brushes[] = { &currentBrushDiffuse, &currentBrushSpecular, &currentBrushNormal };
+	LayerStack* layers[] = { diffuseLayers.get(), specularLayers.get(), normalLayers.get() };
+	std::unique_ptr<TextureBlender>* blenders[] = { &diffuseBlender, &specularBlender, &normalBlender };
+	string* names[] = { &diffuseName, &specularName, &normalName };
+
+	//The layer previews the old blender's stroke buffer.
+	endStroke();
+
+	//Acquire before releasing so reopening the same texture reuses it. Only diffuse holds colour.
+	unsigned int previousBrush = *brushes[channel];
+	*brushes[channel] = textureCache->acquireTexture(image, channel == 0, GL_LINEAR_MIPMAP_LINEAR);
+	textureCache->releaseTexture(previousBrush);
+	brushSources[channel] = BrushSource{ path, image.contentHash };
+
+	//Create texture blender.
+	if (layers[channel])
 	{
-		printf("Error: %s\n", NFD_GetError());
+		*blenders[channel] = std::make_unique<TextureBlender>(*blendShader, layers[channel]->getWidth(), layers[channel]->getHeight(), *brushes[channel]);
 	}
 
-	NFD_Quit();
+	*names[channel] = fileName(path);
 }
 
-void openNormalTexture()
+//Decodes on the calling thread, for replays that need the brush straight away.
+void setBrush(int channel, const std::string& path)
 {
-	NFD_Init();
-
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "Texture file", "png,jpg" } };
-	nfdopendialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_OpenDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
-	{
-		glDeleteTextures(1, &currentBrushNormal);
-		currentBrushNormal = loadTextureFromFile(outPath, false);
+	setBrush(channel, path, textureCache->loadImage(path));
+}
 
-		//Create texture blender.
-		const vector<Texture>& textures = worldObjects.front().getModel().textures_loaded;
-		for (const auto& texture : textures)
+//Saves the flattened layers as they are when the dialog is closed.
+void saveTexture(int channel)
+{
+	backgroundTasks->openFileDialog(true, { { "PNG", "png" }, { "JPEG", "jpg" } }, [channel](const std::string& path)
 		{
-			if (texture.type == "texture_normal")
+			LayerStack* layers[] = { diffuseLayers.get(), specularLayers.get(), normalLayers.get() };
+			//A model loaded since the dialog opened has no layers until its textures have streamed in.
+			if (layers[channel])
 			{
-				normalBlender = std::make_unique<TextureBlender>(*blendShader, texture.id, currentBrushNormal);
-				break;
+				textureExporter->exportTexture(layers[channel]->getCompositeTexture(), path);
 			}
-		}
-
-		string path = outPath;
-		int backslash = path.find_last_of('\\');
-		normalName = path.substr(backslash + 1, path.size() - backslash - 1);
-
-		NFD_FreePathU8(outPath);
-	}
-	else if (result == NFD_CANCEL)
-	{
-	}
-	else
-	{
-		printf("Error: %s\n", NFD_GetError());
-	}
-
-	NFD_Quit();
+		});
 }
 
-unsigned int loadTextureFromFile(const char* path, bool useSRGB)
+string fileName(const std::string& path)
 {
-	string filename = string(path);
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+	//Either separator, like model paths.
+	size_t separator = path.find_last_of("/\\");
+	return separator == string::npos ? path : path.substr(separator + 1);
+}
 
-	int width, height, nrComponents;
-	//Textures are flipped.
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format = 0;
-		GLenum internalFormat = 0;
-		if (nrComponents == 1)
-		{
-			format = GL_RED;
-			internalFormat = GL_RED;
-		}
-		else if (nrComponents == 3)
-		{
-			format = GL_RGB;
-			internalFormat = useSRGB ? GL_SRGB : GL_RGB;
-		}
-		else if (nrComponents == 4)
+void recordStrokes()
+{
+	backgroundTasks->openFileDialog(true, { { "Stroke log", "mtps" } }, [](const std::string& path)
 		{
-			format = GL_RGBA;
-			internalFormat = useSRGB ? GL_SRGB_ALPHA : GL_RGBA;
-		}
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, (int)internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+			//Picking an existing log carries on where it left off.
+			if (strokeLog.open(path))
+			{
+				strokeLogName = path;
+				recordingStartTime = glfwGetTime();
+			}
+			else
+			{
+				std::cout << "Can't record strokes to " << path << std::endl;
+			}
+		});
+}
 
-		stbi_image_free(data);
+//Paints every stroke in a log straight away. Samples keep the alpha they were painted with, so the result doesn't depend
+//on the frame rate of either session.
+void replayStrokes()
+{
+	backgroundTasks->openFileDialog(false, { { "Stroke log", "mtps" } }, [](const std::string& path)
+		{
+			std::vector<LoggedStroke> strokes;
+			std::string error;
+			if (!readStrokeLog(path, strokes, error))
+			{
+				//A bad record leaves the strokes before it, which are replayed, so a damaged log keeps what it can.
+				std::cout << error << std::endl;
+				if (strokes.empty()) return;
+				std::cout << "Replaying the " << strokes.size() << " strokes before it" << std::endl;
+			}
 
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
+			//The log has each stroke's mask weights but not the model's baked masks they apply to.
+			bool masked = std::any_of(strokes.begin(), strokes.end(), [](const LoggedStroke& stroke) { return stroke.settings.maskMode != BrushMaskMode::None; });
+			if (masked && !maskTexture)
+			{
+				std::cout << path << " has masked strokes, which are painted unmasked until the masks are baked" << std::endl;
+			}
 
-	return textureID;
+			endStroke();
+			for (const LoggedStroke& stroke : strokes)
+			{
+				//Brushes are matched by content, so a brush opened from another path is still the same brush.
+				for (int c = 0; c < strokeChannelCount; c++)
+				{
+					const BrushSource& brush = stroke.brushes[c];
+					if (!(stroke.settings.channels & (1 << c)) || brush.contentHash == brushSources[c].contentHash) continue;
+					setBrush(c, brush.path);
+					if (brushSources[c].contentHash != brush.contentHash)
+					{
+						std::cout << "Brush " << brush.path << " has changed since it was recorded" << std::endl;
+					}
+				}
+
+				//A streamed brush only has its placeholder level until it is resident, and the replay paints straight away.
+				unsigned int brushes[] = { currentBrushDiffuse, currentBrushSpecular, currentBrushNormal };
+				for (int c = 0; c < strokeChannelCount; c++)
+				{
+					if (!(stroke.settings.channels & (1 << c)) || textureUploader->isResident(brushes[c])) continue;
+					textureUploader->flush();
+					break;
+				}
+
+				beginStroke(stroke.settings, glfwGetTime());
+				for (const StrokeSample& sample : stroke.samples)
+				{
+					paintAt(sample);
+				}
+				endStroke();
+			}
+		});
 }
 
-void saveDiffuseTexture()
+void gpuProfilerUI()
 {
-	NFD_Init();
-
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "Texture file", "jpg" } };
-	nfdsavedialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_SaveDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
+	ImGui::Begin("GPU Timings", &showGpuProfiler, ImGuiWindowFlags_AlwaysAutoResize);
+	const std::vector<GpuProfiler::Pass>& passes = gpuProfiler->getPasses();
+	if (passes.empty())
 	{
-		const vector<Texture>& textures = worldObjects.front().getModel().textures_loaded;
-		for (const auto& texture : textures)
+		ImGui::Text("Waiting for results");
+	}
+	float totalMs = 0;
+	for (const GpuProfiler::Pass& pass : passes)
+	{
+		if (pass.history.empty()) continue;
+		totalMs += pass.averageMs;
+		ImGui::Text("%s: %.2f ms average, %.2f ms max", pass.name.c_str(), pass.averageMs, pass.maxMs);
+
+		//Frame times over the history, then how they are spread.
+		constexpr int binCount = 24;
+		float bins[binCount] = {};
+		for (float ms : pass.history)
 		{
-			if (texture.type == "texture_diffuse")
-			{
-				glBindTexture(GL_TEXTURE_2D, texture.id);
-				int w, h;
-				int miplevel = 0;
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_WIDTH, &w);
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_HEIGHT, &h);
-				GLubyte* toSave = new GLubyte[w * h * 3];
-				glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, toSave);
-				stbi_flip_vertically_on_write(true);
-				stbi_write_jpg(outPath, w, h, 3, toSave, w * 3);
-
-				glBindTexture(GL_TEXTURE_2D, 0);
-				delete[] toSave;
-				break;
-			}
+			int bin = pass.maxMs > 0 ? static_cast<int>(ms / pass.maxMs * (binCount - 1)) : 0;
+			bins[bin]++;
 		}
-
-		NFD_FreePathU8(outPath);
+		ImGui::PushID(pass.name.c_str());
+		ImGui::PlotLines("##History", pass.history.data(), static_cast<int>(pass.history.size()), 0, NULL, 0, pass.maxMs, ImVec2(240, 40));
+		ImGui::SameLine();
+		ImGui::PlotHistogram("##Spread", bins, binCount, 0, NULL, 0, FLT_MAX, ImVec2(120, 40));
+		ImGui::PopID();
 	}
-	else if (result == NFD_CANCEL)
+	ImGui::Text("Total: %.2f ms", totalMs);
+	if (gpuProfiler->getDroppedFrames())
 	{
+		ImGui::Text("Frames not ready in time: %zu", gpuProfiler->getDroppedFrames());
 	}
-	else
+	if (ImGui::Button("Export CSV"))
 	{
-		printf("Error: %s\n", NFD_GetError());
+		exportGpuTimings();
 	}
-
-	NFD_Quit();
+	ImGui::End();
 }
 
-void saveSpecularTexture()
+void glCallStatsUI()
 {
-	NFD_Init();
-
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "Texture file", "jpg" } };
-	nfdsavedialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_SaveDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
+	ImGui::Begin("GL Calls", &showGLCallStats, ImGuiWindowFlags_AlwaysAutoResize);
+	const GLCallStats& calls = lastFrameCalls;
+	ImGui::Text("Previous frame, not counting the UI.");
+	bool filtering = isGLStateFiltering();
+	if (ImGui::Checkbox("Skip redundant binds", &filtering))
+	{
+		setGLStateFiltering(filtering);
+	}
+	if (ImGui::BeginTable("Calls", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
 	{
-		const vector<Texture>& textures = worldObjects.front().getModel().textures_loaded;
-		for (const auto& texture : textures)
+		ImGui::TableSetupColumn("Call");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("Redundant");
+		ImGui::TableHeadersRow();
+		auto row = [](const char* name, unsigned int count, int redundant)
 		{
-			if (texture.type == "texture_specular")
-			{
-				glBindTexture(GL_TEXTURE_2D, texture.id);
-				int w, h;
-				int miplevel = 0;
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_WIDTH, &w);
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_HEIGHT, &h);
-				GLubyte* toSave = new GLubyte[w * h * 3];
-				glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, toSave);
-				stbi_flip_vertically_on_write(true);
-				stbi_write_jpg(outPath, w, h, 3, toSave, w * 3);
-
-				glBindTexture(GL_TEXTURE_2D, 0);
-				delete[] toSave;
-				break;
-			}
-		}
-
-		NFD_FreePathU8(outPath);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", count);
+			ImGui::TableNextColumn();
+			if (redundant >= 0) ImGui::Text("%d", redundant);
+		};
+		//-1 where redundancy isn't tracked.
+		row("Draws", calls.draws, -1);
+		row("Dispatches", calls.dispatches, -1);
+		row("Program binds", calls.programBinds, calls.redundantProgramBinds);
+		row("Texture binds", calls.textureBinds, calls.redundantTextureBinds);
+		row("Active texture", calls.activeTextureSets, calls.redundantActiveTextureSets);
+		row("Framebuffer binds", calls.framebufferBinds, calls.redundantFramebufferBinds);
+		row("Vertex array binds", calls.vertexArrayBinds, calls.redundantVertexArrayBinds);
+		row("Buffer binds", calls.bufferBinds, -1);
+		row("Uniforms", calls.uniformUploads, -1);
+		ImGui::EndTable();
 	}
-	else if (result == NFD_CANCEL)
+	ImGui::End();
+}
+
+void frameGraphUI()
+{
+	ImGui::Begin("Frame Graph", &showFrameGraph, ImGuiWindowFlags_AlwaysAutoResize);
+	const FrameGraph::Stats& stats = frameGraph->getStats();
+	ImGui::Text("Passes in the order they ran.");
+	for (const FrameGraph::PassInfo& pass : stats.passes)
 	{
+		if (pass.culled) ImGui::TextDisabled("%s (culled)", pass.name);
+		else ImGui::Text("%s", pass.name);
 	}
-	else
+	ImGui::Spacing();
+	if (ImGui::BeginTable("Resources", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
 	{
-		printf("Error: %s\n", NFD_GetError());
+		ImGui::TableSetupColumn("Resource");
+		ImGui::TableSetupColumn("Size");
+		ImGui::TableSetupColumn("Pooled texture");
+		ImGui::TableHeadersRow();
+		for (const FrameGraph::ResourceInfo& resource : stats.resources)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(resource.name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%dx%d", resource.width, resource.height);
+			ImGui::TableNextColumn();
+			if (!resource.transient) ImGui::TextUnformatted("Imported");
+			else if (resource.pooledTexture < 0) ImGui::TextUnformatted("Unused");
+			else ImGui::Text("%d", resource.pooledTexture);
+		}
+		ImGui::EndTable();
 	}
-
-	NFD_Quit();
+	//Aliasing saves the difference between what the transients asked for and what they were given.
+	constexpr float megabyte = 1024.f * 1024.f;
+	ImGui::Text("Transients: %.1f MB", stats.requestedBytes / megabyte);
+	ImGui::Text("Allocated: %.1f MB", stats.allocatedBytes / megabyte);
+	ImGui::Text("Pool: %.1f MB", stats.pooledBytes / megabyte);
+	ImGui::End();
 }
 
-void saveNormalTexture()
+void addLatency(std::vector<float>& history, float ms)
 {
-	NFD_Init();
+	history.push_back(ms);
+	if (history.size() > latencyHistoryLength) history.erase(history.begin());
+}
 
-	nfdu8char_t* outPath;
-	nfdu8filteritem_t filters[1] = { { "Texture file", "jpg" } };
-	nfdsavedialogu8args_t args = { 0 };
-	args.filterList = filters;
-	args.filterCount = 1;
-	nfdresult_t result = NFD_SaveDialogU8_With(&outPath, &args);
-	if (result == NFD_OKAY)
+void inputLatencyUI()
+{
+	ImGui::Begin("Input Latency", &showInputLatency, ImGuiWindowFlags_AlwaysAutoResize);
+	auto plot = [](const char* label, const std::vector<float>& history)
 	{
-		const vector<Texture>& textures = worldObjects.front().getModel().textures_loaded;
-		for (const auto& texture : textures)
+		if (history.empty())
 		{
-			if (texture.type == "texture_normal")
-			{
-				glBindTexture(GL_TEXTURE_2D, texture.id);
-				int w, h;
-				int miplevel = 0;
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_WIDTH, &w);
-				glGetTexLevelParameteriv(GL_TEXTURE_2D, miplevel, GL_TEXTURE_HEIGHT, &h);
-				GLubyte* toSave = new GLubyte[w * h * 3];
-				glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, toSave);
-				stbi_flip_vertically_on_write(true);
-				stbi_write_jpg(outPath, w, h, 3, toSave, w * 3);
-
-				glBindTexture(GL_TEXTURE_2D, 0);
-				delete[] toSave;
-				break;
-			}
+			ImGui::Text("%s: no samples yet", label);
+			return;
 		}
-
-		NFD_FreePathU8(outPath);
-	}
-	else if (result == NFD_CANCEL)
-	{
-	}
-	else
+		float total = 0;
+		float maxMs = 0;
+		for (float ms : history)
+		{
+			total += ms;
+			maxMs = std::max(maxMs, ms);
+		}
+		ImGui::Text("%s: %.2f ms average, %.2f ms max", label, total / history.size(), maxMs);
+		ImGui::PushID(label);
+		ImGui::PlotLines("##History", history.data(), static_cast<int>(history.size()), 0, NULL, 0, maxMs, ImVec2(240, 40));
+		ImGui::PopID();
+	};
+	//From the callback timestamping the input a dab responds to, until the frame with the dab is handed to the swap chain.
+	plot("Input to dab", dabLatencyHistory);
+	//How long events sat in the queue before the render thread took them, the longest per frame.
+	plot("Queue wait", queueWaitHistory);
+	ImGui::Text("Pointer events this frame: %zu", pointerEvents.size());
+	if (droppedInputEvents)
 	{
-		printf("Error: %s\n", NFD_GetError());
+		ImGui::Text("Events dropped with the queue full: %zu", droppedInputEvents.load());
 	}
+	ImGui::End();
+}
 
-	NFD_Quit();
+void exportGpuTimings()
+{
+	backgroundTasks->openFileDialog(true, { { "CSV", "csv" } }, [](const std::string& path)
+		{
+			if (!gpuProfiler->exportCsv(path))
+			{
+				std::cout << "Can't write " << path << std::endl;
+			}
+		});
+}
+
+void saveCpuTrace()
+{
+	backgroundTasks->openFileDialog(true, { { "Chrome Trace", "json" } }, [](const std::string& path)
+		{
+			if (!writeCpuTrace(path))
+			{
+				std::cout << "Can't write " << path << std::endl;
+			}
+		});
 }
\ No newline at end of file
@@ -1,10 +0,0 @@
-#version 330 core
-
-out vec4 FragColor;
-
-in vec2 TexCoords;
-
-void main()
-{
-    FragColor = vec4(TexCoords, 1, 1);
-}
\ No newline at end of file